@@ -14,7 +14,7 @@ static void ts_tuple_field_set_contains_data_flag(ts_tuple_field_t* field,
 static void ts_tuple_field_set_type_flag(ts_tuple_field_t* field,
                                          ts_tuple_field_type_t field_type) {
   field->flags &= 0x80;
-  field->flags |= field_type & 0x3f;
+  field->flags |= field_type & 0x1f;
 }
 
 ts_tuple_field_t ts_tuple_field_set_uint(ts_uint_t value,
@@ -68,13 +68,22 @@ ts_tuple_field_t ts_tuple_field_set_string(ts_string_t value,
 }
 
 ts_tuple_field_type_t ts_tuple_field_get_type(const ts_tuple_field_t* field) {
-  return field->flags & 0x3f;
+  return field->flags & 0x1f;
 }
 
 ts_bool_t ts_tuple_field_contains_data(const ts_tuple_field_t* field) {
   return (field->flags & 0x80) != 0;
 }
 
+ts_bool_t ts_tuple_field_is_inline_string(const ts_tuple_field_t* field) {
+  return (field->flags & 0x20) != 0;
+}
+
+ts_string_t ts_tuple_field_string(const ts_tuple_field_t* field) {
+  return ts_tuple_field_is_inline_string(field) ? field->data.inline_string
+                                                : field->data.string_field;
+}
+
 ts_operation_status_t ts_tuple_field_get_uint(const ts_tuple_field_t* field,
                                               ts_uint_t* value) {
   if (ts_tuple_field_get_type(field) != TS_FIELD_TYPE_UINT) {
@@ -116,7 +125,7 @@ ts_operation_status_t ts_tuple_field_get_string(const ts_tuple_field_t* field,
   if (ts_tuple_field_get_type(field) != TS_FIELD_TYPE_STRING) {
     return TS_OPERATION_FAILURE;
   }
-  *value = field->data.string_field;
+  *value = ts_tuple_field_string(field);
   return TS_OPERATION_SUCCESS;
 }
 
@@ -150,8 +159,8 @@ static ts_bool_t ts_compare_tuple_fields(const ts_tuple_field_t* left_tuple,
     case TS_FIELD_TYPE_UINT:
       return left_tuple->data.uint_field == right_tuple->data.uint_field;
     case TS_FIELD_TYPE_STRING:
-      return strcmp(left_tuple->data.string_field,
-                    right_tuple->data.string_field) == 0;
+      return strcmp(ts_tuple_field_string(left_tuple),
+                    ts_tuple_field_string(right_tuple)) == 0;
     default:
       return TS_FALSE;
   }
@@ -173,6 +182,20 @@ ts_bool_t ts_are_equal_tuples(const ts_tuple_field_t* left_tuple,
   return TS_TRUE;
 }
 
+ts_tuple_signature_t ts_tuple_type_signature(const ts_tuple_field_t* tuple,
+                                             ts_size_t tuple_size) {
+  // Only the low bits of every type take part in the signature; all valid
+  // types fit in them, so tuples with equal signatures have equal shapes.
+  const ts_tuple_signature_t field_mask =
+      (1 << TS_TUPLE_SIGNATURE_FIELD_BITS) - 1;
+  ts_tuple_signature_t signature = 0;
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    signature |= (ts_tuple_field_get_type(&tuple[i]) & field_mask)
+                 << (i * TS_TUPLE_SIGNATURE_FIELD_BITS);
+  }
+  return signature;
+}
+
 ts_bool_t ts_is_matching_tuple(const ts_tuple_field_t* template_tuple,
                                const ts_tuple_field_t* data_tuple,
                                ts_size_t tuple_size) {
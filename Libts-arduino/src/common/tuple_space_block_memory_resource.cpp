@@ -5,14 +5,31 @@
 static void* ts_block_memory_resource_allocation_cb(void* context,
                                                     ts_size_t allocation_size) {
   ts_block_memory_resource_t* resource = (ts_block_memory_resource_t*)context;
+  if (allocation_size > TS_MEMORY_RESOURCE_SIZE - resource->pointer) {
+    return NULL;
+  }
   ts_byte_t* block = &resource->memory[resource->pointer];
   resource->pointer += allocation_size;
+  if (resource->pointer > resource->high_water_mark) {
+    resource->high_water_mark = resource->pointer;
+  }
   return block;
 }
 
 static void ts_block_memory_resource_deallocation_cb(void* context,
                                                      void* memory) {}
 
+static ts_size_t ts_block_memory_resource_mark_cb(void* context) {
+  return ((ts_block_memory_resource_t*)context)->pointer;
+}
+
+static void ts_block_memory_resource_reset_cb(void* context, ts_size_t mark) {
+  ts_block_memory_resource_t* resource = (ts_block_memory_resource_t*)context;
+  if (mark < resource->pointer) {
+    resource->pointer = mark;
+  }
+}
+
 void ts_initialize_memory_resource(ts_block_memory_resource_t* resource) {
   memset(resource, 0, sizeof(ts_block_memory_resource_t));
 }
@@ -23,6 +40,8 @@ ts_allocator_t ts_memory_resource_get_allocator(
   memset(&allocator, 0, sizeof(ts_allocator_t));
   allocator.allocator_cb = ts_block_memory_resource_allocation_cb;
   allocator.deallocator_cb = ts_block_memory_resource_deallocation_cb;
+  allocator.mark_cb = ts_block_memory_resource_mark_cb;
+  allocator.reset_cb = ts_block_memory_resource_reset_cb;
   allocator.context = resource;
   return allocator;
 }
@@ -31,3 +50,8 @@ void ts_memory_resource_free_block(ts_block_memory_resource_t* resource) {
   memset(resource->memory, 0, TS_MEMORY_RESOURCE_SIZE);
   resource->pointer = 0;
 }
+
+ts_size_t ts_memory_resource_high_water_mark(
+    const ts_block_memory_resource_t* resource) {
+  return resource->high_water_mark;
+}
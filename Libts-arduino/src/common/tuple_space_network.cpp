@@ -35,21 +35,6 @@ ts_bool_t ts_initialize_client_context(
   return TS_TRUE;
 }
 
-static ts_bool_t ts_server_listen_for_message(
-    ts_server_context_t* server_context, ts_ipv4_t* sender_ip_address,
-    ts_port_t* sender_port_id, ts_byte_t* buffer, ts_size_t* buffer_size,
-    ts_client_to_server_message_type_t* message_type) {
-  ts_size_t result_size = server_context->device_context.recv_cb(
-      &server_context->device_context, sender_ip_address, sender_port_id,
-      buffer, *buffer_size);
-  if (result_size == 0) {
-    return TS_FALSE;
-  }
-  *buffer_size = result_size;
-  *message_type = ts_client_to_server_message_type(buffer, *buffer_size);
-  return TS_TRUE;
-}
-
 static ts_bool_t ts_client_listen_for_message(
     ts_client_context_t* client_context, ts_ipv4_t* sender_ip_address,
     ts_port_t* sender_port_id, ts_byte_t* buffer, ts_size_t* buffer_size,
@@ -65,6 +50,14 @@ static ts_bool_t ts_client_listen_for_message(
   return TS_TRUE;
 }
 
+void ts_server_release_tuple(const ts_server_context_t* server_context,
+                             ts_tuple_field_t* tuple, ts_size_t packed_size,
+                             const ts_allocator_t* allocator) {
+  ts_allocator_free(allocator,
+                    (ts_byte_t*)tuple - server_context->tuple_header_size,
+                    server_context->tuple_header_size + packed_size);
+}
+
 static void ts_server_process_send_message(ts_server_context_t* server_context,
                                            const ts_byte_t* buffer,
                                            ts_size_t buffer_size,
@@ -79,11 +72,18 @@ static void ts_server_process_send_message(ts_server_context_t* server_context,
         sender_port_id);
     return;
   }
-  ts_tuple_field_t* tuple = (ts_tuple_field_t*)allocator->allocator_cb(
-      allocator->context, sizeof(ts_tuple_field_t) * tuple_size);
-  if (!ts_deserialize_tuple(buffer + 1, buffer_size - 1, tuple, tuple_size,
-                            allocator)) {
-    allocator->deallocator_cb(allocator->context, tuple);
+  ts_size_t packed_size = ts_deserialized_packed_tuple_size(
+      buffer + 1, buffer_size - 1, tuple_size);
+  ts_tuple_field_t* tuple =
+      packed_size ? ts_server_allocate_tuple(server_context, packed_size,
+                                             allocator)
+                  : NULL;
+  if ((tuple == NULL) ||
+      !ts_deserialize_packed_tuple(buffer + 1, buffer_size - 1, tuple,
+                                   tuple_size)) {
+    if (tuple != NULL) {
+      ts_server_release_tuple(server_context, tuple, packed_size, allocator);
+    }
     server_context->server_callbacks.serialization_issue_cb(
         user_data, TS_CLIENT_TO_SERVER_MESSAGE_SEND_TUPLE, sender_ip_address,
         sender_port_id);
@@ -92,11 +92,34 @@ static void ts_server_process_send_message(ts_server_context_t* server_context,
   if (!ts_does_all_fields_of_tuple_contain_data(tuple, tuple_size)) {
     server_context->server_callbacks.send_tuple_invalid_invariant_cb(
         user_data, sender_ip_address, sender_port_id);
-    ts_free_tuple(tuple, tuple_size, allocator);
+    ts_server_release_tuple(server_context, tuple, packed_size, allocator);
     return;
   }
   server_context->server_callbacks.send_tuple_cb(
-      user_data, tuple, tuple_size, sender_ip_address, sender_port_id);
+      user_data, tuple, tuple_size, ts_tuple_type_signature(tuple, tuple_size),
+      sender_ip_address, sender_port_id);
+}
+
+static void ts_server_process_get_message_view(
+    ts_server_context_t* server_context, const ts_byte_t* buffer,
+    ts_size_t buffer_size, ts_size_t tuple_size, ts_bool_t respond_flag,
+    ts_bool_t remove_flag, ts_ipv4_t sender_ip_address,
+    ts_port_t sender_port_id, void* user_data) {
+  ts_tuple_view_t view;
+  if (!ts_parse_tuple_view(buffer + 2, buffer_size - 2, tuple_size, &view)) {
+    server_context->server_callbacks.serialization_issue_cb(
+        user_data, TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE, sender_ip_address,
+        sender_port_id);
+    return;
+  }
+  if (ts_does_all_fields_of_tuple_view_contain_data(&view)) {
+    server_context->server_callbacks.get_tuple_invalid_invariant_cb(
+        user_data, sender_ip_address, sender_port_id);
+    return;
+  }
+  server_context->server_callbacks.get_tuple_view_cb(
+      user_data, &view, ts_tuple_view_type_signature(&view), respond_flag,
+      remove_flag, sender_ip_address, sender_port_id);
 }
 
 static void ts_server_process_get_message(ts_server_context_t* server_context,
@@ -107,19 +130,31 @@ static void ts_server_process_get_message(ts_server_context_t* server_context,
                                           const ts_allocator_t* allocator,
                                           void* user_data) {
   ts_size_t tuple_size = ts_serialized_tuple_size(buffer, buffer_size);
-  if (tuple_size < 2) {
+  if ((tuple_size < 2) || (buffer_size < 2)) {
     server_context->server_callbacks.serialization_issue_cb(
         user_data, TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE, sender_ip_address,
         sender_port_id);
     return;
   }
-  ts_tuple_field_t* tuple = (ts_tuple_field_t*)allocator->allocator_cb(
-      allocator->context, sizeof(ts_tuple_field_t) * tuple_size);
   ts_byte_t remove_flag = (buffer[1] & 0x01) > 0;
   ts_byte_t respond_flag = (buffer[1] & 0x02) > 0;
-  if (!ts_deserialize_tuple(buffer + 2, buffer_size - 2, tuple, tuple_size,
-                            allocator)) {
-    allocator->deallocator_cb(allocator->context, tuple);
+  if (server_context->server_callbacks.get_tuple_view_cb != NULL) {
+    return ts_server_process_get_message_view(
+        server_context, buffer, buffer_size, tuple_size, respond_flag,
+        remove_flag, sender_ip_address, sender_port_id, user_data);
+  }
+  ts_size_t packed_size = ts_deserialized_packed_tuple_size(
+      buffer + 2, buffer_size - 2, tuple_size);
+  ts_tuple_field_t* tuple =
+      packed_size ? ts_server_allocate_tuple(server_context, packed_size,
+                                             allocator)
+                  : NULL;
+  if ((tuple == NULL) ||
+      !ts_deserialize_packed_tuple(buffer + 2, buffer_size - 2, tuple,
+                                   tuple_size)) {
+    if (tuple != NULL) {
+      ts_server_release_tuple(server_context, tuple, packed_size, allocator);
+    }
     server_context->server_callbacks.serialization_issue_cb(
         user_data, TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE, sender_ip_address,
         sender_port_id);
@@ -128,27 +163,31 @@ static void ts_server_process_get_message(ts_server_context_t* server_context,
   if (ts_does_all_fields_of_tuple_contain_data(tuple, tuple_size)) {
     server_context->server_callbacks.get_tuple_invalid_invariant_cb(
         user_data, sender_ip_address, sender_port_id);
-    ts_free_tuple(tuple, tuple_size, allocator);
+    ts_server_release_tuple(server_context, tuple, packed_size, allocator);
     return;
   }
   server_context->server_callbacks.get_tuple_cb(
-      user_data, tuple, tuple_size, respond_flag, remove_flag,
-      sender_ip_address, sender_port_id);
+      user_data, tuple, tuple_size, ts_tuple_type_signature(tuple, tuple_size),
+      respond_flag, remove_flag, sender_ip_address, sender_port_id);
 }
 
-void ts_server_get_message(ts_server_context_t* server_context, void* user_data,
-                           const ts_allocator_t* allocator) {
-  ts_byte_t buffer[TS_BUFFER_SIZE];
-  ts_size_t buffer_size = TS_BUFFER_SIZE;
-  ts_ipv4_t sender_ip_address;
-  ts_port_t sender_port_id;
-  ts_client_to_server_message_type_t message_type;
-  if (!ts_server_listen_for_message(server_context, &sender_ip_address,
-                                    &sender_port_id, buffer, &buffer_size,
-                                    &message_type)) {
-    return;
+ts_bool_t ts_server_wait_for_message(ts_server_context_t* server_context,
+                                     ts_int_t timeout_ms) {
+  if (server_context->device_context.wait_cb == NULL) {
+    return TS_TRUE;
   }
-  switch (message_type) {
+  return server_context->device_context.wait_cb(
+      &server_context->device_context, timeout_ms);
+}
+
+static void ts_server_process_message(ts_server_context_t* server_context,
+                                      const ts_byte_t* buffer,
+                                      ts_size_t buffer_size,
+                                      ts_ipv4_t sender_ip_address,
+                                      ts_port_t sender_port_id,
+                                      void* user_data,
+                                      const ts_allocator_t* allocator) {
+  switch (ts_client_to_server_message_type(buffer, buffer_size)) {
     case TS_CLIENT_TO_SERVER_MESSAGE_SEND_TUPLE:
       return ts_server_process_send_message(server_context, buffer, buffer_size,
                                             sender_ip_address, sender_port_id,
@@ -167,28 +206,206 @@ void ts_server_get_message(ts_server_context_t* server_context, void* user_data,
   }
 }
 
+ts_bool_t ts_server_get_message(ts_server_context_t* server_context,
+                                void* user_data,
+                                const ts_allocator_t* allocator) {
+  ts_byte_t buffer[TS_BUFFER_SIZE];
+  ts_ipv4_t sender_ip_address;
+  ts_port_t sender_port_id;
+  ts_size_t buffer_size = server_context->device_context.recv_cb(
+      &server_context->device_context, &sender_ip_address, &sender_port_id,
+      buffer, TS_BUFFER_SIZE);
+  if (buffer_size == 0) {
+    return TS_FALSE;
+  }
+  ts_server_process_message(server_context, buffer, buffer_size,
+                            sender_ip_address, sender_port_id, user_data,
+                            allocator);
+  return TS_TRUE;
+}
+
+ts_size_t ts_server_receive_messages(ts_server_context_t* server_context,
+                                     ts_datagram_t* datagrams,
+                                     ts_size_t datagrams_count) {
+  ts_device_context_t* device = &server_context->device_context;
+  if (device->recv_batch_cb != NULL) {
+    return device->recv_batch_cb(device, datagrams, datagrams_count);
+  }
+  ts_size_t received = 0;
+  while (received < datagrams_count) {
+    ts_datagram_t* datagram = &datagrams[received];
+    datagram->buffer_size =
+        device->recv_cb(device, &datagram->ip_address, &datagram->port_id,
+                        datagram->buffer, TS_BUFFER_SIZE);
+    datagram->receive_time_ns = 0;
+    if (datagram->buffer_size == 0) {
+      break;
+    }
+    ++received;
+  }
+  return received;
+}
+
+void ts_server_process_messages(ts_server_context_t* server_context,
+                                const ts_datagram_t* datagrams,
+                                ts_size_t datagrams_count, void* user_data,
+                                const ts_allocator_t* allocator) {
+  for (ts_size_t i = 0; i < datagrams_count; ++i) {
+    ts_server_process_message(server_context, datagrams[i].buffer,
+                              datagrams[i].buffer_size,
+                              datagrams[i].ip_address, datagrams[i].port_id,
+                              user_data, allocator);
+  }
+}
+
+ts_size_t ts_server_get_messages(ts_server_context_t* server_context,
+                                 ts_datagram_t* datagrams,
+                                 ts_size_t datagrams_count, void* user_data,
+                                 const ts_allocator_t* allocator) {
+  ts_size_t received =
+      ts_server_receive_messages(server_context, datagrams, datagrams_count);
+  ts_server_process_messages(server_context, datagrams, received, user_data,
+                             allocator);
+  ts_server_flush_messages(server_context);
+  return received;
+}
+
+ts_bool_t ts_client_to_server_message_signature(
+    const ts_byte_t* buffer, ts_size_t buffer_size,
+    ts_tuple_signature_t* signature) {
+  ts_size_t header_size;
+  switch (ts_client_to_server_message_type(buffer, buffer_size)) {
+    case TS_CLIENT_TO_SERVER_MESSAGE_SEND_TUPLE:
+      header_size = 1;
+      break;
+    case TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE:
+      header_size = 2;
+      break;
+    default:
+      return TS_FALSE;
+  }
+  if (buffer_size < header_size) {
+    return TS_FALSE;
+  }
+  return ts_serialized_tuple_type_signature(
+      buffer + header_size, buffer_size - header_size,
+      ts_serialized_tuple_size(buffer, buffer_size), signature);
+}
+
+ts_bool_t ts_client_to_server_get_message_flags(
+    const ts_byte_t* buffer, ts_size_t buffer_size,
+    ts_bool_t* respond_when_available, ts_bool_t* remove_after_use) {
+  if ((buffer_size < 2) ||
+      (ts_client_to_server_message_type(buffer, buffer_size) !=
+       TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE)) {
+    return TS_FALSE;
+  }
+  *remove_after_use = (buffer[1] & 0x01) > 0;
+  *respond_when_available = (buffer[1] & 0x02) > 0;
+  return TS_TRUE;
+}
+
+void ts_server_set_send_batch(ts_server_context_t* server_context,
+                              ts_datagram_t* datagrams,
+                              ts_size_t datagrams_count) {
+  ts_server_flush_messages(server_context);
+  server_context->send_batch = datagrams;
+  server_context->send_batch_capacity = datagrams_count;
+}
+
+ts_bool_t ts_server_flush_messages(ts_server_context_t* server_context) {
+  ts_device_context_t* device = &server_context->device_context;
+  const ts_datagram_t* datagrams = server_context->send_batch;
+  ts_size_t datagrams_count = server_context->send_batch_size;
+  server_context->send_batch_size = 0;
+  if (device->send_batch_cb != NULL) {
+    return device->send_batch_cb(device, datagrams, datagrams_count) ==
+           datagrams_count;
+  }
+  ts_bool_t status = TS_TRUE;
+  for (ts_size_t i = 0; i < datagrams_count; ++i) {
+    if (!device->send_cb(device, datagrams[i].ip_address, datagrams[i].port_id,
+                         datagrams[i].buffer, datagrams[i].buffer_size)) {
+      status = TS_FALSE;
+    }
+  }
+  return status;
+}
+
+// Messages are built where they are sent from: in the next datagram of the
+// send batch when there is one, otherwise in the caller's buffer.
+static ts_byte_t* ts_server_message_buffer(ts_server_context_t* server_context,
+                                           ts_byte_t* buffer) {
+  if (server_context->send_batch_capacity == 0) {
+    return buffer;
+  }
+  if (server_context->send_batch_size == server_context->send_batch_capacity) {
+    ts_server_flush_messages(server_context);
+  }
+  return server_context->send_batch[server_context->send_batch_size].buffer;
+}
+
+static ts_bool_t ts_server_commit_message(ts_server_context_t* server_context,
+                                          ts_ipv4_t client_ip_address,
+                                          ts_port_t client_port_id,
+                                          const ts_byte_t* message,
+                                          ts_size_t message_size) {
+  if (server_context->send_batch_capacity == 0) {
+    return server_context->device_context.send_cb(
+        &server_context->device_context, client_ip_address, client_port_id,
+        message, message_size);
+  }
+  ts_datagram_t* datagram =
+      &server_context->send_batch[server_context->send_batch_size++];
+  datagram->ip_address = client_ip_address;
+  datagram->port_id = client_port_id;
+  datagram->buffer_size = message_size;
+  return TS_TRUE;
+}
+
+static ts_bool_t ts_server_send_message(ts_server_context_t* server_context,
+                                        ts_ipv4_t client_ip_address,
+                                        ts_port_t client_port_id,
+                                        const ts_byte_t* buffer,
+                                        ts_size_t buffer_size) {
+  if (server_context->send_batch_capacity == 0) {
+    return ts_server_commit_message(server_context, client_ip_address,
+                                    client_port_id, buffer, buffer_size);
+  }
+  ts_byte_t* message = ts_server_message_buffer(server_context, NULL);
+  memcpy(message, buffer, buffer_size);
+  return ts_server_commit_message(server_context, client_ip_address,
+                                  client_port_id, message, buffer_size);
+}
+
 static void ts_client_process_tuple_message(ts_client_context_t* client_context,
                                             const ts_byte_t* buffer,
                                             ts_size_t buffer_size,
                                             const ts_allocator_t* allocator,
                                             void* user_data) {
   ts_size_t tuple_size = ts_serialized_tuple_size(buffer, buffer_size);
-  if (tuple_size == 0) {
+  ts_tuple_view_t view;
+  if ((tuple_size == 0) ||
+      !ts_parse_tuple_view(buffer + 1, buffer_size - 1, tuple_size, &view) ||
+      !ts_does_all_fields_of_tuple_view_contain_data(&view)) {
     return client_context->client_callbacks.tuple_invalid_invariant_cb(
         user_data);
   }
+  if (client_context->client_callbacks.tuple_view_cb != NULL) {
+    return client_context->client_callbacks.tuple_view_cb(user_data, &view);
+  }
   ts_tuple_field_t* tuple = (ts_tuple_field_t*)allocator->allocator_cb(
       allocator->context, sizeof(ts_tuple_field_t) * tuple_size);
+  if (tuple == NULL) {
+    return client_context->client_callbacks.tuple_invalid_invariant_cb(
+        user_data);
+  }
   if (!ts_deserialize_tuple(buffer + 1, buffer_size - 1, tuple, tuple_size,
                             allocator)) {
-    allocator->deallocator_cb(allocator->context, tuple);
+    ts_allocator_free(allocator, tuple, sizeof(ts_tuple_field_t) * tuple_size);
     return client_context->client_callbacks.tuple_invalid_invariant_cb(
         user_data);
   }
-  if (!ts_does_all_fields_of_tuple_contain_data(tuple, tuple_size)) {
-    client_context->client_callbacks.tuple_invalid_invariant_cb(user_data);
-    return ts_free_tuple(tuple, tuple_size, allocator);
-  }
   client_context->client_callbacks.tuple_cb(user_data, tuple, tuple_size);
 }
 
@@ -247,7 +464,36 @@ void ts_close_client_context(ts_client_context_t* client_context) {
 void ts_free_tuple(ts_tuple_field_t* tuple, ts_size_t tuple_size,
                    const ts_allocator_t* allocator) {
   ts_deallocate_tuple(tuple, tuple_size, allocator);
-  allocator->deallocator_cb(allocator->context, tuple);
+  ts_allocator_free(allocator, tuple, sizeof(ts_tuple_field_t) * tuple_size);
+}
+
+ts_tuple_field_t* ts_server_allocate_tuple(
+    const ts_server_context_t* server_context, ts_size_t packed_size,
+    const ts_allocator_t* allocator) {
+  ts_byte_t* block = (ts_byte_t*)allocator->allocator_cb(
+      allocator->context, server_context->tuple_header_size + packed_size);
+  if (block == NULL) {
+    return NULL;
+  }
+  return (ts_tuple_field_t*)(block + server_context->tuple_header_size);
+}
+
+ts_tuple_field_t* ts_server_copy_tuple(
+    const ts_server_context_t* server_context, const ts_tuple_field_t* tuple,
+    ts_size_t tuple_size, const ts_allocator_t* allocator) {
+  ts_tuple_field_t* copy = ts_server_allocate_tuple(
+      server_context, ts_packed_tuple_size(tuple, tuple_size), allocator);
+  if (copy != NULL) {
+    ts_pack_tuple(copy, tuple, tuple_size);
+  }
+  return copy;
+}
+
+void ts_server_free_tuple(const ts_server_context_t* server_context,
+                          ts_tuple_field_t* tuple, ts_size_t tuple_size,
+                          const ts_allocator_t* allocator) {
+  ts_server_release_tuple(server_context, tuple,
+                          ts_packed_tuple_size(tuple, tuple_size), allocator);
 }
 
 ts_bool_t ts_server_send_server_to_client_tuple(
@@ -255,21 +501,21 @@ ts_bool_t ts_server_send_server_to_client_tuple(
     ts_size_t tuple_size, ts_ipv4_t client_ip_address,
     ts_port_t client_port_id) {
   ts_byte_t buffer[TS_BUFFER_SIZE];
+  ts_byte_t* message = ts_server_message_buffer(server_context, buffer);
   if (!ts_server_to_client_encode_message_type(
-          TS_SERVER_TO_CLIENT_MESSAGE_TUPLE, buffer, TS_BUFFER_SIZE)) {
+          TS_SERVER_TO_CLIENT_MESSAGE_TUPLE, message, TS_BUFFER_SIZE)) {
     return TS_FALSE;
   }
-  if (!ts_encode_tuple_size(tuple_size, buffer, TS_BUFFER_SIZE)) {
+  if (!ts_encode_tuple_size(tuple_size, message, TS_BUFFER_SIZE)) {
     return TS_FALSE;
   }
-  ts_size_t buffer_size =
-      ts_serialize_tuple(tuple, tuple_size, buffer + 1, TS_BUFFER_SIZE - 1);
-  if (buffer_size == 0) {
+  ts_size_t message_size =
+      ts_serialize_tuple(tuple, tuple_size, message + 1, TS_BUFFER_SIZE - 1);
+  if (message_size == 0) {
     return TS_FALSE;
   }
-  return server_context->device_context.send_cb(
-      &server_context->device_context, client_ip_address, client_port_id,
-      buffer, buffer_size + 1);
+  return ts_server_commit_message(server_context, client_ip_address,
+                                  client_port_id, message, message_size + 1);
 }
 
 ts_bool_t ts_server_send_server_to_client_tuple_span(
@@ -277,21 +523,43 @@ ts_bool_t ts_server_send_server_to_client_tuple_span(
     ts_size_t tuple_size, ts_ipv4_t client_ip_address,
     ts_port_t client_port_id) {
   ts_byte_t buffer[TS_BUFFER_SIZE];
+  ts_byte_t* message = ts_server_message_buffer(server_context, buffer);
   if (!ts_server_to_client_encode_message_type(
-          TS_SERVER_TO_CLIENT_MESSAGE_TUPLE, buffer, TS_BUFFER_SIZE)) {
+          TS_SERVER_TO_CLIENT_MESSAGE_TUPLE, message, TS_BUFFER_SIZE)) {
     return TS_FALSE;
   }
-  if (!ts_encode_tuple_size(tuple_size, buffer, TS_BUFFER_SIZE)) {
+  if (!ts_encode_tuple_size(tuple_size, message, TS_BUFFER_SIZE)) {
     return TS_FALSE;
   }
-  ts_size_t buffer_size = ts_serialize_tuple_span(tuple, tuple_size, buffer + 1,
-                                                  TS_BUFFER_SIZE - 1);
-  if (buffer_size == 0) {
+  ts_size_t message_size = ts_serialize_tuple_span(
+      tuple, tuple_size, message + 1, TS_BUFFER_SIZE - 1);
+  if (message_size == 0) {
+    return TS_FALSE;
+  }
+  return ts_server_commit_message(server_context, client_ip_address,
+                                  client_port_id, message, message_size + 1);
+}
+
+ts_bool_t ts_server_send_server_to_client_serialized_tuple(
+    ts_server_context_t* server_context, const ts_byte_t* serialized_tuple,
+    ts_size_t serialized_size, ts_size_t tuple_size,
+    ts_ipv4_t client_ip_address, ts_port_t client_port_id) {
+  if (serialized_size >= TS_BUFFER_SIZE) {
+    return TS_FALSE;
+  }
+  ts_byte_t buffer[TS_BUFFER_SIZE];
+  ts_byte_t* message = ts_server_message_buffer(server_context, buffer);
+  if (!ts_server_to_client_encode_message_type(
+          TS_SERVER_TO_CLIENT_MESSAGE_TUPLE, message, TS_BUFFER_SIZE)) {
+    return TS_FALSE;
+  }
+  if (!ts_encode_tuple_size(tuple_size, message, TS_BUFFER_SIZE)) {
     return TS_FALSE;
   }
-  return server_context->device_context.send_cb(
-      &server_context->device_context, client_ip_address, client_port_id,
-      buffer, buffer_size + 1);
+  memcpy(message + 1, serialized_tuple, serialized_size);
+  return ts_server_commit_message(server_context, client_ip_address,
+                                  client_port_id, message,
+                                  serialized_size + 1);
 }
 
 static ts_bool_t ts_server_send_server_to_client_payloadless_msg(
@@ -301,9 +569,8 @@ static ts_bool_t ts_server_send_server_to_client_payloadless_msg(
   if (!ts_server_to_client_encode_message_type(message_type, buffer, 1)) {
     return TS_FALSE;
   }
-  return server_context->device_context.send_cb(&server_context->device_context,
-                                                client_ip_address,
-                                                client_port_id, buffer, 1);
+  return ts_server_send_message(server_context, client_ip_address,
+                                client_port_id, buffer, 1);
 }
 
 ts_bool_t ts_server_send_server_to_client_lack_of_tuple(
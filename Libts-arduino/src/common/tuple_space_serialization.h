@@ -6,13 +6,41 @@
 typedef void* (*ts_allocator_cb_t)(void* allocator_context,
                                    ts_size_t allocated_size);
 typedef void (*ts_deallocator_cb_t)(void* allocator_context, void* memory_ptr);
+typedef void (*ts_sized_deallocator_cb_t)(void* allocator_context,
+                                          void* memory_ptr,
+                                          ts_size_t allocated_size);
+typedef void* (*ts_reallocator_cb_t)(void* allocator_context, void* memory_ptr,
+                                     ts_size_t allocated_size,
+                                     ts_size_t new_size);
+typedef ts_size_t (*ts_allocator_mark_cb_t)(void* allocator_context);
+typedef void (*ts_allocator_reset_cb_t)(void* allocator_context,
+                                        ts_size_t mark);
 
+// Only allocator_cb and one of the deallocators are mandatory; the library
+// releases memory through sized_deallocator_cb whenever it is set, so an
+// allocator providing it may leave deallocator_cb NULL. Without
+// reallocator_cb reallocation falls back to allocate, copy and free.
+// mark_cb/reset_cb let arenas drop everything allocated since a mark.
 typedef struct {
   ts_allocator_cb_t allocator_cb;
   ts_deallocator_cb_t deallocator_cb;
   void* context;
+  ts_sized_deallocator_cb_t sized_deallocator_cb;
+  ts_reallocator_cb_t reallocator_cb;
+  ts_allocator_mark_cb_t mark_cb;
+  ts_allocator_reset_cb_t reset_cb;
 } ts_allocator_t;
 
+void ts_allocator_free(const ts_allocator_t* allocator, void* memory_ptr,
+                       ts_size_t allocated_size);
+
+void* ts_allocator_realloc(const ts_allocator_t* allocator, void* memory_ptr,
+                           ts_size_t allocated_size, ts_size_t new_size);
+
+ts_bool_t ts_allocator_mark(const ts_allocator_t* allocator, ts_size_t* mark);
+
+ts_bool_t ts_allocator_reset(const ts_allocator_t* allocator, ts_size_t mark);
+
 void ts_tuple_span(ts_tuple_field_t** tuple_span, ts_tuple_field_t* tuple,
                    ts_size_t tuple_size);
 
@@ -40,6 +68,82 @@ ts_bool_t ts_deserialize_tuple_span(const ts_byte_t* message_buffer,
                                     ts_size_t tuple_size,
                                     const ts_allocator_t* allocator);
 
+// Packed tuples keep the field array and the bytes of all string fields in
+// one block: strings follow the last field and are pointed to from it.
+ts_size_t ts_deserialized_packed_tuple_size(const ts_byte_t* message_buffer,
+                                            ts_size_t buffer_size,
+                                            ts_size_t tuple_size);
+
+// Computes the signature ts_tuple_type_signature would give the tuple once
+// deserialized, without deserializing it.
+ts_bool_t ts_serialized_tuple_type_signature(const ts_byte_t* message_buffer,
+                                             ts_size_t buffer_size,
+                                             ts_size_t tuple_size,
+                                             ts_tuple_signature_t* signature);
+
+ts_bool_t ts_deserialize_packed_tuple(const ts_byte_t* message_buffer,
+                                      ts_size_t buffer_size,
+                                      ts_tuple_field_t* tuple,
+                                      ts_size_t tuple_size);
+
+// A view reads the fields of a serialized tuple in place, without copying
+// them out of the message buffer. It lives no longer than that buffer, and
+// its strings are not NUL-terminated.
+typedef struct {
+  const ts_byte_t* buffer;
+  ts_size_t tuple_size;
+  ts_ushort_t field_offsets[TS_MAX_TUPLE_SIZE];
+} ts_tuple_view_t;
+
+// Checks every field of the serialized tuple and records where it starts.
+ts_bool_t ts_parse_tuple_view(const ts_byte_t* message_buffer,
+                              ts_size_t buffer_size, ts_size_t tuple_size,
+                              ts_tuple_view_t* view);
+
+ts_tuple_field_type_t ts_tuple_view_field_type(const ts_tuple_view_t* view,
+                                               ts_size_t index);
+
+ts_bool_t ts_tuple_view_field_contains_data(const ts_tuple_view_t* view,
+                                            ts_size_t index);
+
+ts_operation_status_t ts_tuple_view_get_uint(const ts_tuple_view_t* view,
+                                             ts_size_t index,
+                                             ts_uint_t* value);
+ts_operation_status_t ts_tuple_view_get_int(const ts_tuple_view_t* view,
+                                            ts_size_t index, ts_int_t* value);
+ts_operation_status_t ts_tuple_view_get_float(const ts_tuple_view_t* view,
+                                              ts_size_t index,
+                                              ts_float_t* value);
+ts_operation_status_t ts_tuple_view_get_bool(const ts_tuple_view_t* view,
+                                             ts_size_t index,
+                                             ts_bool_t* value);
+// The string points into the message buffer and is not NUL-terminated, a
+// field without data gives an empty one. Like ts_deserialize_tuple, the
+// string ends at its first NUL byte.
+ts_operation_status_t ts_tuple_view_get_string(const ts_tuple_view_t* view,
+                                               ts_size_t index,
+                                               const char** string,
+                                               ts_size_t* length);
+
+ts_bool_t ts_does_all_fields_of_tuple_view_contain_data(
+    const ts_tuple_view_t* view);
+
+ts_tuple_signature_t ts_tuple_view_type_signature(const ts_tuple_view_t* view);
+
+// ts_is_matching_tuple with the template or the data tuple read from a view
+// of view->tuple_size fields.
+ts_bool_t ts_is_matching_template_view(const ts_tuple_view_t* template_view,
+                                       const ts_tuple_field_t* data_tuple);
+
+ts_bool_t ts_is_matching_tuple_view(const ts_tuple_field_t* template_tuple,
+                                    const ts_tuple_view_t* data_view);
+
+ts_size_t ts_packed_tuple_size(const ts_tuple_field_t* tuple,
+                               ts_size_t tuple_size);
+
+void ts_pack_tuple(ts_tuple_field_t* packed_tuple,
+                   const ts_tuple_field_t* tuple, ts_size_t tuple_size);
+
 void ts_deallocate_tuple_span(ts_tuple_field_t** tuple, ts_size_t tuple_size,
                               const ts_allocator_t* allocator);
 
@@ -12,6 +12,13 @@ typedef uint32_t ts_size_t;
 typedef int32_t ts_ssize_t;
 typedef uint16_t ts_ushort_t;
 typedef unsigned char ts_byte_t;
+typedef uint64_t ts_tuple_signature_t;
+
+// Bytes of the data union, deserialized strings shorter than that are kept
+// inside the field instead of being allocated.
+#define TS_INLINE_STRING_SIZE                                   \
+  (sizeof(ts_string_t) > sizeof(ts_uint_t) ? sizeof(ts_string_t) \
+                                           : sizeof(ts_uint_t))
 
 typedef struct {
   uint8_t flags;
@@ -21,6 +28,7 @@ typedef struct {
     ts_int_t int_field;
     ts_float_t float_field;
     ts_string_t string_field;
+    char inline_string[TS_INLINE_STRING_SIZE];
   } data;
 } ts_tuple_field_t;
 
@@ -49,6 +57,7 @@ __TS_TUPLE_FACTORY(16);
 #undef __TS_TUPLE_FACTORY
 
 #define TS_MAX_TUPLE_SIZE 16
+#define TS_TUPLE_SIGNATURE_FIELD_BITS 3
 
 typedef enum {
   TS_OPERATION_SUCCESS = 0,
@@ -81,6 +90,12 @@ ts_tuple_field_type_t ts_tuple_field_get_type(const ts_tuple_field_t* field);
 
 ts_bool_t ts_tuple_field_contains_data(const ts_tuple_field_t* field);
 
+ts_bool_t ts_tuple_field_is_inline_string(const ts_tuple_field_t* field);
+
+// Characters of a string field with data, inline strings point into the
+// field itself and live as long as it does.
+ts_string_t ts_tuple_field_string(const ts_tuple_field_t* field);
+
 ts_operation_status_t ts_tuple_field_get_uint(const ts_tuple_field_t* field,
                                               ts_uint_t* value);
 ts_operation_status_t ts_tuple_field_get_int(const ts_tuple_field_t* field,
@@ -102,6 +117,9 @@ ts_bool_t ts_are_equal_tuples(const ts_tuple_field_t* left_tuple,
                               const ts_tuple_field_t* right_tuple,
                               ts_size_t tuple_size);
 
+ts_tuple_signature_t ts_tuple_type_signature(const ts_tuple_field_t* tuple,
+                                             ts_size_t tuple_size);
+
 ts_bool_t ts_is_matching_tuple(const ts_tuple_field_t* template_tuple,
                                const ts_tuple_field_t* data_tuple,
                                ts_size_t tuple_size);
@@ -5,9 +5,11 @@
 
 #define TS_MEMORY_RESOURCE_SIZE 512
 
+// Bump arena: allocations that do not fit the remaining memory return NULL.
 typedef struct {
   ts_byte_t memory[TS_MEMORY_RESOURCE_SIZE];
   ts_size_t pointer;
+  ts_size_t high_water_mark;
 } ts_block_memory_resource_t;
 
 void ts_initialize_memory_resource(ts_block_memory_resource_t* resource);
@@ -17,4 +19,7 @@ ts_allocator_t ts_memory_resource_get_allocator(
 
 void ts_memory_resource_free_block(ts_block_memory_resource_t* resource);
 
+ts_size_t ts_memory_resource_high_water_mark(
+    const ts_block_memory_resource_t* resource);
+
 #endif  // __TUPLE_SPACE_BLOCK_MEMORY_RESOURCE_H__
@@ -93,6 +93,10 @@ static ts_bool_t ts_application_send_template(
       ts_tuple_field_set_uint(connection->app_id, TS_TRUE);
   ts_tuple_field_t** tuple_span = allocator->allocator_cb(
       allocator->context, sizeof(ts_tuple_field_t*) * (template_size + 1));
+  if (tuple_span == NULL) {
+    result->error = TS_APPLICATION_INTERNAL_ERROR;
+    return TS_FALSE;
+  }
   tuple_span[0] = &first_field;
   ts_tuple_span(tuple_span + 1, template_tuple, template_size);
 
@@ -101,7 +105,8 @@ static ts_bool_t ts_application_send_template(
           &connection->app_context->client_context, tuple_span,
           template_size + 1, is_removing, is_blocking, context, allocator);
 
-  allocator->deallocator_cb(allocator->context, tuple_span);
+  ts_allocator_free(allocator, tuple_span,
+                    sizeof(ts_tuple_field_t*) * (template_size + 1));
 
   if (status = TS_CLIENT_TO_SERVER_NO_ERROR) {
     result->error = TS_APPLICATION_INTERNAL_ERROR;
@@ -193,13 +198,17 @@ ts_application_error_t ts_application_out(
       ts_tuple_field_set_uint(connection->app_id, TS_TRUE);
   ts_tuple_field_t** tuple_span = allocator->allocator_cb(
       allocator->context, sizeof(ts_tuple_field_t*) * (template_size + 1));
+  if (tuple_span == NULL) {
+    return TS_APPLICATION_INTERNAL_ERROR;
+  }
   tuple_span[0] = &first_field;
   ts_tuple_span(tuple_span + 1, template_tuple, template_size);
 
   ts_bool_t status = ts_client_send_client_to_server_send_tuple_span(
       &connection->app_context->client_context, tuple_span, template_size + 1);
 
-  allocator->deallocator_cb(allocator->context, tuple_span);
+  ts_allocator_free(allocator, tuple_span,
+                    sizeof(ts_tuple_field_t*) * (template_size + 1));
 
   return status ? TS_APPLICATION_NO_ERROR : TS_APPLICATION_INTERNAL_ERROR;
 }
@@ -207,5 +216,6 @@ ts_application_error_t ts_application_out(
 void ts_free_application_result_tuple(ts_tuple_field_t* tuple, ts_size_t size,
                                       const ts_allocator_t* allocator) {
   ts_deallocate_tuple(tuple - 1, size + 1, allocator);
-  allocator->deallocator_cb(allocator->context, tuple - 1);
+  ts_allocator_free(allocator, tuple - 1,
+                    sizeof(ts_tuple_field_t) * (size + 1));
 }
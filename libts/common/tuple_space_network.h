@@ -9,6 +9,14 @@
 typedef uint32_t ts_ipv4_t;
 typedef uint16_t ts_port_t;
 
+typedef struct {
+  ts_ipv4_t ip_address;
+  ts_port_t port_id;
+  ts_size_t buffer_size;
+  uint64_t receive_time_ns;  // set by devices with receive timestamps, or 0
+  ts_byte_t buffer[TS_BUFFER_SIZE];
+} ts_datagram_t;
+
 typedef ts_size_t (*ts_data_recv_cb_t)(void* device_context,
                                        ts_ipv4_t* sender_ip_address,
                                        ts_port_t* sender_port_id,
@@ -20,6 +28,17 @@ typedef ts_bool_t (*ts_data_send_cb_t)(void* device_context,
                                        const ts_byte_t* buffer,
                                        ts_size_t buffer_size);
 typedef ts_uint_t (*ts_clock_ms_cb_t)(void);
+// Blocks until a datagram can be received or timeout_ms elapses, a negative
+// timeout waits indefinitely. Returns TS_TRUE if a datagram is pending.
+typedef ts_bool_t (*ts_data_wait_cb_t)(void* device_context,
+                                       ts_int_t timeout_ms);
+// Batch variants return the number of datagrams received or sent, in order.
+typedef ts_size_t (*ts_data_recv_batch_cb_t)(void* device_context,
+                                             ts_datagram_t* datagrams,
+                                             ts_size_t datagrams_count);
+typedef ts_size_t (*ts_data_send_batch_cb_t)(void* device_context,
+                                             const ts_datagram_t* datagrams,
+                                             ts_size_t datagrams_count);
 typedef void (*ts_device_context_destructor_cb_t)(void* device_context);
 
 #define TS_DEVICE_CONTEXT_SIZE 50
@@ -34,21 +53,30 @@ typedef struct {
   ts_data_send_cb_t send_cb;
   ts_clock_ms_cb_t clock_cb;
   ts_device_context_destructor_cb_t destructor_cb;
+  ts_data_wait_cb_t wait_cb;              // optional
+  ts_data_recv_batch_cb_t recv_batch_cb;  // optional
+  ts_data_send_batch_cb_t send_batch_cb;  // optional
   ts_byte_t device_context[TS_DEVICE_CONTEXT_SIZE];
   ts_byte_t current_state;  // ts_device_state_t
   ts_byte_t can_receive_ip;
 } ts_device_context_t;
 
-typedef void (*ts_client_to_server_send_tuple_cb_t)(void* user_data,
-                                                    ts_tuple_field_t* tuple,
-                                                    ts_size_t tuple_size,
-                                                    ts_ipv4_t sender_ip_address,
-                                                    ts_port_t sender_port_id);
+typedef void (*ts_client_to_server_send_tuple_cb_t)(
+    void* user_data, ts_tuple_field_t* tuple, ts_size_t tuple_size,
+    ts_tuple_signature_t signature, ts_ipv4_t sender_ip_address,
+    ts_port_t sender_port_id);
 
 typedef void (*ts_client_to_server_get_tuple_cb_t)(
     void* user_data, ts_tuple_field_t* tuple, ts_size_t tuple_size,
-    ts_bool_t respond_when_available, ts_bool_t remove_after_use,
-    ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
+    ts_tuple_signature_t signature, ts_bool_t respond_when_available,
+    ts_bool_t remove_after_use, ts_ipv4_t sender_ip_address,
+    ts_port_t sender_port_id);
+
+typedef void (*ts_client_to_server_get_tuple_view_cb_t)(
+    void* user_data, const ts_tuple_view_t* tuple,
+    ts_tuple_signature_t signature, ts_bool_t respond_when_available,
+    ts_bool_t remove_after_use, ts_ipv4_t sender_ip_address,
+    ts_port_t sender_port_id);
 
 typedef void (*ts_client_to_server_ack_cb_t)(void* user_data,
                                              ts_ipv4_t sender_ip_address,
@@ -71,17 +99,31 @@ typedef struct {
   ts_client_to_server_processing_error_cb_t send_tuple_invalid_invariant_cb;
   ts_client_to_server_processing_error_cb_t get_tuple_invalid_invariant_cb;
   ts_client_to_server_serialization_issue_t serialization_issue_cb;
+  ts_client_to_server_get_tuple_view_cb_t get_tuple_view_cb;  // optional
 } ts_server_receiver_callbacks_t;
 
+// Tuples handed to the server callbacks are packed into a single block
+// preceded by tuple_header_size bytes reserved for the caller, e.g. a list
+// node. They are released with ts_server_free_tuple. When get_tuple_view_cb
+// is set, get messages are handed to it as a view of the received datagram
+// instead, and nothing is allocated for them.
+// Once a send batch is set, replies are queued in it and go out on
+// ts_server_flush_messages or when the batch fills up.
 typedef struct {
   ts_device_context_t device_context;
   ts_server_receiver_callbacks_t server_callbacks;
+  ts_size_t tuple_header_size;
+  ts_datagram_t* send_batch;
+  ts_size_t send_batch_capacity;
+  ts_size_t send_batch_size;
 } ts_server_context_t;
 
 typedef void (*ts_server_to_client_lack_of_tuple_cb_t)(void* user_data);
 typedef void (*ts_server_to_client_tuple_cb_t)(void* user_data,
                                                ts_tuple_field_t* tuple,
                                                ts_size_t tuple_size);
+typedef void (*ts_server_to_client_tuple_view_cb_t)(
+    void* user_data, const ts_tuple_view_t* tuple);
 typedef void (*ts_server_to_client_error_cb_t)(void* user_data);
 typedef void (*ts_server_to_client_unknown_sender_cb_t)(
     void* user_data, ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
@@ -92,6 +134,9 @@ typedef struct {
   ts_server_to_client_error_cb_t error_cb;
   ts_server_to_client_unknown_sender_cb_t unknown_sender_cb;
   ts_server_to_client_error_cb_t tuple_invalid_invariant_cb;
+  // Optional, called instead of tuple_cb with a view of the received
+  // datagram for callers that do not need to keep the tuple.
+  ts_server_to_client_tuple_view_cb_t tuple_view_cb;
 } ts_client_receiver_callbacks_t;
 
 typedef struct {
@@ -114,8 +159,49 @@ ts_bool_t ts_initialize_client_context(
     ts_ipv4_t server_ip_address, ts_port_t server_port_id,
     ts_size_t max_number_of_repeats, ts_uint_t ack_await_time);
 
-void ts_server_get_message(ts_server_context_t* server_context, void* user_data,
-                           const ts_allocator_t* allocator);
+// Devices without a wait callback return TS_TRUE at once, leaving the caller
+// to poll ts_server_get_message.
+ts_bool_t ts_server_wait_for_message(ts_server_context_t* server_context,
+                                     ts_int_t timeout_ms);
+
+// Returns TS_FALSE if no datagram was pending.
+ts_bool_t ts_server_get_message(ts_server_context_t* server_context,
+                                void* user_data,
+                                const ts_allocator_t* allocator);
+
+// Returns the number of datagrams received, without waiting for any.
+ts_size_t ts_server_receive_messages(ts_server_context_t* server_context,
+                                     ts_datagram_t* datagrams,
+                                     ts_size_t datagrams_count);
+
+void ts_server_process_messages(ts_server_context_t* server_context,
+                                const ts_datagram_t* datagrams,
+                                ts_size_t datagrams_count, void* user_data,
+                                const ts_allocator_t* allocator);
+
+// Receives up to datagrams_count datagrams into datagrams, processes them and
+// flushes the replies. Returns the number of datagrams processed.
+ts_size_t ts_server_get_messages(ts_server_context_t* server_context,
+                                 ts_datagram_t* datagrams,
+                                 ts_size_t datagrams_count, void* user_data,
+                                 const ts_allocator_t* allocator);
+
+void ts_server_set_send_batch(ts_server_context_t* server_context,
+                              ts_datagram_t* datagrams,
+                              ts_size_t datagrams_count);
+
+ts_bool_t ts_server_flush_messages(ts_server_context_t* server_context);
+
+// Signature of the tuple carried by a send or get message, TS_FALSE for
+// other or malformed messages.
+ts_bool_t ts_client_to_server_message_signature(
+    const ts_byte_t* buffer, ts_size_t buffer_size,
+    ts_tuple_signature_t* signature);
+
+// Flags of a get message, TS_FALSE for other or malformed messages.
+ts_bool_t ts_client_to_server_get_message_flags(
+    const ts_byte_t* buffer, ts_size_t buffer_size,
+    ts_bool_t* respond_when_available, ts_bool_t* remove_after_use);
 
 ts_bool_t ts_client_get_message(ts_client_context_t* client_context,
                                 void* user_data,
@@ -131,6 +217,13 @@ ts_bool_t ts_server_send_server_to_client_tuple_span(
     ts_size_t tuple_size, ts_ipv4_t client_ip_address,
     ts_port_t client_port_id);
 
+// Sends a tuple already serialized by ts_serialize_tuple, copying it into
+// the message once.
+ts_bool_t ts_server_send_server_to_client_serialized_tuple(
+    ts_server_context_t* server_context, const ts_byte_t* serialized_tuple,
+    ts_size_t serialized_size, ts_size_t tuple_size,
+    ts_ipv4_t client_ip_address, ts_port_t client_port_id);
+
 ts_bool_t ts_server_send_server_to_client_lack_of_tuple(
     ts_server_context_t* server_context, ts_ipv4_t client_ip_address,
     ts_port_t client_port_id);
@@ -178,4 +271,21 @@ void ts_close_client_context(ts_client_context_t* client_context);
 void ts_free_tuple(ts_tuple_field_t* tuple, ts_size_t tuple_size,
                    const ts_allocator_t* allocator);
 
+ts_tuple_field_t* ts_server_allocate_tuple(
+    const ts_server_context_t* server_context, ts_size_t packed_size,
+    const ts_allocator_t* allocator);
+
+// Frees a block of ts_server_allocate_tuple, whatever its fields point to.
+void ts_server_release_tuple(const ts_server_context_t* server_context,
+                             ts_tuple_field_t* tuple, ts_size_t packed_size,
+                             const ts_allocator_t* allocator);
+
+ts_tuple_field_t* ts_server_copy_tuple(
+    const ts_server_context_t* server_context, const ts_tuple_field_t* tuple,
+    ts_size_t tuple_size, const ts_allocator_t* allocator);
+
+void ts_server_free_tuple(const ts_server_context_t* server_context,
+                          ts_tuple_field_t* tuple, ts_size_t tuple_size,
+                          const ts_allocator_t* allocator);
+
 #endif  // __TUPLE_SPACE_NETWORK_H__
@@ -22,6 +22,50 @@ static void ts_endianaware_memcpy(void* dst, const void* src, ts_size_t size) {
   }
 }
 
+void ts_allocator_free(const ts_allocator_t* allocator, void* memory_ptr,
+                       ts_size_t allocated_size) {
+  if (allocator->sized_deallocator_cb != NULL) {
+    allocator->sized_deallocator_cb(allocator->context, memory_ptr,
+                                    allocated_size);
+  } else {
+    allocator->deallocator_cb(allocator->context, memory_ptr);
+  }
+}
+
+void* ts_allocator_realloc(const ts_allocator_t* allocator, void* memory_ptr,
+                           ts_size_t allocated_size, ts_size_t new_size) {
+  if (allocator->reallocator_cb != NULL) {
+    return allocator->reallocator_cb(allocator->context, memory_ptr,
+                                     allocated_size, new_size);
+  }
+  void* new_memory = allocator->allocator_cb(allocator->context, new_size);
+  if (new_memory == NULL) {
+    return NULL;
+  }
+  if (memory_ptr != NULL) {
+    memcpy(new_memory, memory_ptr,
+           allocated_size < new_size ? allocated_size : new_size);
+    ts_allocator_free(allocator, memory_ptr, allocated_size);
+  }
+  return new_memory;
+}
+
+ts_bool_t ts_allocator_mark(const ts_allocator_t* allocator, ts_size_t* mark) {
+  if (allocator->mark_cb == NULL) {
+    return TS_FALSE;
+  }
+  *mark = allocator->mark_cb(allocator->context);
+  return TS_TRUE;
+}
+
+ts_bool_t ts_allocator_reset(const ts_allocator_t* allocator, ts_size_t mark) {
+  if (allocator->reset_cb == NULL) {
+    return TS_FALSE;
+  }
+  allocator->reset_cb(allocator->context, mark);
+  return TS_TRUE;
+}
+
 void ts_tuple_span(ts_tuple_field_t** tuple_span, ts_tuple_field_t* tuple,
                    ts_size_t tuple_size) {
   for (ts_size_t i = 0; i < tuple_size; ++i) {
@@ -45,13 +89,14 @@ static ts_size_t ts_serialize_tuple_field_data(const ts_tuple_field_t* field,
 static ts_size_t ts_serialize_tuple_field_string(const ts_tuple_field_t* field,
                                                  ts_byte_t** buffer,
                                                  ts_size_t* buffer_size) {
-  const ts_ushort_t string_length = strlen(field->data.string_field);
+  ts_string_t string = ts_tuple_field_string(field);
+  const ts_ushort_t string_length = strlen(string);
   const ts_size_t total_field_len = string_length + 2;
   if (total_field_len > *buffer_size) {
     return 0;
   }
   ts_endianaware_memcpy(*buffer, &string_length, 2);
-  memcpy(*buffer + 2, field->data.string_field, string_length);
+  memcpy(*buffer + 2, string, string_length);
   (*buffer) += total_field_len;
   (*buffer_size) -= total_field_len;
   return total_field_len;
@@ -63,7 +108,8 @@ static ts_size_t ts_serialize_tuple_field(const ts_tuple_field_t* field,
   if (*buffer_size == 0) {
     return 0;
   }
-  (*buffer)[0] = field->flags;
+  // Whether a string is inline is private to each side
+  (*buffer)[0] = field->flags & 0xdf;
   ++(*buffer);
   --(*buffer_size);
   if (!ts_tuple_field_contains_data(field)) {
@@ -147,9 +193,14 @@ static ts_bool_t ts_deserialize_tuple_field_data(
   return TS_TRUE;
 }
 
+static ts_bool_t ts_is_inline_string_size(ts_size_t string_size) {
+  return string_size < TS_INLINE_STRING_SIZE;
+}
+
 static ts_bool_t ts_deserialize_tuple_field_string(
     ts_tuple_field_t* current_field, const ts_byte_t** buffer,
-    ts_size_t* remaining_size, const ts_allocator_t* allocator) {
+    ts_size_t* remaining_size, const ts_allocator_t* allocator,
+    char** packed_strings) {
   if (*remaining_size < 2) {
     return TS_FALSE;
   }
@@ -160,8 +211,22 @@ static ts_bool_t ts_deserialize_tuple_field_string(
   if (*remaining_size < string_size) {
     return TS_FALSE;
   }
-  char* string_buffer =
-      (char*)allocator->allocator_cb(allocator->context, string_size + 1);
+  if (ts_is_inline_string_size(string_size)) {
+    current_field->flags |= 0x20;
+    memset(current_field->data.inline_string, 0, TS_INLINE_STRING_SIZE);
+    memcpy(current_field->data.inline_string, *buffer, string_size);
+    *remaining_size -= string_size;
+    *buffer += string_size;
+    return TS_TRUE;
+  }
+  char* string_buffer;
+  if (packed_strings != NULL) {
+    string_buffer = *packed_strings;
+    *packed_strings += string_size + 1;
+  } else {
+    string_buffer =
+        (char*)allocator->allocator_cb(allocator->context, string_size + 1);
+  }
   if (string_buffer == NULL) {
     return TS_FALSE;
   }
@@ -176,13 +241,17 @@ static ts_bool_t ts_deserialize_tuple_field_string(
 static ts_bool_t ts_deserialize_tuple_field(ts_tuple_field_t* current_field,
                                             const ts_byte_t** buffer,
                                             ts_size_t* remaining_size,
-                                            const ts_allocator_t* allocator) {
+                                            const ts_allocator_t* allocator,
+                                            char** packed_strings) {
   if (*remaining_size == 0) {
     return TS_FALSE;
   }
   current_field->flags = (*buffer)[0];
   --(*remaining_size);
   ++(*buffer);
+  if (ts_tuple_field_is_inline_string(current_field)) {
+    return TS_FALSE;
+  }
   if (!ts_tuple_field_contains_data(current_field)) {
     return TS_TRUE;
   }
@@ -193,8 +262,8 @@ static ts_bool_t ts_deserialize_tuple_field(ts_tuple_field_t* current_field,
       return ts_deserialize_tuple_field_data(current_field, buffer,
                                              remaining_size, 4);
     case TS_FIELD_TYPE_STRING:
-      return ts_deserialize_tuple_field_string(current_field, buffer,
-                                               remaining_size, allocator);
+      return ts_deserialize_tuple_field_string(
+          current_field, buffer, remaining_size, allocator, packed_strings);
     case TS_FIELD_TYPE_BOOL:
       current_field->data.bool_field = (current_field->flags & 0x40) >> 6;
       return TS_TRUE;
@@ -210,8 +279,8 @@ ts_bool_t ts_deserialize_tuple(const ts_byte_t* message_buffer,
                                const ts_allocator_t* allocator) {
   for (ts_size_t i = 0; i < tuple_size; ++i) {
     if (!ts_deserialize_tuple_field(&tuple[i], &message_buffer, &buffer_size,
-                                    allocator)) {
-      ts_deallocate_tuple(tuple, tuple_size, allocator);
+                                    allocator, NULL)) {
+      ts_deallocate_tuple(tuple, i, allocator);
       return TS_FALSE;
     }
   }
@@ -225,22 +294,345 @@ ts_bool_t ts_deserialize_tuple_span(const ts_byte_t* message_buffer,
                                     const ts_allocator_t* allocator) {
   for (ts_size_t i = 0; i < tuple_size; ++i) {
     if (!ts_deserialize_tuple_field(tuple[i], &message_buffer, &buffer_size,
-                                    allocator)) {
-      ts_deallocate_tuple_span(tuple, tuple_size, allocator);
+                                    allocator, NULL)) {
+      ts_deallocate_tuple_span(tuple, i, allocator);
+      return TS_FALSE;
+    }
+  }
+  return TS_TRUE;
+}
+
+// Reads the flags of the next serialized field and steps over its data.
+static ts_bool_t ts_skip_serialized_tuple_field(ts_tuple_field_t* field,
+                                                const ts_byte_t** buffer,
+                                                ts_size_t* buffer_size,
+                                                ts_ushort_t* string_size) {
+  if (*buffer_size == 0) {
+    return TS_FALSE;
+  }
+  field->flags = (*buffer)[0];
+  ++(*buffer);
+  --(*buffer_size);
+  *string_size = 0;
+  if (ts_tuple_field_is_inline_string(field)) {
+    return TS_FALSE;
+  }
+  if (!ts_tuple_field_contains_data(field)) {
+    return TS_TRUE;
+  }
+  ts_size_t data_size = 0;
+  switch (ts_tuple_field_get_type(field)) {
+    case TS_FIELD_TYPE_UINT:
+    case TS_FIELD_TYPE_INT:
+    case TS_FIELD_TYPE_FLOAT:
+      data_size = 4;
+      break;
+    case TS_FIELD_TYPE_STRING:
+      if (*buffer_size < 2) {
+        return TS_FALSE;
+      }
+      ts_endianaware_memcpy(string_size, *buffer, 2);
+      data_size = 2 + *string_size;
+      break;
+    case TS_FIELD_TYPE_BOOL:
+      break;
+    default:
+      return TS_FALSE;
+  }
+  if (*buffer_size < data_size) {
+    return TS_FALSE;
+  }
+  *buffer += data_size;
+  *buffer_size -= data_size;
+  return TS_TRUE;
+}
+
+ts_size_t ts_deserialized_packed_tuple_size(const ts_byte_t* message_buffer,
+                                            ts_size_t buffer_size,
+                                            ts_size_t tuple_size) {
+  ts_size_t packed_size = sizeof(ts_tuple_field_t) * tuple_size;
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    ts_tuple_field_t field;
+    ts_ushort_t string_size;
+    if (!ts_skip_serialized_tuple_field(&field, &message_buffer, &buffer_size,
+                                        &string_size)) {
+      return 0;
+    }
+    if (ts_tuple_field_contains_data(&field) &&
+        ts_tuple_field_get_type(&field) == TS_FIELD_TYPE_STRING &&
+        !ts_is_inline_string_size(string_size)) {
+      packed_size += string_size + 1;
+    }
+  }
+  return packed_size;
+}
+
+ts_bool_t ts_serialized_tuple_type_signature(const ts_byte_t* message_buffer,
+                                             ts_size_t buffer_size,
+                                             ts_size_t tuple_size,
+                                             ts_tuple_signature_t* signature) {
+  ts_tuple_field_t tuple[TS_MAX_TUPLE_SIZE];
+  if (tuple_size > TS_MAX_TUPLE_SIZE) {
+    return TS_FALSE;
+  }
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    ts_ushort_t string_size;
+    if (!ts_skip_serialized_tuple_field(&tuple[i], &message_buffer,
+                                        &buffer_size, &string_size)) {
+      return TS_FALSE;
+    }
+  }
+  *signature = ts_tuple_type_signature(tuple, tuple_size);
+  return TS_TRUE;
+}
+
+ts_bool_t ts_deserialize_packed_tuple(const ts_byte_t* message_buffer,
+                                      ts_size_t buffer_size,
+                                      ts_tuple_field_t* tuple,
+                                      ts_size_t tuple_size) {
+  char* packed_strings = (char*)&tuple[tuple_size];
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    if (!ts_deserialize_tuple_field(&tuple[i], &message_buffer, &buffer_size,
+                                    NULL, &packed_strings)) {
+      return TS_FALSE;
+    }
+  }
+  return TS_TRUE;
+}
+
+ts_bool_t ts_parse_tuple_view(const ts_byte_t* message_buffer,
+                              ts_size_t buffer_size, ts_size_t tuple_size,
+                              ts_tuple_view_t* view) {
+  if (tuple_size > TS_MAX_TUPLE_SIZE) {
+    return TS_FALSE;
+  }
+  const ts_byte_t* field_buffer = message_buffer;
+  view->buffer = message_buffer;
+  view->tuple_size = tuple_size;
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    ts_tuple_field_t field;
+    ts_ushort_t string_size;
+    view->field_offsets[i] = (ts_ushort_t)(field_buffer - message_buffer);
+    if (!ts_skip_serialized_tuple_field(&field, &field_buffer, &buffer_size,
+                                        &string_size)) {
       return TS_FALSE;
     }
   }
   return TS_TRUE;
 }
 
+static const ts_byte_t* ts_tuple_view_field(const ts_tuple_view_t* view,
+                                            ts_size_t index) {
+  return view->buffer + view->field_offsets[index];
+}
+
+ts_tuple_field_type_t ts_tuple_view_field_type(const ts_tuple_view_t* view,
+                                               ts_size_t index) {
+  return (ts_tuple_field_type_t)(ts_tuple_view_field(view, index)[0] & 0x1f);
+}
+
+ts_bool_t ts_tuple_view_field_contains_data(const ts_tuple_view_t* view,
+                                            ts_size_t index) {
+  return (ts_tuple_view_field(view, index)[0] & 0x80) != 0;
+}
+
+// Fields without data read as zero, like the fields ts_deserialize_tuple
+// makes of them.
+static ts_operation_status_t ts_tuple_view_get_data(
+    const ts_tuple_view_t* view, ts_size_t index, ts_tuple_field_type_t type,
+    void* value) {
+  if (ts_tuple_view_field_type(view, index) != type) {
+    return TS_OPERATION_FAILURE;
+  }
+  if (ts_tuple_view_field_contains_data(view, index)) {
+    ts_endianaware_memcpy(value, ts_tuple_view_field(view, index) + 1, 4);
+  } else {
+    memset(value, 0, 4);
+  }
+  return TS_OPERATION_SUCCESS;
+}
+
+ts_operation_status_t ts_tuple_view_get_uint(const ts_tuple_view_t* view,
+                                             ts_size_t index,
+                                             ts_uint_t* value) {
+  return ts_tuple_view_get_data(view, index, TS_FIELD_TYPE_UINT, value);
+}
+
+ts_operation_status_t ts_tuple_view_get_int(const ts_tuple_view_t* view,
+                                            ts_size_t index, ts_int_t* value) {
+  return ts_tuple_view_get_data(view, index, TS_FIELD_TYPE_INT, value);
+}
+
+ts_operation_status_t ts_tuple_view_get_float(const ts_tuple_view_t* view,
+                                              ts_size_t index,
+                                              ts_float_t* value) {
+  return ts_tuple_view_get_data(view, index, TS_FIELD_TYPE_FLOAT, value);
+}
+
+ts_operation_status_t ts_tuple_view_get_bool(const ts_tuple_view_t* view,
+                                             ts_size_t index,
+                                             ts_bool_t* value) {
+  if (ts_tuple_view_field_type(view, index) != TS_FIELD_TYPE_BOOL) {
+    return TS_OPERATION_FAILURE;
+  }
+  *value = (ts_tuple_view_field(view, index)[0] & 0x40) >> 6;
+  return TS_OPERATION_SUCCESS;
+}
+
+ts_operation_status_t ts_tuple_view_get_string(const ts_tuple_view_t* view,
+                                               ts_size_t index,
+                                               const char** string,
+                                               ts_size_t* length) {
+  if (ts_tuple_view_field_type(view, index) != TS_FIELD_TYPE_STRING) {
+    return TS_OPERATION_FAILURE;
+  }
+  const ts_byte_t* field = ts_tuple_view_field(view, index);
+  ts_ushort_t string_size = 0;
+  if (ts_tuple_view_field_contains_data(view, index)) {
+    ts_endianaware_memcpy(&string_size, field + 1, 2);
+  }
+  *string = (const char*)field + 3;
+  const char* string_end = (const char*)memchr(*string, '\0', string_size);
+  *length = string_end != NULL ? (ts_size_t)(string_end - *string)
+                               : string_size;
+  return TS_OPERATION_SUCCESS;
+}
+
+ts_bool_t ts_does_all_fields_of_tuple_view_contain_data(
+    const ts_tuple_view_t* view) {
+  for (ts_size_t i = 0; i < view->tuple_size; ++i) {
+    if (!ts_tuple_view_field_contains_data(view, i)) {
+      return TS_FALSE;
+    }
+  }
+  return TS_TRUE;
+}
+
+ts_tuple_signature_t ts_tuple_view_type_signature(
+    const ts_tuple_view_t* view) {
+  const ts_tuple_signature_t field_mask =
+      (1 << TS_TUPLE_SIGNATURE_FIELD_BITS) - 1;
+  ts_tuple_signature_t signature = 0;
+  for (ts_size_t i = 0; i < view->tuple_size; ++i) {
+    signature |= (ts_tuple_view_field_type(view, i) & field_mask)
+                 << (i * TS_TUPLE_SIGNATURE_FIELD_BITS);
+  }
+  return signature;
+}
+
+// A field of the view that cannot be read matches nothing.
+static ts_bool_t ts_compare_tuple_view_field(const ts_tuple_field_t* field,
+                                             const ts_tuple_view_t* view,
+                                             ts_size_t index) {
+  switch (ts_tuple_field_get_type(field)) {
+    case TS_FIELD_TYPE_BOOL: {
+      ts_bool_t value = TS_FALSE;
+      return ts_tuple_view_get_bool(view, index, &value) ==
+                 TS_OPERATION_SUCCESS &&
+             field->data.bool_field == value;
+    }
+    case TS_FIELD_TYPE_FLOAT: {
+      ts_float_t value = 0;
+      return ts_tuple_view_get_float(view, index, &value) ==
+                 TS_OPERATION_SUCCESS &&
+             field->data.float_field == value;
+    }
+    case TS_FIELD_TYPE_INT: {
+      ts_int_t value = 0;
+      return ts_tuple_view_get_int(view, index, &value) ==
+                 TS_OPERATION_SUCCESS &&
+             field->data.int_field == value;
+    }
+    case TS_FIELD_TYPE_UINT: {
+      ts_uint_t value = 0;
+      return ts_tuple_view_get_uint(view, index, &value) ==
+                 TS_OPERATION_SUCCESS &&
+             field->data.uint_field == value;
+    }
+    case TS_FIELD_TYPE_STRING: {
+      const char* string = NULL;
+      ts_size_t length = 0;
+      if (ts_tuple_view_get_string(view, index, &string, &length) !=
+          TS_OPERATION_SUCCESS) {
+        return TS_FALSE;
+      }
+      ts_string_t field_string = ts_tuple_field_string(field);
+      return strlen(field_string) == length &&
+             memcmp(field_string, string, length) == 0;
+    }
+    default:
+      return TS_FALSE;
+  }
+  return TS_FALSE;
+}
+
+static ts_bool_t ts_is_matching_view_fields(const ts_tuple_field_t* tuple,
+                                            const ts_tuple_view_t* view,
+                                            ts_bool_t is_view_template) {
+  for (ts_size_t i = 0; i < view->tuple_size; ++i) {
+    if (ts_tuple_field_get_type(&tuple[i]) !=
+        ts_tuple_view_field_type(view, i)) {
+      return TS_FALSE;
+    }
+    if (is_view_template ? !ts_tuple_view_field_contains_data(view, i)
+                         : !ts_tuple_field_contains_data(&tuple[i])) {
+      continue;
+    }
+    if (!ts_compare_tuple_view_field(&tuple[i], view, i)) {
+      return TS_FALSE;
+    }
+  }
+  return TS_TRUE;
+}
+
+ts_bool_t ts_is_matching_template_view(const ts_tuple_view_t* template_view,
+                                       const ts_tuple_field_t* data_tuple) {
+  return ts_is_matching_view_fields(data_tuple, template_view, TS_TRUE);
+}
+
+ts_bool_t ts_is_matching_tuple_view(const ts_tuple_field_t* template_tuple,
+                                    const ts_tuple_view_t* data_view) {
+  return ts_is_matching_view_fields(template_tuple, data_view, TS_FALSE);
+}
+
+ts_size_t ts_packed_tuple_size(const ts_tuple_field_t* tuple,
+                               ts_size_t tuple_size) {
+  ts_size_t packed_size = sizeof(ts_tuple_field_t) * tuple_size;
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    if ((ts_tuple_field_get_type(&tuple[i]) == TS_FIELD_TYPE_STRING) &&
+        ts_tuple_field_contains_data(&tuple[i]) &&
+        !ts_tuple_field_is_inline_string(&tuple[i])) {
+      packed_size += strlen(tuple[i].data.string_field) + 1;
+    }
+  }
+  return packed_size;
+}
+
+void ts_pack_tuple(ts_tuple_field_t* packed_tuple,
+                   const ts_tuple_field_t* tuple, ts_size_t tuple_size) {
+  char* packed_strings = (char*)&packed_tuple[tuple_size];
+  memcpy(packed_tuple, tuple, sizeof(ts_tuple_field_t) * tuple_size);
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    if ((ts_tuple_field_get_type(&tuple[i]) == TS_FIELD_TYPE_STRING) &&
+        ts_tuple_field_contains_data(&tuple[i]) &&
+        !ts_tuple_field_is_inline_string(&tuple[i])) {
+      size_t length = strlen(tuple[i].data.string_field) + 1;
+      memcpy(packed_strings, tuple[i].data.string_field, length);
+      packed_tuple[i].data.string_field = packed_strings;
+      packed_strings += length;
+    }
+  }
+}
+
 void ts_deallocate_tuple(ts_tuple_field_t* tuple, ts_size_t tuple_size,
                          const ts_allocator_t* allocator) {
   for (ts_size_t i = 0; i < tuple_size; ++i) {
     ts_tuple_field_t* current_field = &tuple[i];
     if ((ts_tuple_field_get_type(current_field) == TS_FIELD_TYPE_STRING) &&
-        ts_tuple_field_contains_data(current_field)) {
-      allocator->deallocator_cb(allocator->context,
-                                (char*)current_field->data.string_field);
+        ts_tuple_field_contains_data(current_field) &&
+        !ts_tuple_field_is_inline_string(current_field)) {
+      ts_allocator_free(allocator, (char*)current_field->data.string_field,
+                        strlen(current_field->data.string_field) + 1);
     }
   }
 }
@@ -250,9 +642,10 @@ void ts_deallocate_tuple_span(ts_tuple_field_t** tuple, ts_size_t tuple_size,
   for (ts_size_t i = 0; i < tuple_size; ++i) {
     ts_tuple_field_t* current_field = tuple[i];
     if ((ts_tuple_field_get_type(current_field) == TS_FIELD_TYPE_STRING) &&
-        ts_tuple_field_contains_data(current_field)) {
-      allocator->deallocator_cb(allocator->context,
-                                (char*)current_field->data.string_field);
+        ts_tuple_field_contains_data(current_field) &&
+        !ts_tuple_field_is_inline_string(current_field)) {
+      ts_allocator_free(allocator, (char*)current_field->data.string_field,
+                        strlen(current_field->data.string_field) + 1);
     }
   }
 }
@@ -0,0 +1,119 @@
+// Checks matching against tuple views, which has no caller in the library
+// itself: for every case a template or data tuple read through a view must
+// match exactly when its deserialized copy does. Strings on the wire may
+// carry NUL bytes, ts_deserialize_tuple keeps them up to the first one.
+//
+// Build and run, preferably with -fsanitize=address:
+//   gcc -O1 -g -o tuple_space_view_test libts/tests/tuple_space_view_test.c
+//       libts/common/*.c libts/unix/*.c -lpthread
+//   ./tuple_space_view_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/tuple_space_serialization.h"
+#include "../unix/tuple_space_unix_alloc.h"
+
+#define TEST_TUPLE_SIZE 2
+#define TEST_BUFFER_SIZE 128
+#define TEST_NUL_MARKER '#'
+
+typedef struct {
+  const char* wire_string;  // TEST_NUL_MARKER stands for a NUL byte
+  const char* field_string;
+  ts_bool_t is_matching;
+} test_case_t;
+
+static const test_case_t TestCases[] = {
+    {"ab", "ab", TS_TRUE},
+    {"ab", "abc", TS_FALSE},
+    {"abc", "ab", TS_FALSE},
+    {"ab#cd", "ab", TS_TRUE},
+    {"ab#cd", "abcd", TS_FALSE},
+    {"ab#", "ab", TS_TRUE},
+    {"#abc", "", TS_TRUE},
+    {"#abc", "abc", TS_FALSE},
+    {"abcdefghij#klmnopqrstuvwxyz", "abcdefghij", TS_TRUE},
+    {"abcdefghij#klmnopqrstuvwxyz", "abcdefghijklmnopqrstuvwxyz", TS_FALSE},
+    {"abcdefghij", "abcdefghijk", TS_FALSE},
+    {"abcdefghijk", "abcdefghij", TS_FALSE},
+};
+
+// Serializes the tuple of the wire string and turns its markers into NULs.
+static ts_size_t test_serialize(const test_case_t* test_case,
+                                ts_byte_t* buffer, ts_size_t buffer_size) {
+  ts_tuple_field_t tuple[TEST_TUPLE_SIZE];
+  tuple[0] = ts_tuple_field_set_uint(7, TS_TRUE);
+  tuple[1] = ts_tuple_field_set_string(test_case->wire_string, TS_TRUE);
+  ts_size_t size =
+      ts_serialize_tuple(tuple, TEST_TUPLE_SIZE, buffer, buffer_size);
+  ts_size_t length = strlen(test_case->wire_string);
+  ts_byte_t* string = buffer + size - length;
+  for (ts_size_t i = 0; i < length; ++i) {
+    if (string[i] == TEST_NUL_MARKER) {
+      string[i] = '\0';
+    }
+  }
+  return size;
+}
+
+static int test_view(const test_case_t* test_case,
+                     const ts_allocator_t* allocator) {
+  ts_byte_t buffer[TEST_BUFFER_SIZE];
+  ts_size_t buffer_size = test_serialize(test_case, buffer, TEST_BUFFER_SIZE);
+  ts_tuple_view_t view;
+  ts_tuple_field_t deserialized_tuple[TEST_TUPLE_SIZE];
+  if (!ts_parse_tuple_view(buffer, buffer_size, TEST_TUPLE_SIZE, &view) ||
+      !ts_deserialize_tuple(buffer, buffer_size, deserialized_tuple,
+                            TEST_TUPLE_SIZE, allocator)) {
+    printf("Failed to read \"%s\"\n", test_case->wire_string);
+    return 0;
+  }
+
+  // A copy of its own, so a read past its end is caught by a sanitizer
+  char* field_string = strdup(test_case->field_string);
+  ts_tuple_field_t tuple[TEST_TUPLE_SIZE];
+  tuple[0] = ts_tuple_field_set_uint(7, TS_TRUE);
+  tuple[1] = ts_tuple_field_set_string(field_string, TS_TRUE);
+
+  const char* string = NULL;
+  ts_size_t length = 0;
+  ts_bool_t is_string_read =
+      ts_tuple_view_get_string(&view, 1, &string, &length) ==
+      TS_OPERATION_SUCCESS;
+  ts_string_t deserialized_string =
+      ts_tuple_field_string(&deserialized_tuple[1]);
+  ts_bool_t results[] = {
+      is_string_read && (length == strlen(deserialized_string)) &&
+          (memcmp(string, deserialized_string, length) == 0),
+      ts_is_matching_template_view(&view, tuple) == test_case->is_matching,
+      ts_is_matching_tuple_view(tuple, &view) == test_case->is_matching,
+      ts_is_matching_tuple(deserialized_tuple, tuple, TEST_TUPLE_SIZE) ==
+          test_case->is_matching,
+  };
+  static const char* const result_names[] = {
+      "string", "template view", "tuple view", "deserialized tuple"};
+  int status = 1;
+  for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); ++i) {
+    if (!results[i]) {
+      printf("\"%s\" against \"%s\": %s check failed\n",
+             test_case->wire_string, test_case->field_string,
+             result_names[i]);
+      status = 0;
+    }
+  }
+  free(field_string);
+  ts_deallocate_tuple(deserialized_tuple, TEST_TUPLE_SIZE, allocator);
+  return status;
+}
+
+int main(void) {
+  ts_allocator_t allocator = ts_initialize_unix_allocator();
+  int status = 1;
+  for (size_t i = 0; i < sizeof(TestCases) / sizeof(TestCases[0]); ++i) {
+    status &= test_view(&TestCases[i], &allocator);
+  }
+  printf("%s\n", status ? "OK" : "FAILED");
+  return status ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include "tuple_space_unix_alloc.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,11 +13,115 @@ static void ts_unix_deallocator(void* /*allocator_context*/, void* memory_ptr) {
   free(memory_ptr);
 }
 
+static void* ts_unix_reallocator(void* /*allocator_context*/, void* memory_ptr,
+                                 ts_size_t /*allocated_size*/,
+                                 ts_size_t new_size) {
+  return realloc(memory_ptr, new_size);
+}
+
 ts_allocator_t ts_initialize_unix_allocator(void) {
   ts_allocator_t allocator;
   memset(&allocator, 0, sizeof(ts_allocator_t));
   allocator.allocator_cb = ts_unix_allocator;
   allocator.deallocator_cb = ts_unix_deallocator;
+  allocator.reallocator_cb = ts_unix_reallocator;
+  allocator.context = NULL;
+  return allocator;
+}
+
+typedef struct {
+  void* next_block;
+} ts_unix_pool_free_block_t;
+
+#define TS_UNIX_POOL_LARGE_CLASS TS_UNIX_POOL_SIZE_CLASSES
+
+static _Thread_local ts_unix_pool_free_block_t*
+    TsUnixPoolFreeLists[TS_UNIX_POOL_SIZE_CLASSES];
+
+static ts_size_t ts_unix_pool_block_size(ts_size_t size_class) {
+  return (ts_size_t)TS_UNIX_POOL_MIN_BLOCK_SIZE << size_class;
+}
+
+static ts_size_t ts_unix_pool_size_class(ts_size_t allocated_size) {
+  ts_size_t size_class = 0;
+  while ((size_class < TS_UNIX_POOL_SIZE_CLASSES) &&
+         (ts_unix_pool_block_size(size_class) < allocated_size)) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+static ts_bool_t ts_unix_pool_refill(ts_size_t size_class) {
+  ts_size_t block_size = ts_unix_pool_block_size(size_class);
+  ts_size_t block_count = TS_UNIX_POOL_CHUNK_SIZE / block_size;
+  ts_byte_t* chunk = (ts_byte_t*)malloc(block_count * block_size);
+  if (chunk == NULL) {
+    return TS_FALSE;
+  }
+  for (ts_size_t i = block_count; i > 0; --i) {
+    ts_unix_pool_free_block_t* block =
+        (ts_unix_pool_free_block_t*)(chunk + (i - 1) * block_size);
+    block->next_block = TsUnixPoolFreeLists[size_class];
+    TsUnixPoolFreeLists[size_class] = block;
+  }
+  return TS_TRUE;
+}
+
+static void* ts_unix_pool_allocator(void* /*allocator_context*/,
+                                    ts_size_t allocated_size) {
+  ts_size_t size_class = ts_unix_pool_size_class(allocated_size);
+  if (size_class == TS_UNIX_POOL_LARGE_CLASS) {
+    return malloc(allocated_size);
+  }
+  if ((TsUnixPoolFreeLists[size_class] == NULL) &&
+      !ts_unix_pool_refill(size_class)) {
+    return NULL;
+  }
+  ts_unix_pool_free_block_t* block = TsUnixPoolFreeLists[size_class];
+  TsUnixPoolFreeLists[size_class] =
+      (ts_unix_pool_free_block_t*)block->next_block;
+  return block;
+}
+
+static void ts_unix_pool_deallocator(void* /*allocator_context*/,
+                                     void* memory_ptr,
+                                     ts_size_t allocated_size) {
+  if (memory_ptr == NULL) {
+    return;
+  }
+  ts_size_t size_class = ts_unix_pool_size_class(allocated_size);
+  if (size_class == TS_UNIX_POOL_LARGE_CLASS) {
+    free(memory_ptr);
+    return;
+  }
+  ts_unix_pool_free_block_t* block = (ts_unix_pool_free_block_t*)memory_ptr;
+  block->next_block = TsUnixPoolFreeLists[size_class];
+  TsUnixPoolFreeLists[size_class] = block;
+}
+
+static void* ts_unix_pool_reallocator(void* allocator_context,
+                                      void* memory_ptr,
+                                      ts_size_t allocated_size,
+                                      ts_size_t new_size) {
+  if ((memory_ptr != NULL) && (ts_unix_pool_size_class(allocated_size) ==
+                               ts_unix_pool_size_class(new_size))) {
+    return memory_ptr;
+  }
+  void* new_memory = ts_unix_pool_allocator(allocator_context, new_size);
+  if ((new_memory != NULL) && (memory_ptr != NULL)) {
+    memcpy(new_memory, memory_ptr,
+           allocated_size < new_size ? allocated_size : new_size);
+    ts_unix_pool_deallocator(allocator_context, memory_ptr, allocated_size);
+  }
+  return new_memory;
+}
+
+ts_allocator_t ts_initialize_unix_pool_allocator(void) {
+  ts_allocator_t allocator;
+  memset(&allocator, 0, sizeof(ts_allocator_t));
+  allocator.allocator_cb = ts_unix_pool_allocator;
+  allocator.sized_deallocator_cb = ts_unix_pool_deallocator;
+  allocator.reallocator_cb = ts_unix_pool_reallocator;
   allocator.context = NULL;
   return allocator;
 }
@@ -3,6 +3,17 @@
 
 #include "../common/tuple_space_serialization.h"
 
+#define TS_UNIX_POOL_MIN_BLOCK_SIZE 16
+#define TS_UNIX_POOL_SIZE_CLASSES 8
+#define TS_UNIX_POOL_CHUNK_SIZE 16384
+
 ts_allocator_t ts_initialize_unix_allocator(void);
 
+// Size-class allocator: requests up to the largest class (2 KiB) are served
+// from per-thread free lists refilled a chunk at a time, larger ones go to
+// malloc. Blocks freed on another thread join that thread's free lists.
+// Blocks carry no header, so memory must be released with its size through
+// sized_deallocator_cb.
+ts_allocator_t ts_initialize_unix_pool_allocator(void);
+
 #endif  // __TUPLE_SPACE_UNIX_ALLOC_H__
@@ -2,72 +2,79 @@
 
 #include <stdio.h>
 
-static void ts_print_tuple_field_type(const ts_tuple_field_t* field) {
-  printf("Type: ");
+static void ts_print_tuple_field_type(FILE* stream,
+                                      const ts_tuple_field_t* field) {
+  fprintf(stream, "Type: ");
   switch (ts_tuple_field_get_type(field)) {
     case TS_FIELD_TYPE_BOOL:
-      printf("Bool");
+      fprintf(stream, "Bool");
       return;
     case TS_FIELD_TYPE_FLOAT:
-      printf("Float");
+      fprintf(stream, "Float");
       return;
     case TS_FIELD_TYPE_INT:
-      printf("Int");
+      fprintf(stream, "Int");
       return;
     case TS_FIELD_TYPE_UINT:
-      printf("UInt");
+      fprintf(stream, "UInt");
       return;
     case TS_FIELD_TYPE_STRING:
-      printf("String");
+      fprintf(stream, "String");
       return;
     default:
-      printf("Invalid");
+      fprintf(stream, "Invalid");
       break;
   }
 }
 
-static void ts_print_tuple_field_payload(const ts_tuple_field_t* field) {
-  printf("Payload: ");
+static void ts_print_tuple_field_payload(FILE* stream,
+                                         const ts_tuple_field_t* field) {
+  fprintf(stream, "Payload: ");
   switch (ts_tuple_field_get_type(field)) {
     case TS_FIELD_TYPE_BOOL:
-      printf(field->data.bool_field ? "True" : "False");
+      fprintf(stream, field->data.bool_field ? "True" : "False");
       return;
     case TS_FIELD_TYPE_FLOAT:
-      printf("%f", field->data.float_field);
+      fprintf(stream, "%f", field->data.float_field);
       return;
     case TS_FIELD_TYPE_INT:
-      printf("%d", field->data.int_field);
+      fprintf(stream, "%d", field->data.int_field);
       return;
     case TS_FIELD_TYPE_UINT:
-      printf("%u", field->data.uint_field);
+      fprintf(stream, "%u", field->data.uint_field);
       return;
     case TS_FIELD_TYPE_STRING:
-      printf("\"%s\"", field->data.string_field);
+      fprintf(stream, "\"%s\"", ts_tuple_field_string(field));
       return;
     default:
-      printf("?");
+      fprintf(stream, "?");
       break;
   }
 }
 
-static void ts_print_tuple_field(const ts_tuple_field_t* field) {
-  printf("(");
-  ts_print_tuple_field_type(field);
-  printf(", ");
+static void ts_print_tuple_field(FILE* stream, const ts_tuple_field_t* field) {
+  fprintf(stream, "(");
+  ts_print_tuple_field_type(stream, field);
+  fprintf(stream, ", ");
   if (ts_tuple_field_contains_data(field)) {
-    ts_print_tuple_field_payload(field);
+    ts_print_tuple_field_payload(stream, field);
   } else {
-    printf("Field does not contain data");
+    fprintf(stream, "Field does not contain data");
   }
-  printf(")");
+  fprintf(stream, ")");
 }
 
-void ts_print_tuple(const ts_tuple_field_t* tuple, ts_size_t tuple_size) {
-  printf("{\n");
+void ts_fprint_tuple(FILE* stream, const ts_tuple_field_t* tuple,
+                     ts_size_t tuple_size) {
+  fprintf(stream, "{\n");
   for (ts_size_t i = 0; i < tuple_size; ++i) {
-    printf("\t");
-    ts_print_tuple_field(&tuple[i]);
-    printf(",\n");
+    fprintf(stream, "\t");
+    ts_print_tuple_field(stream, &tuple[i]);
+    fprintf(stream, ",\n");
   }
-  printf("}\n");
+  fprintf(stream, "}\n");
+}
+
+void ts_print_tuple(const ts_tuple_field_t* tuple, ts_size_t tuple_size) {
+  ts_fprint_tuple(stdout, tuple, tuple_size);
 }
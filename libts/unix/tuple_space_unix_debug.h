@@ -1,8 +1,13 @@
 #ifndef __tuple_space_unix_debug_H__
 #define __tuple_space_unix_debug_H__
 
+#include <stdio.h>
+
 #include "../common/tuple_space.h"
 
+void ts_fprint_tuple(FILE* stream, const ts_tuple_field_t* tuple,
+                     ts_size_t tuple_size);
+
 void ts_print_tuple(const ts_tuple_field_t* tuple, ts_size_t tuple_size);
 
 #endif  // __tuple_space_unix_debug_H__
@@ -1,17 +1,23 @@
+#define _GNU_SOURCE
+
 #include "tuple_space_unix_device.h"
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#define TS_UNIX_DEVICE_BATCH_SIZE 64
+
 typedef int32_t ts_socket_t;
 
 typedef struct {
@@ -19,21 +25,24 @@ typedef struct {
   ts_data_send_cb_t send_cb;
   ts_clock_ms_cb_t clock_cb;
   ts_device_context_destructor_cb_t destructor_cb;
+  ts_data_wait_cb_t wait_cb;
+  ts_data_recv_batch_cb_t recv_batch_cb;
+  ts_data_send_batch_cb_t send_batch_cb;
   ts_socket_t socket;
-  ts_byte_t reserved[TS_DEVICE_CONTEXT_SIZE - sizeof(ts_socket_t)];
+  int32_t epoll_descriptor;
+  ts_bool_t gso_enabled;
+  ts_bool_t timestamps_enabled;
+  ts_byte_t reserved[TS_DEVICE_CONTEXT_SIZE - sizeof(ts_socket_t) -
+                     sizeof(int32_t) - 2 * sizeof(ts_bool_t)];
   ts_byte_t current_state;  // ts_device_state_t
   ts_byte_t can_receive_ip;
 } ts_unix_device_context_t;
 
-static ts_bool_t ts_unix_device_receive_has_data(
-    ts_unix_device_context_t* handle) {
-  fd_set set;
-  struct timeval wait_time = {0};
-  FD_ZERO(&set);
-  FD_SET(handle->socket, &set);
-
-  int status = select(handle->socket + 1, &set, NULL, NULL, &wait_time);
-  return status > 0;
+static ts_bool_t ts_unix_device_wait(void* device_context,
+                                     ts_int_t timeout_ms) {
+  ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
+  struct epoll_event event;
+  return epoll_wait(handle->epoll_descriptor, &event, 1, timeout_ms) > 0;
 }
 
 static ts_size_t ts_unix_device_receive(void* device_context,
@@ -42,9 +51,6 @@ static ts_size_t ts_unix_device_receive(void* device_context,
                                         ts_byte_t* buffer,
                                         ts_size_t buffer_size) {
   ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
-  if (!ts_unix_device_receive_has_data(handle)) {
-    return 0;
-  }
   struct sockaddr_in address;
   memset(&address, 0, sizeof(struct sockaddr_in));
   socklen_t length = sizeof(struct sockaddr_in);
@@ -73,6 +79,148 @@ static ts_bool_t ts_unix_device_send(void* device_context,
                 sizeof(struct sockaddr_in)) == buffer_size;
 }
 
+static uint64_t ts_unix_device_receive_time_ns(const struct msghdr* header) {
+  for (struct cmsghdr* control = CMSG_FIRSTHDR(header); control != NULL;
+       control = CMSG_NXTHDR((struct msghdr*)header, control)) {
+    if (control->cmsg_level == SOL_SOCKET &&
+        control->cmsg_type == SCM_TIMESTAMPNS) {
+      struct timespec time;
+      memcpy(&time, CMSG_DATA(control), sizeof(struct timespec));
+      return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+    }
+  }
+  return 0;
+}
+
+static ts_size_t ts_unix_device_receive_batch(void* device_context,
+                                              ts_datagram_t* datagrams,
+                                              ts_size_t datagrams_count) {
+  ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
+  struct mmsghdr messages[TS_UNIX_DEVICE_BATCH_SIZE];
+  struct iovec vectors[TS_UNIX_DEVICE_BATCH_SIZE];
+  struct sockaddr_in addresses[TS_UNIX_DEVICE_BATCH_SIZE];
+  union {
+    char buffer[CMSG_SPACE(sizeof(struct timespec))];
+    struct cmsghdr align;
+  } controls[TS_UNIX_DEVICE_BATCH_SIZE];
+  if (datagrams_count > TS_UNIX_DEVICE_BATCH_SIZE) {
+    datagrams_count = TS_UNIX_DEVICE_BATCH_SIZE;
+  }
+  memset(messages, 0, sizeof(struct mmsghdr) * datagrams_count);
+  for (ts_size_t i = 0; i < datagrams_count; ++i) {
+    vectors[i].iov_base = datagrams[i].buffer;
+    vectors[i].iov_len = TS_BUFFER_SIZE;
+    messages[i].msg_hdr.msg_name = &addresses[i];
+    messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    messages[i].msg_hdr.msg_iov = &vectors[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+    if (handle->timestamps_enabled) {
+      messages[i].msg_hdr.msg_control = controls[i].buffer;
+      messages[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+    }
+  }
+  int result = recvmmsg(handle->socket, messages, datagrams_count,
+                        MSG_DONTWAIT, NULL);
+  if (result <= 0) {
+    return 0;
+  }
+  for (int i = 0; i < result; ++i) {
+    datagrams[i].ip_address = addresses[i].sin_addr.s_addr;
+    datagrams[i].port_id = ntohs(addresses[i].sin_port);
+    datagrams[i].buffer_size = messages[i].msg_len;
+    datagrams[i].receive_time_ns =
+        ts_unix_device_receive_time_ns(&messages[i].msg_hdr);
+  }
+  return (ts_size_t)result;
+}
+
+// Counts the leading datagrams that can leave as segments of one GSO send:
+// same target, all but the last of the same size and the last not larger.
+static ts_size_t ts_unix_device_gso_segments(
+    const ts_unix_device_context_t* handle, const ts_datagram_t* datagrams,
+    ts_size_t datagrams_count) {
+  ts_size_t segments = 1;
+  if (!handle->gso_enabled) {
+    return segments;
+  }
+  while (segments < datagrams_count &&
+         datagrams[segments].ip_address == datagrams[0].ip_address &&
+         datagrams[segments].port_id == datagrams[0].port_id &&
+         datagrams[segments - 1].buffer_size == datagrams[0].buffer_size &&
+         datagrams[segments].buffer_size <= datagrams[0].buffer_size) {
+    ++segments;
+  }
+  return segments;
+}
+
+static ts_size_t ts_unix_device_send_batch(void* device_context,
+                                           const ts_datagram_t* datagrams,
+                                           ts_size_t datagrams_count) {
+  ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
+  struct mmsghdr messages[TS_UNIX_DEVICE_BATCH_SIZE];
+  struct iovec vectors[TS_UNIX_DEVICE_BATCH_SIZE];
+  struct sockaddr_in addresses[TS_UNIX_DEVICE_BATCH_SIZE];
+  ts_size_t message_segments[TS_UNIX_DEVICE_BATCH_SIZE];
+#ifdef UDP_SEGMENT
+  union {
+    char buffer[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+  } controls[TS_UNIX_DEVICE_BATCH_SIZE];
+#endif
+  ts_size_t sent = 0;
+  while (sent < datagrams_count) {
+    ts_size_t messages_count = 0;
+    ts_size_t vectors_count = 0;
+    ts_size_t next = sent;
+    memset(messages, 0, sizeof(messages));
+    while (next < datagrams_count &&
+           vectors_count < TS_UNIX_DEVICE_BATCH_SIZE) {
+      ts_size_t available = datagrams_count - next;
+      if (available > TS_UNIX_DEVICE_BATCH_SIZE - vectors_count) {
+        available = TS_UNIX_DEVICE_BATCH_SIZE - vectors_count;
+      }
+      ts_size_t segments =
+          ts_unix_device_gso_segments(handle, datagrams + next, available);
+      struct msghdr* header = &messages[messages_count].msg_hdr;
+      memset(&addresses[messages_count], 0, sizeof(struct sockaddr_in));
+      addresses[messages_count].sin_family = AF_INET;
+      addresses[messages_count].sin_addr.s_addr = datagrams[next].ip_address;
+      addresses[messages_count].sin_port = htons(datagrams[next].port_id);
+      header->msg_name = &addresses[messages_count];
+      header->msg_namelen = sizeof(struct sockaddr_in);
+      header->msg_iov = &vectors[vectors_count];
+      header->msg_iovlen = segments;
+      for (ts_size_t i = 0; i < segments; ++i) {
+        vectors[vectors_count].iov_base = (void*)datagrams[next + i].buffer;
+        vectors[vectors_count].iov_len = datagrams[next + i].buffer_size;
+        ++vectors_count;
+      }
+#ifdef UDP_SEGMENT
+      if (segments > 1) {
+        header->msg_control = controls[messages_count].buffer;
+        header->msg_controllen = sizeof(controls[messages_count].buffer);
+        struct cmsghdr* control = CMSG_FIRSTHDR(header);
+        control->cmsg_level = IPPROTO_UDP;
+        control->cmsg_type = UDP_SEGMENT;
+        control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segment_size = (uint16_t)datagrams[next].buffer_size;
+        memcpy(CMSG_DATA(control), &segment_size, sizeof(uint16_t));
+      }
+#endif
+      message_segments[messages_count++] = segments;
+      next += segments;
+    }
+    int result = sendmmsg(handle->socket, messages, messages_count, 0);
+    if (result <= 0) {
+      return sent;
+    }
+    for (int i = 0; i < result; ++i) {
+      sent += message_segments[i];
+    }
+  }
+  return sent;
+}
+
 static ts_uint_t ts_unix_device_clock_ms(void) {
   struct timeval timev;
   gettimeofday(&timev, NULL);
@@ -82,16 +230,25 @@ static ts_uint_t ts_unix_device_clock_ms(void) {
 
 static void ts_unix_device_destructor(void* device_context) {
   ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
+  if (handle->epoll_descriptor >= 0) {
+    close(handle->epoll_descriptor);
+  }
   if (handle->socket >= 0) {
     close(handle->socket);
   }
 }
 
 static ts_bool_t ts_initialize_socket(ts_unix_device_context_t* device,
-                                      ts_port_t server_port) {
+                                      ts_port_t server_port,
+                                      ts_bool_t reuse_port) {
   if ((device->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
     return TS_OPERATION_FAILURE;
   }
+  int option = 1;
+  if (reuse_port && setsockopt(device->socket, SOL_SOCKET, SO_REUSEPORT,
+                               &option, sizeof(int)) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
   struct sockaddr_in address;
   memset(&address, 0, sizeof(struct sockaddr_in));
   address.sin_family = AF_INET;
@@ -104,16 +261,35 @@ static ts_bool_t ts_initialize_socket(ts_unix_device_context_t* device,
   if (fcntl(device->socket, F_SETFL, O_NONBLOCK) < 0) {
     return TS_OPERATION_FAILURE;
   }
+#ifdef UDP_SEGMENT
+  int segment_size = 0;
+  socklen_t segment_size_length = sizeof(int);
+  device->gso_enabled =
+      getsockopt(device->socket, IPPROTO_UDP, UDP_SEGMENT, &segment_size,
+                 &segment_size_length) == 0;
+#endif
+  if ((device->epoll_descriptor = epoll_create1(0)) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = EPOLLIN;
+  event.data.fd = device->socket;
+  if (epoll_ctl(device->epoll_descriptor, EPOLL_CTL_ADD, device->socket,
+                &event) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
   return TS_OPERATION_SUCCESS;
 }
 
-ts_device_context_t ts_initialize_unix_device_context(
-    ts_port_t server_port_id) {
+static ts_device_context_t ts_initialize_device_context(
+    ts_port_t server_port_id, ts_bool_t reuse_port) {
   ts_device_context_t context;
   memset(&context, 0, sizeof(ts_device_context_t));
   ts_unix_device_context_t* handle = (ts_unix_device_context_t*)&context;
 
-  if (ts_initialize_socket(handle, server_port_id) == TS_OPERATION_FAILURE) {
+  if (ts_initialize_socket(handle, server_port_id, reuse_port) ==
+      TS_OPERATION_FAILURE) {
     context.current_state = TS_DEVICE_UNINITIALIZED;
     return context;
   }
@@ -121,11 +297,45 @@ ts_device_context_t ts_initialize_unix_device_context(
   context.send_cb = ts_unix_device_send;
   context.clock_cb = ts_unix_device_clock_ms;
   context.destructor_cb = ts_unix_device_destructor;
+  context.wait_cb = ts_unix_device_wait;
+  context.recv_batch_cb = ts_unix_device_receive_batch;
+  context.send_batch_cb = ts_unix_device_send_batch;
   context.can_receive_ip = TS_TRUE;
   context.current_state = TS_DEVICE_INITIALIZED;
   return context;
 }
 
+ts_device_context_t ts_initialize_unix_device_context(
+    ts_port_t server_port_id) {
+  return ts_initialize_device_context(server_port_id, TS_FALSE);
+}
+
+ts_device_context_t ts_initialize_unix_shared_device_context(
+    ts_port_t server_port_id) {
+  return ts_initialize_device_context(server_port_id, TS_TRUE);
+}
+
+ts_bool_t ts_unix_device_watch_descriptor(ts_device_context_t* device_context,
+                                          int32_t descriptor) {
+  ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = EPOLLIN;
+  event.data.fd = descriptor;
+  return epoll_ctl(handle->epoll_descriptor, EPOLL_CTL_ADD, descriptor,
+                   &event) == 0;
+}
+
+ts_bool_t ts_unix_device_enable_receive_timestamps(
+    ts_device_context_t* device_context) {
+  ts_unix_device_context_t* handle = (ts_unix_device_context_t*)device_context;
+  int option = 1;
+  handle->timestamps_enabled =
+      setsockopt(handle->socket, SOL_SOCKET, SO_TIMESTAMPNS, &option,
+                 sizeof(int)) == 0;
+  return handle->timestamps_enabled;
+}
+
 ts_ipv4_t ts_unix_ipv4_from_str(ts_string_t ip_address) {
   return inet_addr(ip_address);
 }
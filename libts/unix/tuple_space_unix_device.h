@@ -5,6 +5,20 @@
 
 ts_device_context_t ts_initialize_unix_device_context(ts_port_t server_port_id);
 
+// Binds with SO_REUSEPORT, so several devices can share the port; the kernel
+// then spreads the clients between them by address.
+ts_device_context_t ts_initialize_unix_shared_device_context(
+    ts_port_t server_port_id);
+
+// The device wait callback also returns once the descriptor is readable.
+ts_bool_t ts_unix_device_watch_descriptor(ts_device_context_t* device_context,
+                                          int32_t descriptor);
+
+// Batch receives then fill receive_time_ns with the kernel receive time,
+// taken from CLOCK_REALTIME.
+ts_bool_t ts_unix_device_enable_receive_timestamps(
+    ts_device_context_t* device_context);
+
 ts_ipv4_t ts_unix_ipv4_from_str(ts_string_t ip_address);
 
 ts_string_t ts_unix_ipv4_to_str(ts_ipv4_t ip_address);
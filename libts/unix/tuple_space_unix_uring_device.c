@@ -0,0 +1,501 @@
+#define _GNU_SOURCE
+
+#include "tuple_space_unix_uring_device.h"
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define TS_URING_ENTRIES 256
+#define TS_URING_RECV_BUFFERS 256  // power of two
+#define TS_URING_SEND_SLOTS 256
+#define TS_URING_BUFFER_GROUP 0
+#define TS_URING_RECEIVE_TAG UINT64_MAX
+#define TS_URING_RECV_BUFFER_SIZE                                       \
+  (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + \
+   TS_BUFFER_SIZE)
+
+typedef struct {
+  struct msghdr header;
+  struct iovec vector;
+  struct sockaddr_in address;
+  ts_byte_t buffer[TS_BUFFER_SIZE];
+} ts_uring_send_slot_t;
+
+typedef struct {
+  uint16_t buffer_id;
+  uint32_t buffer_size;
+} ts_uring_received_t;
+
+typedef struct {
+  int ring_descriptor;
+  int socket;
+  void* rings;
+  size_t rings_size;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_array;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned sq_local_tail;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe* cqes;
+  struct io_uring_buf_ring* buffer_ring;
+  uint16_t buffer_ring_tail;
+  ts_byte_t* recv_buffers;
+  struct msghdr recv_header;
+  ts_bool_t is_receiving;
+  ts_uring_received_t received[TS_URING_RECV_BUFFERS];
+  unsigned received_head;
+  unsigned received_count;
+  ts_uring_send_slot_t send_slots[TS_URING_SEND_SLOTS];
+  uint16_t free_slots[TS_URING_SEND_SLOTS];
+  unsigned free_slots_count;
+} ts_uring_t;
+
+typedef struct {
+  ts_data_recv_cb_t recv_cb;
+  ts_data_send_cb_t send_cb;
+  ts_clock_ms_cb_t clock_cb;
+  ts_device_context_destructor_cb_t destructor_cb;
+  ts_data_wait_cb_t wait_cb;
+  ts_data_recv_batch_cb_t recv_batch_cb;
+  ts_data_send_batch_cb_t send_batch_cb;
+  ts_uring_t* uring;
+  ts_byte_t reserved[TS_DEVICE_CONTEXT_SIZE - sizeof(ts_uring_t*)];
+  ts_byte_t current_state;  // ts_device_state_t
+  ts_byte_t can_receive_ip;
+} ts_unix_uring_device_context_t;
+
+static int ts_uring_enter(ts_uring_t* uring, unsigned to_submit,
+                          unsigned min_complete, unsigned flags, void* arg,
+                          size_t arg_size) {
+  return (int)syscall(__NR_io_uring_enter, uring->ring_descriptor, to_submit,
+                      min_complete, flags, arg, arg_size);
+}
+
+// Hands every queued submission to the kernel and, when wait_count is set,
+// waits for that many completions or until timeout passes.
+static int ts_uring_submit(ts_uring_t* uring, unsigned wait_count,
+                           struct __kernel_timespec* timeout) {
+  __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+  unsigned to_submit =
+      uring->sq_local_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  if (to_submit == 0 && wait_count == 0) {
+    return 0;
+  }
+  unsigned flags = wait_count ? IORING_ENTER_GETEVENTS : 0;
+  if (timeout == NULL) {
+    return ts_uring_enter(uring, to_submit, wait_count, flags, NULL, 0);
+  }
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(struct io_uring_getevents_arg));
+  arg.ts = (uint64_t)(uintptr_t)timeout;
+  return ts_uring_enter(uring, to_submit, wait_count,
+                        flags | IORING_ENTER_EXT_ARG, &arg,
+                        sizeof(struct io_uring_getevents_arg));
+}
+
+static struct io_uring_sqe* ts_uring_get_sqe(ts_uring_t* uring) {
+  if (uring->sq_local_tail -
+          __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) ==
+      uring->sq_entries) {
+    ts_uring_submit(uring, 0, NULL);
+    if (uring->sq_local_tail -
+            __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) ==
+        uring->sq_entries) {
+      return NULL;
+    }
+  }
+  unsigned index = uring->sq_local_tail++ & uring->sq_mask;
+  struct io_uring_sqe* sqe = &uring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  uring->sq_array[index] = index;
+  return sqe;
+}
+
+static void ts_uring_recycle_buffer(ts_uring_t* uring, uint16_t buffer_id) {
+  struct io_uring_buf* buffer =
+      &uring->buffer_ring
+           ->bufs[uring->buffer_ring_tail & (TS_URING_RECV_BUFFERS - 1)];
+  buffer->addr = (uint64_t)(uintptr_t)(uring->recv_buffers +
+                                       buffer_id * TS_URING_RECV_BUFFER_SIZE);
+  buffer->len = TS_URING_RECV_BUFFER_SIZE;
+  buffer->bid = buffer_id;
+  __atomic_store_n(&uring->buffer_ring->tail, ++uring->buffer_ring_tail,
+                   __ATOMIC_RELEASE);
+}
+
+// The multishot receive stops when the buffer ring runs dry, it is posted
+// again once buffers have been given back.
+static void ts_uring_arm_receive(ts_uring_t* uring) {
+  if (uring->is_receiving) {
+    return;
+  }
+  struct io_uring_sqe* sqe = ts_uring_get_sqe(uring);
+  if (sqe == NULL) {
+    return;
+  }
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = uring->socket;
+  sqe->addr = (uint64_t)(uintptr_t)&uring->recv_header;
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = TS_URING_BUFFER_GROUP;
+  sqe->user_data = TS_URING_RECEIVE_TAG;
+  uring->is_receiving = TS_TRUE;
+}
+
+static void ts_uring_reap(ts_uring_t* uring) {
+  unsigned head = *uring->cq_head;
+  unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    struct io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+    if (cqe->user_data != TS_URING_RECEIVE_TAG) {
+      uring->free_slots[uring->free_slots_count++] = (uint16_t)cqe->user_data;
+      continue;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      uring->is_receiving = TS_FALSE;
+    }
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+      continue;
+    }
+    uint16_t buffer_id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    if (cqe->res <= 0) {
+      ts_uring_recycle_buffer(uring, buffer_id);
+      continue;
+    }
+    ts_uring_received_t* received =
+        &uring->received[(uring->received_head + uring->received_count++) &
+                         (TS_URING_RECV_BUFFERS - 1)];
+    received->buffer_id = buffer_id;
+    received->buffer_size = (uint32_t)cqe->res;
+  }
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void ts_uring_pop_received(ts_uring_t* uring, ts_datagram_t* datagram) {
+  ts_uring_received_t* received = &uring->received[uring->received_head];
+  uring->received_head =
+      (uring->received_head + 1) & (TS_URING_RECV_BUFFERS - 1);
+  --uring->received_count;
+  ts_byte_t* buffer =
+      uring->recv_buffers + received->buffer_id * TS_URING_RECV_BUFFER_SIZE;
+  struct io_uring_recvmsg_out* header = (struct io_uring_recvmsg_out*)buffer;
+  const struct sockaddr_in* address = (const struct sockaddr_in*)(header + 1);
+  size_t payload_offset =
+      sizeof(struct io_uring_recvmsg_out) + uring->recv_header.msg_namelen;
+  size_t payload_size = header->payloadlen;
+  if (payload_size > received->buffer_size - payload_offset) {
+    payload_size = received->buffer_size - payload_offset;
+  }
+  datagram->ip_address = address->sin_addr.s_addr;
+  datagram->port_id = ntohs(address->sin_port);
+  datagram->buffer_size = (ts_size_t)payload_size;
+  datagram->receive_time_ns = 0;
+  memcpy(datagram->buffer, buffer + payload_offset, payload_size);
+  ts_uring_recycle_buffer(uring, received->buffer_id);
+}
+
+static ts_size_t ts_unix_uring_device_receive_batch(void* device_context,
+                                                    ts_datagram_t* datagrams,
+                                                    ts_size_t datagrams_count) {
+  ts_uring_t* uring = ((ts_unix_uring_device_context_t*)device_context)->uring;
+  ts_uring_reap(uring);
+  ts_size_t received = 0;
+  while (received < datagrams_count && uring->received_count) {
+    ts_uring_pop_received(uring, &datagrams[received++]);
+  }
+  if (!uring->is_receiving) {
+    ts_uring_arm_receive(uring);
+    ts_uring_submit(uring, 0, NULL);
+  }
+  return received;
+}
+
+static ts_size_t ts_unix_uring_device_receive(void* device_context,
+                                              ts_ipv4_t* sender_ip_address,
+                                              ts_port_t* sender_port_id,
+                                              ts_byte_t* buffer,
+                                              ts_size_t buffer_size) {
+  ts_datagram_t datagram;
+  if (!ts_unix_uring_device_receive_batch(device_context, &datagram, 1)) {
+    return 0;
+  }
+  if (datagram.buffer_size > buffer_size) {
+    datagram.buffer_size = buffer_size;
+  }
+  *sender_ip_address = datagram.ip_address;
+  *sender_port_id = datagram.port_id;
+  memcpy(buffer, datagram.buffer, datagram.buffer_size);
+  return datagram.buffer_size;
+}
+
+static ts_bool_t ts_uring_queue_send(ts_uring_t* uring,
+                                     ts_ipv4_t target_ip_address,
+                                     ts_port_t target_port_id,
+                                     const ts_byte_t* buffer,
+                                     ts_size_t buffer_size) {
+  // Checked before an sqe is taken, a taken one is always submitted.
+  if (buffer_size > TS_BUFFER_SIZE) {
+    return TS_FALSE;
+  }
+  while (uring->free_slots_count == 0) {
+    if (ts_uring_submit(uring, 1, NULL) < 0) {
+      return TS_FALSE;
+    }
+    ts_uring_reap(uring);
+  }
+  struct io_uring_sqe* sqe = ts_uring_get_sqe(uring);
+  if (sqe == NULL) {
+    return TS_FALSE;
+  }
+  uint16_t slot_id = uring->free_slots[--uring->free_slots_count];
+  ts_uring_send_slot_t* slot = &uring->send_slots[slot_id];
+  memset(slot, 0, offsetof(ts_uring_send_slot_t, buffer));
+  slot->address.sin_family = AF_INET;
+  slot->address.sin_addr.s_addr = target_ip_address;
+  slot->address.sin_port = htons(target_port_id);
+  memcpy(slot->buffer, buffer, buffer_size);
+  slot->vector.iov_base = slot->buffer;
+  slot->vector.iov_len = buffer_size;
+  slot->header.msg_name = &slot->address;
+  slot->header.msg_namelen = sizeof(struct sockaddr_in);
+  slot->header.msg_iov = &slot->vector;
+  slot->header.msg_iovlen = 1;
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = uring->socket;
+  sqe->addr = (uint64_t)(uintptr_t)&slot->header;
+  sqe->len = 1;
+  sqe->user_data = slot_id;
+  return TS_TRUE;
+}
+
+static ts_bool_t ts_unix_uring_device_send(void* device_context,
+                                           ts_ipv4_t target_ip_address,
+                                           ts_port_t target_port_id,
+                                           const ts_byte_t* buffer,
+                                           ts_size_t buffer_size) {
+  ts_uring_t* uring = ((ts_unix_uring_device_context_t*)device_context)->uring;
+  if (!ts_uring_queue_send(uring, target_ip_address, target_port_id, buffer,
+                           buffer_size)) {
+    return TS_FALSE;
+  }
+  return ts_uring_submit(uring, 0, NULL) >= 0;
+}
+
+static ts_size_t ts_unix_uring_device_send_batch(
+    void* device_context, const ts_datagram_t* datagrams,
+    ts_size_t datagrams_count) {
+  ts_uring_t* uring = ((ts_unix_uring_device_context_t*)device_context)->uring;
+  ts_size_t queued = 0;
+  while (queued < datagrams_count &&
+         ts_uring_queue_send(uring, datagrams[queued].ip_address,
+                             datagrams[queued].port_id,
+                             datagrams[queued].buffer,
+                             datagrams[queued].buffer_size)) {
+    ++queued;
+  }
+  ts_uring_submit(uring, 0, NULL);
+  return queued;
+}
+
+static ts_bool_t ts_unix_uring_device_wait(void* device_context,
+                                           ts_int_t timeout_ms) {
+  ts_uring_t* uring = ((ts_unix_uring_device_context_t*)device_context)->uring;
+  ts_uring_reap(uring);
+  ts_uring_arm_receive(uring);
+  if (uring->received_count) {
+    ts_uring_submit(uring, 0, NULL);
+    return TS_TRUE;
+  }
+  struct __kernel_timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+  ts_uring_submit(uring, 1, timeout_ms < 0 ? NULL : &timeout);
+  ts_uring_reap(uring);
+  return uring->received_count > 0;
+}
+
+static ts_uint_t ts_unix_uring_device_clock_ms(void) {
+  struct timeval timev;
+  gettimeofday(&timev, NULL);
+
+  return timev.tv_sec * 1000 + timev.tv_usec / 1000;
+}
+
+static void ts_uring_destroy(ts_uring_t* uring) {
+  if (uring->ring_descriptor >= 0) {
+    close(uring->ring_descriptor);
+  }
+  if (uring->socket >= 0) {
+    close(uring->socket);
+  }
+  if (uring->rings != NULL) {
+    munmap(uring->rings, uring->rings_size);
+  }
+  if (uring->sqes != NULL) {
+    munmap(uring->sqes, uring->sqes_size);
+  }
+  if (uring->buffer_ring != NULL) {
+    munmap(uring->buffer_ring,
+           TS_URING_RECV_BUFFERS * sizeof(struct io_uring_buf));
+  }
+  free(uring->recv_buffers);
+  free(uring);
+}
+
+static void ts_unix_uring_device_destructor(void* device_context) {
+  ts_uring_destroy(((ts_unix_uring_device_context_t*)device_context)->uring);
+}
+
+static ts_bool_t ts_uring_map_rings(ts_uring_t* uring,
+                                    const struct io_uring_params* params) {
+  if (!(params->features & IORING_FEAT_SINGLE_MMAP) ||
+      !(params->features & IORING_FEAT_EXT_ARG)) {
+    return TS_OPERATION_FAILURE;
+  }
+  size_t sq_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+  size_t cq_size = params->cq_off.cqes +
+                   params->cq_entries * sizeof(struct io_uring_cqe);
+  uring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+  void* rings = mmap(NULL, uring->rings_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, uring->ring_descriptor,
+                     IORING_OFF_SQ_RING);
+  if (rings == MAP_FAILED) {
+    return TS_OPERATION_FAILURE;
+  }
+  uring->rings = rings;
+  uring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, uring->ring_descriptor,
+                    IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return TS_OPERATION_FAILURE;
+  }
+  uring->sqes = (struct io_uring_sqe*)sqes;
+  ts_byte_t* base = (ts_byte_t*)rings;
+  uring->sq_head = (unsigned*)(base + params->sq_off.head);
+  uring->sq_tail = (unsigned*)(base + params->sq_off.tail);
+  uring->sq_array = (unsigned*)(base + params->sq_off.array);
+  uring->sq_mask = *(unsigned*)(base + params->sq_off.ring_mask);
+  uring->sq_entries = params->sq_entries;
+  uring->sq_local_tail = *uring->sq_tail;
+  uring->cq_head = (unsigned*)(base + params->cq_off.head);
+  uring->cq_tail = (unsigned*)(base + params->cq_off.tail);
+  uring->cq_mask = *(unsigned*)(base + params->cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe*)(base + params->cq_off.cqes);
+  return TS_OPERATION_SUCCESS;
+}
+
+static ts_bool_t ts_uring_register_buffers(ts_uring_t* uring) {
+  void* buffer_ring =
+      mmap(NULL, TS_URING_RECV_BUFFERS * sizeof(struct io_uring_buf),
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer_ring == MAP_FAILED) {
+    return TS_OPERATION_FAILURE;
+  }
+  uring->buffer_ring = (struct io_uring_buf_ring*)buffer_ring;
+  uring->recv_buffers =
+      (ts_byte_t*)malloc(TS_URING_RECV_BUFFERS * TS_URING_RECV_BUFFER_SIZE);
+  if (uring->recv_buffers == NULL) {
+    return TS_OPERATION_FAILURE;
+  }
+  struct io_uring_buf_reg registration;
+  memset(&registration, 0, sizeof(struct io_uring_buf_reg));
+  registration.ring_addr = (uint64_t)(uintptr_t)buffer_ring;
+  registration.ring_entries = TS_URING_RECV_BUFFERS;
+  registration.bgid = TS_URING_BUFFER_GROUP;
+  if (syscall(__NR_io_uring_register, uring->ring_descriptor,
+              IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
+  for (uint16_t i = 0; i < TS_URING_RECV_BUFFERS; ++i) {
+    ts_uring_recycle_buffer(uring, i);
+  }
+  return TS_OPERATION_SUCCESS;
+}
+
+static ts_bool_t ts_uring_initialize(ts_uring_t* uring,
+                                     ts_port_t server_port) {
+  if ((uring->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(struct sockaddr_in));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(server_port);
+  if (bind(uring->socket, (const struct sockaddr*)&address,
+           sizeof(struct sockaddr_in)) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(struct io_uring_params));
+  uring->ring_descriptor =
+      (int)syscall(__NR_io_uring_setup, TS_URING_ENTRIES, &params);
+  if (uring->ring_descriptor < 0) {
+    return TS_OPERATION_FAILURE;
+  }
+  if (ts_uring_map_rings(uring, &params) == TS_OPERATION_FAILURE ||
+      ts_uring_register_buffers(uring) == TS_OPERATION_FAILURE) {
+    return TS_OPERATION_FAILURE;
+  }
+  uring->recv_header.msg_namelen = sizeof(struct sockaddr_in);
+  for (uint16_t i = 0; i < TS_URING_SEND_SLOTS; ++i) {
+    uring->free_slots[i] = TS_URING_SEND_SLOTS - 1 - i;
+  }
+  uring->free_slots_count = TS_URING_SEND_SLOTS;
+  ts_uring_arm_receive(uring);
+  if (ts_uring_submit(uring, 0, NULL) < 0) {
+    return TS_OPERATION_FAILURE;
+  }
+  return TS_OPERATION_SUCCESS;
+}
+
+ts_device_context_t ts_initialize_unix_uring_device_context(
+    ts_port_t server_port_id) {
+  ts_device_context_t context;
+  memset(&context, 0, sizeof(ts_device_context_t));
+  ts_unix_uring_device_context_t* handle =
+      (ts_unix_uring_device_context_t*)&context;
+
+  ts_uring_t* uring = (ts_uring_t*)calloc(1, sizeof(ts_uring_t));
+  if (uring == NULL) {
+    context.current_state = TS_DEVICE_UNINITIALIZED;
+    return context;
+  }
+  uring->ring_descriptor = -1;
+  uring->socket = -1;
+  if (ts_uring_initialize(uring, server_port_id) == TS_OPERATION_FAILURE) {
+    ts_uring_destroy(uring);
+    context.current_state = TS_DEVICE_UNINITIALIZED;
+    return context;
+  }
+  handle->uring = uring;
+  context.recv_cb = ts_unix_uring_device_receive;
+  context.send_cb = ts_unix_uring_device_send;
+  context.clock_cb = ts_unix_uring_device_clock_ms;
+  context.destructor_cb = ts_unix_uring_device_destructor;
+  context.wait_cb = ts_unix_uring_device_wait;
+  context.recv_batch_cb = ts_unix_uring_device_receive_batch;
+  context.send_batch_cb = ts_unix_uring_device_send_batch;
+  context.can_receive_ip = TS_TRUE;
+  context.current_state = TS_DEVICE_INITIALIZED;
+  return context;
+}
@@ -0,0 +1,13 @@
+#ifndef __TUPLE_SPACE_UNIX_URING_DEVICE_H__
+#define __TUPLE_SPACE_UNIX_URING_DEVICE_H__
+
+#include "../common/tuple_space_network.h"
+
+// Linux only. Receives through a multishot recvmsg fed from a provided buffer
+// ring and queues sends as submissions, so a batch of datagrams costs a single
+// io_uring_enter. The current_state is TS_DEVICE_UNINITIALIZED when the kernel
+// lacks io_uring support.
+ts_device_context_t ts_initialize_unix_uring_device_context(
+    ts_port_t server_port_id);
+
+#endif  // __TUPLE_SPACE_UNIX_URING_DEVICE_H__
@@ -14,6 +14,9 @@ struct ts_zsut_device_context_t {
   ts_data_send_cb_t send_cb;
   ts_clock_ms_cb_t clock_cb;
   ts_device_context_destructor_cb_t destructor_cb;
+  ts_data_wait_cb_t wait_cb;
+  ts_data_recv_batch_cb_t recv_batch_cb;
+  ts_data_send_batch_cb_t send_batch_cb;
   ZsutEthernetUDP udp_connection;
   ts_byte_t reserved[TS_DEVICE_CONTEXT_SIZE - sizeof(ZsutEthernetUDP)];
   ts_byte_t current_state;  // ts_device_state_t
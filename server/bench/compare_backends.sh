@@ -0,0 +1,17 @@
+#!/bin/sh
+# Runs server_bench against the server once per device backend.
+# Usage: compare_backends.sh <server binary> <server_bench binary> [bench args]
+set -e
+
+SERVER=$1
+BENCH=$2
+shift 2
+
+for DEVICE in epoll io_uring; do
+  "$SERVER" --device="$DEVICE" > /dev/null 2>&1 &
+  SERVER_PID=$!
+  sleep 1
+  "$BENCH" --label="$DEVICE" --server-pid="$SERVER_PID" "$@"
+  kill -INT "$SERVER_PID"
+  wait "$SERVER_PID" || true
+done
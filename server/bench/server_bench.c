@@ -0,0 +1,304 @@
+// Load generator for the tuple space server. Every client thread repeats an
+// out, an inp of the same tuple and the ack of the received tuple, timing each
+// request until its reply. Prints the throughput and latency percentiles and,
+// given the server pid, the messages handled per second of server CPU time.
+//
+// Build:
+//   gcc -O2 -o server_bench server/bench/server_bench.c libts/common/*.c
+//       libts/unix/*.c -lpthread
+// Compare the device backends with server/bench/compare_backends.sh.
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../libts/common/tuple_space_network.h"
+#include "../../libts/common/tuple_space_serialization.h"
+
+#define BENCH_DEFAULT_PORT 43532
+#define BENCH_REPLY_TIMEOUT_MS 1000
+
+typedef struct {
+  const char* label;
+  const char* host;
+  ts_port_t port;
+  size_t clients;
+  size_t duration_s;
+  long server_pid;
+} bench_config_t;
+
+typedef struct {
+  const bench_config_t* config;
+  size_t client_id;
+  volatile const int* is_running;
+  uint64_t* latencies_ns;
+  size_t latencies_count;
+  size_t latencies_capacity;
+  size_t timeouts;
+} bench_client_t;
+
+static uint64_t bench_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void bench_record(bench_client_t* client, uint64_t latency_ns) {
+  if (client->latencies_count == client->latencies_capacity) {
+    client->latencies_capacity =
+        client->latencies_capacity ? client->latencies_capacity * 2 : 4096;
+    client->latencies_ns = (uint64_t*)realloc(
+        client->latencies_ns, client->latencies_capacity * sizeof(uint64_t));
+  }
+  client->latencies_ns[client->latencies_count++] = latency_ns;
+}
+
+// Sends the request and waits for a reply of the expected type, skipping
+// resends and await notifications left over from earlier requests.
+static ts_bool_t bench_request(bench_client_t* client, int socket_descriptor,
+                               const ts_byte_t* buffer, ts_size_t buffer_size,
+                               ts_server_to_client_message_type_t reply_type) {
+  uint64_t start = bench_time_ns();
+  if (send(socket_descriptor, buffer, buffer_size, 0) != buffer_size) {
+    return TS_FALSE;
+  }
+  ts_byte_t reply[TS_BUFFER_SIZE];
+  for (;;) {
+    ssize_t reply_size = recv(socket_descriptor, reply, TS_BUFFER_SIZE, 0);
+    if (reply_size <= 0) {
+      ++client->timeouts;
+      return TS_FALSE;
+    }
+    if (ts_server_to_client_message_type(reply, reply_size) == reply_type) {
+      break;
+    }
+  }
+  bench_record(client, bench_time_ns() - start);
+  return TS_TRUE;
+}
+
+static ts_size_t bench_encode(ts_client_to_server_message_type_t type,
+                              ts_tuple_field_t* tuple, ts_size_t tuple_size,
+                              ts_byte_t flags, ts_byte_t* buffer) {
+  ts_size_t header_size =
+      type == TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE ? 2 : 1;
+  ts_client_to_server_encode_message_type(type, buffer, TS_BUFFER_SIZE);
+  ts_encode_tuple_size(tuple_size, buffer, TS_BUFFER_SIZE);
+  if (type == TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE) {
+    buffer[1] = flags;
+  }
+  return header_size + ts_serialize_tuple(tuple, tuple_size,
+                                          buffer + header_size,
+                                          TS_BUFFER_SIZE - header_size);
+}
+
+static int bench_connect(const bench_config_t* config) {
+  int socket_descriptor = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_descriptor < 0) {
+    return -1;
+  }
+  struct timeval timeout = {BENCH_REPLY_TIMEOUT_MS / 1000,
+                            (BENCH_REPLY_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(socket_descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+             sizeof(struct timeval));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(struct sockaddr_in));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = inet_addr(config->host);
+  address.sin_port = htons(config->port);
+  if (connect(socket_descriptor, (const struct sockaddr*)&address,
+              sizeof(struct sockaddr_in)) < 0) {
+    close(socket_descriptor);
+    return -1;
+  }
+  return socket_descriptor;
+}
+
+static void* bench_client_run(void* user_data) {
+  bench_client_t* client = (bench_client_t*)user_data;
+  int socket_descriptor = bench_connect(client->config);
+  if (socket_descriptor < 0) {
+    return NULL;
+  }
+  ts_byte_t out_buffer[TS_BUFFER_SIZE];
+  ts_byte_t inp_buffer[TS_BUFFER_SIZE];
+  ts_byte_t ack_buffer[TS_CLIENT_TO_SERVER_ACK_SIZE];
+  ts_client_to_server_encode_message_type(
+      TS_CLIENT_TO_SERVER_MESSAGE_RECEIVED_MSG, ack_buffer,
+      TS_CLIENT_TO_SERVER_ACK_SIZE);
+  ts_tuple_field_t template_tuple[2] = {
+      ts_tuple_field_set_uint((ts_uint_t)client->client_id, TS_TRUE),
+      ts_tuple_field_set_int(0, TS_FALSE)};
+  ts_size_t inp_size =
+      bench_encode(TS_CLIENT_TO_SERVER_MESSAGE_GET_TUPLE, template_tuple, 2,
+                   0x01, inp_buffer);
+  for (ts_int_t sequence = 0; *client->is_running; ++sequence) {
+    ts_tuple_field_t data_tuple[2] = {
+        ts_tuple_field_set_uint((ts_uint_t)client->client_id, TS_TRUE),
+        ts_tuple_field_set_int(sequence, TS_TRUE)};
+    ts_size_t out_size = bench_encode(TS_CLIENT_TO_SERVER_MESSAGE_SEND_TUPLE,
+                                      data_tuple, 2, 0, out_buffer);
+    if (!bench_request(client, socket_descriptor, out_buffer, out_size,
+                       TS_SERVER_TO_CLIENT_MESSAGE_RECEIVED_MSG)) {
+      continue;
+    }
+    if (!bench_request(client, socket_descriptor, inp_buffer, inp_size,
+                       TS_SERVER_TO_CLIENT_MESSAGE_TUPLE)) {
+      continue;
+    }
+    bench_request(client, socket_descriptor, ack_buffer,
+                  TS_CLIENT_TO_SERVER_ACK_SIZE,
+                  TS_SERVER_TO_CLIENT_MESSAGE_RECEIVED_MSG);
+  }
+  close(socket_descriptor);
+  return NULL;
+}
+
+// Returns the user and system time of the process in clock ticks.
+static long bench_process_cpu_ticks(long pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  unsigned long user_ticks = 0;
+  unsigned long system_ticks = 0;
+  int matched = fscanf(file,
+                       "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                       "%lu %lu",
+                       &user_ticks, &system_ticks);
+  fclose(file);
+  return matched == 2 ? (long)(user_ticks + system_ticks) : -1;
+}
+
+static int bench_compare_latencies(const void* lhs, const void* rhs) {
+  uint64_t left = *(const uint64_t*)lhs;
+  uint64_t right = *(const uint64_t*)rhs;
+  return left < right ? -1 : left > right;
+}
+
+static double bench_percentile_us(const uint64_t* latencies_ns, size_t count,
+                                  double percentile) {
+  if (count == 0) {
+    return 0.0;
+  }
+  size_t index = (size_t)(percentile * (double)(count - 1));
+  return (double)latencies_ns[index] / 1000.0;
+}
+
+static ts_bool_t bench_parse_config(bench_config_t* config, int argc,
+                                    char** argv) {
+  static const struct option options[] = {
+      {"label", required_argument, NULL, 'l'},
+      {"host", required_argument, NULL, 'a'},
+      {"port", required_argument, NULL, 'p'},
+      {"clients", required_argument, NULL, 'c'},
+      {"duration", required_argument, NULL, 'd'},
+      {"server-pid", required_argument, NULL, 's'},
+      {NULL, 0, NULL, 0}};
+  int option;
+  while ((option = getopt_long(argc, argv, "l:a:p:c:d:s:", options, NULL)) !=
+         -1) {
+    switch (option) {
+      case 'l':
+        config->label = optarg;
+        break;
+      case 'a':
+        config->host = optarg;
+        break;
+      case 'p':
+        config->port = (ts_port_t)atoi(optarg);
+        break;
+      case 'c':
+        config->clients = (size_t)atoi(optarg);
+        break;
+      case 'd':
+        config->duration_s = (size_t)atoi(optarg);
+        break;
+      case 's':
+        config->server_pid = atol(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [--label=name] [--host=ip] [--port=port] "
+                "[--clients=n] [--duration=seconds] [--server-pid=pid]\n",
+                argv[0]);
+        return TS_FALSE;
+    }
+  }
+  return config->clients > 0 && config->duration_s > 0;
+}
+
+int main(int argc, char** argv) {
+  bench_config_t config = {"server", "127.0.0.1", BENCH_DEFAULT_PORT, 8, 5, 0};
+  if (!bench_parse_config(&config, argc, argv)) {
+    return -1;
+  }
+  volatile int is_running = 1;
+  bench_client_t* clients =
+      (bench_client_t*)calloc(config.clients, sizeof(bench_client_t));
+  pthread_t* threads =
+      (pthread_t*)calloc(config.clients, sizeof(pthread_t));
+  long cpu_ticks = config.server_pid ? bench_process_cpu_ticks(config.server_pid)
+                                     : -1;
+  uint64_t start = bench_time_ns();
+  for (size_t i = 0; i < config.clients; ++i) {
+    clients[i].config = &config;
+    clients[i].client_id = (size_t)getpid() * 1000 + i;
+    clients[i].is_running = &is_running;
+    pthread_create(&threads[i], NULL, bench_client_run, &clients[i]);
+  }
+  sleep((unsigned)config.duration_s);
+  is_running = 0;
+  for (size_t i = 0; i < config.clients; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  double elapsed_s = (double)(bench_time_ns() - start) / 1e9;
+  if (cpu_ticks >= 0) {
+    long end_ticks = bench_process_cpu_ticks(config.server_pid);
+    cpu_ticks = end_ticks >= cpu_ticks ? end_ticks - cpu_ticks : -1;
+  }
+
+  size_t requests = 0;
+  size_t timeouts = 0;
+  for (size_t i = 0; i < config.clients; ++i) {
+    requests += clients[i].latencies_count;
+    timeouts += clients[i].timeouts;
+  }
+  uint64_t* latencies_ns = (uint64_t*)malloc((requests + 1) * sizeof(uint64_t));
+  size_t offset = 0;
+  for (size_t i = 0; i < config.clients; ++i) {
+    memcpy(latencies_ns + offset, clients[i].latencies_ns,
+           clients[i].latencies_count * sizeof(uint64_t));
+    offset += clients[i].latencies_count;
+    free(clients[i].latencies_ns);
+  }
+  qsort(latencies_ns, requests, sizeof(uint64_t), bench_compare_latencies);
+
+  printf("%s: %zu clients, %zu requests in %.2f s, %.0f req/s, %zu timeouts\n",
+         config.label, config.clients, requests, elapsed_s,
+         (double)requests / elapsed_s, timeouts);
+  printf("%s: latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+         config.label, bench_percentile_us(latencies_ns, requests, 0.50),
+         bench_percentile_us(latencies_ns, requests, 0.99),
+         bench_percentile_us(latencies_ns, requests, 0.999),
+         bench_percentile_us(latencies_ns, requests, 1.0));
+  if (cpu_ticks > 0) {
+    double cpu_s = (double)cpu_ticks / (double)sysconf(_SC_CLK_TCK);
+    printf("%s: server cpu %.2f s, %.0f req per cpu second\n", config.label,
+           cpu_s, (double)requests / cpu_s);
+  }
+  free(latencies_ns);
+  free(threads);
+  free(clients);
+  return 0;
+}
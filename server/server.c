@@ -1,65 +1,159 @@
+#define _GNU_SOURCE
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <unistd.h>
 
 #include "../libts/unix/tuple_space_unix_alloc.h"
 #include "../libts/unix/tuple_space_unix_device.h"
+#include "../libts/unix/tuple_space_unix_uring_device.h"
+#include "server_config.h"
+#include "server_epoch.h"
 #include "server_log.h"
 #include "server_process_requests.h"
+#include "server_shard.h"
+#include "server_trace.h"
 
 #define SERVER_PORT 43532
 #define MAX_ACK_REPLIES 5
 #define MAX_ACK_AWAIT_TIME 1000
+#define MAX_ACK_BACKOFF_TIME 8000
+#define METRICS_INTERVAL 1000
+#define PROFILE_INTERVAL 10000
+#define MAX_MESSAGES_PER_WAKEUP 1024
 
 static void server_error_cb(void* user_data) {
   server_data_t* data = (server_data_t*)user_data;
-  server_log("Unknown error found during input operation\n");
+  SERVER_LOG_WARNING("Unknown error found during input operation\n");
   ++data->metrics.total_errors;
 }
 
-static void server_get_tuple_cb(void* user_data, ts_tuple_field_t* tuple,
-                                ts_size_t tuple_size,
-                                ts_bool_t respond_when_available,
-                                ts_bool_t remove_after_use,
-                                ts_ipv4_t sender_ip_address,
-                                ts_port_t sender_port_id) {
-  server_data_t* data = (server_data_t*)user_data;
-  server_log("Received GET TUPLE message from %s and port %d\n",
-             ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
-  server_log("Tuple from message:\n");
-  ts_print_tuple(tuple, tuple_size);
+static void server_compact_failure(server_data_t* data,
+                                   ts_ipv4_t sender_ip_address,
+                                   ts_port_t sender_port_id) {
+  SERVER_LOG_WARNING(
+      "Dropped the tuple from %s and port %d, it could not be stored\n",
+      ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
+  ++data->metrics.total_errors;
+  server_trace_end_request();
+}
+
+static server_operation_t server_get_tuple_operation(
+    ts_bool_t respond_when_available, ts_bool_t remove_after_use) {
+  if (remove_after_use) {
+    return respond_when_available ? SERVER_OPERATION_IN : SERVER_OPERATION_INP;
+  }
+  return respond_when_available ? SERVER_OPERATION_RD : SERVER_OPERATION_RDP;
+}
+
+static void server_process_get_tuple(server_data_t* data,
+                                     server_operation_t operation,
+                                     server_field_t* tuple,
+                                     ts_size_t tuple_size,
+                                     ts_tuple_signature_t signature,
+                                     ts_ipv4_t sender_ip_address,
+                                     ts_port_t sender_port_id) {
   data->metrics.acc_received_message_length += tuple_size;
   ++data->metrics.total_received_messages;
-  if (remove_after_use && respond_when_available) {
-    server_log("Processing IN message\n");
+  if (operation == SERVER_OPERATION_IN) {
+    SERVER_LOG_DEBUG("Processing IN message\n");
     ++data->metrics.total_in_messages;
-    server_process_in(data, tuple, tuple_size, sender_ip_address,
+    server_process_in(data, tuple, tuple_size, signature, sender_ip_address,
                       sender_port_id);
-  } else if (remove_after_use && !respond_when_available) {
-    server_log("Processing INP message\n");
+  } else if (operation == SERVER_OPERATION_INP) {
+    SERVER_LOG_DEBUG("Processing INP message\n");
     ++data->metrics.total_inp_messages;
-    server_process_inp(data, tuple, tuple_size, sender_ip_address,
+    server_process_inp(data, tuple, tuple_size, signature, sender_ip_address,
                        sender_port_id);
-  } else if (!remove_after_use && respond_when_available) {
-    server_log("Processing RD message\n");
+  } else if (operation == SERVER_OPERATION_RD) {
+    SERVER_LOG_DEBUG("Processing RD message\n");
     ++data->metrics.total_rd_messages;
-    server_process_rd(data, tuple, tuple_size, sender_ip_address,
+    server_process_rd(data, tuple, tuple_size, signature, sender_ip_address,
                       sender_port_id);
   } else {
-    server_log("Processing RDP message\n");
+    SERVER_LOG_DEBUG("Processing RDP message\n");
     ++data->metrics.total_rdp_messages;
-    server_process_rdp(data, tuple, tuple_size, sender_ip_address,
+    server_process_rdp(data, tuple, tuple_size, signature, sender_ip_address,
                        sender_port_id);
   }
+  server_release_field_strings(data->strings, tuple, tuple_size);
+  server_trace_stage(SERVER_TRACE_ENCODE);
+  server_trace_end_request();
+}
+
+static server_operation_t server_receive_get_tuple(
+    ts_bool_t respond_when_available, ts_bool_t remove_after_use,
+    ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_operation_t operation =
+      server_get_tuple_operation(respond_when_available, remove_after_use);
+  server_trace_request(operation, sender_ip_address, sender_port_id);
+  SERVER_LOG_DEBUG("Received GET TUPLE message from %s and port %d\n",
+                   ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
+  SERVER_LOG_DEBUG("Tuple from message:\n");
+  return operation;
+}
+
+static void server_get_tuple_cb(void* user_data, ts_tuple_field_t* tuple,
+                                ts_size_t tuple_size,
+                                ts_tuple_signature_t signature,
+                                ts_bool_t respond_when_available,
+                                ts_bool_t remove_after_use,
+                                ts_ipv4_t sender_ip_address,
+                                ts_port_t sender_port_id) {
+  server_data_t* data = (server_data_t*)user_data;
+  uint64_t start_time = server_monotonic_time_us();
+  server_operation_t operation = server_receive_get_tuple(
+      respond_when_available, remove_after_use, sender_ip_address,
+      sender_port_id);
+  SERVER_LOG_TUPLE(SERVER_LOG_LEVEL_DEBUG, tuple, tuple_size);
+  server_field_t template_tuple[TS_MAX_TUPLE_SIZE];
+  ts_bool_t is_compacted =
+      server_compact_fields(data->strings, template_tuple, tuple, tuple_size);
+  ts_server_free_tuple(&data->server_context, tuple, tuple_size,
+                       &data->allocator);
+  if (!is_compacted) {
+    server_compact_failure(data, sender_ip_address, sender_port_id);
+    return;
+  }
+  server_process_get_tuple(data, operation, template_tuple, tuple_size,
+                           signature, sender_ip_address, sender_port_id);
+  server_record_histogram(&data->metrics.service_time[operation],
+                          server_monotonic_time_us() - start_time);
+}
+
+// Nothing is allocated for the template unless it waits for a match or
+// brings a string the server does not hold yet.
+static void server_get_tuple_view_cb(void* user_data,
+                                     const ts_tuple_view_t* tuple,
+                                     ts_tuple_signature_t signature,
+                                     ts_bool_t respond_when_available,
+                                     ts_bool_t remove_after_use,
+                                     ts_ipv4_t sender_ip_address,
+                                     ts_port_t sender_port_id) {
+  server_data_t* data = (server_data_t*)user_data;
+  uint64_t start_time = server_monotonic_time_us();
+  server_operation_t operation = server_receive_get_tuple(
+      respond_when_available, remove_after_use, sender_ip_address,
+      sender_port_id);
+  server_field_t template_tuple[TS_MAX_TUPLE_SIZE];
+  if (!server_compact_view_fields(data->strings, template_tuple, tuple)) {
+    server_compact_failure(data, sender_ip_address, sender_port_id);
+    return;
+  }
+  server_log_fields(data, template_tuple, tuple->tuple_size);
+  server_process_get_tuple(data, operation, template_tuple, tuple->tuple_size,
+                           signature, sender_ip_address, sender_port_id);
+  server_record_histogram(&data->metrics.service_time[operation],
+                          server_monotonic_time_us() - start_time);
 }
 
 static void server_get_tuple_invalid_invariant_cb(void* user_data,
                                                   ts_ipv4_t sender_ip_address,
                                                   ts_port_t sender_port_id) {
   server_data_t* data = (server_data_t*)user_data;
-  server_log(
+  SERVER_LOG_WARNING(
       "Received GET TUPLE message from %s and port %d with invalid data\n",
       ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
   ++data->metrics.total_invalid_get_tuples;
@@ -67,26 +161,39 @@ static void server_get_tuple_invalid_invariant_cb(void* user_data,
 
 static void server_send_tuple_cb(void* user_data, ts_tuple_field_t* tuple,
                                  ts_size_t tuple_size,
+                                 ts_tuple_signature_t signature,
                                  ts_ipv4_t sender_ip_address,
                                  ts_port_t sender_port_id) {
   server_data_t* data = (server_data_t*)user_data;
-  server_log("Received SEND TUPLE message from %s and port %d\n",
-             ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
-  server_log("Received tuple:\n");
-  ts_print_tuple(tuple, tuple_size);
+  uint64_t start_time = server_monotonic_time_us();
+  server_trace_request(SERVER_OPERATION_OUT, sender_ip_address,
+                       sender_port_id);
+  SERVER_LOG_DEBUG("Received SEND TUPLE message from %s and port %d\n",
+                   ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
+  SERVER_LOG_DEBUG("Received tuple:\n");
+  SERVER_LOG_TUPLE(SERVER_LOG_LEVEL_DEBUG, tuple, tuple_size);
+  server_field_t* compact_tuple = server_compact_tuple(data, tuple, tuple_size);
+  if (compact_tuple == NULL) {
+    server_compact_failure(data, sender_ip_address, sender_port_id);
+    return;
+  }
   ++data->metrics.total_out_messages;
   data->metrics.acc_received_message_length += tuple_size;
   ++data->metrics.total_received_messages;
-  server_log("Processing OUT tuple\n");
-  server_process_out(data, tuple, tuple_size, sender_ip_address,
-                     sender_port_id);
+  SERVER_LOG_DEBUG("Processing OUT tuple\n");
+  server_process_out(data, compact_tuple, tuple_size, signature,
+                     sender_ip_address, sender_port_id);
+  server_trace_stage(SERVER_TRACE_ENCODE);
+  server_trace_end_request();
+  server_record_histogram(&data->metrics.service_time[SERVER_OPERATION_OUT],
+                          server_monotonic_time_us() - start_time);
 }
 
 static void server_send_tuple_invalid_invariant_cb(void* user_data,
                                                    ts_ipv4_t sender_ip_address,
                                                    ts_port_t sender_port_id) {
   server_data_t* data = (server_data_t*)user_data;
-  server_log(
+  SERVER_LOG_WARNING(
       "Received SEND TUPLE message from %s and port %d with invalid data\n",
       ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
   ++data->metrics.total_invalid_send_tuples;
@@ -96,21 +203,33 @@ static void server_serialization_issue_cb(
     void* user_data, ts_client_to_server_message_type_t message_type,
     ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
   server_data_t* data = (server_data_t*)user_data;
-  server_log(
+  SERVER_LOG_WARNING(
       "Received SEND TUPLE message from %s and port %d could not been "
       "serialized\n",
       ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
   ++data->metrics.total_serialization_issues;
 }
 
+static void server_release_connection(server_data_t* data,
+                                      ts_ipv4_t sender_ip_address,
+                                      ts_port_t sender_port_id) {
+  server_connection_node_t node = server_remove_connection_node(
+      &data->active_connections, sender_ip_address, sender_port_id);
+  if (node.last_send_time_us != 0) {
+    server_record_histogram(
+        &data->metrics.ack_round_trip_time,
+        server_monotonic_time_us() - node.last_send_time_us);
+  }
+  server_trace_ack(node.trace_request_id, sender_ip_address, sender_port_id);
+  server_free_tuple(data, node.data_tuple, node.tuple_size);
+}
+
 static void server_ack_cb(void* user_data, ts_ipv4_t sender_ip_address,
                           ts_port_t sender_port_id) {
   server_data_t* data = (server_data_t*)user_data;
-  server_log("Received ACK message from %s and port %d\n",
-             ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
-  server_connection_node_t node = server_remove_connection_node(
-      &data->active_connections, sender_ip_address, sender_port_id);
-  ts_free_tuple(node.data_tuple, node.tuple_size, &data->allocator);
+  SERVER_LOG_DEBUG("Received ACK message from %s and port %d\n",
+                   ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
+  server_release_connection(data, sender_ip_address, sender_port_id);
   server_send_single_ack(data, sender_ip_address, sender_port_id);
 }
 
@@ -119,6 +238,7 @@ static ts_server_receiver_callbacks_t server_initialize_callbacks(void) {
   memset(&callbacks, 0, sizeof(ts_server_receiver_callbacks_t));
   callbacks.error_cb = server_error_cb;
   callbacks.get_tuple_cb = server_get_tuple_cb;
+  callbacks.get_tuple_view_cb = server_get_tuple_view_cb;
   callbacks.get_tuple_invalid_invariant_cb =
       server_get_tuple_invalid_invariant_cb;
   callbacks.send_tuple_cb = server_send_tuple_cb;
@@ -130,86 +250,382 @@ static ts_server_receiver_callbacks_t server_initialize_callbacks(void) {
 }
 
 static void server_resend_tuple_remove_node(server_data_t* server_data,
-                                            server_connection_node_t** node) {
-  server_connection_node_t* old_node = *node;
-  *node = old_node->next_node;
-  if (old_node->insert_if_rejected) {
-    server_insert_data_tuple(&server_data->tuple_stash, old_node->data_tuple,
-                             old_node->tuple_size);
+                                            server_connection_node_t* node) {
+  if (node->insert_if_rejected) {
+    ts_tuple_signature_t signature =
+        server_fields_signature(node->data_tuple, node->tuple_size);
+    server_profile_population(&server_data->profile, node->data_tuple,
+                              node->tuple_size, signature, 1);
+    server_insert_data_tuple(server_data->tuple_stash, node->data_tuple,
+                             node->tuple_size, signature);
   } else {
-    ts_free_tuple(old_node->data_tuple, old_node->tuple_size,
-                  &server_data->allocator);
-  }
-  free(old_node);
-}
-
-static void server_resend_tuple_for_connections(server_data_t* server_data,
-                                                ts_size_t max_resend_count,
-                                                ts_uint_t resend_interval) {
-  server_connection_node_t** node = &server_data->active_connections.list;
-  ts_uint_t current_time = server_current_time_ms();
-  for (; (*node) != NULL;
-       node = (server_connection_node_t**)&(*node)->next_node) {
-    if ((*node)->insertion_time + resend_interval < current_time) {
-      if (!(*node)->ping_for_await &&
-          (*node)->resend_counter++ == max_resend_count) {
-        server_resend_tuple_remove_node(server_data, node);
-      } else if (!(*node)->ping_for_await) {
-        ts_server_send_server_to_client_tuple(
-            &server_data->server_context, (*node)->data_tuple,
-            (*node)->tuple_size, (*node)->receiver_ip, (*node)->receiver_port);
-        (*node)->insertion_time = current_time;
-      } else if ((*node)->tuple_size) {
-        ts_server_send_server_to_client_await_for_tuple(
-            &server_data->server_context, (*node)->receiver_ip,
-            (*node)->receiver_port);
-      } else {
-        ts_server_send_server_to_client_lack_of_tuple(
-            &server_data->server_context, (*node)->receiver_ip,
-            (*node)->receiver_port);
-      }
-    }
+    server_free_tuple(server_data, node->data_tuple, node->tuple_size);
   }
+  server_erase_connection_node(&server_data->active_connections, node);
+}
+
+static void server_resend_expired_cb(void* user_data, server_timer_t* timer) {
+  server_data_t* server_data = (server_data_t*)user_data;
+  server_connection_node_t* node = SERVER_CONNECTION_TIMER_NODE(timer);
+  if (!node->ping_for_await && node->resend_counter++ == MAX_ACK_REPLIES) {
+    server_resend_tuple_remove_node(server_data, node);
+    return;
+  }
+  if (!node->ping_for_await) {
+    server_send_tuple(server_data, node->data_tuple, node->tuple_size,
+                      node->receiver_ip, node->receiver_port);
+  } else if (node->tuple_size) {
+    ts_server_send_server_to_client_await_for_tuple(
+        &server_data->server_context, node->receiver_ip, node->receiver_port);
+  } else {
+    ts_server_send_server_to_client_lack_of_tuple(
+        &server_data->server_context, node->receiver_ip, node->receiver_port);
+  }
+  server_back_off_connection_timer(&server_data->active_connections, node);
 }
 
 static volatile ts_bool_t IsWorking = TS_TRUE;
+static server_tuple_space_t SharedTupleStash;
+static server_intern_table_t InternTable;
+static server_epoch_domain_t EpochDomain;
+static server_pipeline_t Pipeline;
+static const char* MetricsPath = NULL;
+static size_t ProfileTop = 0;
 
 static void server_sigint_handler(int) { IsWorking = TS_FALSE; }
 
-static size_t server_current_time_s(void) {
-  time_t time_ = time(NULL);
-  return localtime(&time_)->tm_sec;
+static ts_bool_t server_initialize_shard(server_shard_t* shard,
+                                         const server_config_t* config) {
+  server_data_t* server_data = &shard->server_data;
+  if (shard->is_stash_shared) {
+    server_data->tuple_stash = &SharedTupleStash;
+  } else {
+    server_initialize_tuple_space(&shard->tuple_stash);
+    server_data->tuple_stash = &shard->tuple_stash;
+  }
+  server_data->strings = &InternTable;
+  server_data->is_wire_storage = config->storage_mode == SERVER_STORAGE_WIRE;
+  server_initialize_tuple_queue(&server_data->tuple_queue,
+                                config->dispatch_mode);
+  server_initialize_active_connections(&server_data->active_connections,
+                                       MAX_ACK_AWAIT_TIME,
+                                       MAX_ACK_BACKOFF_TIME);
+  server_initialize_metrics(&server_data->metrics);
+  server_initialize_profile(&server_data->profile, config->profile_top > 0);
+  pthread_mutex_init(&shard->metrics_lock, NULL);
+  // The pool allocator keeps its free lists per thread, while a tuple of a
+  // shared stash may be freed by another shard than the one allocating it.
+  server_data->allocator = shard->is_stash_shared
+                               ? ts_initialize_unix_allocator()
+                               : ts_initialize_unix_pool_allocator();
+
+  ts_device_context_t device_context;
+  if (config->device_backend == SERVER_DEVICE_IO_URING) {
+    device_context = ts_initialize_unix_uring_device_context(SERVER_PORT);
+  } else if (shard->shards_count > 1) {
+    device_context = ts_initialize_unix_shared_device_context(SERVER_PORT);
+  } else {
+    device_context = ts_initialize_unix_device_context(SERVER_PORT);
+  }
+  if (config->trace_path != NULL &&
+      config->device_backend == SERVER_DEVICE_EPOLL &&
+      !ts_unix_device_enable_receive_timestamps(&device_context)) {
+    SERVER_LOG_WARNING("Kernel receive timestamps are not available\n");
+  }
+  if (config->is_pipelined) {
+    // Tuples are allocated by the receiver thread and freed by this one, the
+    // pool allocator keeps its free lists per thread.
+    server_data->allocator = ts_initialize_unix_allocator();
+    shard->pipeline = &Pipeline;
+    if (!server_initialize_pipeline(shard->pipeline, device_context,
+                                    sizeof(server_tuple_space_node_t),
+                                    server_data->allocator)) {
+      return TS_FALSE;
+    }
+    device_context = server_pipeline_device_context(shard->pipeline);
+  }
+  if (!ts_initialize_server_context(&server_data->server_context,
+                                    device_context,
+                                    server_initialize_callbacks())) {
+    return TS_FALSE;
+  }
+  if (shard->shards_count > 1 &&
+      (!server_initialize_shard_queue(&shard->inbox) ||
+       !ts_unix_device_watch_descriptor(
+           &server_data->server_context.device_context,
+           shard->inbox.wakeup_descriptor))) {
+    return TS_FALSE;
+  }
+  server_data->server_context.tuple_header_size =
+      sizeof(server_tuple_space_node_t);
+  ts_server_set_send_batch(&server_data->server_context, shard->sent_datagrams,
+                           SERVER_SHARD_DATAGRAM_BATCH_SIZE);
+  return TS_TRUE;
 }
 
-int main() {
-  signal(SIGINT, server_sigint_handler);
-  server_data_t server_data;
-  memset(&server_data, 0, sizeof(server_data_t));
-  server_data.metrics = server_initialize_metrics();
-  server_data.allocator = ts_initialize_unix_allocator();
-
-  if (!ts_initialize_server_context(
-          &server_data.server_context,
-          ts_initialize_unix_device_context(SERVER_PORT),
-          server_initialize_callbacks())) {
-    return -1;
+static void server_destroy_shard(server_shard_t* shard) {
+  ts_close_server_context(&shard->server_data.server_context);
+  server_destroy_pool(&shard->server_data.tuple_queue.node_pool);
+  server_destroy_active_connections(&shard->server_data.active_connections);
+  server_destroy_shard_queue(&shard->inbox);
+  server_destroy_profile(&shard->server_data.profile);
+  pthread_mutex_destroy(&shard->metrics_lock);
+}
+
+// A traced request needs the receive time of its own datagram.
+static void server_process_datagrams(server_data_t* server_data,
+                                     const ts_datagram_t* datagrams,
+                                     ts_size_t datagrams_count) {
+  if (!server_is_tracing()) {
+    ts_server_process_messages(&server_data->server_context, datagrams,
+                               datagrams_count, server_data,
+                               &server_data->allocator);
+    return;
+  }
+  for (ts_size_t i = 0; i < datagrams_count; ++i) {
+    server_trace_receive(datagrams[i].receive_time_ns);
+    ts_server_process_messages(&server_data->server_context, &datagrams[i], 1,
+                               server_data, &server_data->allocator);
+  }
+}
+
+static void server_receive_messages(server_shard_t* shard) {
+  server_data_t* server_data = &shard->server_data;
+  size_t received = 0;
+  while (received < MAX_MESSAGES_PER_WAKEUP) {
+    ts_size_t count = ts_server_receive_messages(
+        &server_data->server_context, shard->received_datagrams,
+        SERVER_SHARD_DATAGRAM_BATCH_SIZE);
+    if (count == 0) {
+      break;
+    }
+    received += count;
+    if (shard->shards_count > 1) {
+      count = server_route_datagrams(shard, shard->received_datagrams, count);
+    }
+    server_process_datagrams(server_data, shard->received_datagrams, count);
+    ts_server_flush_messages(&server_data->server_context);
+    server_trace_send();
+  }
+}
+
+// Returns TS_TRUE when the inbox may still hold messages.
+static ts_bool_t server_receive_forwarded_messages(server_shard_t* shard) {
+  server_data_t* server_data = &shard->server_data;
+  ts_datagram_t* datagram = &shard->received_datagrams[0];
+  ts_bool_t is_forwarded_ack;
+  size_t received = 0;
+  server_clear_shard_wakeup(&shard->inbox);
+  while (received < MAX_MESSAGES_PER_WAKEUP &&
+         server_pop_shard_message(&shard->inbox, datagram, &is_forwarded_ack)) {
+    ++received;
+    server_trace_receive(datagram->receive_time_ns);
+    if (is_forwarded_ack) {
+      server_release_connection(server_data, datagram->ip_address,
+                                datagram->port_id);
+    } else {
+      server_process_datagrams(server_data, datagram, 1);
+    }
+  }
+  return received == MAX_MESSAGES_PER_WAKEUP;
+}
+
+static void server_sample_shard_metrics(server_shard_t* shard) {
+  server_data_t* server_data = &shard->server_data;
+  server_metrics_t* metrics = &server_data->metrics;
+  if (shard->shard_id == 0) {
+    metrics->interned_strings = server_interned_strings_count(&InternTable);
+    metrics->interned_saved_bytes = server_interned_saved_bytes(&InternTable);
   }
+  metrics->queue_nodes = server_data->tuple_queue.node_pool.usage;
+  metrics->connection_nodes = server_data->active_connections.node_pool.usage;
+  if (shard->pipeline != NULL) {
+    server_sample_pipeline(shard->pipeline, metrics);
+  }
+}
 
-  size_t last_message_time_s = server_current_time_s();
+// Every shard publishes a copy of its metrics, the first one merges the
+// copies and rewrites the metrics file, or prints them without a file.
+static void server_report_metrics(server_shard_t* shard) {
+  static server_metrics_t merged_metrics;
+  server_sample_shard_metrics(shard);
+  pthread_mutex_lock(&shard->metrics_lock);
+  memcpy(&shard->published_metrics, &shard->server_data.metrics,
+         sizeof(server_metrics_t));
+  pthread_mutex_unlock(&shard->metrics_lock);
+  if (shard->shard_id != 0) {
+    return;
+  }
+  server_initialize_metrics(&merged_metrics);
+  for (size_t i = 0; i < shard->shards_count; ++i) {
+    server_shard_t* other = &shard->shards[i];
+    pthread_mutex_lock(&other->metrics_lock);
+    server_merge_metrics(&merged_metrics, &other->published_metrics);
+    pthread_mutex_unlock(&other->metrics_lock);
+  }
+  if (MetricsPath == NULL) {
+    server_print_metrics(&merged_metrics);
+    return;
+  }
+  if (!server_export_metrics(MetricsPath, &merged_metrics)) {
+    SERVER_LOG_WARNING("Failed to write the metrics to %s\n", MetricsPath);
+  }
+}
+
+static void server_run(server_shard_t* shard) {
+  server_data_t* server_data = &shard->server_data;
+  uint64_t next_metrics_time = server_monotonic_time_ms() + METRICS_INTERVAL;
+  uint64_t next_profile_time = server_monotonic_time_ms() + PROFILE_INTERVAL;
+  ts_bool_t is_inbox_pending = TS_FALSE;
+  if (shard->is_stash_shared &&
+      !server_register_epoch_participant(&EpochDomain)) {
+    return;
+  }
 
   while (IsWorking) {
-    ts_server_get_message(&server_data.server_context, &server_data,
-                          &server_data.allocator);
-    size_t current_time_s = server_current_time_s();
-    if (last_message_time_s != current_time_s) {
-      server_print_metrics(&server_data.metrics);
-      last_message_time_s = current_time_s;
+    uint64_t current_time = server_monotonic_time_ms();
+    int64_t timeout = server_timer_wheel_timeout(
+        &server_data->active_connections.resend_timers, current_time);
+    if (timeout < 0 || current_time + timeout > next_metrics_time) {
+      timeout = next_metrics_time > current_time
+                    ? (int64_t)(next_metrics_time - current_time)
+                    : 0;
+    }
+    if (is_inbox_pending) {
+      timeout = 0;
+    }
+    ts_bool_t is_readable = ts_server_wait_for_message(
+        &server_data->server_context, (ts_int_t)timeout);
+    // Tuples found in a shared stash are not kept past one iteration
+    server_epoch_enter();
+    if (is_readable && shard->pipeline != NULL) {
+      server_dispatch_pipeline_messages(
+          shard->pipeline, &server_data->server_context.server_callbacks,
+          server_data, MAX_MESSAGES_PER_WAKEUP);
+    } else if (is_readable) {
+      server_receive_messages(shard);
+    }
+    if (shard->shards_count > 1) {
+      is_inbox_pending = server_receive_forwarded_messages(shard);
+    }
+    current_time = server_monotonic_time_ms();
+    if (current_time >= next_metrics_time) {
+      server_report_metrics(shard);
+      server_flush_trace();
+      next_metrics_time = current_time + METRICS_INTERVAL;
+    }
+    if (ProfileTop > 0 && current_time >= next_profile_time) {
+      if (shard->shards_count > 1) {
+        SERVER_LOG_INFO("Shard %zu:\n", shard->shard_id);
+      }
+      server_report_profile(&server_data->profile, ProfileTop,
+                            PROFILE_INTERVAL);
+      next_profile_time = current_time + PROFILE_INTERVAL;
     }
-    server_resend_tuple_for_connections(&server_data, MAX_ACK_REPLIES,
-                                        MAX_ACK_AWAIT_TIME);
+    server_advance_timer_wheel(&server_data->active_connections.resend_timers,
+                               current_time, server_resend_expired_cb,
+                               server_data);
+    ts_server_flush_messages(&server_data->server_context);
+    server_trace_send();
+    server_epoch_exit();
+    server_epoch_collect();
   }
+  server_flush_trace();
+}
+
+static void* server_shard_thread(void* argument) {
+  server_shard_t* shard = (server_shard_t*)argument;
+  long cpus_count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus_count > 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(shard->shard_id % (size_t)cpus_count, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+  }
+  server_run(shard);
+  return NULL;
+}
 
-  ts_close_server_context(&server_data.server_context);
+int main(int argc, char** argv) {
+  server_config_t config = server_initialize_config();
+  if (!server_parse_config(&config, argc, argv)) {
+    return -1;
+  }
+
+  server_set_log_level(config.log_level);
+  MetricsPath = config.metrics_path;
+  ProfileTop = config.profile_top;
+  if (!server_start_log()) {
+    fprintf(stderr, "Failed to start the log thread, logging synchronously\n");
+  }
+  if (config.trace_path != NULL &&
+      !server_open_trace(config.trace_path, config.trace_sample_interval)) {
+    fprintf(stderr, "Failed to open the trace file %s\n", config.trace_path);
+    return -1;
+  }
+  signal(SIGINT, server_sigint_handler);
+  server_shard_t* shards =
+      (server_shard_t*)calloc(config.shards_count, sizeof(server_shard_t));
+  if (shards == NULL) {
+    return -1;
+  }
+  if (!server_initialize_intern_table(&InternTable, config.shards_count > 1)) {
+    return -1;
+  }
+  if (config.stash_mode == SERVER_STASH_SHARED) {
+    server_initialize_epoch_domain(&EpochDomain);
+    if (!server_initialize_shared_tuple_space(&SharedTupleStash)) {
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < config.shards_count; ++i) {
+    shards[i].shard_id = i;
+    shards[i].shards_count = config.shards_count;
+    shards[i].shards = shards;
+    shards[i].is_stash_shared = config.stash_mode == SERVER_STASH_SHARED;
+    if (!server_initialize_shard(&shards[i], &config)) {
+      fprintf(stderr, "Failed to initialize the network device\n");
+      return -1;
+    }
+  }
+
+  if (config.shards_count == 1) {
+    if (shards[0].pipeline != NULL && !server_start_pipeline(&Pipeline)) {
+      fprintf(stderr, "Failed to start the pipeline\n");
+      return -1;
+    }
+    server_run(&shards[0]);
+  } else {
+    // Workers inherit the blocked SIGINT, main waits for it and wakes them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    for (size_t i = 0; i < config.shards_count; ++i) {
+      if (pthread_create(&shards[i].thread, NULL, server_shard_thread,
+                         &shards[i]) != 0) {
+        fprintf(stderr, "Failed to start shard %zu\n", i);
+        return -1;
+      }
+    }
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    IsWorking = TS_FALSE;
+    for (size_t i = 0; i < config.shards_count; ++i) {
+      server_wake_shard_queue(&shards[i].inbox);
+    }
+    for (size_t i = 0; i < config.shards_count; ++i) {
+      pthread_join(shards[i].thread, NULL);
+    }
+  }
+
+  for (size_t i = 0; i < config.shards_count; ++i) {
+    server_destroy_shard(&shards[i]);
+  }
+  free(shards);
+  server_destroy_intern_table(&InternTable);
+  server_close_trace();
+  server_stop_log();
 
   return 0;
 }
@@ -5,32 +5,201 @@
 #include <string.h>
 
 #include "server_log.h"
+#include "server_trace.h"
+#include "server_tuple_index.h"
 
-void server_add_connection_node(server_active_connections_t* connection_list,
-                                ts_ipv4_t receiver_ip, ts_port_t receiver_port,
-                                ts_tuple_field_t* data_tuple,
-                                ts_size_t tuple_size,
-                                ts_bool_t insert_if_rejected,
-                                ts_bool_t ping_for_await) {
-  server_connection_node_t** root_node = &connection_list->list;
+void server_initialize_active_connections(
+    server_active_connections_t* connection_list,
+    ts_uint_t initial_resend_interval, ts_uint_t max_resend_interval) {
+  memset(connection_list, 0, sizeof(server_active_connections_t));
+  server_initialize_pool(&connection_list->node_pool,
+                         sizeof(server_connection_node_t));
+  server_initialize_timer_wheel(&connection_list->resend_timers,
+                                server_monotonic_time_ms());
+  connection_list->initial_resend_interval = initial_resend_interval;
+  connection_list->max_resend_interval = max_resend_interval;
+}
+
+void server_restart_connection_timer(
+    server_active_connections_t* connection_list,
+    server_connection_node_t* node) {
+  node->resend_interval = connection_list->initial_resend_interval;
+  node->last_send_time_us = server_monotonic_time_us();
+  server_schedule_timer(&connection_list->resend_timers, &node->resend_timer,
+                        server_monotonic_time_ms() + node->resend_interval);
+}
+
+void server_back_off_connection_timer(
+    server_active_connections_t* connection_list,
+    server_connection_node_t* node) {
+  node->resend_interval *= 2;
+  if (node->resend_interval > connection_list->max_resend_interval) {
+    node->resend_interval = connection_list->max_resend_interval;
+  }
+  node->last_send_time_us = server_monotonic_time_us();
+  server_schedule_timer(&connection_list->resend_timers, &node->resend_timer,
+                        server_monotonic_time_ms() + node->resend_interval);
+}
+
+void server_destroy_active_connections(
+    server_active_connections_t* connection_list) {
+  free(connection_list->slots);
+  server_destroy_pool(&connection_list->node_pool);
+  memset(connection_list, 0, sizeof(server_active_connections_t));
+}
+
+static ts_size_t server_connection_home_slot(ts_size_t slots_size,
+                                             ts_ipv4_t receiver_ip,
+                                             ts_port_t receiver_port) {
+  uint32_t hash = server_hash_bytes(SERVER_HASH_OFFSET_BASIS, &receiver_ip,
+                                    sizeof(ts_ipv4_t));
+  hash = server_hash_bytes(hash, &receiver_port, sizeof(ts_port_t));
+  return hash & (slots_size - 1);
+}
+
+// Returns the slot of the client, or the free slot where it would go.
+static server_connection_slot_t* server_find_connection_slot(
+    server_connection_slot_t* slots, ts_size_t slots_size,
+    ts_ipv4_t receiver_ip, ts_port_t receiver_port) {
+  ts_size_t slot =
+      server_connection_home_slot(slots_size, receiver_ip, receiver_port);
+  while ((slots[slot].nodes != NULL) &&
+         ((slots[slot].receiver_ip != receiver_ip) ||
+          (slots[slot].receiver_port != receiver_port))) {
+    slot = (slot + 1) & (slots_size - 1);
+  }
+  return &slots[slot];
+}
+
+static ts_bool_t server_grow_connection_table(
+    server_active_connections_t* connection_list) {
+  server_connection_slot_t* old_slots = connection_list->slots;
+  ts_size_t old_size = connection_list->slots_size;
+  ts_size_t new_size =
+      old_size ? old_size * 2 : SERVER_CONNECTION_TABLE_INITIAL_SIZE;
+  server_connection_slot_t* new_slots = (server_connection_slot_t*)calloc(
+      new_size, sizeof(server_connection_slot_t));
+  if (new_slots == NULL) {
+    return TS_FALSE;
+  }
+  connection_list->slots = new_slots;
+  connection_list->slots_size = new_size;
+  for (ts_size_t i = 0; i < old_size; ++i) {
+    if (old_slots[i].nodes != NULL) {
+      *server_find_connection_slot(connection_list->slots, new_size,
+                                   old_slots[i].receiver_ip,
+                                   old_slots[i].receiver_port) = old_slots[i];
+    }
+  }
+  free(old_slots);
+  return TS_TRUE;
+}
+
+// Backward-shift deletion keeps probe sequences intact without tombstones.
+static void server_release_connection_slot(
+    server_active_connections_t* connection_list,
+    server_connection_slot_t* slot) {
+  server_connection_slot_t* slots = connection_list->slots;
+  ts_size_t mask = connection_list->slots_size - 1;
+  ts_size_t hole = slot - slots;
+  ts_size_t current = hole;
+  for (;;) {
+    current = (current + 1) & mask;
+    if (slots[current].nodes == NULL) {
+      break;
+    }
+    ts_size_t home = server_connection_home_slot(
+        connection_list->slots_size, slots[current].receiver_ip,
+        slots[current].receiver_port);
+    if (((current - home) & mask) >= ((current - hole) & mask)) {
+      slots[hole] = slots[current];
+      hole = current;
+    }
+  }
+  memset(&slots[hole], 0, sizeof(server_connection_slot_t));
+  --connection_list->clients_count;
+}
+
+ts_bool_t server_add_connection_node(
+    server_active_connections_t* connection_list, ts_ipv4_t receiver_ip,
+    ts_port_t receiver_port, server_field_t* data_tuple, ts_size_t tuple_size,
+    ts_bool_t insert_if_rejected, ts_bool_t ping_for_await) {
+  if (((connection_list->clients_count + 1) * 2 >
+       connection_list->slots_size) &&
+      !server_grow_connection_table(connection_list)) {
+    return TS_FALSE;
+  }
   server_connection_node_t* new_node =
-      (server_connection_node_t*)malloc(sizeof(server_connection_node_t));
+      (server_connection_node_t*)server_pool_allocate(
+          &connection_list->node_pool);
+  if (new_node == NULL) {
+    return TS_FALSE;
+  }
   memset(new_node, 0, sizeof(server_connection_node_t));
   new_node->data_tuple = data_tuple;
   new_node->receiver_ip = receiver_ip;
   new_node->receiver_port = receiver_port;
-  new_node->insertion_time = server_current_time_ms();
   new_node->insert_if_rejected = insert_if_rejected;
   new_node->tuple_size = tuple_size;
   new_node->resend_counter = 0;
   new_node->ping_for_await = ping_for_await;
-  new_node->next_node = NULL;
-  if (*root_node == NULL) {
-    *root_node = new_node;
+  new_node->trace_request_id = server_current_trace_request_id();
+  new_node->next_node = connection_list->list;
+  if (connection_list->list != NULL) {
+    connection_list->list->previous_node = new_node;
+  }
+  connection_list->list = new_node;
+
+  server_connection_slot_t* slot = server_find_connection_slot(
+      connection_list->slots, connection_list->slots_size, receiver_ip,
+      receiver_port);
+  if (slot->nodes == NULL) {
+    slot->receiver_ip = receiver_ip;
+    slot->receiver_port = receiver_port;
+    ++connection_list->clients_count;
+  } else {
+    slot->nodes->previous_client_node = new_node;
+  }
+  new_node->next_client_node = slot->nodes;
+  slot->nodes = new_node;
+  server_restart_connection_timer(connection_list, new_node);
+  return TS_TRUE;
+}
+
+void server_erase_connection_node(server_active_connections_t* connection_list,
+                                  server_connection_node_t* node) {
+  server_cancel_timer(&connection_list->resend_timers, &node->resend_timer);
+  server_connection_node_t* previous =
+      (server_connection_node_t*)node->previous_node;
+  server_connection_node_t* next = (server_connection_node_t*)node->next_node;
+  if (previous != NULL) {
+    previous->next_node = next;
+  } else {
+    connection_list->list = next;
+  }
+  if (next != NULL) {
+    next->previous_node = previous;
+  }
+
+  server_connection_node_t* previous_client =
+      (server_connection_node_t*)node->previous_client_node;
+  server_connection_node_t* next_client =
+      (server_connection_node_t*)node->next_client_node;
+  if (next_client != NULL) {
+    next_client->previous_client_node = previous_client;
+  }
+  if (previous_client != NULL) {
+    previous_client->next_client_node = next_client;
   } else {
-    new_node->next_node = *root_node;
-    *root_node = new_node;
+    server_connection_slot_t* slot = server_find_connection_slot(
+        connection_list->slots, connection_list->slots_size,
+        node->receiver_ip, node->receiver_port);
+    slot->nodes = next_client;
+    if (next_client == NULL) {
+      server_release_connection_slot(connection_list, slot);
+    }
   }
+  server_pool_free(&connection_list->node_pool, node);
 }
 
 server_connection_node_t server_remove_connection_node(
@@ -38,18 +207,11 @@ server_connection_node_t server_remove_connection_node(
     ts_port_t receiver_port) {
   server_connection_node_t result;
   memset(&result, 0, sizeof(server_connection_node_t));
-  server_connection_node_t** node = &connection_list->list;
-  for (; *node != NULL;
-       node = (server_connection_node_t**)&(*node)->next_node) {
-    if (((*node)->receiver_ip == receiver_ip) &&
-        ((*node)->receiver_port == receiver_port)) {
-      ts_tuple_field_t* data_tuple = (*node)->data_tuple;
-      server_connection_node_t* old_node = *node;
-      result = *old_node;
-      *node = (*node)->next_node;
-      free(old_node);
-      return result;
-    }
+  server_connection_node_t* node =
+      server_find_connection_node(connection_list, receiver_ip, receiver_port);
+  if (node != NULL) {
+    result = *node;
+    server_erase_connection_node(connection_list, node);
   }
   return result;
 }
@@ -57,12 +219,11 @@ server_connection_node_t server_remove_connection_node(
 server_connection_node_t* server_find_connection_node(
     server_active_connections_t* connection_list, ts_ipv4_t receiver_ip,
     ts_port_t receiver_port) {
-  server_connection_node_t* node = connection_list->list;
-  for (; node != NULL; node = (server_connection_node_t*)node->next_node) {
-    if ((node->receiver_ip == receiver_ip) &&
-        (node->receiver_port == receiver_ip)) {
-      return node;
-    }
+  if (connection_list->slots == NULL) {
+    return NULL;
   }
-  return NULL;
+  return server_find_connection_slot(connection_list->slots,
+                                     connection_list->slots_size, receiver_ip,
+                                     receiver_port)
+      ->nodes;
 }
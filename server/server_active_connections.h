@@ -2,34 +2,96 @@
 #define __SERVER_ACTIVE_CONNECTIONS_H__
 
 #include "../libts/common/tuple_space_network.h"
+#include "server_field.h"
+#include "server_pool.h"
+#include "server_timer_wheel.h"
 
+#define SERVER_CONNECTION_TABLE_INITIAL_SIZE 64
+
+// Nodes are linked twice: into the list of all connections, walked by the
+// resend loop, and into a newest-first list of the nodes of the same client,
+// reached through the client's slot in the connection table.
+// The resend timer of a node first fires after the initial interval of the
+// table, and every later one waits twice as long, up to the max interval.
 typedef struct {
   void* next_node;
+  void* previous_node;
+  void* next_client_node;
+  void* previous_client_node;
+  server_timer_t resend_timer;
   ts_ipv4_t receiver_ip;
   ts_port_t receiver_port;
-  ts_tuple_field_t* data_tuple;
+  server_field_t* data_tuple;
   ts_size_t tuple_size;
   ts_size_t resend_counter;
-  ts_uint_t insertion_time;
+  ts_uint_t resend_interval;
+  uint64_t last_send_time_us;  // the timer is (re)armed on every send
+  uint64_t trace_request_id;   // 0 unless the request is traced
   ts_bool_t insert_if_rejected;
   ts_bool_t ping_for_await;
 } server_connection_node_t;
 
+#define SERVER_CONNECTION_TIMER_NODE(timer)                      \
+  ((server_connection_node_t*)((char*)(timer) -                  \
+                               offsetof(server_connection_node_t, \
+                                        resend_timer)))
+
+// Open addressing with linear probing, one slot per client; a slot is free
+// when it has no nodes.
+typedef struct {
+  ts_ipv4_t receiver_ip;
+  ts_port_t receiver_port;
+  server_connection_node_t* nodes;
+} server_connection_slot_t;
+
 typedef struct {
   server_connection_node_t* list;
+  server_connection_slot_t* slots;
+  ts_size_t slots_size;
+  ts_size_t clients_count;
+  server_pool_t node_pool;
+  server_timer_wheel_t resend_timers;
+  ts_uint_t initial_resend_interval;
+  ts_uint_t max_resend_interval;
 } server_active_connections_t;
 
-void server_add_connection_node(server_active_connections_t* connection_list,
-                                ts_ipv4_t receiver_ip, ts_port_t receiver_port,
-                                ts_tuple_field_t* data_tuple,
-                                ts_size_t tuple_size,
-                                ts_bool_t insert_if_rejected,
-                                ts_bool_t ping_for_await);
+void server_initialize_active_connections(
+    server_active_connections_t* connection_list,
+    ts_uint_t initial_resend_interval, ts_uint_t max_resend_interval);
+
+void server_destroy_active_connections(
+    server_active_connections_t* connection_list);
+
+// Returns TS_FALSE, leaving the table as it was, when the node or a larger
+// table cannot be allocated.
+ts_bool_t server_add_connection_node(
+    server_active_connections_t* connection_list, ts_ipv4_t receiver_ip,
+    ts_port_t receiver_port, server_field_t* data_tuple, ts_size_t tuple_size,
+    ts_bool_t insert_if_rejected, ts_bool_t ping_for_await);
+
+// Restarts the backoff of the node: its timer fires after the initial
+// interval again.
+void server_restart_connection_timer(
+    server_active_connections_t* connection_list,
+    server_connection_node_t* node);
+
+// Schedules the next resend of the node after doubling its interval.
+void server_back_off_connection_timer(
+    server_active_connections_t* connection_list,
+    server_connection_node_t* node);
+
+// Unlinks the node from both lists, cancels its timer and returns it to the
+// pool.
+void server_erase_connection_node(server_active_connections_t* connection_list,
+                                  server_connection_node_t* node);
 
+// Removes the newest node of the client and returns a copy of it; the copy
+// is zeroed when the client has none.
 server_connection_node_t server_remove_connection_node(
     server_active_connections_t* connection_list, ts_ipv4_t receiver_ip,
     ts_port_t receiver_port);
 
+// Returns the newest node of the client or NULL.
 server_connection_node_t* server_find_connection_node(
     server_active_connections_t* connection_list, ts_ipv4_t receiver_ip,
     ts_port_t receiver_port);
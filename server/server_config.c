@@ -0,0 +1,243 @@
+#include "server_config.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+server_config_t server_initialize_config(void) {
+  server_config_t config;
+  memset(&config, 0, sizeof(server_config_t));
+  config.dispatch_mode = SERVER_DISPATCH_FIFO;
+  config.device_backend = SERVER_DEVICE_EPOLL;
+  config.shards_count = 1;
+  config.stash_mode = SERVER_STASH_PARTITIONED;
+  config.storage_mode = SERVER_STORAGE_COMPACT;
+  config.is_pipelined = TS_FALSE;
+  config.log_level = SERVER_LOG_LEVEL_INFO;
+  config.metrics_path = NULL;
+  config.trace_path = NULL;
+  config.trace_sample_interval = SERVER_TRACE_DEFAULT_SAMPLE_INTERVAL;
+  config.profile_top = 0;
+  return config;
+}
+
+static ts_bool_t server_parse_dispatch_mode(const char* value,
+                                            server_dispatch_mode_t* mode) {
+  if (strcmp(value, "lifo") == 0) {
+    *mode = SERVER_DISPATCH_LIFO;
+  } else if (strcmp(value, "fifo") == 0) {
+    *mode = SERVER_DISPATCH_FIFO;
+  } else if (strcmp(value, "round-robin") == 0) {
+    *mode = SERVER_DISPATCH_ROUND_ROBIN;
+  } else {
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_device_backend(
+    const char* value, server_device_backend_t* backend) {
+  if (strcmp(value, "epoll") == 0) {
+    *backend = SERVER_DEVICE_EPOLL;
+  } else if (strcmp(value, "io_uring") == 0) {
+    *backend = SERVER_DEVICE_IO_URING;
+  } else {
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_shards_count(const char* value,
+                                           size_t* shards_count) {
+  char* end;
+  unsigned long count = strtoul(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || count == 0 ||
+      count > SERVER_MAX_SHARDS) {
+    return TS_FALSE;
+  }
+  *shards_count = (size_t)count;
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_stash_mode(const char* value,
+                                         server_stash_mode_t* mode) {
+  if (strcmp(value, "partitioned") == 0) {
+    *mode = SERVER_STASH_PARTITIONED;
+  } else if (strcmp(value, "shared") == 0) {
+    *mode = SERVER_STASH_SHARED;
+  } else {
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_storage_mode(const char* value,
+                                           server_storage_mode_t* mode) {
+  if (strcmp(value, "compact") == 0) {
+    *mode = SERVER_STORAGE_COMPACT;
+  } else if (strcmp(value, "wire") == 0) {
+    *mode = SERVER_STORAGE_WIRE;
+  } else {
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_log_level(const char* value,
+                                        server_log_level_t* level) {
+  if (strcmp(value, "debug") == 0) {
+    *level = SERVER_LOG_LEVEL_DEBUG;
+  } else if (strcmp(value, "info") == 0) {
+    *level = SERVER_LOG_LEVEL_INFO;
+  } else if (strcmp(value, "warning") == 0) {
+    *level = SERVER_LOG_LEVEL_WARNING;
+  } else if (strcmp(value, "error") == 0) {
+    *level = SERVER_LOG_LEVEL_ERROR;
+  } else if (strcmp(value, "off") == 0) {
+    *level = SERVER_LOG_LEVEL_OFF;
+  } else {
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_sample_interval(const char* value,
+                                              uint32_t* sample_interval) {
+  char* end;
+  unsigned long interval = strtoul(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || interval == 0 ||
+      interval > UINT32_MAX) {
+    return TS_FALSE;
+  }
+  *sample_interval = (uint32_t)interval;
+  return TS_TRUE;
+}
+
+static ts_bool_t server_parse_profile_top(const char* value,
+                                          size_t* profile_top) {
+  char* end;
+  unsigned long top = strtoul(value, &end, 10);
+  if (*value == '\0' || *end != '\0') {
+    return TS_FALSE;
+  }
+  *profile_top = (size_t)top;
+  return TS_TRUE;
+}
+
+static void server_print_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--dispatch=lifo|fifo|round-robin] "
+          "[--device=epoll|io_uring] [--shards=N] "
+          "[--stash=partitioned|shared] [--storage=compact|wire] "
+          "[--pipeline] "
+          "[--log-level=debug|info|warning|error|off] "
+          "[--metrics-file=PATH] [--trace-file=PATH] [--trace-sample=N] "
+          "[--profile-top=N]\n",
+          program);
+}
+
+ts_bool_t server_parse_config(server_config_t* config, int argc, char** argv) {
+  static const struct option options[] = {
+      {"dispatch", required_argument, NULL, 'd'},
+      {"device", required_argument, NULL, 'b'},
+      {"shards", required_argument, NULL, 's'},
+      {"stash", required_argument, NULL, 't'},
+      {"storage", required_argument, NULL, 'w'},
+      {"pipeline", no_argument, NULL, 'p'},
+      {"log-level", required_argument, NULL, 'l'},
+      {"metrics-file", required_argument, NULL, 'm'},
+      {"trace-file", required_argument, NULL, 'r'},
+      {"trace-sample", required_argument, NULL, 'S'},
+      {"profile-top", required_argument, NULL, 'P'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  int option;
+  while ((option = getopt_long(argc, argv, "d:b:s:t:w:pl:m:r:S:P:h", options,
+                               NULL)) != -1) {
+    switch (option) {
+      case 'd':
+        if (!server_parse_dispatch_mode(optarg, &config->dispatch_mode)) {
+          fprintf(stderr, "Unknown dispatch mode: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 'b':
+        if (!server_parse_device_backend(optarg, &config->device_backend)) {
+          fprintf(stderr, "Unknown device backend: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 's':
+        if (!server_parse_shards_count(optarg, &config->shards_count)) {
+          fprintf(stderr, "Invalid shards count: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 't':
+        if (!server_parse_stash_mode(optarg, &config->stash_mode)) {
+          fprintf(stderr, "Unknown stash mode: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 'w':
+        if (!server_parse_storage_mode(optarg, &config->storage_mode)) {
+          fprintf(stderr, "Unknown storage mode: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 'p':
+        config->is_pipelined = TS_TRUE;
+        break;
+      case 'l':
+        if (!server_parse_log_level(optarg, &config->log_level)) {
+          fprintf(stderr, "Unknown log level: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 'm':
+        config->metrics_path = optarg;
+        break;
+      case 'r':
+        config->trace_path = optarg;
+        break;
+      case 'S':
+        if (!server_parse_sample_interval(optarg,
+                                          &config->trace_sample_interval)) {
+          fprintf(stderr, "Invalid trace sample interval: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      case 'P':
+        if (!server_parse_profile_top(optarg, &config->profile_top)) {
+          fprintf(stderr, "Invalid profile top count: %s\n", optarg);
+          server_print_usage(argv[0]);
+          return TS_FALSE;
+        }
+        break;
+      default:
+        server_print_usage(argv[0]);
+        return TS_FALSE;
+    }
+  }
+  if (config->shards_count > 1 &&
+      config->device_backend != SERVER_DEVICE_EPOLL) {
+    fprintf(stderr, "Sharding is only supported by the epoll device\n");
+    return TS_FALSE;
+  }
+  if (config->is_pipelined &&
+      (config->shards_count > 1 ||
+       config->device_backend != SERVER_DEVICE_EPOLL)) {
+    fprintf(stderr,
+            "Pipelining is only supported by a single epoll device shard\n");
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
@@ -0,0 +1,47 @@
+#ifndef __SERVER_CONFIG_H__
+#define __SERVER_CONFIG_H__
+
+#include "../libts/common/tuple_space.h"
+#include "server_log.h"
+#include "server_trace.h"
+#include "server_tuple_space.h"
+
+typedef enum {
+  SERVER_DEVICE_EPOLL = 0,
+  SERVER_DEVICE_IO_URING = 1
+} server_device_backend_t;
+
+typedef enum {
+  SERVER_STASH_PARTITIONED = 0,
+  SERVER_STASH_SHARED = 1
+} server_stash_mode_t;
+
+// Wire storage keeps the serialized form of every stored tuple next to its
+// compact fields, so that replies and resends copy it instead of serializing
+// the tuple again.
+typedef enum {
+  SERVER_STORAGE_COMPACT = 0,
+  SERVER_STORAGE_WIRE = 1
+} server_storage_mode_t;
+
+#define SERVER_MAX_SHARDS 64
+
+typedef struct {
+  server_dispatch_mode_t dispatch_mode;
+  server_device_backend_t device_backend;
+  size_t shards_count;
+  server_stash_mode_t stash_mode;
+  server_storage_mode_t storage_mode;
+  ts_bool_t is_pipelined;
+  server_log_level_t log_level;
+  const char* metrics_path;  // NULL prints the metrics to stdout
+  const char* trace_path;    // NULL disables tracing
+  uint32_t trace_sample_interval;
+  size_t profile_top;  // 0 disables the lookup profile
+} server_config_t;
+
+server_config_t server_initialize_config(void);
+
+ts_bool_t server_parse_config(server_config_t* config, int argc, char** argv);
+
+#endif  // __SERVER_CONFIG_H__
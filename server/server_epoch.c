@@ -0,0 +1,120 @@
+#include "server_epoch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SERVER_EPOCH_LIMBO_INITIAL_CAPACITY 64
+
+static _Thread_local server_epoch_domain_t* ServerEpochDomain;
+static _Thread_local server_epoch_participant_t* ServerEpochParticipant;
+
+void server_initialize_epoch_domain(server_epoch_domain_t* domain) {
+  memset(domain, 0, sizeof(server_epoch_domain_t));
+}
+
+ts_bool_t server_register_epoch_participant(server_epoch_domain_t* domain) {
+  size_t slot =
+      __atomic_fetch_add(&domain->participants_count, 1, __ATOMIC_ACQ_REL);
+  if (slot >= SERVER_EPOCH_MAX_PARTICIPANTS) {
+    return TS_FALSE;
+  }
+  ServerEpochDomain = domain;
+  ServerEpochParticipant = &domain->participants[slot];
+  return TS_TRUE;
+}
+
+void server_epoch_enter(void) {
+  if (ServerEpochParticipant == NULL) {
+    return;
+  }
+  uint64_t epoch =
+      __atomic_load_n(&ServerEpochDomain->global_epoch, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&ServerEpochParticipant->state, (epoch << 1) | 1,
+                   __ATOMIC_RELAXED);
+  // Published before any shared pointer is read
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void server_epoch_exit(void) {
+  if (ServerEpochParticipant == NULL) {
+    return;
+  }
+  __atomic_store_n(&ServerEpochParticipant->state, 0, __ATOMIC_RELEASE);
+}
+
+static void server_epoch_free_limbo(server_epoch_limbo_t* limbo) {
+  for (ts_size_t i = 0; i < limbo->size; ++i) {
+    server_epoch_retired_t* retired = &limbo->entries[i];
+    retired->free_cb(retired->context, retired->memory, retired->size);
+  }
+  limbo->size = 0;
+}
+
+ts_bool_t server_epoch_retire(void* memory, ts_size_t size,
+                              server_epoch_free_cb_t free_cb, void* context) {
+  if (ServerEpochParticipant == NULL) {
+    return TS_FALSE;
+  }
+  uint64_t epoch =
+      __atomic_load_n(&ServerEpochDomain->global_epoch, __ATOMIC_ACQUIRE);
+  server_epoch_limbo_t* limbo =
+      &ServerEpochParticipant->limbo[epoch % SERVER_EPOCH_LIMBO_LISTS];
+  if (limbo->epoch != epoch) {
+    // Left over from at least SERVER_EPOCH_LIMBO_LISTS epochs ago
+    server_epoch_free_limbo(limbo);
+    limbo->epoch = epoch;
+  }
+  if (limbo->size == limbo->capacity) {
+    ts_size_t capacity = limbo->capacity
+                             ? limbo->capacity * 2
+                             : SERVER_EPOCH_LIMBO_INITIAL_CAPACITY;
+    server_epoch_retired_t* entries = (server_epoch_retired_t*)realloc(
+        limbo->entries, capacity * sizeof(server_epoch_retired_t));
+    if (entries == NULL) {
+      // Leaked, freeing it here could pull it from under a reader
+      return TS_TRUE;
+    }
+    limbo->entries = entries;
+    limbo->capacity = capacity;
+  }
+  server_epoch_retired_t* retired = &limbo->entries[limbo->size++];
+  retired->memory = memory;
+  retired->size = size;
+  retired->free_cb = free_cb;
+  retired->context = context;
+  return TS_TRUE;
+}
+
+static void server_epoch_try_advance(server_epoch_domain_t* domain) {
+  uint64_t epoch = __atomic_load_n(&domain->global_epoch, __ATOMIC_ACQUIRE);
+  size_t participants_count =
+      __atomic_load_n(&domain->participants_count, __ATOMIC_ACQUIRE);
+  if (participants_count > SERVER_EPOCH_MAX_PARTICIPANTS) {
+    participants_count = SERVER_EPOCH_MAX_PARTICIPANTS;
+  }
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (size_t i = 0; i < participants_count; ++i) {
+    uint64_t state =
+        __atomic_load_n(&domain->participants[i].state, __ATOMIC_ACQUIRE);
+    if ((state & 1) && ((state >> 1) != epoch)) {
+      return;
+    }
+  }
+  __atomic_compare_exchange_n(&domain->global_epoch, &epoch, epoch + 1,
+                              TS_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+void server_epoch_collect(void) {
+  if (ServerEpochParticipant == NULL) {
+    return;
+  }
+  server_epoch_try_advance(ServerEpochDomain);
+  uint64_t epoch =
+      __atomic_load_n(&ServerEpochDomain->global_epoch, __ATOMIC_ACQUIRE);
+  for (size_t i = 0; i < SERVER_EPOCH_LIMBO_LISTS; ++i) {
+    server_epoch_limbo_t* limbo = &ServerEpochParticipant->limbo[i];
+    if ((limbo->size > 0) && (limbo->epoch + 2 <= epoch)) {
+      server_epoch_free_limbo(limbo);
+    }
+  }
+}
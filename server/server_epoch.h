@@ -0,0 +1,64 @@
+#ifndef __SERVER_EPOCH_H__
+#define __SERVER_EPOCH_H__
+
+#include <stddef.h>
+
+#include "../libts/common/tuple_space.h"
+
+#define SERVER_EPOCH_MAX_PARTICIPANTS 64
+#define SERVER_EPOCH_LIMBO_LISTS 3
+
+typedef void (*server_epoch_free_cb_t)(void* context, void* memory,
+                                       ts_size_t size);
+
+typedef struct {
+  void* memory;
+  ts_size_t size;
+  server_epoch_free_cb_t free_cb;
+  void* context;
+} server_epoch_retired_t;
+
+typedef struct {
+  server_epoch_retired_t* entries;
+  ts_size_t size;
+  ts_size_t capacity;
+  uint64_t epoch;
+} server_epoch_limbo_t;
+
+// The state is the observed epoch shifted left by one with the lowest bit
+// set while the thread is inside a critical section, 0 otherwise.
+typedef struct {
+  uint64_t state __attribute__((aligned(64)));
+  server_epoch_limbo_t limbo[SERVER_EPOCH_LIMBO_LISTS];
+} server_epoch_participant_t;
+
+// Memory unlinked from a shared structure is retired instead of freed, and
+// released once every thread has left the critical sections that could
+// still see it. The epoch only advances when all active threads observed the
+// current one, so anything retired two epochs ago is unreachable.
+typedef struct {
+  uint64_t global_epoch __attribute__((aligned(64)));
+  size_t participants_count;
+  server_epoch_participant_t participants[SERVER_EPOCH_MAX_PARTICIPANTS];
+} server_epoch_domain_t;
+
+void server_initialize_epoch_domain(server_epoch_domain_t* domain);
+
+// Registers the calling thread, the functions below act on the participant
+// of the calling thread and do nothing for unregistered threads.
+ts_bool_t server_register_epoch_participant(server_epoch_domain_t* domain);
+
+void server_epoch_enter(void);
+
+void server_epoch_exit(void);
+
+// Returns TS_FALSE when the calling thread is not registered, the memory
+// can be freed right away then.
+ts_bool_t server_epoch_retire(void* memory, ts_size_t size,
+                              server_epoch_free_cb_t free_cb, void* context);
+
+// Tries to advance the epoch and frees what the calling thread retired long
+// enough ago. Must be called outside of a critical section.
+void server_epoch_collect(void);
+
+#endif  // __SERVER_EPOCH_H__
@@ -0,0 +1,232 @@
+#include "server_field.h"
+
+#include <string.h>
+
+ts_tuple_field_type_t server_field_get_type(const server_field_t* field) {
+  return (ts_tuple_field_type_t)(field->flags & 0x1f);
+}
+
+ts_bool_t server_field_contains_data(const server_field_t* field) {
+  return (field->flags & 0x80) != 0;
+}
+
+ts_bool_t server_field_is_inline_string(const server_field_t* field) {
+  return (field->flags & 0x20) != 0;
+}
+
+static ts_bool_t server_is_interned_field(const server_field_t* field) {
+  return server_field_get_type(field) == TS_FIELD_TYPE_STRING &&
+         server_field_contains_data(field) &&
+         !server_field_is_inline_string(field);
+}
+
+static ts_bool_t server_compact_string(server_intern_table_t* table,
+                                       server_field_t* field,
+                                       const char* string, ts_size_t length) {
+  if (length < SERVER_INLINE_STRING_SIZE) {
+    field->flags |= 0x20;
+    memcpy(field->data.inline_string, string, length);
+    return TS_TRUE;
+  }
+  return server_intern_string(table, string, length, &field->data.string_id);
+}
+
+ts_bool_t server_compact_fields(server_intern_table_t* table,
+                                server_field_t* fields,
+                                const ts_tuple_field_t* tuple,
+                                ts_size_t tuple_size) {
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    const ts_tuple_field_t* field = &tuple[i];
+    server_field_t* compact_field = &fields[i];
+    memset(compact_field, 0, sizeof(server_field_t));
+    compact_field->flags = field->flags & 0xdf;
+    if (!ts_tuple_field_contains_data(field)) {
+      continue;
+    }
+    switch (ts_tuple_field_get_type(field)) {
+      case TS_FIELD_TYPE_STRING: {
+        ts_string_t string = ts_tuple_field_string(field);
+        if (!server_compact_string(table, compact_field, string,
+                                   (ts_size_t)strlen(string))) {
+          server_release_field_strings(table, fields, i);
+          return TS_FALSE;
+        }
+        break;
+      }
+      case TS_FIELD_TYPE_BOOL:
+        compact_field->data.bool_field = field->data.bool_field;
+        break;
+      case TS_FIELD_TYPE_FLOAT:
+        compact_field->data.float_field = field->data.float_field;
+        break;
+      case TS_FIELD_TYPE_INT:
+        compact_field->data.int_field = field->data.int_field;
+        break;
+      case TS_FIELD_TYPE_UINT:
+        compact_field->data.uint_field = field->data.uint_field;
+        break;
+      default:
+        break;
+    }
+  }
+  return TS_TRUE;
+}
+
+ts_bool_t server_compact_view_fields(server_intern_table_t* table,
+                                     server_field_t* fields,
+                                     const ts_tuple_view_t* view) {
+  for (ts_size_t i = 0; i < view->tuple_size; ++i) {
+    server_field_t* compact_field = &fields[i];
+    memset(compact_field, 0, sizeof(server_field_t));
+    compact_field->flags = view->buffer[view->field_offsets[i]];
+    if (!ts_tuple_view_field_contains_data(view, i)) {
+      continue;
+    }
+    switch (ts_tuple_view_field_type(view, i)) {
+      case TS_FIELD_TYPE_STRING: {
+        const char* string;
+        ts_size_t length;
+        ts_tuple_view_get_string(view, i, &string, &length);
+        if (!server_compact_string(table, compact_field, string, length)) {
+          server_release_field_strings(table, fields, i);
+          return TS_FALSE;
+        }
+        break;
+      }
+      case TS_FIELD_TYPE_BOOL:
+        ts_tuple_view_get_bool(view, i, &compact_field->data.bool_field);
+        break;
+      case TS_FIELD_TYPE_FLOAT:
+        ts_tuple_view_get_float(view, i, &compact_field->data.float_field);
+        break;
+      case TS_FIELD_TYPE_INT:
+        ts_tuple_view_get_int(view, i, &compact_field->data.int_field);
+        break;
+      case TS_FIELD_TYPE_UINT:
+        ts_tuple_view_get_uint(view, i, &compact_field->data.uint_field);
+        break;
+      default:
+        break;
+    }
+  }
+  return TS_TRUE;
+}
+
+void server_expand_fields(server_intern_table_t* table,
+                          ts_tuple_field_t* tuple,
+                          const server_field_t* fields, ts_size_t tuple_size) {
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    const server_field_t* field = &fields[i];
+    ts_tuple_field_t* expanded_field = &tuple[i];
+    memset(expanded_field, 0, sizeof(ts_tuple_field_t));
+    expanded_field->flags = field->flags;
+    if (!server_field_contains_data(field)) {
+      continue;
+    }
+    switch (server_field_get_type(field)) {
+      case TS_FIELD_TYPE_STRING:
+        if (server_field_is_inline_string(field)) {
+          memcpy(expanded_field->data.inline_string,
+                 field->data.inline_string, SERVER_INLINE_STRING_SIZE);
+        } else {
+          expanded_field->data.string_field =
+              server_interned_string(table, field->data.string_id);
+        }
+        break;
+      case TS_FIELD_TYPE_BOOL:
+        expanded_field->data.bool_field = field->data.bool_field;
+        break;
+      case TS_FIELD_TYPE_FLOAT:
+        expanded_field->data.float_field = field->data.float_field;
+        break;
+      case TS_FIELD_TYPE_INT:
+        expanded_field->data.int_field = field->data.int_field;
+        break;
+      case TS_FIELD_TYPE_UINT:
+        expanded_field->data.uint_field = field->data.uint_field;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void server_retain_field_strings(server_intern_table_t* table,
+                                 const server_field_t* fields,
+                                 ts_size_t tuple_size) {
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    if (server_is_interned_field(&fields[i])) {
+      server_retain_string(table, fields[i].data.string_id);
+    }
+  }
+}
+
+void server_release_field_strings(server_intern_table_t* table,
+                                  const server_field_t* fields,
+                                  ts_size_t tuple_size) {
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    if (server_is_interned_field(&fields[i])) {
+      server_release_string(table, fields[i].data.string_id);
+    }
+  }
+}
+
+ts_tuple_signature_t server_fields_signature(const server_field_t* fields,
+                                             ts_size_t tuple_size) {
+  const ts_tuple_signature_t field_mask =
+      (1 << TS_TUPLE_SIGNATURE_FIELD_BITS) - 1;
+  ts_tuple_signature_t signature = 0;
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    signature |= (server_field_get_type(&fields[i]) & field_mask)
+                 << (i * TS_TUPLE_SIGNATURE_FIELD_BITS);
+  }
+  return signature;
+}
+
+ts_bool_t server_do_all_fields_contain_data(const server_field_t* fields,
+                                            ts_size_t fields_count) {
+  for (ts_size_t i = 0; i < fields_count; ++i) {
+    if (!server_field_contains_data(&fields[i])) {
+      return TS_FALSE;
+    }
+  }
+  return TS_TRUE;
+}
+
+// Equal strings have equal lengths, so they are either both inline or both
+// interned under the same id; the inline flag keeps an id from comparing
+// equal to inline characters with the same bits.
+ts_bool_t server_is_matching_fields(const server_field_t* template_fields,
+                                    const server_field_t* data_fields,
+                                    ts_size_t tuple_size) {
+  for (ts_size_t i = 0; i < tuple_size; ++i) {
+    const server_field_t* template_field = &template_fields[i];
+    const server_field_t* data_field = &data_fields[i];
+    if (!server_field_contains_data(template_field)) {
+      continue;
+    }
+    switch (server_field_get_type(template_field)) {
+      case TS_FIELD_TYPE_FLOAT:
+        if (template_field->data.float_field != data_field->data.float_field) {
+          return TS_FALSE;
+        }
+        break;
+      case TS_FIELD_TYPE_STRING:
+        if (server_field_is_inline_string(template_field) !=
+            server_field_is_inline_string(data_field)) {
+          return TS_FALSE;
+        }
+        // fall through
+      case TS_FIELD_TYPE_BOOL:
+      case TS_FIELD_TYPE_INT:
+      case TS_FIELD_TYPE_UINT:
+        if (template_field->data.bits != data_field->data.bits) {
+          return TS_FALSE;
+        }
+        break;
+      default:
+        return TS_FALSE;
+    }
+  }
+  return TS_TRUE;
+}
@@ -0,0 +1,71 @@
+#ifndef __SERVER_FIELD_H__
+#define __SERVER_FIELD_H__
+
+#include "../libts/common/tuple_space.h"
+#include "../libts/common/tuple_space_serialization.h"
+#include "server_intern.h"
+
+#define SERVER_INLINE_STRING_SIZE 4
+
+// Tuples the server holds keep their fields in this form instead of
+// ts_tuple_field_t, whose union pads every field to 16 bytes on 64-bit
+// hosts. The flags are those of the field it was made from, the type bits
+// included. Strings shorter than SERVER_INLINE_STRING_SIZE are kept inline,
+// the rest by their id in the intern table. Fields turn back into
+// ts_tuple_field_t only to be sent or logged.
+typedef struct {
+  ts_byte_t flags;
+  union {
+    ts_bool_t bool_field;
+    ts_uint_t uint_field;
+    ts_int_t int_field;
+    ts_float_t float_field;
+    uint32_t string_id;
+    char inline_string[SERVER_INLINE_STRING_SIZE];
+    uint32_t bits;
+  } data;
+} server_field_t;
+
+ts_tuple_field_type_t server_field_get_type(const server_field_t* field);
+
+ts_bool_t server_field_contains_data(const server_field_t* field);
+
+ts_bool_t server_field_is_inline_string(const server_field_t* field);
+
+// Interns the strings of the tuple. On failure nothing is left interned.
+ts_bool_t server_compact_fields(server_intern_table_t* table,
+                                server_field_t* fields,
+                                const ts_tuple_field_t* tuple,
+                                ts_size_t tuple_size);
+
+// server_compact_fields for a template read in place from a datagram.
+ts_bool_t server_compact_view_fields(server_intern_table_t* table,
+                                     server_field_t* fields,
+                                     const ts_tuple_view_t* view);
+
+// Strings of the expanded tuple point into the fields or into the intern
+// table, so it lives no longer than the fields do.
+void server_expand_fields(server_intern_table_t* table,
+                          ts_tuple_field_t* tuple,
+                          const server_field_t* fields, ts_size_t tuple_size);
+
+void server_retain_field_strings(server_intern_table_t* table,
+                                 const server_field_t* fields,
+                                 ts_size_t tuple_size);
+
+void server_release_field_strings(server_intern_table_t* table,
+                                  const server_field_t* fields,
+                                  ts_size_t tuple_size);
+
+ts_tuple_signature_t server_fields_signature(const server_field_t* fields,
+                                             ts_size_t tuple_size);
+
+ts_bool_t server_do_all_fields_contain_data(const server_field_t* fields,
+                                            ts_size_t fields_count);
+
+// ts_is_matching_tuple for fields of the same signature.
+ts_bool_t server_is_matching_fields(const server_field_t* template_fields,
+                                    const server_field_t* data_fields,
+                                    ts_size_t tuple_size);
+
+#endif  // __SERVER_FIELD_H__
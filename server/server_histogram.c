@@ -0,0 +1,77 @@
+#include "server_histogram.h"
+
+#include <string.h>
+
+#define SERVER_HISTOGRAM_HALF_SUB_BUCKETS (SERVER_HISTOGRAM_SUB_BUCKETS / 2)
+
+static size_t server_histogram_index(uint64_t value) {
+  if (value < SERVER_HISTOGRAM_SUB_BUCKETS) {
+    return (size_t)value;
+  }
+  // Keeps the top SERVER_HISTOGRAM_SUB_BUCKET_BITS bits of the value
+  size_t shift = 63 - __builtin_clzll(value) -
+                 (SERVER_HISTOGRAM_SUB_BUCKET_BITS - 1);
+  if (shift > SERVER_HISTOGRAM_MAX_SHIFT) {
+    return SERVER_HISTOGRAM_BUCKETS - 1;
+  }
+  return SERVER_HISTOGRAM_SUB_BUCKETS +
+         (shift - 1) * SERVER_HISTOGRAM_HALF_SUB_BUCKETS +
+         (size_t)(value >> shift) - SERVER_HISTOGRAM_HALF_SUB_BUCKETS;
+}
+
+static uint64_t server_histogram_upper_bound(size_t index) {
+  if (index < SERVER_HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+  index -= SERVER_HISTOGRAM_SUB_BUCKETS;
+  size_t shift = index / SERVER_HISTOGRAM_HALF_SUB_BUCKETS + 1;
+  uint64_t mantissa = index % SERVER_HISTOGRAM_HALF_SUB_BUCKETS +
+                      SERVER_HISTOGRAM_HALF_SUB_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void server_initialize_histogram(server_histogram_t* histogram) {
+  memset(histogram, 0, sizeof(server_histogram_t));
+}
+
+void server_record_histogram(server_histogram_t* histogram, uint64_t value) {
+  ++histogram->buckets[server_histogram_index(value)];
+  ++histogram->count;
+  histogram->sum += value;
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+void server_merge_histogram(server_histogram_t* histogram,
+                            const server_histogram_t* other) {
+  for (size_t i = 0; i < SERVER_HISTOGRAM_BUCKETS; ++i) {
+    histogram->buckets[i] += other->buckets[i];
+  }
+  histogram->count += other->count;
+  histogram->sum += other->sum;
+  if (other->max > histogram->max) {
+    histogram->max = other->max;
+  }
+}
+
+uint64_t server_histogram_quantile(const server_histogram_t* histogram,
+                                   double quantile) {
+  if (histogram->count == 0) {
+    return 0;
+  }
+  double position = quantile * histogram->count;
+  uint64_t rank = (uint64_t)position;
+  if (rank < position || rank == 0) {
+    ++rank;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < SERVER_HISTOGRAM_BUCKETS; ++i) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t bound = server_histogram_upper_bound(i);
+      return bound < histogram->max ? bound : histogram->max;
+    }
+  }
+  return histogram->max;
+}
@@ -0,0 +1,37 @@
+#ifndef __SERVER_HISTOGRAM_H__
+#define __SERVER_HISTOGRAM_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define SERVER_HISTOGRAM_SUB_BUCKET_BITS 5
+#define SERVER_HISTOGRAM_SUB_BUCKETS (1 << SERVER_HISTOGRAM_SUB_BUCKET_BITS)
+#define SERVER_HISTOGRAM_MAX_SHIFT 36
+#define SERVER_HISTOGRAM_BUCKETS   \
+  (SERVER_HISTOGRAM_SUB_BUCKETS + \
+   SERVER_HISTOGRAM_MAX_SHIFT * (SERVER_HISTOGRAM_SUB_BUCKETS / 2))
+
+// Log-linear histogram in the spirit of HdrHistogram. Values below
+// SERVER_HISTOGRAM_SUB_BUCKETS are counted exactly, larger ones in buckets
+// no wider than 1/16 of their lower bound, up to about 2^41. Not thread
+// safe, every thread records into its own and they are merged for reading.
+typedef struct {
+  uint64_t buckets[SERVER_HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+} server_histogram_t;
+
+void server_initialize_histogram(server_histogram_t* histogram);
+
+void server_record_histogram(server_histogram_t* histogram, uint64_t value);
+
+void server_merge_histogram(server_histogram_t* histogram,
+                            const server_histogram_t* other);
+
+// Returns the upper bound of the bucket holding the given quantile (0 to 1),
+// capped at the largest recorded value, or 0 for an empty histogram.
+uint64_t server_histogram_quantile(const server_histogram_t* histogram,
+                                   double quantile);
+
+#endif  // __SERVER_HISTOGRAM_H__
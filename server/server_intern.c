@@ -0,0 +1,250 @@
+#include "server_intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "server_tuple_index.h"
+
+#define SERVER_INTERN_STRIPE_SHIFT 28
+#define SERVER_INTERN_INITIAL_SLOTS 64
+
+ts_bool_t server_initialize_intern_table(server_intern_table_t* table,
+                                         ts_bool_t is_shared) {
+  memset(table, 0, sizeof(server_intern_table_t));
+  if (!is_shared) {
+    return TS_TRUE;
+  }
+  table->stripe_locks =
+      (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t) * SERVER_INTERN_STRIPES);
+  if (table->stripe_locks == NULL) {
+    return TS_FALSE;
+  }
+  for (ts_size_t i = 0; i < SERVER_INTERN_STRIPES; ++i) {
+    pthread_mutex_init(&table->stripe_locks[i], NULL);
+  }
+  return TS_TRUE;
+}
+
+void server_destroy_intern_table(server_intern_table_t* table) {
+  for (ts_size_t i = 0; i < SERVER_INTERN_STRIPES; ++i) {
+    server_intern_stripe_t* stripe = &table->stripes[i];
+    for (ts_size_t j = 0; j < stripe->buckets_count; ++j) {
+      server_interned_string_t* entry = stripe->buckets[j];
+      while (entry != NULL) {
+        server_interned_string_t* next_entry =
+            (server_interned_string_t*)entry->next_string;
+        free(entry);
+        entry = next_entry;
+      }
+    }
+    free(stripe->buckets);
+    free(stripe->slots);
+    free(stripe->free_slots);
+    if (table->stripe_locks != NULL) {
+      pthread_mutex_destroy(&table->stripe_locks[i]);
+    }
+  }
+  free(table->stripe_locks);
+  memset(table, 0, sizeof(server_intern_table_t));
+}
+
+static ts_size_t server_intern_stripe_of(uint32_t hash) {
+  return (hash >> SERVER_INTERN_STRIPE_SHIFT) & (SERVER_INTERN_STRIPES - 1);
+}
+
+static void server_lock_intern_stripe(server_intern_table_t* table,
+                                      ts_size_t stripe) {
+  if (table->stripe_locks != NULL) {
+    pthread_mutex_lock(&table->stripe_locks[stripe]);
+  }
+}
+
+static void server_unlock_intern_stripe(server_intern_table_t* table,
+                                        ts_size_t stripe) {
+  if (table->stripe_locks != NULL) {
+    pthread_mutex_unlock(&table->stripe_locks[stripe]);
+  }
+}
+
+static ts_bool_t server_grow_intern_stripe(server_intern_stripe_t* stripe) {
+  ts_size_t buckets_count = stripe->buckets_count
+                                ? stripe->buckets_count * 2
+                                : SERVER_INTERN_INITIAL_BUCKETS;
+  server_interned_string_t** buckets = (server_interned_string_t**)calloc(
+      buckets_count, sizeof(server_interned_string_t*));
+  if (buckets == NULL) {
+    return TS_FALSE;
+  }
+  for (ts_size_t i = 0; i < stripe->buckets_count; ++i) {
+    server_interned_string_t* entry = stripe->buckets[i];
+    while (entry != NULL) {
+      server_interned_string_t* next_entry =
+          (server_interned_string_t*)entry->next_string;
+      server_interned_string_t** bucket =
+          &buckets[entry->hash & (buckets_count - 1)];
+      entry->next_string = *bucket;
+      *bucket = entry;
+      entry = next_entry;
+    }
+  }
+  free(stripe->buckets);
+  stripe->buckets = buckets;
+  stripe->buckets_count = buckets_count;
+  return TS_TRUE;
+}
+
+// Returns the slot of a new string, or -1 when the slots could not grow.
+static int64_t server_take_intern_slot(server_intern_stripe_t* stripe) {
+  if (stripe->free_slots_count > 0) {
+    return stripe->free_slots[--stripe->free_slots_count];
+  }
+  if (stripe->slots_count == stripe->slots_size) {
+    ts_size_t slots_size = stripe->slots_size ? stripe->slots_size * 2
+                                              : SERVER_INTERN_INITIAL_SLOTS;
+    if (slots_size > (1u << (32 - SERVER_INTERN_STRIPE_BITS))) {
+      return -1;
+    }
+    server_interned_string_t** slots = (server_interned_string_t**)realloc(
+        stripe->slots, slots_size * sizeof(server_interned_string_t*));
+    if (slots == NULL) {
+      return -1;
+    }
+    stripe->slots = slots;
+    uint32_t* free_slots = (uint32_t*)realloc(stripe->free_slots,
+                                              slots_size * sizeof(uint32_t));
+    if (free_slots == NULL) {
+      return -1;
+    }
+    stripe->free_slots = free_slots;
+    stripe->slots_size = slots_size;
+  }
+  return stripe->slots_count++;
+}
+
+static server_interned_string_t* server_interned_string_entry(
+    server_intern_table_t* table, uint32_t string_id) {
+  return table->stripes[string_id & (SERVER_INTERN_STRIPES - 1)]
+      .slots[string_id >> SERVER_INTERN_STRIPE_BITS];
+}
+
+static int64_t server_interned_string_size(ts_size_t length) {
+  return (int64_t)(sizeof(server_interned_string_t) + length + 1);
+}
+
+// Saved bytes count length + 1 for every reference, the size of a string
+// packed into its tuple, less the size of every entry.
+static void server_count_interned_bytes(server_intern_table_t* table,
+                                        int64_t strings_delta,
+                                        int64_t bytes_delta) {
+  __atomic_fetch_add(&table->strings_count, strings_delta, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&table->saved_bytes, bytes_delta, __ATOMIC_RELAXED);
+}
+
+ts_bool_t server_intern_string(server_intern_table_t* table,
+                               const char* string, ts_size_t length,
+                               uint32_t* string_id) {
+  uint32_t hash = server_hash_bytes(SERVER_HASH_OFFSET_BASIS, string, length);
+  ts_size_t stripe_index = server_intern_stripe_of(hash);
+  server_intern_stripe_t* stripe = &table->stripes[stripe_index];
+  server_lock_intern_stripe(table, stripe_index);
+  if (stripe->strings_count >= stripe->buckets_count &&
+      !server_grow_intern_stripe(stripe) && stripe->buckets_count == 0) {
+    server_unlock_intern_stripe(table, stripe_index);
+    return TS_FALSE;
+  }
+  server_interned_string_t** bucket =
+      &stripe->buckets[hash & (stripe->buckets_count - 1)];
+  for (server_interned_string_t* entry = *bucket; entry != NULL;
+       entry = (server_interned_string_t*)entry->next_string) {
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->string, string, length) == 0) {
+      ++entry->references;
+      *string_id = entry->id;
+      server_unlock_intern_stripe(table, stripe_index);
+      server_count_interned_bytes(table, 0, (int64_t)length + 1);
+      return TS_TRUE;
+    }
+  }
+  server_interned_string_t* entry =
+      (server_interned_string_t*)malloc(server_interned_string_size(length));
+  int64_t slot = entry != NULL ? server_take_intern_slot(stripe) : -1;
+  if (slot < 0) {
+    server_unlock_intern_stripe(table, stripe_index);
+    free(entry);
+    return TS_FALSE;
+  }
+  entry->hash = hash;
+  entry->id = ((uint32_t)slot << SERVER_INTERN_STRIPE_BITS) | stripe_index;
+  entry->references = 1;
+  entry->length = length;
+  memcpy(entry->string, string, length);
+  entry->string[length] = '\0';
+  entry->next_string = *bucket;
+  *bucket = entry;
+  stripe->slots[slot] = entry;
+  ++stripe->strings_count;
+  *string_id = entry->id;
+  server_unlock_intern_stripe(table, stripe_index);
+  server_count_interned_bytes(
+      table, 1, (int64_t)length + 1 - server_interned_string_size(length));
+  return TS_TRUE;
+}
+
+void server_retain_string(server_intern_table_t* table, uint32_t string_id) {
+  ts_size_t stripe_index = string_id & (SERVER_INTERN_STRIPES - 1);
+  server_lock_intern_stripe(table, stripe_index);
+  server_interned_string_t* entry =
+      server_interned_string_entry(table, string_id);
+  ++entry->references;
+  ts_size_t length = entry->length;
+  server_unlock_intern_stripe(table, stripe_index);
+  server_count_interned_bytes(table, 0, (int64_t)length + 1);
+}
+
+void server_release_string(server_intern_table_t* table, uint32_t string_id) {
+  ts_size_t stripe_index = string_id & (SERVER_INTERN_STRIPES - 1);
+  server_intern_stripe_t* stripe = &table->stripes[stripe_index];
+  server_lock_intern_stripe(table, stripe_index);
+  server_interned_string_t* entry =
+      server_interned_string_entry(table, string_id);
+  ts_size_t length = entry->length;
+  if (--entry->references > 0) {
+    server_unlock_intern_stripe(table, stripe_index);
+    server_count_interned_bytes(table, 0, -((int64_t)length + 1));
+    return;
+  }
+  server_interned_string_t** link =
+      &stripe->buckets[entry->hash & (stripe->buckets_count - 1)];
+  while (*link != entry) {
+    link = (server_interned_string_t**)&(*link)->next_string;
+  }
+  *link = (server_interned_string_t*)entry->next_string;
+  stripe->slots[string_id >> SERVER_INTERN_STRIPE_BITS] = NULL;
+  stripe->free_slots[stripe->free_slots_count++] =
+      string_id >> SERVER_INTERN_STRIPE_BITS;
+  --stripe->strings_count;
+  server_unlock_intern_stripe(table, stripe_index);
+  free(entry);
+  server_count_interned_bytes(table, -1, server_interned_string_size(length) -
+                                             ((int64_t)length + 1));
+}
+
+// The entry cannot go away under a caller holding a reference, only the
+// slots array can move, so that is all the lock covers.
+ts_string_t server_interned_string(server_intern_table_t* table,
+                                   uint32_t string_id) {
+  ts_size_t stripe_index = string_id & (SERVER_INTERN_STRIPES - 1);
+  server_lock_intern_stripe(table, stripe_index);
+  server_interned_string_t* entry =
+      server_interned_string_entry(table, string_id);
+  server_unlock_intern_stripe(table, stripe_index);
+  return entry->string;
+}
+
+int64_t server_interned_strings_count(const server_intern_table_t* table) {
+  return __atomic_load_n(&table->strings_count, __ATOMIC_RELAXED);
+}
+
+int64_t server_interned_saved_bytes(const server_intern_table_t* table) {
+  return __atomic_load_n(&table->saved_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,72 @@
+#ifndef __SERVER_INTERN_H__
+#define __SERVER_INTERN_H__
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "../libts/common/tuple_space.h"
+
+#define SERVER_INTERN_STRIPE_BITS 4
+#define SERVER_INTERN_STRIPES (1 << SERVER_INTERN_STRIPE_BITS)
+#define SERVER_INTERN_INITIAL_BUCKETS 64
+
+typedef struct {
+  void* next_string;
+  uint32_t hash;
+  uint32_t id;
+  uint32_t references;
+  ts_size_t length;
+  char string[];
+} server_interned_string_t;
+
+// Strings are found by their hash through the buckets and by their id
+// through the slots. Slots of released strings are reused.
+typedef struct {
+  server_interned_string_t** buckets;
+  ts_size_t buckets_count;
+  ts_size_t strings_count;
+  server_interned_string_t** slots;
+  uint32_t* free_slots;
+  ts_size_t slots_count;
+  ts_size_t slots_size;
+  ts_size_t free_slots_count;
+} server_intern_stripe_t;
+
+// Every string field of a tuple the server holds that is not inline refers
+// to this table by a 32-bit id, the slot of the string in its stripe above
+// the stripe bits. Each distinct string is kept once with a reference count,
+// so two such fields are equal exactly when their ids are. A shared table
+// takes the lock of a stripe to look up or change its strings.
+typedef struct {
+  server_intern_stripe_t stripes[SERVER_INTERN_STRIPES];
+  pthread_mutex_t* stripe_locks;
+  int64_t strings_count;
+  int64_t saved_bytes;
+} server_intern_table_t;
+
+ts_bool_t server_initialize_intern_table(server_intern_table_t* table,
+                                         ts_bool_t is_shared);
+
+void server_destroy_intern_table(server_intern_table_t* table);
+
+// Sets the id of the interned copy of the string and takes one more
+// reference to it. Returns TS_FALSE when it could not be allocated.
+ts_bool_t server_intern_string(server_intern_table_t* table,
+                               const char* string, ts_size_t length,
+                               uint32_t* string_id);
+
+void server_retain_string(server_intern_table_t* table, uint32_t string_id);
+
+void server_release_string(server_intern_table_t* table, uint32_t string_id);
+
+// The characters stay valid as long as the caller holds a reference.
+ts_string_t server_interned_string(server_intern_table_t* table,
+                                   uint32_t string_id);
+
+int64_t server_interned_strings_count(const server_intern_table_t* table);
+
+// Bytes the string copies of every reference would take, less what the
+// table takes to keep one copy of each string.
+int64_t server_interned_saved_bytes(const server_intern_table_t* table);
+
+#endif  // __SERVER_INTERN_H__
@@ -1,17 +1,59 @@
 #include "server_log.h"
 
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <time.h>
 
-static int32_t server_log_message(const char* message) {
-  char buffer[SERVER_LOG_BUFFER_SIZE];
-  memset(buffer, 0, SERVER_LOG_BUFFER_SIZE);
-  server_current_date(buffer, SERVER_LOG_BUFFER_SIZE);
-  return printf("[%s] %s\n", buffer, message);
-}
+#include "../libts/unix/tuple_space_unix_debug.h"
+#include "server_ring.h"
+
+#define SERVER_LOG_PAYLOAD_SIZE \
+  (SERVER_LOG_RECORD_SIZE - 2 * sizeof(uint64_t) - 2 * sizeof(uint8_t))
+
+typedef enum {
+  SERVER_LOG_RECORD_MESSAGE = 0,
+  SERVER_LOG_RECORD_TUPLE = 1
+} server_log_record_kind_t;
+
+typedef enum {
+  SERVER_LOG_ARGUMENT_NONE = 0,
+  SERVER_LOG_ARGUMENT_INT = 1,
+  SERVER_LOG_ARGUMENT_LONG = 2,
+  SERVER_LOG_ARGUMENT_LONG_LONG = 3,
+  SERVER_LOG_ARGUMENT_SIZE = 4,
+  SERVER_LOG_ARGUMENT_INTMAX = 5,
+  SERVER_LOG_ARGUMENT_PTRDIFF = 6,
+  SERVER_LOG_ARGUMENT_DOUBLE = 7,
+  SERVER_LOG_ARGUMENT_LONG_DOUBLE = 8,
+  SERVER_LOG_ARGUMENT_STRING = 9,
+  SERVER_LOG_ARGUMENT_POINTER = 10
+} server_log_argument_t;
+
+// Numbers take 8 bytes of the payload and strings their length plus the
+// terminator. A tuple field takes its flags byte followed by 4 bytes of
+// data or a string.
+typedef struct {
+  const char* format_string;
+  uint64_t timestamp_ns;
+  uint8_t kind;         // server_log_record_kind_t
+  uint8_t items_count;  // arguments or tuple fields
+  ts_byte_t payload[SERVER_LOG_PAYLOAD_SIZE];
+} server_log_record_t;
+
+server_log_level_t ServerLogLevel = SERVER_LOG_LEVEL_INFO;
+
+static server_ring_t* LogRings[SERVER_LOG_MAX_THREADS];
+static size_t LogRingsCount = 0;
+static size_t DroppedRecords = 0;
+static ts_bool_t IsLogRunning = TS_FALSE;
+static pthread_t LogThread;
+static _Thread_local server_ring_t* LogRing = NULL;
+static _Thread_local ts_bool_t IsLogRingMissing = TS_FALSE;
 
 uint64_t server_current_time_ms(void) {
   struct timeval timev;
@@ -20,30 +62,487 @@ uint64_t server_current_time_ms(void) {
   return timev.tv_usec / 1000;
 }
 
+uint64_t server_monotonic_time_ms(void) {
+  struct timespec time_spec;
+  clock_gettime(CLOCK_MONOTONIC, &time_spec);
+
+  return (uint64_t)time_spec.tv_sec * 1000 + time_spec.tv_nsec / 1000000;
+}
+
+uint64_t server_monotonic_time_us(void) {
+  struct timespec time_spec;
+  clock_gettime(CLOCK_MONOTONIC, &time_spec);
+
+  return (uint64_t)time_spec.tv_sec * 1000000 + time_spec.tv_nsec / 1000;
+}
+
 int32_t server_current_date(char* buffer, size_t size) {
   time_t rawtime;
+  struct tm local_time;
   memset(buffer, 0, size);
   time(&rawtime);
-  int32_t offst =
-      strftime(buffer, size, "%Y/%m/%d %H:%M:%S.", localtime(&rawtime));
+  int32_t offst = strftime(buffer, size, "%Y/%m/%d %H:%M:%S.",
+                           localtime_r(&rawtime, &local_time));
   if (offst > 0) {
     offst += sprintf(buffer + offst, "%04lu", server_current_time_ms());
   }
   return offst;
 }
 
-int32_t server_log(const char* format_string, ...) {
-  char buffer[SERVER_LOG_BUFFER_SIZE + 1];
-  memset(buffer, 0, SERVER_LOG_BUFFER_SIZE + 1);
-  va_list parameter_pack;
+void server_set_log_level(server_log_level_t level) {
+  __atomic_store_n(&ServerLogLevel, level, __ATOMIC_RELAXED);
+}
+
+// Parses the conversion specification following a '%' and returns the
+// character after it.
+static const char* server_log_parse_conversion(
+    const char* format, server_log_argument_t* argument) {
+  char modifier = '\0';
+  format += strspn(format, "-+ #0123456789.");
+  if (*format == 'h') {
+    format += (format[1] == 'h') ? 2 : 1;
+  } else if (*format == 'l') {
+    modifier = (format[1] == 'l') ? 'q' : 'l';
+    format += (format[1] == 'l') ? 2 : 1;
+  } else if (*format != '\0' && strchr("zjtL", *format) != NULL) {
+    modifier = *format++;
+  }
+  switch (*format) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    case 'c':
+      switch (modifier) {
+        case 'l':
+          *argument = SERVER_LOG_ARGUMENT_LONG;
+          break;
+        case 'q':
+          *argument = SERVER_LOG_ARGUMENT_LONG_LONG;
+          break;
+        case 'z':
+          *argument = SERVER_LOG_ARGUMENT_SIZE;
+          break;
+        case 'j':
+          *argument = SERVER_LOG_ARGUMENT_INTMAX;
+          break;
+        case 't':
+          *argument = SERVER_LOG_ARGUMENT_PTRDIFF;
+          break;
+        default:
+          *argument = SERVER_LOG_ARGUMENT_INT;
+          break;
+      }
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      *argument = (modifier == 'L') ? SERVER_LOG_ARGUMENT_LONG_DOUBLE
+                                    : SERVER_LOG_ARGUMENT_DOUBLE;
+      break;
+    case 's':
+      *argument = SERVER_LOG_ARGUMENT_STRING;
+      break;
+    case 'p':
+      *argument = SERVER_LOG_ARGUMENT_POINTER;
+      break;
+    case '\0':
+      *argument = SERVER_LOG_ARGUMENT_NONE;
+      return format;
+    default:
+      *argument = SERVER_LOG_ARGUMENT_NONE;
+      break;
+  }
+  return format + 1;
+}
+
+// Stops at the first argument that does not fit, the formatter prints '?'
+// for it and for all the following ones.
+static uint8_t server_log_encode_arguments(ts_byte_t* payload,
+                                           const char* format,
+                                           va_list arguments) {
+  size_t offset = 0;
+  uint8_t count = 0;
+  while ((format = strchr(format, '%')) != NULL) {
+    server_log_argument_t argument;
+    format = server_log_parse_conversion(format + 1, &argument);
+    uint64_t value = 0;
+    double real_value;
+    switch (argument) {
+      case SERVER_LOG_ARGUMENT_NONE:
+        continue;
+      case SERVER_LOG_ARGUMENT_INT:
+        value = (uint64_t)(int64_t)va_arg(arguments, int);
+        break;
+      case SERVER_LOG_ARGUMENT_LONG:
+        value = (uint64_t)va_arg(arguments, long);
+        break;
+      case SERVER_LOG_ARGUMENT_LONG_LONG:
+        value = (uint64_t)va_arg(arguments, long long);
+        break;
+      case SERVER_LOG_ARGUMENT_SIZE:
+        value = (uint64_t)va_arg(arguments, size_t);
+        break;
+      case SERVER_LOG_ARGUMENT_INTMAX:
+        value = (uint64_t)va_arg(arguments, intmax_t);
+        break;
+      case SERVER_LOG_ARGUMENT_PTRDIFF:
+        value = (uint64_t)va_arg(arguments, ptrdiff_t);
+        break;
+      case SERVER_LOG_ARGUMENT_DOUBLE:
+        real_value = va_arg(arguments, double);
+        memcpy(&value, &real_value, sizeof(uint64_t));
+        break;
+      case SERVER_LOG_ARGUMENT_LONG_DOUBLE:
+        real_value = (double)va_arg(arguments, long double);
+        memcpy(&value, &real_value, sizeof(uint64_t));
+        break;
+      case SERVER_LOG_ARGUMENT_POINTER:
+        value = (uint64_t)(uintptr_t)va_arg(arguments, void*);
+        break;
+      case SERVER_LOG_ARGUMENT_STRING: {
+        const char* string = va_arg(arguments, const char*);
+        if (string == NULL) {
+          string = "(null)";
+        }
+        if (offset == SERVER_LOG_PAYLOAD_SIZE) {
+          return count;
+        }
+        size_t length = strnlen(string, SERVER_LOG_PAYLOAD_SIZE - offset - 1);
+        memcpy(payload + offset, string, length);
+        payload[offset + length] = '\0';
+        offset += length + 1;
+        ++count;
+        continue;
+      }
+    }
+    if (offset + sizeof(uint64_t) > SERVER_LOG_PAYLOAD_SIZE) {
+      return count;
+    }
+    memcpy(payload + offset, &value, sizeof(uint64_t));
+    offset += sizeof(uint64_t);
+    ++count;
+  }
+  return count;
+}
+
+static uint8_t server_log_encode_tuple(ts_byte_t* payload,
+                                       const ts_tuple_field_t* tuple,
+                                       ts_size_t tuple_size) {
+  size_t offset = 0;
+  uint8_t count = 0;
+  if (tuple_size > TS_MAX_TUPLE_SIZE) {
+    tuple_size = TS_MAX_TUPLE_SIZE;
+  }
+  while (count < tuple_size &&
+         SERVER_LOG_PAYLOAD_SIZE - offset >= 1 + sizeof(ts_uint_t)) {
+    const ts_tuple_field_t* field = &tuple[count++];
+    payload[offset++] = field->flags;
+    if (!ts_tuple_field_contains_data(field)) {
+      continue;
+    }
+    if (ts_tuple_field_get_type(field) == TS_FIELD_TYPE_STRING) {
+      ts_string_t string = ts_tuple_field_string(field);
+      size_t length = strnlen(string, SERVER_LOG_PAYLOAD_SIZE - offset - 1);
+      memcpy(payload + offset, string, length);
+      payload[offset + length] = '\0';
+      offset += length + 1;
+    } else {
+      memcpy(payload + offset, &field->data, sizeof(ts_uint_t));
+      offset += sizeof(ts_uint_t);
+    }
+  }
+  return count;
+}
+
+static void server_log_write_date(FILE* stream, uint64_t timestamp_ns) {
+  static _Thread_local time_t cached_seconds = 0;
+  static _Thread_local char cached_date[32];
+  time_t seconds = (time_t)(timestamp_ns / 1000000000);
+  if (seconds != cached_seconds || cached_date[0] == '\0') {
+    struct tm local_time;
+    strftime(cached_date, sizeof(cached_date), "%Y/%m/%d %H:%M:%S.",
+             localtime_r(&seconds, &local_time));
+    cached_seconds = seconds;
+  }
+  fprintf(stream, "[%s%04lu] ", cached_date,
+          (unsigned long)(timestamp_ns / 1000000 % 1000));
+}
+
+static void server_log_write_argument(FILE* stream, const char* specification,
+                                      server_log_argument_t argument,
+                                      uint64_t value) {
+  double real_value;
+  switch (argument) {
+    case SERVER_LOG_ARGUMENT_INT:
+      fprintf(stream, specification, (int)value);
+      return;
+    case SERVER_LOG_ARGUMENT_LONG:
+      fprintf(stream, specification, (long)value);
+      return;
+    case SERVER_LOG_ARGUMENT_LONG_LONG:
+      fprintf(stream, specification, (long long)value);
+      return;
+    case SERVER_LOG_ARGUMENT_SIZE:
+      fprintf(stream, specification, (size_t)value);
+      return;
+    case SERVER_LOG_ARGUMENT_INTMAX:
+      fprintf(stream, specification, (intmax_t)value);
+      return;
+    case SERVER_LOG_ARGUMENT_PTRDIFF:
+      fprintf(stream, specification, (ptrdiff_t)value);
+      return;
+    case SERVER_LOG_ARGUMENT_DOUBLE:
+      memcpy(&real_value, &value, sizeof(double));
+      fprintf(stream, specification, real_value);
+      return;
+    case SERVER_LOG_ARGUMENT_LONG_DOUBLE:
+      memcpy(&real_value, &value, sizeof(double));
+      fprintf(stream, specification, (long double)real_value);
+      return;
+    case SERVER_LOG_ARGUMENT_POINTER:
+      fprintf(stream, specification, (void*)(uintptr_t)value);
+      return;
+    default:
+      return;
+  }
+}
+
+static void server_log_write_message(FILE* stream,
+                                     const server_log_record_t* record) {
+  const char* format = record->format_string;
+  const ts_byte_t* payload = record->payload;
+  uint8_t remaining = record->items_count;
+  server_log_write_date(stream, record->timestamp_ns);
+  while (*format != '\0') {
+    const char* conversion = strchr(format, '%');
+    if (conversion == NULL) {
+      fputs(format, stream);
+      break;
+    }
+    fwrite(format, 1, conversion - format, stream);
+    server_log_argument_t argument;
+    format = server_log_parse_conversion(conversion + 1, &argument);
+    char specification[32];
+    size_t length = format - conversion;
+    if (length >= sizeof(specification)) {
+      length = sizeof(specification) - 1;
+    }
+    memcpy(specification, conversion, length);
+    specification[length] = '\0';
+    if (argument == SERVER_LOG_ARGUMENT_NONE) {
+      if (conversion[1] == '%') {
+        fputc('%', stream);
+      }
+    } else if (remaining == 0) {
+      fputc('?', stream);
+    } else if (argument == SERVER_LOG_ARGUMENT_STRING) {
+      fprintf(stream, specification, (const char*)payload);
+      payload += strlen((const char*)payload) + 1;
+      --remaining;
+    } else {
+      uint64_t value;
+      memcpy(&value, payload, sizeof(uint64_t));
+      server_log_write_argument(stream, specification, argument, value);
+      payload += sizeof(uint64_t);
+      --remaining;
+    }
+  }
+  fputc('\n', stream);
+}
 
+static void server_log_write_tuple(FILE* stream,
+                                   const server_log_record_t* record) {
+  ts_tuple_field_t tuple[TS_MAX_TUPLE_SIZE];
+  const ts_byte_t* payload = record->payload;
+  for (uint8_t i = 0; i < record->items_count; ++i) {
+    memset(&tuple[i], 0, sizeof(ts_tuple_field_t));
+    tuple[i].flags = *payload++;
+    if (!ts_tuple_field_contains_data(&tuple[i])) {
+      continue;
+    }
+    if (ts_tuple_field_get_type(&tuple[i]) == TS_FIELD_TYPE_STRING) {
+      tuple[i] = ts_tuple_field_set_string((ts_string_t)payload, TS_TRUE);
+      payload += strlen((const char*)payload) + 1;
+    } else {
+      memcpy(&tuple[i].data, payload, sizeof(ts_uint_t));
+      payload += sizeof(ts_uint_t);
+    }
+  }
+  ts_fprint_tuple(stream, tuple, record->items_count);
+}
+
+static void server_log_write_record(FILE* stream,
+                                    const server_log_record_t* record) {
+  if (record->kind == SERVER_LOG_RECORD_TUPLE) {
+    server_log_write_tuple(stream, record);
+  } else {
+    server_log_write_message(stream, record);
+  }
+}
+
+static server_ring_t* server_log_thread_ring(void) {
+  if (LogRing != NULL || IsLogRingMissing) {
+    return LogRing;
+  }
+  size_t index = __atomic_fetch_add(&LogRingsCount, 1, __ATOMIC_ACQ_REL);
+  server_ring_t* ring = (server_ring_t*)malloc(sizeof(server_ring_t));
+  if (index >= SERVER_LOG_MAX_THREADS || ring == NULL ||
+      !server_initialize_ring(ring, sizeof(server_log_record_t),
+                              SERVER_LOG_RING_SIZE)) {
+    free(ring);
+    IsLogRingMissing = TS_TRUE;
+    return NULL;
+  }
+  __atomic_store_n(&LogRings[index], ring, __ATOMIC_RELEASE);
+  LogRing = ring;
+  return ring;
+}
+
+// Returns the record to fill, either a ring slot or the local one when
+// the record is written synchronously, or NULL when it has to be dropped.
+static server_log_record_t* server_log_begin_record(
+    server_log_record_t* local_record, server_ring_t** ring) {
+  *ring = NULL;
+  server_log_record_t* record = local_record;
+  if (__atomic_load_n(&IsLogRunning, __ATOMIC_ACQUIRE)) {
+    *ring = server_log_thread_ring();
+  }
+  if (*ring != NULL) {
+    record = (server_log_record_t*)server_ring_reserve(*ring);
+    if (record == NULL) {
+      __atomic_fetch_add(&DroppedRecords, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+  }
+  struct timespec time_spec;
+  clock_gettime(CLOCK_REALTIME, &time_spec);
+  record->timestamp_ns =
+      (uint64_t)time_spec.tv_sec * 1000000000 + time_spec.tv_nsec;
+  return record;
+}
+
+static void server_log_end_record(server_log_record_t* record,
+                                  server_ring_t* ring) {
+  if (ring != NULL) {
+    server_ring_commit(ring);
+    return;
+  }
+  flockfile(stdout);
+  server_log_write_record(stdout, record);
+  funlockfile(stdout);
+}
+
+void server_log_record(const char* format_string, ...) {
+  server_log_record_t local_record;
+  server_ring_t* ring;
+  server_log_record_t* record = server_log_begin_record(&local_record, &ring);
+  if (record == NULL) {
+    return;
+  }
+  record->kind = SERVER_LOG_RECORD_MESSAGE;
+  record->format_string = format_string;
+  va_list parameter_pack;
   va_start(parameter_pack, format_string);
-  int length =
-      vsnprintf(buffer, SERVER_LOG_BUFFER_SIZE, format_string, parameter_pack);
+  record->items_count = server_log_encode_arguments(
+      record->payload, format_string, parameter_pack);
   va_end(parameter_pack);
+  server_log_end_record(record, ring);
+}
+
+void server_log_tuple_record(const ts_tuple_field_t* tuple,
+                             ts_size_t tuple_size) {
+  server_log_record_t local_record;
+  server_ring_t* ring;
+  server_log_record_t* record = server_log_begin_record(&local_record, &ring);
+  if (record == NULL) {
+    return;
+  }
+  record->kind = SERVER_LOG_RECORD_TUPLE;
+  record->format_string = NULL;
+  record->items_count =
+      server_log_encode_tuple(record->payload, tuple, tuple_size);
+  server_log_end_record(record, ring);
+}
+
+static size_t server_log_drain(FILE* stream) {
+  size_t written = 0;
+  size_t rings_count = __atomic_load_n(&LogRingsCount, __ATOMIC_ACQUIRE);
+  if (rings_count > SERVER_LOG_MAX_THREADS) {
+    rings_count = SERVER_LOG_MAX_THREADS;
+  }
+  for (size_t i = 0; i < rings_count; ++i) {
+    server_ring_t* ring = __atomic_load_n(&LogRings[i], __ATOMIC_ACQUIRE);
+    if (ring == NULL) {
+      continue;
+    }
+    size_t count;
+    const server_log_record_t* records;
+    while ((records = (const server_log_record_t*)server_ring_peek(
+                ring, &count)) != NULL) {
+      for (size_t j = 0; j < count; ++j) {
+        server_log_write_record(stream, &records[j]);
+      }
+      server_ring_release(ring, count);
+      written += count;
+    }
+  }
+  size_t dropped = __atomic_exchange_n(&DroppedRecords, 0, __ATOMIC_RELAXED);
+  if (dropped > 0) {
+    struct timespec time_spec;
+    clock_gettime(CLOCK_REALTIME, &time_spec);
+    server_log_write_date(
+        stream, (uint64_t)time_spec.tv_sec * 1000000000 + time_spec.tv_nsec);
+    fprintf(stream, "Dropped %zu log records\n", dropped);
+    ++written;
+  }
+  return written;
+}
+
+static void* server_log_thread(void* /*argument*/) {
+  const struct timespec idle_time = {0, SERVER_LOG_IDLE_SLEEP_MS * 1000000};
+  ts_bool_t is_running = TS_TRUE;
+  while (is_running) {
+    is_running = __atomic_load_n(&IsLogRunning, __ATOMIC_ACQUIRE);
+    flockfile(stdout);
+    size_t written = server_log_drain(stdout);
+    funlockfile(stdout);
+    if (written > 0) {
+      fflush(stdout);
+    } else if (is_running) {
+      nanosleep(&idle_time, NULL);
+    }
+  }
+  return NULL;
+}
+
+ts_bool_t server_start_log(void) {
+  // Signals are left to the server threads
+  sigset_t signals;
+  sigset_t previous_signals;
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+  __atomic_store_n(&IsLogRunning, TS_TRUE, __ATOMIC_RELEASE);
+  ts_bool_t status =
+      pthread_create(&LogThread, NULL, server_log_thread, NULL) == 0;
+  if (!status) {
+    __atomic_store_n(&IsLogRunning, TS_FALSE, __ATOMIC_RELEASE);
+  }
+  pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+  return status;
+}
 
-  if (length > SERVER_LOG_BUFFER_SIZE) {
-    return -1;
+void server_stop_log(void) {
+  if (!__atomic_load_n(&IsLogRunning, __ATOMIC_ACQUIRE)) {
+    return;
   }
-  return server_log_message(buffer);
+  __atomic_store_n(&IsLogRunning, TS_FALSE, __ATOMIC_RELEASE);
+  pthread_join(LogThread, NULL);
 }
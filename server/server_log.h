@@ -4,12 +4,78 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+#include "../libts/common/tuple_space.h"
+
 #define SERVER_LOG_BUFFER_SIZE 1024
+#define SERVER_LOG_RECORD_SIZE 256
+#define SERVER_LOG_RING_SIZE 1024  // records per thread, power of two
+#define SERVER_LOG_MAX_THREADS 128
+#define SERVER_LOG_IDLE_SLEEP_MS 5
+
+typedef enum {
+  SERVER_LOG_LEVEL_DEBUG = 0,
+  SERVER_LOG_LEVEL_INFO = 1,
+  SERVER_LOG_LEVEL_WARNING = 2,
+  SERVER_LOG_LEVEL_ERROR = 3,
+  SERVER_LOG_LEVEL_OFF = 4
+} server_log_level_t;
+
+// Records below this level are compiled out, e.g. -DSERVER_LOG_COMPILE_LEVEL=1
+// drops debug records together with the evaluation of their arguments.
+#ifndef SERVER_LOG_COMPILE_LEVEL
+#define SERVER_LOG_COMPILE_LEVEL SERVER_LOG_LEVEL_DEBUG
+#endif
+
+extern server_log_level_t ServerLogLevel;
+
+#define SERVER_LOG_IS_ENABLED(level) \
+  ((level) >= SERVER_LOG_COMPILE_LEVEL && (level) >= ServerLogLevel)
+
+// The format string must outlive the record, in practice it is a literal.
+// Arguments are captured by value, strings are copied and truncated to fit
+// the record. Width and precision given as '*' are not supported.
+#define SERVER_LOG(level, ...)          \
+  do {                                  \
+    if (SERVER_LOG_IS_ENABLED(level)) { \
+      server_log_record(__VA_ARGS__);   \
+    }                                   \
+  } while (0)
+
+#define SERVER_LOG_DEBUG(...) SERVER_LOG(SERVER_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define SERVER_LOG_INFO(...) SERVER_LOG(SERVER_LOG_LEVEL_INFO, __VA_ARGS__)
+#define SERVER_LOG_WARNING(...) \
+  SERVER_LOG(SERVER_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define SERVER_LOG_ERROR(...) SERVER_LOG(SERVER_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#define SERVER_LOG_TUPLE(level, tuple, tuple_size)    \
+  do {                                                \
+    if (SERVER_LOG_IS_ENABLED(level)) {               \
+      server_log_tuple_record((tuple), (tuple_size)); \
+    }                                                 \
+  } while (0)
 
 int32_t server_current_date(char* buffer, size_t size);
 
 uint64_t server_current_time_ms(void);
 
-int32_t server_log(const char* format_string, ...);
+uint64_t server_monotonic_time_ms(void);
+
+uint64_t server_monotonic_time_us(void);
+
+void server_set_log_level(server_log_level_t level);
+
+// Starts the thread formatting and writing the records. Until it runs, and
+// after server_stop_log, records are written synchronously by the caller.
+ts_bool_t server_start_log(void);
+
+// Writes out the records still queued and stops the log thread. Threads
+// still logging at this point may lose their records.
+void server_stop_log(void);
+
+void server_log_record(const char* format_string, ...)
+    __attribute__((format(printf, 1, 2)));
+
+void server_log_tuple_record(const ts_tuple_field_t* tuple,
+                             ts_size_t tuple_size);
 
 #endif  // __SERVER_LOG_H__
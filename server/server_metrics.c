@@ -6,10 +6,60 @@
 
 #include "server_log.h"
 
-server_metrics_t server_initialize_metrics(void) {
-  server_metrics_t metrics;
-  memset(&metrics, 0, sizeof(server_metrics_t));
-  return metrics;
+static const char* const OperationNames[SERVER_OPERATIONS_COUNT] = {
+    "out", "in", "inp", "rd", "rdp"};
+
+void server_initialize_metrics(server_metrics_t* metrics) {
+  memset(metrics, 0, sizeof(server_metrics_t));
+}
+
+void server_merge_metrics(server_metrics_t* metrics,
+                          const server_metrics_t* other) {
+  metrics->total_received_messages += other->total_received_messages;
+  metrics->total_send_mesages += other->total_send_mesages;
+  metrics->total_out_messages += other->total_out_messages;
+  metrics->total_in_messages += other->total_in_messages;
+  metrics->total_inp_messages += other->total_inp_messages;
+  metrics->total_rd_messages += other->total_rd_messages;
+  metrics->total_rdp_messages += other->total_rdp_messages;
+  metrics->total_rejected_inp_messages += other->total_rejected_inp_messages;
+  metrics->total_rejected_rdp_messages += other->total_rejected_rdp_messages;
+  metrics->total_queued_in_messages += other->total_queued_in_messages;
+  metrics->total_queued_rd_messages += other->total_queued_rd_messages;
+  metrics->currently_stashed_tuples += other->currently_stashed_tuples;
+  metrics->currently_queued_tuples += other->currently_queued_tuples;
+  metrics->total_dispatched_waiters += other->total_dispatched_waiters;
+  metrics->acc_waiter_queue_time_ms += other->acc_waiter_queue_time_ms;
+  if (other->max_waiter_queue_time_ms > metrics->max_waiter_queue_time_ms) {
+    metrics->max_waiter_queue_time_ms = other->max_waiter_queue_time_ms;
+  }
+  metrics->acc_received_message_length += other->acc_received_message_length;
+  metrics->acc_send_message_length += other->acc_send_message_length;
+  metrics->total_serialization_issues += other->total_serialization_issues;
+  metrics->total_invalid_get_tuples += other->total_invalid_get_tuples;
+  metrics->total_invalid_send_tuples += other->total_invalid_send_tuples;
+  metrics->total_errors += other->total_errors;
+  metrics->interned_strings += other->interned_strings;
+  metrics->interned_saved_bytes += other->interned_saved_bytes;
+  for (size_t i = 0; i < SERVER_OPERATIONS_COUNT; ++i) {
+    server_merge_histogram(&metrics->service_time[i], &other->service_time[i]);
+    server_merge_histogram(&metrics->waiter_queue_time[i],
+                           &other->waiter_queue_time[i]);
+  }
+  server_merge_histogram(&metrics->ack_round_trip_time,
+                         &other->ack_round_trip_time);
+  server_merge_pool_usage(&metrics->queue_nodes, &other->queue_nodes);
+  server_merge_pool_usage(&metrics->connection_nodes,
+                          &other->connection_nodes);
+  metrics->is_pipelined |= other->is_pipelined;
+  metrics->ingress_depth += other->ingress_depth;
+  metrics->egress_depth += other->egress_depth;
+  if (other->ingress_max_depth > metrics->ingress_max_depth) {
+    metrics->ingress_max_depth = other->ingress_max_depth;
+  }
+  if (other->egress_max_depth > metrics->egress_max_depth) {
+    metrics->egress_max_depth = other->egress_max_depth;
+  }
 }
 
 void server_print_metrics(const server_metrics_t* metrics) {
@@ -41,6 +91,16 @@ void server_print_metrics(const server_metrics_t* metrics) {
          metrics->total_rd_messages - metrics->total_queued_rd_messages);
   printf("Currently stashed tuples: %lu\n", metrics->currently_stashed_tuples);
   printf("Currently queued tuples: %lu\n", metrics->currently_queued_tuples);
+  printf("Total dispatched waiters: %lu\n", metrics->total_dispatched_waiters);
+  if (metrics->total_dispatched_waiters) {
+    printf("Average waiter time in queue: %f ms\n",
+           (float)metrics->acc_waiter_queue_time_ms /
+               metrics->total_dispatched_waiters);
+  } else {
+    printf("Average waiter time in queue: N/A\n");
+  }
+  printf("Max waiter time in queue: %" PRIu64 " ms\n",
+         metrics->max_waiter_queue_time_ms);
   printf("Accumulated received messages length: %lu\n",
          metrics->acc_received_message_length);
   printf("Accumulated send messages length: %lu\n",
@@ -67,5 +127,195 @@ void server_print_metrics(const server_metrics_t* metrics) {
   printf("Total serialization issues: %lu\n",
          metrics->total_serialization_issues);
   printf("Total errors: %lu\n", metrics->total_errors);
+  printf("Interned strings: %" PRId64 "\n", metrics->interned_strings);
+  printf("Bytes saved by interning: %" PRId64 "\n",
+         metrics->interned_saved_bytes);
+  server_print_pool_usage("queue nodes", &metrics->queue_nodes);
+  server_print_pool_usage("connection nodes", &metrics->connection_nodes);
+  if (metrics->is_pipelined) {
+    printf(
+        "Pipeline ingress depth: %zu (max %zu), egress depth: %zu (max %zu)\n",
+        metrics->ingress_depth, metrics->ingress_max_depth,
+        metrics->egress_depth, metrics->egress_max_depth);
+  }
   printf("==================================================\n");
 }
+
+static void server_write_metric_header(FILE* stream, const char* name,
+                                       const char* type, const char* help) {
+  fprintf(stream, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void server_write_summary(FILE* stream, const char* name,
+                                 const char* labels,
+                                 const server_histogram_t* histogram) {
+  static const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+  ts_bool_t has_labels = labels[0] != '\0';
+  for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+    fprintf(stream, "%s{%s%squantile=\"%g\"} %" PRIu64 "\n", name, labels,
+            has_labels ? "," : "", quantiles[i],
+            server_histogram_quantile(histogram, quantiles[i]));
+  }
+  fprintf(stream, "%s_sum%s%s%s %" PRIu64 "\n", name, has_labels ? "{" : "",
+          labels, has_labels ? "}" : "", histogram->sum);
+  fprintf(stream, "%s_count%s%s%s %" PRIu64 "\n", name,
+          has_labels ? "{" : "", labels, has_labels ? "}" : "",
+          histogram->count);
+}
+
+void server_write_metrics(FILE* stream, const server_metrics_t* metrics) {
+  const size_t requests[SERVER_OPERATIONS_COUNT] = {
+      metrics->total_out_messages, metrics->total_in_messages,
+      metrics->total_inp_messages, metrics->total_rd_messages,
+      metrics->total_rdp_messages};
+  char labels[64];
+
+  server_write_metric_header(stream, "tuple_space_received_messages_total",
+                             "counter", "Tuple messages received.");
+  fprintf(stream, "tuple_space_received_messages_total %zu\n",
+          metrics->total_received_messages);
+  server_write_metric_header(stream, "tuple_space_sent_messages_total",
+                             "counter", "Tuples sent to clients.");
+  fprintf(stream, "tuple_space_sent_messages_total %zu\n",
+          metrics->total_send_mesages);
+  server_write_metric_header(stream, "tuple_space_received_fields_total",
+                             "counter", "Fields of the received tuples.");
+  fprintf(stream, "tuple_space_received_fields_total %zu\n",
+          metrics->acc_received_message_length);
+  server_write_metric_header(stream, "tuple_space_sent_fields_total",
+                             "counter", "Fields of the tuples sent.");
+  fprintf(stream, "tuple_space_sent_fields_total %zu\n",
+          metrics->acc_send_message_length);
+
+  server_write_metric_header(stream, "tuple_space_requests_total", "counter",
+                             "Requests by operation.");
+  for (size_t i = 0; i < SERVER_OPERATIONS_COUNT; ++i) {
+    fprintf(stream, "tuple_space_requests_total{operation=\"%s\"} %zu\n",
+            OperationNames[i], requests[i]);
+  }
+  server_write_metric_header(stream, "tuple_space_rejected_requests_total",
+                             "counter",
+                             "Non-blocking requests without a match.");
+  fprintf(stream,
+          "tuple_space_rejected_requests_total{operation=\"inp\"} %zu\n"
+          "tuple_space_rejected_requests_total{operation=\"rdp\"} %zu\n",
+          metrics->total_rejected_inp_messages,
+          metrics->total_rejected_rdp_messages);
+  server_write_metric_header(stream, "tuple_space_queued_requests_total",
+                             "counter",
+                             "Blocking requests queued for a match.");
+  fprintf(stream,
+          "tuple_space_queued_requests_total{operation=\"in\"} %zu\n"
+          "tuple_space_queued_requests_total{operation=\"rd\"} %zu\n",
+          metrics->total_queued_in_messages, metrics->total_queued_rd_messages);
+  server_write_metric_header(stream, "tuple_space_dispatched_waiters_total",
+                             "counter", "Queued requests answered.");
+  fprintf(stream, "tuple_space_dispatched_waiters_total %zu\n",
+          metrics->total_dispatched_waiters);
+
+  server_write_metric_header(stream, "tuple_space_stashed_tuples", "gauge",
+                             "Tuples in the stash.");
+  fprintf(stream, "tuple_space_stashed_tuples %zu\n",
+          metrics->currently_stashed_tuples);
+  server_write_metric_header(stream, "tuple_space_queued_templates", "gauge",
+                             "Requests waiting for a match.");
+  fprintf(stream, "tuple_space_queued_templates %zu\n",
+          metrics->currently_queued_tuples);
+
+  server_write_metric_header(stream, "tuple_space_invalid_messages_total",
+                             "counter", "Messages that were rejected.");
+  fprintf(stream,
+          "tuple_space_invalid_messages_total{kind=\"get\"} %zu\n"
+          "tuple_space_invalid_messages_total{kind=\"send\"} %zu\n"
+          "tuple_space_invalid_messages_total{kind=\"serialization\"} %zu\n",
+          metrics->total_invalid_get_tuples, metrics->total_invalid_send_tuples,
+          metrics->total_serialization_issues);
+  server_write_metric_header(stream, "tuple_space_errors_total", "counter",
+                             "Unknown input errors.");
+  fprintf(stream, "tuple_space_errors_total %zu\n", metrics->total_errors);
+
+  server_write_metric_header(
+      stream, "tuple_space_interned_strings", "gauge",
+      "Distinct strings of the tuples the server holds.");
+  fprintf(stream, "tuple_space_interned_strings %" PRId64 "\n",
+          metrics->interned_strings);
+  server_write_metric_header(
+      stream, "tuple_space_interned_saved_bytes", "gauge",
+      "Bytes the string copies would take over the intern table.");
+  fprintf(stream, "tuple_space_interned_saved_bytes %" PRId64 "\n",
+          metrics->interned_saved_bytes);
+
+  server_write_metric_header(stream, "tuple_space_pool_live_objects", "gauge",
+                             "Objects allocated from the node pools.");
+  fprintf(stream,
+          "tuple_space_pool_live_objects{pool=\"queue\"} %zu\n"
+          "tuple_space_pool_live_objects{pool=\"connection\"} %zu\n",
+          metrics->queue_nodes.live_objects,
+          metrics->connection_nodes.live_objects);
+  server_write_metric_header(stream, "tuple_space_pool_peak_objects", "gauge",
+                             "Sum of the peak objects of every shard.");
+  fprintf(stream,
+          "tuple_space_pool_peak_objects{pool=\"queue\"} %zu\n"
+          "tuple_space_pool_peak_objects{pool=\"connection\"} %zu\n",
+          metrics->queue_nodes.peak_objects,
+          metrics->connection_nodes.peak_objects);
+  if (metrics->is_pipelined) {
+    server_write_metric_header(stream, "tuple_space_pipeline_ring_depth",
+                               "gauge", "Messages in a pipeline ring.");
+    fprintf(stream,
+            "tuple_space_pipeline_ring_depth{ring=\"ingress\"} %zu\n"
+            "tuple_space_pipeline_ring_depth{ring=\"egress\"} %zu\n",
+            metrics->ingress_depth, metrics->egress_depth);
+    server_write_metric_header(
+        stream, "tuple_space_pipeline_ring_max_depth", "gauge",
+        "Most messages in a pipeline ring since the previous report.");
+    fprintf(stream,
+            "tuple_space_pipeline_ring_max_depth{ring=\"ingress\"} %zu\n"
+            "tuple_space_pipeline_ring_max_depth{ring=\"egress\"} %zu\n",
+            metrics->ingress_max_depth, metrics->egress_max_depth);
+  }
+
+  server_write_metric_header(stream, "tuple_space_service_time_microseconds",
+                             "summary",
+                             "Time from decoding a request to answering it.");
+  for (size_t i = 0; i < SERVER_OPERATIONS_COUNT; ++i) {
+    snprintf(labels, sizeof(labels), "operation=\"%s\"", OperationNames[i]);
+    server_write_summary(stream, "tuple_space_service_time_microseconds",
+                         labels, &metrics->service_time[i]);
+  }
+  server_write_metric_header(
+      stream, "tuple_space_waiter_queue_time_microseconds", "summary",
+      "Time blocked requests waited for a matching tuple.");
+  for (size_t i = 0; i < SERVER_OPERATIONS_COUNT; ++i) {
+    if (i != SERVER_OPERATION_IN && i != SERVER_OPERATION_RD) {
+      continue;
+    }
+    snprintf(labels, sizeof(labels), "operation=\"%s\"", OperationNames[i]);
+    server_write_summary(stream, "tuple_space_waiter_queue_time_microseconds",
+                         labels, &metrics->waiter_queue_time[i]);
+  }
+  server_write_metric_header(
+      stream, "tuple_space_ack_round_trip_microseconds", "summary",
+      "Time from sending a tuple or a ping to the client ACK.");
+  server_write_summary(stream, "tuple_space_ack_round_trip_microseconds", "",
+                       &metrics->ack_round_trip_time);
+}
+
+ts_bool_t server_export_metrics(const char* path,
+                                const server_metrics_t* metrics) {
+  char temporary_path[SERVER_LOG_BUFFER_SIZE];
+  if (snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path) >=
+      (int)sizeof(temporary_path)) {
+    return TS_FALSE;
+  }
+  FILE* stream = fopen(temporary_path, "w");
+  if (stream == NULL) {
+    return TS_FALSE;
+  }
+  server_write_metrics(stream, metrics);
+  if (fclose(stream) != 0) {
+    remove(temporary_path);
+    return TS_FALSE;
+  }
+  return rename(temporary_path, path) == 0;
+}
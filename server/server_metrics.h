@@ -3,6 +3,20 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include <stdio.h>
+
+#include "../libts/common/tuple_space.h"
+#include "server_histogram.h"
+#include "server_pool.h"
+
+typedef enum {
+  SERVER_OPERATION_OUT = 0,
+  SERVER_OPERATION_IN = 1,
+  SERVER_OPERATION_INP = 2,
+  SERVER_OPERATION_RD = 3,
+  SERVER_OPERATION_RDP = 4,
+  SERVER_OPERATIONS_COUNT = 5
+} server_operation_t;
 
 typedef struct {
   size_t total_received_messages;
@@ -18,16 +32,46 @@ typedef struct {
   size_t total_queued_rd_messages;
   size_t currently_stashed_tuples;
   size_t currently_queued_tuples;
+  size_t total_dispatched_waiters;
+  uint64_t acc_waiter_queue_time_ms;
+  uint64_t max_waiter_queue_time_ms;
   size_t acc_received_message_length;
   size_t acc_send_message_length;
   size_t total_serialization_issues;
   size_t total_invalid_get_tuples;
   size_t total_invalid_send_tuples;
   size_t total_errors;
+  // The intern table is server-wide, only the first shard reports it.
+  int64_t interned_strings;
+  int64_t interned_saved_bytes;
+  // In microseconds. Queue times are only recorded for in and rd.
+  server_histogram_t service_time[SERVER_OPERATIONS_COUNT];
+  server_histogram_t waiter_queue_time[SERVER_OPERATIONS_COUNT];
+  server_histogram_t ack_round_trip_time;
+  // Sampled by every shard when it reports its metrics. The ring depths are
+  // those of the pipeline, the max ones since the previous report.
+  server_pool_usage_t queue_nodes;
+  server_pool_usage_t connection_nodes;
+  ts_bool_t is_pipelined;
+  size_t ingress_depth;
+  size_t ingress_max_depth;
+  size_t egress_depth;
+  size_t egress_max_depth;
 } server_metrics_t;
 
-server_metrics_t server_initialize_metrics(void);
+void server_initialize_metrics(server_metrics_t* metrics);
+
+void server_merge_metrics(server_metrics_t* metrics,
+                          const server_metrics_t* other);
 
 void server_print_metrics(const server_metrics_t* metrics);
 
+// Writes the metrics in the Prometheus text format.
+void server_write_metrics(FILE* stream, const server_metrics_t* metrics);
+
+// Rewrites the file through a temporary one renamed over it, so readers
+// never see it partially written.
+ts_bool_t server_export_metrics(const char* path,
+                                const server_metrics_t* metrics);
+
 #endif  // __SERVER_METRICS_H__
@@ -0,0 +1,436 @@
+#include "server_pipeline.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../libts/unix/tuple_space_unix_device.h"
+#include "server_trace.h"
+
+typedef struct {
+  ts_data_recv_cb_t recv_cb;
+  ts_data_send_cb_t send_cb;
+  ts_clock_ms_cb_t clock_cb;
+  ts_device_context_destructor_cb_t destructor_cb;
+  ts_data_wait_cb_t wait_cb;
+  ts_data_recv_batch_cb_t recv_batch_cb;
+  ts_data_send_batch_cb_t send_batch_cb;
+  server_pipeline_t* pipeline;
+  ts_byte_t reserved[TS_DEVICE_CONTEXT_SIZE - sizeof(server_pipeline_t*)];
+  ts_byte_t current_state;  // ts_device_state_t
+  ts_byte_t can_receive_ip;
+} server_pipeline_device_context_t;
+
+static ts_bool_t server_pipeline_is_running(server_pipeline_t* pipeline) {
+  return __atomic_load_n(&pipeline->is_running, __ATOMIC_ACQUIRE);
+}
+
+static server_pipeline_message_t* server_pipeline_reserve_message(
+    server_pipeline_t* pipeline, server_pipeline_message_kind_t kind,
+    ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_pipeline_message_t* message =
+      (server_pipeline_message_t*)server_ring_reserve(&pipeline->ingress);
+  if (message == NULL) {
+    return NULL;
+  }
+  memset(message, 0, sizeof(server_pipeline_message_t));
+  message->kind = kind;
+  message->sender_ip_address = sender_ip_address;
+  message->sender_port_id = sender_port_id;
+  message->receive_time_ns = pipeline->receive_time_ns;
+  return message;
+}
+
+static void server_pipeline_error_cb(void* user_data) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  if (server_pipeline_reserve_message(pipeline, SERVER_PIPELINE_ERROR, 0, 0)) {
+    server_ring_commit(&pipeline->ingress);
+  }
+}
+
+static void server_pipeline_send_tuple_cb(void* user_data,
+                                          ts_tuple_field_t* tuple,
+                                          ts_size_t tuple_size,
+                                          ts_tuple_signature_t signature,
+                                          ts_ipv4_t sender_ip_address,
+                                          ts_port_t sender_port_id) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  server_pipeline_message_t* message = server_pipeline_reserve_message(
+      pipeline, SERVER_PIPELINE_SEND_TUPLE, sender_ip_address, sender_port_id);
+  if (message == NULL) {
+    ts_server_free_tuple(&pipeline->receiver_context, tuple, tuple_size,
+                         &pipeline->allocator);
+    return;
+  }
+  message->tuple = tuple;
+  message->tuple_size = tuple_size;
+  message->signature = signature;
+  server_ring_commit(&pipeline->ingress);
+}
+
+static void server_pipeline_get_tuple_cb(
+    void* user_data, ts_tuple_field_t* tuple, ts_size_t tuple_size,
+    ts_tuple_signature_t signature, ts_bool_t respond_when_available,
+    ts_bool_t remove_after_use, ts_ipv4_t sender_ip_address,
+    ts_port_t sender_port_id) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  server_pipeline_message_t* message = server_pipeline_reserve_message(
+      pipeline, SERVER_PIPELINE_GET_TUPLE, sender_ip_address, sender_port_id);
+  if (message == NULL) {
+    ts_server_free_tuple(&pipeline->receiver_context, tuple, tuple_size,
+                         &pipeline->allocator);
+    return;
+  }
+  message->tuple = tuple;
+  message->tuple_size = tuple_size;
+  message->signature = signature;
+  message->respond_when_available = respond_when_available;
+  message->remove_after_use = remove_after_use;
+  server_ring_commit(&pipeline->ingress);
+}
+
+static void server_pipeline_send_tuple_invalid_invariant_cb(
+    void* user_data, ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  if (server_pipeline_reserve_message(pipeline,
+                                      SERVER_PIPELINE_SEND_TUPLE_INVALID,
+                                      sender_ip_address, sender_port_id)) {
+    server_ring_commit(&pipeline->ingress);
+  }
+}
+
+static void server_pipeline_get_tuple_invalid_invariant_cb(
+    void* user_data, ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  if (server_pipeline_reserve_message(pipeline,
+                                      SERVER_PIPELINE_GET_TUPLE_INVALID,
+                                      sender_ip_address, sender_port_id)) {
+    server_ring_commit(&pipeline->ingress);
+  }
+}
+
+static void server_pipeline_serialization_issue_cb(
+    void* user_data, ts_client_to_server_message_type_t message_type,
+    ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  server_pipeline_message_t* message = server_pipeline_reserve_message(
+      pipeline, SERVER_PIPELINE_SERIALIZATION_ISSUE, sender_ip_address,
+      sender_port_id);
+  if (message != NULL) {
+    message->message_type = message_type;
+    server_ring_commit(&pipeline->ingress);
+  }
+}
+
+static void server_pipeline_ack_cb(void* user_data,
+                                   ts_ipv4_t sender_ip_address,
+                                   ts_port_t sender_port_id) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)user_data;
+  if (server_pipeline_reserve_message(pipeline, SERVER_PIPELINE_ACK,
+                                      sender_ip_address, sender_port_id)) {
+    server_ring_commit(&pipeline->ingress);
+  }
+}
+
+static ts_server_receiver_callbacks_t server_pipeline_callbacks(void) {
+  ts_server_receiver_callbacks_t callbacks;
+  memset(&callbacks, 0, sizeof(ts_server_receiver_callbacks_t));
+  callbacks.error_cb = server_pipeline_error_cb;
+  callbacks.get_tuple_cb = server_pipeline_get_tuple_cb;
+  callbacks.get_tuple_invalid_invariant_cb =
+      server_pipeline_get_tuple_invalid_invariant_cb;
+  callbacks.send_tuple_cb = server_pipeline_send_tuple_cb;
+  callbacks.send_tuple_invalid_invariant_cb =
+      server_pipeline_send_tuple_invalid_invariant_cb;
+  callbacks.ack_cb = server_pipeline_ack_cb;
+  callbacks.serialization_issue_cb = server_pipeline_serialization_issue_cb;
+  return callbacks;
+}
+
+// Every received datagram produces exactly one message, so receiving no more
+// datagrams than there are free slots never overflows the ring.
+static void* server_pipeline_receiver_thread(void* argument) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)argument;
+  ts_server_context_t* context = &pipeline->receiver_context;
+  while (server_pipeline_is_running(pipeline)) {
+    size_t free_slots =
+        pipeline->ingress.capacity - server_ring_depth(&pipeline->ingress);
+    if (free_slots == 0) {
+      server_ring_wait_for_space(&pipeline->ingress, -1);
+      continue;
+    }
+    if (free_slots > SERVER_PIPELINE_DATAGRAM_BATCH_SIZE) {
+      free_slots = SERVER_PIPELINE_DATAGRAM_BATCH_SIZE;
+    }
+    ts_size_t count = ts_server_receive_messages(
+        context, pipeline->received_datagrams, free_slots);
+    if (count == 0) {
+      ts_server_wait_for_message(context, -1);
+      continue;
+    }
+    for (ts_size_t i = 0; i < count; ++i) {
+      const ts_datagram_t* datagram = &pipeline->received_datagrams[i];
+      pipeline->receive_time_ns = datagram->receive_time_ns;
+      ts_server_process_messages(context, datagram, 1, pipeline,
+                                 &pipeline->allocator);
+    }
+  }
+  return NULL;
+}
+
+static void server_pipeline_send_datagrams(server_pipeline_t* pipeline,
+                                           const ts_datagram_t* datagrams,
+                                           ts_size_t datagrams_count) {
+  ts_device_context_t* device = &pipeline->receiver_context.device_context;
+  if (device->send_batch_cb != NULL) {
+    device->send_batch_cb(device, datagrams, datagrams_count);
+    return;
+  }
+  for (ts_size_t i = 0; i < datagrams_count; ++i) {
+    device->send_cb(device, datagrams[i].ip_address, datagrams[i].port_id,
+                    datagrams[i].buffer, datagrams[i].buffer_size);
+  }
+}
+
+static void* server_pipeline_sender_thread(void* argument) {
+  server_pipeline_t* pipeline = (server_pipeline_t*)argument;
+  while (server_pipeline_is_running(pipeline)) {
+    size_t count;
+    const ts_datagram_t* datagrams =
+        (const ts_datagram_t*)server_ring_peek(&pipeline->egress, &count);
+    if (datagrams == NULL) {
+      server_ring_wait_for_data(&pipeline->egress, -1);
+      continue;
+    }
+    server_pipeline_send_datagrams(pipeline, datagrams, count);
+    server_ring_release(&pipeline->egress, count);
+  }
+  return NULL;
+}
+
+static ts_bool_t server_pipeline_device_wait(void* device_context,
+                                             ts_int_t timeout_ms) {
+  server_pipeline_device_context_t* handle =
+      (server_pipeline_device_context_t*)device_context;
+  return server_ring_wait_for_data(&handle->pipeline->ingress, timeout_ms);
+}
+
+// Messages reach the matching thread decoded, see
+// server_dispatch_pipeline_messages.
+static ts_size_t server_pipeline_device_receive(
+    void* /*device_context*/, ts_ipv4_t* /*sender_ip_address*/,
+    ts_port_t* /*sender_port_id*/, ts_byte_t* /*buffer*/,
+    ts_size_t /*buffer_size*/) {
+  return 0;
+}
+
+static ts_bool_t server_pipeline_device_send(void* device_context,
+                                             ts_ipv4_t target_ip_address,
+                                             ts_port_t target_port_id,
+                                             const ts_byte_t* buffer,
+                                             ts_size_t buffer_size) {
+  server_pipeline_t* pipeline =
+      ((server_pipeline_device_context_t*)device_context)->pipeline;
+  ts_datagram_t* datagram;
+  while ((datagram = (ts_datagram_t*)server_ring_reserve(&pipeline->egress)) ==
+         NULL) {
+    if (!server_pipeline_is_running(pipeline)) {
+      return TS_FALSE;
+    }
+    server_ring_wait_for_space(&pipeline->egress, -1);
+  }
+  datagram->ip_address = target_ip_address;
+  datagram->port_id = target_port_id;
+  datagram->buffer_size = buffer_size;
+  memcpy(datagram->buffer, buffer, buffer_size);
+  server_ring_commit(&pipeline->egress);
+  return TS_TRUE;
+}
+
+static ts_size_t server_pipeline_device_send_batch(
+    void* device_context, const ts_datagram_t* datagrams,
+    ts_size_t datagrams_count) {
+  ts_size_t sent = 0;
+  while ((sent < datagrams_count) &&
+         server_pipeline_device_send(
+             device_context, datagrams[sent].ip_address,
+             datagrams[sent].port_id, datagrams[sent].buffer,
+             datagrams[sent].buffer_size)) {
+    ++sent;
+  }
+  return sent;
+}
+
+static void server_pipeline_release_messages(server_pipeline_t* pipeline) {
+  size_t count;
+  server_pipeline_message_t* messages;
+  while ((messages = (server_pipeline_message_t*)server_ring_peek(
+              &pipeline->ingress, &count)) != NULL) {
+    for (size_t i = 0; i < count; ++i) {
+      if (messages[i].tuple != NULL) {
+        ts_server_free_tuple(&pipeline->receiver_context, messages[i].tuple,
+                             messages[i].tuple_size, &pipeline->allocator);
+      }
+    }
+    server_ring_release(&pipeline->ingress, count);
+  }
+}
+
+static void server_pipeline_device_destructor(void* device_context) {
+  server_pipeline_t* pipeline =
+      ((server_pipeline_device_context_t*)device_context)->pipeline;
+  if (server_pipeline_is_running(pipeline)) {
+    __atomic_store_n(&pipeline->is_running, TS_FALSE, __ATOMIC_RELEASE);
+    server_ring_wake(&pipeline->ingress);
+    server_ring_wake(&pipeline->egress);
+    pthread_join(pipeline->receiver_thread, NULL);
+    pthread_join(pipeline->sender_thread, NULL);
+  }
+  server_pipeline_release_messages(pipeline);
+  ts_close_server_context(&pipeline->receiver_context);
+  server_destroy_ring(&pipeline->ingress);
+  server_destroy_ring(&pipeline->egress);
+}
+
+ts_bool_t server_initialize_pipeline(server_pipeline_t* pipeline,
+                                     ts_device_context_t device_context,
+                                     ts_size_t tuple_header_size,
+                                     ts_allocator_t allocator) {
+  memset(pipeline, 0, sizeof(server_pipeline_t));
+  if (!ts_initialize_server_context(&pipeline->receiver_context,
+                                    device_context,
+                                    server_pipeline_callbacks())) {
+    return TS_FALSE;
+  }
+  pipeline->receiver_context.tuple_header_size = tuple_header_size;
+  pipeline->allocator = allocator;
+  if (!server_initialize_ring(&pipeline->ingress,
+                              sizeof(server_pipeline_message_t),
+                              SERVER_PIPELINE_RING_SIZE) ||
+      !server_initialize_ring(&pipeline->egress, sizeof(ts_datagram_t),
+                              SERVER_PIPELINE_RING_SIZE)) {
+    return TS_FALSE;
+  }
+  // Lets the receiver thread sleep on the device and still be woken up by
+  // server_ring_wake on shutdown.
+  return ts_unix_device_watch_descriptor(
+      &pipeline->receiver_context.device_context,
+      pipeline->ingress.space_descriptor);
+}
+
+ts_device_context_t server_pipeline_device_context(
+    server_pipeline_t* pipeline) {
+  ts_device_context_t device_context;
+  memset(&device_context, 0, sizeof(ts_device_context_t));
+  server_pipeline_device_context_t* handle =
+      (server_pipeline_device_context_t*)&device_context;
+  handle->recv_cb = server_pipeline_device_receive;
+  handle->send_cb = server_pipeline_device_send;
+  handle->clock_cb = pipeline->receiver_context.device_context.clock_cb;
+  handle->destructor_cb = server_pipeline_device_destructor;
+  handle->wait_cb = server_pipeline_device_wait;
+  handle->send_batch_cb = server_pipeline_device_send_batch;
+  handle->pipeline = pipeline;
+  handle->current_state = TS_DEVICE_INITIALIZED;
+  return device_context;
+}
+
+ts_bool_t server_start_pipeline(server_pipeline_t* pipeline) {
+  // Signals are left to the matching thread
+  sigset_t signals;
+  sigset_t previous_signals;
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+  __atomic_store_n(&pipeline->is_running, TS_TRUE, __ATOMIC_RELEASE);
+  ts_bool_t status = TS_FALSE;
+  if (pthread_create(&pipeline->receiver_thread, NULL,
+                     server_pipeline_receiver_thread, pipeline) == 0) {
+    status = pthread_create(&pipeline->sender_thread, NULL,
+                            server_pipeline_sender_thread, pipeline) == 0;
+    if (!status) {
+      __atomic_store_n(&pipeline->is_running, TS_FALSE, __ATOMIC_RELEASE);
+      server_ring_wake(&pipeline->ingress);
+      pthread_join(pipeline->receiver_thread, NULL);
+    }
+  } else {
+    __atomic_store_n(&pipeline->is_running, TS_FALSE, __ATOMIC_RELEASE);
+  }
+  pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+  return status;
+}
+
+static void server_dispatch_pipeline_message(
+    const ts_server_receiver_callbacks_t* callbacks, void* user_data,
+    const server_pipeline_message_t* message) {
+  server_trace_receive(message->receive_time_ns);
+  switch (message->kind) {
+    case SERVER_PIPELINE_SEND_TUPLE:
+      callbacks->send_tuple_cb(user_data, message->tuple, message->tuple_size,
+                               message->signature, message->sender_ip_address,
+                               message->sender_port_id);
+      return;
+    case SERVER_PIPELINE_SEND_TUPLE_INVALID:
+      callbacks->send_tuple_invalid_invariant_cb(
+          user_data, message->sender_ip_address, message->sender_port_id);
+      return;
+    case SERVER_PIPELINE_GET_TUPLE:
+      callbacks->get_tuple_cb(user_data, message->tuple, message->tuple_size,
+                              message->signature,
+                              message->respond_when_available,
+                              message->remove_after_use,
+                              message->sender_ip_address,
+                              message->sender_port_id);
+      return;
+    case SERVER_PIPELINE_GET_TUPLE_INVALID:
+      callbacks->get_tuple_invalid_invariant_cb(
+          user_data, message->sender_ip_address, message->sender_port_id);
+      return;
+    case SERVER_PIPELINE_SERIALIZATION_ISSUE:
+      callbacks->serialization_issue_cb(user_data, message->message_type,
+                                        message->sender_ip_address,
+                                        message->sender_port_id);
+      return;
+    case SERVER_PIPELINE_ACK:
+      callbacks->ack_cb(user_data, message->sender_ip_address,
+                        message->sender_port_id);
+      return;
+    case SERVER_PIPELINE_ERROR:
+    default:
+      callbacks->error_cb(user_data);
+      return;
+  }
+}
+
+ts_size_t server_dispatch_pipeline_messages(
+    server_pipeline_t* pipeline,
+    const ts_server_receiver_callbacks_t* callbacks, void* user_data,
+    ts_size_t max_messages) {
+  ts_size_t dispatched = 0;
+  while (dispatched < max_messages) {
+    size_t count;
+    const server_pipeline_message_t* messages =
+        (const server_pipeline_message_t*)server_ring_peek(&pipeline->ingress,
+                                                           &count);
+    if (messages == NULL) {
+      break;
+    }
+    if (count > max_messages - dispatched) {
+      count = max_messages - dispatched;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      server_dispatch_pipeline_message(callbacks, user_data, &messages[i]);
+    }
+    server_ring_release(&pipeline->ingress, count);
+    dispatched += count;
+  }
+  return dispatched;
+}
+
+void server_sample_pipeline(server_pipeline_t* pipeline,
+                            server_metrics_t* metrics) {
+  metrics->is_pipelined = TS_TRUE;
+  metrics->ingress_depth = server_ring_depth(&pipeline->ingress);
+  metrics->ingress_max_depth = server_ring_take_max_depth(&pipeline->ingress);
+  metrics->egress_depth = server_ring_depth(&pipeline->egress);
+  metrics->egress_max_depth = server_ring_take_max_depth(&pipeline->egress);
+}
@@ -0,0 +1,79 @@
+#ifndef __SERVER_PIPELINE_H__
+#define __SERVER_PIPELINE_H__
+
+#include <pthread.h>
+
+#include "../libts/common/tuple_space_network.h"
+#include "server_metrics.h"
+#include "server_ring.h"
+
+#define SERVER_PIPELINE_RING_SIZE 4096  // power of two
+#define SERVER_PIPELINE_DATAGRAM_BATCH_SIZE 64
+
+typedef enum {
+  SERVER_PIPELINE_ERROR = 0,
+  SERVER_PIPELINE_SEND_TUPLE = 1,
+  SERVER_PIPELINE_SEND_TUPLE_INVALID = 2,
+  SERVER_PIPELINE_GET_TUPLE = 3,
+  SERVER_PIPELINE_GET_TUPLE_INVALID = 4,
+  SERVER_PIPELINE_SERIALIZATION_ISSUE = 5,
+  SERVER_PIPELINE_ACK = 6
+} server_pipeline_message_kind_t;
+
+// A decoded client message, one per received datagram.
+typedef struct {
+  server_pipeline_message_kind_t kind;
+  ts_tuple_field_t* tuple;
+  ts_size_t tuple_size;
+  ts_tuple_signature_t signature;
+  ts_bool_t respond_when_available;
+  ts_bool_t remove_after_use;
+  ts_client_to_server_message_type_t message_type;
+  ts_ipv4_t sender_ip_address;
+  ts_port_t sender_port_id;
+  uint64_t receive_time_ns;
+} server_pipeline_message_t;
+
+// Splits the server into three threads. The receiver thread reads datagrams
+// from the device and decodes them into the ingress ring, the matching thread
+// (the caller) dispatches them and its replies go through the egress ring to
+// the sender thread, which writes them to the same device.
+typedef struct {
+  ts_server_context_t receiver_context;
+  ts_allocator_t allocator;
+  server_ring_t ingress;
+  server_ring_t egress;
+  pthread_t receiver_thread;
+  pthread_t sender_thread;
+  ts_bool_t is_running;
+  uint64_t receive_time_ns;  // of the datagram the receiver decodes
+  ts_datagram_t received_datagrams[SERVER_PIPELINE_DATAGRAM_BATCH_SIZE];
+} server_pipeline_t;
+
+// The allocator is used by two threads, so it must not keep per-thread
+// state. Tuples get the same tuple_header_size as the matching side uses.
+ts_bool_t server_initialize_pipeline(server_pipeline_t* pipeline,
+                                     ts_device_context_t device_context,
+                                     ts_size_t tuple_header_size,
+                                     ts_allocator_t allocator);
+
+// Device for the matching thread: waiting waits for decoded messages and
+// sends go to the egress ring. Its destructor stops the pipeline and closes
+// the underlying device.
+ts_device_context_t server_pipeline_device_context(
+    server_pipeline_t* pipeline);
+
+ts_bool_t server_start_pipeline(server_pipeline_t* pipeline);
+
+// Passes up to max_messages decoded messages to the callbacks and returns
+// the number of messages dispatched.
+ts_size_t server_dispatch_pipeline_messages(
+    server_pipeline_t* pipeline,
+    const ts_server_receiver_callbacks_t* callbacks, void* user_data,
+    ts_size_t max_messages);
+
+// Records the ring depths in the metrics and restarts their max depths.
+void server_sample_pipeline(server_pipeline_t* pipeline,
+                            server_metrics_t* metrics);
+
+#endif  // __SERVER_PIPELINE_H__
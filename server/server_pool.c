@@ -0,0 +1,100 @@
+#include "server_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../libts/common/tuple_space.h"
+
+// Objects smaller than a cache line are padded to a power of two so that none
+// of them straddles two lines; larger ones are padded to whole lines.
+static size_t server_pool_object_size(size_t object_size) {
+  size_t size = sizeof(server_pool_free_node_t);
+  if (object_size > SERVER_POOL_CACHE_LINE_SIZE) {
+    return (object_size + SERVER_POOL_CACHE_LINE_SIZE - 1) &
+           ~(size_t)(SERVER_POOL_CACHE_LINE_SIZE - 1);
+  }
+  while (size < object_size) {
+    size *= 2;
+  }
+  return size;
+}
+
+void server_initialize_pool(server_pool_t* pool, size_t object_size) {
+  memset(pool, 0, sizeof(server_pool_t));
+  pool->object_size = server_pool_object_size(object_size);
+  pool->objects_per_slab =
+      (SERVER_POOL_SLAB_SIZE - SERVER_POOL_CACHE_LINE_SIZE) / pool->object_size;
+  if (pool->objects_per_slab == 0) {
+    pool->objects_per_slab = 1;
+  }
+}
+
+static ts_bool_t server_pool_refill(server_pool_t* pool) {
+  size_t slab_size =
+      SERVER_POOL_CACHE_LINE_SIZE + pool->objects_per_slab * pool->object_size;
+  slab_size = (slab_size + SERVER_POOL_CACHE_LINE_SIZE - 1) &
+              ~(size_t)(SERVER_POOL_CACHE_LINE_SIZE - 1);
+  server_pool_slab_t* slab = (server_pool_slab_t*)aligned_alloc(
+      SERVER_POOL_CACHE_LINE_SIZE, slab_size);
+  if (slab == NULL) {
+    return TS_FALSE;
+  }
+  slab->next_slab = pool->slabs;
+  pool->slabs = slab;
+  ++pool->usage.slab_count;
+  char* objects = (char*)slab + SERVER_POOL_CACHE_LINE_SIZE;
+  for (size_t i = pool->objects_per_slab; i > 0; --i) {
+    server_pool_free_node_t* node =
+        (server_pool_free_node_t*)(objects + (i - 1) * pool->object_size);
+    node->next_node = pool->free_list;
+    pool->free_list = node;
+  }
+  pool->usage.free_objects += pool->objects_per_slab;
+  return TS_TRUE;
+}
+
+void* server_pool_allocate(server_pool_t* pool) {
+  if (pool->free_list == NULL && !server_pool_refill(pool)) {
+    return NULL;
+  }
+  server_pool_free_node_t* node = pool->free_list;
+  pool->free_list = (server_pool_free_node_t*)node->next_node;
+  --pool->usage.free_objects;
+  if (++pool->usage.live_objects > pool->usage.peak_objects) {
+    pool->usage.peak_objects = pool->usage.live_objects;
+  }
+  return node;
+}
+
+void server_pool_free(server_pool_t* pool, void* object) {
+  server_pool_free_node_t* node = (server_pool_free_node_t*)object;
+  node->next_node = pool->free_list;
+  pool->free_list = node;
+  --pool->usage.live_objects;
+  ++pool->usage.free_objects;
+}
+
+void server_destroy_pool(server_pool_t* pool) {
+  while (pool->slabs != NULL) {
+    server_pool_slab_t* slab = pool->slabs;
+    pool->slabs = (server_pool_slab_t*)slab->next_slab;
+    free(slab);
+  }
+  memset(pool, 0, sizeof(server_pool_t));
+}
+
+void server_merge_pool_usage(server_pool_usage_t* usage,
+                             const server_pool_usage_t* other) {
+  usage->live_objects += other->live_objects;
+  usage->free_objects += other->free_objects;
+  usage->peak_objects += other->peak_objects;
+  usage->slab_count += other->slab_count;
+}
+
+void server_print_pool_usage(const char* name,
+                             const server_pool_usage_t* usage) {
+  printf("Pool %s: live %zu, free %zu, peak %zu, slabs %zu\n", name,
+         usage->live_objects, usage->free_objects, usage->peak_objects,
+         usage->slab_count);
+}
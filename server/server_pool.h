@@ -0,0 +1,51 @@
+#ifndef __SERVER_POOL_H__
+#define __SERVER_POOL_H__
+
+#include <stddef.h>
+
+#define SERVER_POOL_CACHE_LINE_SIZE 64
+#define SERVER_POOL_SLAB_SIZE 4096
+
+// Fixed-size object pool. Objects are carved out of cache-line aligned slabs
+// and recycled through an intrusive free list; a slab is refilled in one go
+// when the free list runs dry and is only returned on destroy.
+typedef struct {
+  void* next_node;
+} server_pool_free_node_t;
+
+typedef struct {
+  void* next_slab;
+} server_pool_slab_t;
+
+typedef struct {
+  size_t live_objects;
+  size_t free_objects;
+  size_t peak_objects;
+  size_t slab_count;
+} server_pool_usage_t;
+
+typedef struct {
+  size_t object_size;
+  size_t objects_per_slab;
+  server_pool_free_node_t* free_list;
+  server_pool_slab_t* slabs;
+  server_pool_usage_t usage;
+} server_pool_t;
+
+void server_initialize_pool(server_pool_t* pool, size_t object_size);
+
+// Returns NULL when a new slab cannot be allocated.
+void* server_pool_allocate(server_pool_t* pool);
+
+void server_pool_free(server_pool_t* pool, void* object);
+
+void server_destroy_pool(server_pool_t* pool);
+
+// Adds up the usage of two pools, the peaks are summed as well.
+void server_merge_pool_usage(server_pool_usage_t* usage,
+                             const server_pool_usage_t* other);
+
+void server_print_pool_usage(const char* name,
+                             const server_pool_usage_t* usage);
+
+#endif  // __SERVER_POOL_H__
@@ -1,10 +1,166 @@
 #include "server_process_requests.h"
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
-#include "../libts/unix/tuple_space_unix_debug.h"
 #include "../libts/unix/tuple_space_unix_device.h"
+#include "server_epoch.h"
 #include "server_log.h"
+#include "server_trace.h"
+
+// In wire storage every tuple block ends with the serialized fields of the
+// tuple, empty for templates, which are never sent.
+typedef struct {
+  ts_ushort_t size;
+  ts_byte_t bytes[];
+} server_wire_tuple_t;
+
+static server_wire_tuple_t* server_wire_tuple(const server_field_t* tuple,
+                                              ts_size_t tuple_size) {
+  return (server_wire_tuple_t*)&tuple[tuple_size];
+}
+
+static ts_size_t server_block_size(const server_data_t* data,
+                                   ts_size_t tuple_size, ts_size_t wire_size) {
+  ts_size_t block_size = sizeof(server_field_t) * tuple_size;
+  if (data->is_wire_storage) {
+    block_size += sizeof(server_wire_tuple_t) + wire_size;
+  }
+  return block_size;
+}
+
+static ts_size_t server_tuple_block_size(const server_data_t* data,
+                                         const server_field_t* tuple,
+                                         ts_size_t tuple_size) {
+  return server_block_size(
+      data, tuple_size,
+      data->is_wire_storage ? server_wire_tuple(tuple, tuple_size)->size : 0);
+}
+
+static server_field_t* server_allocate_tuple(server_data_t* data,
+                                             ts_size_t tuple_size,
+                                             const ts_byte_t* wire_bytes,
+                                             ts_size_t wire_size) {
+  server_field_t* tuple = (server_field_t*)ts_server_allocate_tuple(
+      &data->server_context, server_block_size(data, tuple_size, wire_size),
+      &data->allocator);
+  if (tuple != NULL && data->is_wire_storage) {
+    server_wire_tuple_t* wire_tuple = server_wire_tuple(tuple, tuple_size);
+    wire_tuple->size = (ts_ushort_t)wire_size;
+    if (wire_size > 0) {
+      memcpy(wire_tuple->bytes, wire_bytes, wire_size);
+    }
+  }
+  return tuple;
+}
+
+static void server_deallocate_tuple(server_data_t* data, server_field_t* tuple,
+                                    ts_size_t tuple_size) {
+  ts_server_release_tuple(&data->server_context, (ts_tuple_field_t*)tuple,
+                          server_tuple_block_size(data, tuple, tuple_size),
+                          &data->allocator);
+}
+
+server_field_t* server_compact_tuple(server_data_t* data,
+                                     ts_tuple_field_t* tuple,
+                                     ts_size_t tuple_size) {
+  ts_byte_t wire_bytes[TS_BUFFER_SIZE];
+  ts_size_t wire_size =
+      data->is_wire_storage
+          ? ts_serialize_tuple(tuple, tuple_size, wire_bytes,
+                               TS_BUFFER_SIZE - 1)
+          : 0;
+  server_field_t* compact_tuple = NULL;
+  if (!data->is_wire_storage || wire_size > 0) {
+    compact_tuple =
+        server_allocate_tuple(data, tuple_size, wire_bytes, wire_size);
+  }
+  if (compact_tuple != NULL &&
+      !server_compact_fields(data->strings, compact_tuple, tuple,
+                             tuple_size)) {
+    server_deallocate_tuple(data, compact_tuple, tuple_size);
+    compact_tuple = NULL;
+  }
+  ts_server_free_tuple(&data->server_context, tuple, tuple_size,
+                       &data->allocator);
+  return compact_tuple;
+}
+
+server_field_t* server_copy_tuple(server_data_t* data,
+                                  const server_field_t* tuple,
+                                  ts_size_t tuple_size) {
+  ts_size_t block_size = server_tuple_block_size(data, tuple, tuple_size);
+  server_field_t* copy = (server_field_t*)ts_server_allocate_tuple(
+      &data->server_context, block_size, &data->allocator);
+  if (copy != NULL) {
+    memcpy(copy, tuple, block_size);
+    server_retain_field_strings(data->strings, copy, tuple_size);
+  }
+  return copy;
+}
+
+static server_field_t* server_copy_template_tuple(server_data_t* data,
+                                                  const server_field_t* tuple,
+                                                  ts_size_t tuple_size) {
+  server_field_t* copy = server_allocate_tuple(data, tuple_size, NULL, 0);
+  if (copy != NULL) {
+    memcpy(copy, tuple, sizeof(server_field_t) * tuple_size);
+    server_retain_field_strings(data->strings, copy, tuple_size);
+  }
+  return copy;
+}
+
+static void server_release_tuple(server_data_t* data, server_field_t* tuple,
+                                 ts_size_t tuple_size) {
+  server_release_field_strings(data->strings, tuple, tuple_size);
+  server_deallocate_tuple(data, tuple, tuple_size);
+}
+
+static void server_free_retired_tuple_cb(void* context, void* memory,
+                                         ts_size_t size) {
+  server_release_tuple((server_data_t*)context, (server_field_t*)memory, size);
+}
+
+// Threads sharing a stash retire every tuple, readers of other threads may
+// still be matching against it.
+void server_free_tuple(server_data_t* data, server_field_t* tuple,
+                       ts_size_t tuple_size) {
+  if (tuple == NULL) {
+    return;
+  }
+  if (server_epoch_retire(tuple, tuple_size, server_free_retired_tuple_cb,
+                          data)) {
+    return;
+  }
+  server_release_tuple(data, tuple, tuple_size);
+}
+
+ts_bool_t server_send_tuple(server_data_t* data, const server_field_t* tuple,
+                            ts_size_t tuple_size, ts_ipv4_t receiver_ip_address,
+                            ts_port_t receiver_port_id) {
+  if (data->is_wire_storage) {
+    const server_wire_tuple_t* wire_tuple =
+        server_wire_tuple(tuple, tuple_size);
+    return ts_server_send_server_to_client_serialized_tuple(
+        &data->server_context, wire_tuple->bytes, wire_tuple->size, tuple_size,
+        receiver_ip_address, receiver_port_id);
+  }
+  ts_tuple_field_t expanded_tuple[TS_MAX_TUPLE_SIZE];
+  server_expand_fields(data->strings, expanded_tuple, tuple, tuple_size);
+  return ts_server_send_server_to_client_tuple(
+      &data->server_context, expanded_tuple, tuple_size, receiver_ip_address,
+      receiver_port_id);
+}
+
+void server_log_fields(server_data_t* data, const server_field_t* tuple,
+                       ts_size_t tuple_size) {
+  if (SERVER_LOG_IS_ENABLED(SERVER_LOG_LEVEL_DEBUG)) {
+    ts_tuple_field_t expanded_tuple[TS_MAX_TUPLE_SIZE];
+    server_expand_fields(data->strings, expanded_tuple, tuple, tuple_size);
+    server_log_tuple_record(expanded_tuple, tuple_size);
+  }
+}
 
 void server_send_single_ack(server_data_t* data, ts_ipv4_t sender_ip_address,
                             ts_port_t sender_port_id) {
@@ -12,15 +168,78 @@ void server_send_single_ack(server_data_t* data, ts_ipv4_t sender_ip_address,
                                       sender_port_id);
 }
 
+// A tuple whose node cannot be added is dropped, it would never be resent.
+static void server_add_connection(server_data_t* data, ts_ipv4_t receiver_ip,
+                                  ts_port_t receiver_port,
+                                  server_field_t* data_tuple,
+                                  ts_size_t tuple_size,
+                                  ts_bool_t insert_if_rejected,
+                                  ts_bool_t ping_for_await) {
+  if (server_add_connection_node(&data->active_connections, receiver_ip,
+                                 receiver_port, data_tuple, tuple_size,
+                                 insert_if_rejected, ping_for_await)) {
+    return;
+  }
+  SERVER_LOG_WARNING(
+      "Dropped the pending response to %s and port %d, it could not be "
+      "tracked\n",
+      ts_unix_ipv4_to_str(receiver_ip), receiver_port);
+  ++data->metrics.total_errors;
+  server_free_tuple(data, data_tuple, tuple_size);
+}
+
+// Without a copy the tuple is sent once and never resent.
+static server_field_t* server_copy_sent_tuple(server_data_t* data,
+                                              const server_field_t* tuple,
+                                              ts_size_t tuple_size,
+                                              ts_ipv4_t receiver_ip,
+                                              ts_port_t receiver_port) {
+  server_field_t* copy = server_copy_tuple(data, tuple, tuple_size);
+  if (copy == NULL) {
+    SERVER_LOG_WARNING(
+        "The tuple sent to %s and port %d could not be copied, it will not "
+        "be resent\n",
+        ts_unix_ipv4_to_str(receiver_ip), receiver_port);
+    ++data->metrics.total_errors;
+  }
+  return copy;
+}
+
+// Templates of get requests are borrowed, the one queued for a match is a
+// copy of its own.
+static ts_bool_t server_queue_template_tuple(server_data_t* data,
+                                             server_field_t* tuple,
+                                             ts_size_t tuple_size,
+                                             ts_tuple_signature_t signature,
+                                             ts_ipv4_t sender_ip_address,
+                                             ts_port_t sender_port_id,
+                                             ts_bool_t remove_matching) {
+  server_field_t* queued_tuple =
+      server_copy_template_tuple(data, tuple, tuple_size);
+  if ((queued_tuple == NULL) ||
+      !server_insert_template_tuple(&data->tuple_queue, queued_tuple,
+                                    tuple_size, signature, sender_ip_address,
+                                    sender_port_id, remove_matching)) {
+    server_free_tuple(data, queued_tuple, tuple_size);
+    SERVER_LOG_WARNING(
+        "Dropped the template from %s and port %d, it could not be queued\n",
+        ts_unix_ipv4_to_str(sender_ip_address), sender_port_id);
+    ++data->metrics.total_errors;
+    return TS_FALSE;
+  }
+  ++data->metrics.currently_queued_tuples;
+  server_profile_population(&data->profile, queued_tuple, tuple_size,
+                            signature, 1);
+  return TS_TRUE;
+}
+
 static ts_bool_t server_process_in_send_tuple_to_client(
-    server_data_t* data, ts_tuple_field_t* data_tuple, ts_size_t tuple_size,
+    server_data_t* data, server_field_t* data_tuple, ts_size_t tuple_size,
     ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
-  ts_bool_t status = ts_server_send_server_to_client_tuple(
-      &data->server_context, data_tuple, tuple_size, sender_ip_address,
-      sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, data_tuple, tuple_size, TS_TRUE,
-                             TS_FALSE);
+  ts_bool_t status = server_send_tuple(data, data_tuple, tuple_size,
+                                       sender_ip_address, sender_port_id);
+  server_add_connection(data, sender_ip_address, sender_port_id, data_tuple,
+                        tuple_size, TS_TRUE, TS_FALSE);
   return status;
 }
 
@@ -29,49 +248,57 @@ static ts_bool_t server_process_in_await_for_tuple(server_data_t* data,
                                                    ts_port_t sender_port_id) {
   ts_bool_t status = ts_server_send_server_to_client_await_for_tuple(
       &data->server_context, sender_ip_address, sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, NULL, 1, TS_FALSE, TS_TRUE);
+  server_add_connection(data, sender_ip_address, sender_port_id, NULL, 1,
+                        TS_FALSE, TS_TRUE);
   return status;
 }
 
-void server_process_in(server_data_t* data, ts_tuple_field_t* tuple,
-                       ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                       ts_port_t sender_port_id) {
-  ts_tuple_field_t* data_tuple =
-      server_get_data_node(&data->tuple_stash, tuple, tuple_size, TS_TRUE);
+void server_process_in(server_data_t* data, server_field_t* tuple,
+                       ts_size_t tuple_size, ts_tuple_signature_t signature,
+                       ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_scan_stats_t scan_stats;
+  memset(&scan_stats, 0, sizeof(server_scan_stats_t));
+  server_field_t* data_tuple =
+      server_get_data_node(data->tuple_stash, tuple, tuple_size, signature,
+                           TS_TRUE, &scan_stats);
+  server_trace_stage(SERVER_TRACE_MATCH);
+  server_profile_lookup(&data->profile, tuple, tuple_size, signature,
+                        SERVER_PROFILE_STASH_LOOKUP, &scan_stats,
+                        data_tuple != NULL);
   if (data_tuple != NULL) {
     --data->metrics.currently_stashed_tuples;
-    server_log("Found matching tuple:\n");
-    ts_print_tuple(data_tuple, tuple_size);
+    server_profile_population(&data->profile, data_tuple, tuple_size,
+                              signature, -1);
+    SERVER_LOG_DEBUG("Found matching tuple:\n");
+    server_log_fields(data, data_tuple, tuple_size);
     ts_bool_t status = server_process_in_send_tuple_to_client(
         data, data_tuple, tuple_size, sender_ip_address, sender_port_id);
-    server_log(
+    SERVER_LOG_DEBUG(
         "Responded to the client at %s:%d with a given tuple with "
         "status %d - removing tuple from stash\n",
         ts_unix_ipv4_to_str(sender_ip_address), sender_port_id, status);
     ++data->metrics.total_send_mesages;
     data->metrics.acc_send_message_length += tuple_size;
-    data->allocator.deallocator_cb(data->allocator.context, tuple);
     return;
   }
-  ++data->metrics.currently_queued_tuples;
+  if (!server_queue_template_tuple(data, tuple, tuple_size, signature,
+                                   sender_ip_address, sender_port_id,
+                                   TS_TRUE)) {
+    return;
+  }
   ++data->metrics.total_queued_in_messages;
-  server_log(
+  SERVER_LOG_DEBUG(
       "No matching tuples has been found - queueing tuple for a match\n");
-  server_insert_template_tuple(&data->tuple_queue, tuple, tuple_size,
-                               sender_ip_address, sender_port_id, TS_TRUE);
   server_process_in_await_for_tuple(data, sender_ip_address, sender_port_id);
 }
 
 static ts_bool_t server_process_inp_send_tuple_to_client(
-    server_data_t* data, ts_tuple_field_t* data_tuple, ts_size_t tuple_size,
+    server_data_t* data, server_field_t* data_tuple, ts_size_t tuple_size,
     ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
-  ts_bool_t status = ts_server_send_server_to_client_tuple(
-      &data->server_context, data_tuple, tuple_size, sender_ip_address,
-      sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, data_tuple, tuple_size, TS_TRUE,
-                             TS_FALSE);
+  ts_bool_t status = server_send_tuple(data, data_tuple, tuple_size,
+                                       sender_ip_address, sender_port_id);
+  server_add_connection(data, sender_ip_address, sender_port_id, data_tuple,
+                        tuple_size, TS_TRUE, TS_FALSE);
   return status;
 }
 
@@ -80,51 +307,60 @@ static ts_bool_t server_process_inp_await_for_tuple(server_data_t* data,
                                                     ts_port_t sender_port_id) {
   ts_bool_t status = ts_server_send_server_to_client_await_for_tuple(
       &data->server_context, sender_ip_address, sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, NULL, 0, TS_FALSE, TS_TRUE);
+  server_add_connection(data, sender_ip_address, sender_port_id, NULL, 0,
+                        TS_FALSE, TS_TRUE);
   return status;
 }
 
-void server_process_inp(server_data_t* data, ts_tuple_field_t* tuple,
-                        ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                        ts_port_t sender_port_id) {
-  ts_tuple_field_t* data_tuple =
-      server_get_data_node(&data->tuple_stash, tuple, tuple_size, TS_TRUE);
+void server_process_inp(server_data_t* data, server_field_t* tuple,
+                        ts_size_t tuple_size, ts_tuple_signature_t signature,
+                        ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_scan_stats_t scan_stats;
+  memset(&scan_stats, 0, sizeof(server_scan_stats_t));
+  server_field_t* data_tuple =
+      server_get_data_node(data->tuple_stash, tuple, tuple_size, signature,
+                           TS_TRUE, &scan_stats);
+  server_trace_stage(SERVER_TRACE_MATCH);
+  server_profile_lookup(&data->profile, tuple, tuple_size, signature,
+                        SERVER_PROFILE_STASH_LOOKUP, &scan_stats,
+                        data_tuple != NULL);
   if (data_tuple != NULL) {
     --data->metrics.currently_stashed_tuples;
-    server_log("Found matching tuple:\n");
-    ts_print_tuple(data_tuple, tuple_size);
+    server_profile_population(&data->profile, data_tuple, tuple_size,
+                              signature, -1);
+    SERVER_LOG_DEBUG("Found matching tuple:\n");
+    server_log_fields(data, data_tuple, tuple_size);
     ts_bool_t status = server_process_inp_send_tuple_to_client(
         data, data_tuple, tuple_size, sender_ip_address, sender_port_id);
-    server_log(
+    SERVER_LOG_DEBUG(
         "Responded to the client at %s:%d with a given tuple with "
         "status %d - removing tuple from stash\n",
         ts_unix_ipv4_to_str(sender_ip_address), sender_port_id, status);
     ++data->metrics.total_send_mesages;
     data->metrics.acc_send_message_length += tuple_size;
-    data->allocator.deallocator_cb(data->allocator.context, tuple);
     return;
   }
   ++data->metrics.total_rejected_inp_messages;
-  data->allocator.deallocator_cb(data->allocator.context, tuple);
   ts_bool_t status = ts_server_send_server_to_client_lack_of_tuple(
       &data->server_context, sender_ip_address, sender_port_id);
   server_process_inp_await_for_tuple(data, sender_ip_address, sender_port_id);
-  server_log(
+  SERVER_LOG_DEBUG(
       "No matching tuples has been found - responding to a client about it "
       "with status %d\n",
       status);
 }
 
 static ts_bool_t server_process_rd_send_tuple_to_client(
-    server_data_t* data, ts_tuple_field_t* data_tuple, ts_size_t tuple_size,
+    server_data_t* data, server_field_t* data_tuple, ts_size_t tuple_size,
     ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
-  ts_bool_t status = ts_server_send_server_to_client_tuple(
-      &data->server_context, data_tuple, tuple_size, sender_ip_address,
-      sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, data_tuple, tuple_size, TS_FALSE,
-                             TS_FALSE);
+  ts_bool_t status = server_send_tuple(data, data_tuple, tuple_size,
+                                       sender_ip_address, sender_port_id);
+  server_field_t* sent_tuple = server_copy_sent_tuple(
+      data, data_tuple, tuple_size, sender_ip_address, sender_port_id);
+  if (sent_tuple != NULL) {
+    server_add_connection(data, sender_ip_address, sender_port_id, sent_tuple,
+                          tuple_size, TS_FALSE, TS_FALSE);
+  }
   return status;
 }
 
@@ -133,48 +369,58 @@ static ts_bool_t server_process_rd_await_for_tuple(server_data_t* data,
                                                    ts_port_t sender_port_id) {
   ts_bool_t status = ts_server_send_server_to_client_await_for_tuple(
       &data->server_context, sender_ip_address, sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, NULL, 1, TS_FALSE, TS_FALSE);
+  server_add_connection(data, sender_ip_address, sender_port_id, NULL, 1,
+                        TS_FALSE, TS_TRUE);
   return status;
 }
 
-void server_process_rd(server_data_t* data, ts_tuple_field_t* tuple,
-                       ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                       ts_port_t sender_port_id) {
-  ts_tuple_field_t* data_tuple =
-      server_get_data_node(&data->tuple_stash, tuple, tuple_size, TS_FALSE);
+void server_process_rd(server_data_t* data, server_field_t* tuple,
+                       ts_size_t tuple_size, ts_tuple_signature_t signature,
+                       ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_scan_stats_t scan_stats;
+  memset(&scan_stats, 0, sizeof(server_scan_stats_t));
+  server_field_t* data_tuple =
+      server_get_data_node(data->tuple_stash, tuple, tuple_size, signature,
+                           TS_FALSE, &scan_stats);
+  server_trace_stage(SERVER_TRACE_MATCH);
+  server_profile_lookup(&data->profile, tuple, tuple_size, signature,
+                        SERVER_PROFILE_STASH_LOOKUP, &scan_stats,
+                        data_tuple != NULL);
   if (data_tuple != NULL) {
-    server_log("Found matching tuple:\n");
-    ts_print_tuple(data_tuple, tuple_size);
+    SERVER_LOG_DEBUG("Found matching tuple:\n");
+    server_log_fields(data, data_tuple, tuple_size);
     ts_bool_t status = server_process_rd_send_tuple_to_client(
         data, data_tuple, tuple_size, sender_ip_address, sender_port_id);
-    server_log(
+    SERVER_LOG_DEBUG(
         "Responded to the client at %s:%d with a given tuple with "
         "status %d\n",
         ts_unix_ipv4_to_str(sender_ip_address), sender_port_id, status);
     ++data->metrics.total_send_mesages;
     data->metrics.acc_send_message_length += tuple_size;
-    data->allocator.deallocator_cb(data->allocator.context, tuple);
     return;
   }
-  ++data->metrics.currently_queued_tuples;
+  if (!server_queue_template_tuple(data, tuple, tuple_size, signature,
+                                   sender_ip_address, sender_port_id,
+                                   TS_FALSE)) {
+    return;
+  }
   ++data->metrics.total_queued_rd_messages;
-  server_log(
+  SERVER_LOG_DEBUG(
       "No matching tuples has been found - queueing tuple for a match\n");
   server_process_rd_await_for_tuple(data, sender_ip_address, sender_port_id);
-  server_insert_template_tuple(&data->tuple_queue, tuple, tuple_size,
-                               sender_ip_address, sender_port_id, TS_FALSE);
 }
 
 static ts_bool_t server_process_rdp_send_tuple_to_client(
-    server_data_t* data, ts_tuple_field_t* data_tuple, ts_size_t tuple_size,
+    server_data_t* data, server_field_t* data_tuple, ts_size_t tuple_size,
     ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
-  ts_bool_t status = ts_server_send_server_to_client_tuple(
-      &data->server_context, data_tuple, tuple_size, sender_ip_address,
-      sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, data_tuple, tuple_size, TS_FALSE,
-                             TS_FALSE);
+  ts_bool_t status = server_send_tuple(data, data_tuple, tuple_size,
+                                       sender_ip_address, sender_port_id);
+  server_field_t* sent_tuple = server_copy_sent_tuple(
+      data, data_tuple, tuple_size, sender_ip_address, sender_port_id);
+  if (sent_tuple != NULL) {
+    server_add_connection(data, sender_ip_address, sender_port_id, sent_tuple,
+                          tuple_size, TS_FALSE, TS_FALSE);
+  }
   return status;
 }
 
@@ -183,97 +429,154 @@ static ts_bool_t server_process_rdp_await_for_tuple(server_data_t* data,
                                                     ts_port_t sender_port_id) {
   ts_bool_t status = ts_server_send_server_to_client_await_for_tuple(
       &data->server_context, sender_ip_address, sender_port_id);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, NULL, 0, TS_FALSE, TS_FALSE);
+  server_add_connection(data, sender_ip_address, sender_port_id, NULL, 0,
+                        TS_FALSE, TS_TRUE);
   return status;
 }
 
-void server_process_rdp(server_data_t* data, ts_tuple_field_t* tuple,
-                        ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                        ts_port_t sender_port_id) {
-  ts_tuple_field_t* data_tuple =
-      server_get_data_node(&data->tuple_stash, tuple, tuple_size, TS_FALSE);
+void server_process_rdp(server_data_t* data, server_field_t* tuple,
+                        ts_size_t tuple_size, ts_tuple_signature_t signature,
+                        ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_scan_stats_t scan_stats;
+  memset(&scan_stats, 0, sizeof(server_scan_stats_t));
+  server_field_t* data_tuple =
+      server_get_data_node(data->tuple_stash, tuple, tuple_size, signature,
+                           TS_FALSE, &scan_stats);
+  server_trace_stage(SERVER_TRACE_MATCH);
+  server_profile_lookup(&data->profile, tuple, tuple_size, signature,
+                        SERVER_PROFILE_STASH_LOOKUP, &scan_stats,
+                        data_tuple != NULL);
   if (data_tuple != NULL) {
-    server_log("Found matching tuple:\n");
-    ts_print_tuple(data_tuple, tuple_size);
+    SERVER_LOG_DEBUG("Found matching tuple:\n");
+    server_log_fields(data, data_tuple, tuple_size);
     ts_bool_t status = server_process_rdp_send_tuple_to_client(
         data, data_tuple, tuple_size, sender_ip_address, sender_port_id);
-    server_add_connection_node(&data->active_connections, sender_ip_address,
-                               sender_port_id, data_tuple, tuple_size, TS_FALSE,
-                               TS_FALSE);
-    server_log(
+    SERVER_LOG_DEBUG(
         "Responded to the client at %s:%d with a given tuple with "
         "status %d - removing tuple from stash\n",
         ts_unix_ipv4_to_str(sender_ip_address), sender_port_id, status);
     ++data->metrics.total_send_mesages;
     data->metrics.acc_send_message_length += tuple_size;
-    data->allocator.deallocator_cb(data->allocator.context, tuple);
     return;
   }
   ++data->metrics.total_rejected_rdp_messages;
-  data->allocator.deallocator_cb(data->allocator.context, tuple);
-  server_add_connection_node(&data->active_connections, sender_ip_address,
-                             sender_port_id, NULL, 0, TS_FALSE, TS_FALSE);
   ts_bool_t status = ts_server_send_server_to_client_lack_of_tuple(
       &data->server_context, sender_ip_address, sender_port_id);
-  server_log(
+  SERVER_LOG_DEBUG(
       "No matching tuples has been found - responding to a client about it "
       "with status %d\n",
       status);
   server_process_rdp_await_for_tuple(data, sender_ip_address, sender_port_id);
 }
 
+// Without a tuple to resend the await pings of the waiter just stop.
 static void server_process_out_transform_await(server_data_t* data,
-                                               ts_tuple_field_t* tuple,
+                                               server_field_t* tuple,
                                                ts_size_t tuple_size,
-                                               ts_ipv4_t sender_ip_address,
-                                               ts_port_t sender_port_id,
+                                               ts_ipv4_t waiter_ip_address,
+                                               ts_port_t waiter_port_id,
                                                ts_bool_t do_remove) {
   server_connection_node_t* node = server_find_connection_node(
-      &data->active_connections, sender_ip_address, sender_port_id);
-  if (!node) {
-    return server_add_connection_node(&data->active_connections,
-                                      sender_ip_address, sender_port_id, tuple,
-                                      tuple_size, !do_remove, TS_FALSE);
+      &data->active_connections, waiter_ip_address, waiter_port_id);
+  if (tuple == NULL) {
+    if (node && node->ping_for_await) {
+      server_erase_connection_node(&data->active_connections, node);
+    }
+    return;
+  }
+  if (!node || !node->ping_for_await) {
+    server_add_connection(data, waiter_ip_address, waiter_port_id, tuple,
+                          tuple_size, do_remove, TS_FALSE);
+    return;
   }
   node->ping_for_await = TS_FALSE;
-  node->insert_if_rejected = !do_remove;
+  node->resend_counter = 0;
+  server_restart_connection_timer(&data->active_connections, node);
+  node->insert_if_rejected = do_remove;
   node->tuple_size = tuple_size;
   node->data_tuple = tuple;
 }
 
-void server_process_out(server_data_t* data, ts_tuple_field_t* tuple,
-                        ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                        ts_port_t sender_port_id) {
-  server_tuple_queue_entry_t entry =
-      server_get_template_node(&data->tuple_queue, tuple, tuple_size, TS_TRUE);
-  while (entry.tuple != NULL) {
-    --data->metrics.currently_queued_tuples;
-    ts_bool_t status = ts_server_send_server_to_client_tuple(
-        &data->server_context, tuple, tuple_size, entry.sender_ip_address,
-        entry.sender_port_id);
-    server_process_out_transform_await(data, tuple, tuple_size,
-                                       sender_ip_address, sender_port_id,
-                                       entry.remove_matching);
-    server_log(
-        "Responded to the awaiting client at %s:%d with a given tuple with "
-        "status %d\n",
-        ts_unix_ipv4_to_str(entry.sender_ip_address), entry.sender_port_id,
-        status);
-    ++data->metrics.total_send_mesages;
-    data->metrics.acc_send_message_length += tuple_size;
-    data->allocator.deallocator_cb(data->allocator.context, entry.tuple);
-    if (entry.remove_matching) {
-      server_log(
-          "Tuple has been redirected to the awaiting client - not saving\n");
-      data->allocator.deallocator_cb(data->allocator.context, tuple);
-      return;
-    }
-    entry = server_get_template_node(&data->tuple_queue, tuple, tuple_size,
-                                     TS_TRUE);
+typedef struct {
+  server_data_t* data;
+  server_field_t* tuple;
+  ts_size_t tuple_size;
+  ts_tuple_signature_t signature;
+  ts_bool_t is_consumed;
+} server_process_out_context_t;
+
+// An in waiter takes over the tuple itself, every rd waiter gets its own
+// copy so that its pending resend never points at a consumed tuple.
+static void server_process_out_deliver_cb(
+    void* user_data, const server_tuple_queue_entry_t* entry) {
+  server_process_out_context_t* context =
+      (server_process_out_context_t*)user_data;
+  server_data_t* data = context->data;
+  uint64_t queue_time_us =
+      server_monotonic_time_us() - entry->insertion_time_us;
+  uint64_t queue_time_ms = queue_time_us / 1000;
+  server_record_histogram(
+      &data->metrics.waiter_queue_time[entry->remove_matching
+                                           ? SERVER_OPERATION_IN
+                                           : SERVER_OPERATION_RD],
+      queue_time_us);
+  --data->metrics.currently_queued_tuples;
+  ++data->metrics.total_dispatched_waiters;
+  data->metrics.acc_waiter_queue_time_ms += queue_time_ms;
+  if (queue_time_ms > data->metrics.max_waiter_queue_time_ms) {
+    data->metrics.max_waiter_queue_time_ms = queue_time_ms;
+  }
+  ts_bool_t status =
+      server_send_tuple(data, context->tuple, context->tuple_size,
+                        entry->sender_ip_address, entry->sender_port_id);
+  server_field_t* delivered_tuple =
+      entry->remove_matching
+          ? context->tuple
+          : server_copy_sent_tuple(data, context->tuple, context->tuple_size,
+                                   entry->sender_ip_address,
+                                   entry->sender_port_id);
+  server_process_out_transform_await(
+      data, delivered_tuple, context->tuple_size, entry->sender_ip_address,
+      entry->sender_port_id, entry->remove_matching);
+  SERVER_LOG_DEBUG(
+      "Responded to the awaiting client at %s:%d with a given tuple with "
+      "status %d after %" PRIu64 " ms in queue\n",
+      ts_unix_ipv4_to_str(entry->sender_ip_address), entry->sender_port_id,
+      status, queue_time_ms);
+  ++data->metrics.total_send_mesages;
+  data->metrics.acc_send_message_length += context->tuple_size;
+  server_profile_population(&data->profile, entry->tuple, context->tuple_size,
+                            context->signature, -1);
+  server_free_tuple(data, entry->tuple, context->tuple_size);
+  context->is_consumed |= entry->remove_matching;
+}
+
+void server_process_out(server_data_t* data, server_field_t* tuple,
+                        ts_size_t tuple_size, ts_tuple_signature_t signature,
+                        ts_ipv4_t sender_ip_address, ts_port_t sender_port_id) {
+  server_process_out_context_t context;
+  memset(&context, 0, sizeof(server_process_out_context_t));
+  context.data = data;
+  context.tuple = tuple;
+  context.tuple_size = tuple_size;
+  context.signature = signature;
+  server_scan_stats_t scan_stats;
+  memset(&scan_stats, 0, sizeof(server_scan_stats_t));
+  ts_size_t taken_count = server_take_template_nodes(
+      &data->tuple_queue, tuple, tuple_size, signature,
+      server_process_out_deliver_cb, &context, &scan_stats);
+  server_profile_lookup(&data->profile, tuple, tuple_size, signature,
+                        SERVER_PROFILE_WAITER_LOOKUP, &scan_stats,
+                        taken_count > 0);
+  if (context.is_consumed) {
+    SERVER_LOG_DEBUG(
+        "Tuple has been redirected to the awaiting client - not saving\n");
+  } else {
+    SERVER_LOG_DEBUG("Saving tuple on the stash\n");
+    ++data->metrics.currently_stashed_tuples;
+    server_profile_population(&data->profile, tuple, tuple_size, signature, 1);
+    server_insert_data_tuple(data->tuple_stash, tuple, tuple_size, signature);
   }
-  server_log("Saving tuple on the stash\n");
-  ++data->metrics.currently_stashed_tuples;
-  server_insert_data_tuple(&data->tuple_stash, tuple, tuple_size);
+  server_trace_stage(SERVER_TRACE_MATCH);
   server_send_single_ack(data, sender_ip_address, sender_port_id);
 }
@@ -4,39 +4,70 @@
 #include "../libts/common/tuple_space_network.h"
 #include "../libts/unix/tuple_space_unix_debug.h"
 #include "server_active_connections.h"
+#include "server_field.h"
+#include "server_intern.h"
 #include "server_metrics.h"
+#include "server_profile.h"
 #include "server_tuple_space.h"
 
 typedef struct {
   server_metrics_t metrics;
   ts_server_context_t server_context;
-  server_tuple_space_t tuple_stash;
+  server_tuple_space_t* tuple_stash;
+  server_intern_table_t* strings;
+  ts_bool_t is_wire_storage;
   server_tuple_queue_t tuple_queue;
   server_active_connections_t active_connections;
   ts_allocator_t allocator;
+  server_profile_t profile;
 } server_data_t;
 
+// Tuples held by the server keep their compact fields in a block of their
+// own, followed by their serialized form in wire storage, and their strings
+// in the intern table. Takes over the received packed tuple, returns NULL
+// and frees it when the tuple could not be stored.
+server_field_t* server_compact_tuple(server_data_t* data,
+                                     ts_tuple_field_t* tuple,
+                                     ts_size_t tuple_size);
+
+server_field_t* server_copy_tuple(server_data_t* data,
+                                  const server_field_t* tuple,
+                                  ts_size_t tuple_size);
+
+void server_free_tuple(server_data_t* data, server_field_t* tuple,
+                       ts_size_t tuple_size);
+
+ts_bool_t server_send_tuple(server_data_t* data, const server_field_t* tuple,
+                            ts_size_t tuple_size, ts_ipv4_t receiver_ip_address,
+                            ts_port_t receiver_port_id);
+
+// Logs the tuple at debug level.
+void server_log_fields(server_data_t* data, const server_field_t* tuple,
+                       ts_size_t tuple_size);
+
 void server_send_single_ack(server_data_t* data, ts_ipv4_t sender_ip_address,
                             ts_port_t sender_port_id);
 
-void server_process_in(server_data_t* data, ts_tuple_field_t* tuple,
-                       ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                       ts_port_t sender_port_id);
+// Get requests leave the template to the caller, copying it when it has to
+// wait for a match. An out request takes over its tuple.
+void server_process_in(server_data_t* data, server_field_t* tuple,
+                       ts_size_t tuple_size, ts_tuple_signature_t signature,
+                       ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
 
-void server_process_inp(server_data_t* data, ts_tuple_field_t* tuple,
-                        ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                        ts_port_t sender_port_id);
+void server_process_inp(server_data_t* data, server_field_t* tuple,
+                        ts_size_t tuple_size, ts_tuple_signature_t signature,
+                        ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
 
-void server_process_rd(server_data_t* data, ts_tuple_field_t* tuple,
-                       ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                       ts_port_t sender_port_id);
+void server_process_rd(server_data_t* data, server_field_t* tuple,
+                       ts_size_t tuple_size, ts_tuple_signature_t signature,
+                       ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
 
-void server_process_rdp(server_data_t* data, ts_tuple_field_t* tuple,
-                        ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                        ts_port_t sender_port_id);
+void server_process_rdp(server_data_t* data, server_field_t* tuple,
+                        ts_size_t tuple_size, ts_tuple_signature_t signature,
+                        ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
 
-void server_process_out(server_data_t* data, ts_tuple_field_t* tuple,
-                        ts_size_t tuple_size, ts_ipv4_t sender_ip_address,
-                        ts_port_t sender_port_id);
+void server_process_out(server_data_t* data, server_field_t* tuple,
+                        ts_size_t tuple_size, ts_tuple_signature_t signature,
+                        ts_ipv4_t sender_ip_address, ts_port_t sender_port_id);
 
 #endif  // __SERVER_PROCESS_REQUESTS_H__
@@ -0,0 +1,279 @@
+#include "server_profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server_log.h"
+#include "server_tuple_index.h"
+
+#define SERVER_PROFILE_SHAPE_SIZE 160
+
+void server_initialize_profile(server_profile_t* profile,
+                               ts_bool_t is_enabled) {
+  memset(profile, 0, sizeof(server_profile_t));
+  profile->is_enabled = is_enabled;
+}
+
+void server_destroy_profile(server_profile_t* profile) {
+  free(profile->entries);
+  memset(profile, 0, sizeof(server_profile_t));
+}
+
+static uint16_t server_profile_formal_mask(const server_field_t* tuple,
+                                           ts_size_t tuple_size) {
+  uint16_t formal_mask = 0;
+  for (ts_size_t i = 0; i < tuple_size && i < TS_MAX_TUPLE_SIZE; ++i) {
+    if (!server_field_contains_data(&tuple[i])) {
+      formal_mask |= (uint16_t)(1u << i);
+    }
+  }
+  return formal_mask;
+}
+
+// Returns the entry of the shape, or the free slot where it would go.
+static server_profile_entry_t* server_find_profile_slot(
+    server_profile_entry_t* entries, ts_size_t entries_size,
+    ts_tuple_signature_t signature, ts_size_t tuple_size,
+    uint16_t formal_mask) {
+  uint32_t hash = server_hash_bytes(SERVER_HASH_OFFSET_BASIS, &signature,
+                                    sizeof(ts_tuple_signature_t));
+  hash = server_hash_bytes(hash, &tuple_size, sizeof(ts_size_t));
+  hash = server_hash_bytes(hash, &formal_mask, sizeof(uint16_t));
+  ts_size_t slot = hash & (entries_size - 1);
+  while (entries[slot].is_used &&
+         ((entries[slot].signature != signature) ||
+          (entries[slot].tuple_size != tuple_size) ||
+          (entries[slot].formal_mask != formal_mask))) {
+    slot = (slot + 1) & (entries_size - 1);
+  }
+  return &entries[slot];
+}
+
+static void server_grow_profile_table(server_profile_t* profile) {
+  server_profile_entry_t* old_entries = profile->entries;
+  ts_size_t old_size = profile->entries_size;
+  ts_size_t new_size =
+      old_size ? old_size * 2 : SERVER_PROFILE_TABLE_INITIAL_SIZE;
+  profile->entries = (server_profile_entry_t*)calloc(
+      new_size, sizeof(server_profile_entry_t));
+  profile->entries_size = new_size;
+  for (ts_size_t i = 0; i < old_size; ++i) {
+    if (old_entries[i].is_used) {
+      *server_find_profile_slot(profile->entries, new_size,
+                                old_entries[i].signature,
+                                old_entries[i].tuple_size,
+                                old_entries[i].formal_mask) = old_entries[i];
+    }
+  }
+  free(old_entries);
+}
+
+static server_profile_entry_t* server_profile_entry(
+    server_profile_t* profile, ts_tuple_signature_t signature,
+    ts_size_t tuple_size, uint16_t formal_mask) {
+  if ((profile->entries_count + 1) * 2 > profile->entries_size) {
+    server_grow_profile_table(profile);
+  }
+  server_profile_entry_t* entry =
+      server_find_profile_slot(profile->entries, profile->entries_size,
+                               signature, tuple_size, formal_mask);
+  if (!entry->is_used) {
+    entry->is_used = TS_TRUE;
+    entry->signature = signature;
+    entry->tuple_size = tuple_size;
+    entry->formal_mask = formal_mask;
+    ++profile->entries_count;
+  }
+  return entry;
+}
+
+void server_profile_lookup(server_profile_t* profile,
+                           const server_field_t* tuple, ts_size_t tuple_size,
+                           ts_tuple_signature_t signature,
+                           server_profile_lookup_t lookup,
+                           const server_scan_stats_t* scan_stats,
+                           ts_bool_t is_hit) {
+  if (!profile->is_enabled) {
+    return;
+  }
+  server_profile_entry_t* entry =
+      server_profile_entry(profile, signature, tuple_size,
+                           server_profile_formal_mask(tuple, tuple_size));
+  ++entry->lookups[lookup];
+  entry->hits[lookup] += is_hit;
+  entry->visited_nodes[lookup] += scan_stats->visited_nodes;
+  entry->matched_nodes[lookup] += scan_stats->matched_nodes;
+}
+
+void server_profile_population(server_profile_t* profile,
+                               const server_field_t* tuple,
+                               ts_size_t tuple_size,
+                               ts_tuple_signature_t signature, int64_t delta) {
+  if (!profile->is_enabled) {
+    return;
+  }
+  uint16_t formal_mask = server_profile_formal_mask(tuple, tuple_size);
+  server_profile_entry_t* entry =
+      server_profile_entry(profile, signature, tuple_size, formal_mask);
+  if (formal_mask == 0) {
+    entry->stashed_tuples += delta;
+  } else {
+    entry->queued_templates += delta;
+  }
+}
+
+static void server_format_shape(const server_profile_entry_t* entry,
+                                char* buffer, size_t buffer_size) {
+  static const char* type_names[] = {"invalid", "uint",   "int",
+                                     "float",   "string", "bool"};
+  const ts_tuple_signature_t field_mask =
+      (1 << TS_TUPLE_SIGNATURE_FIELD_BITS) - 1;
+  size_t length = 0;
+  buffer[length++] = '(';
+  for (ts_size_t i = 0; i < entry->tuple_size && i < TS_MAX_TUPLE_SIZE; ++i) {
+    size_t type = (size_t)((entry->signature >>
+                            (i * TS_TUPLE_SIGNATURE_FIELD_BITS)) &
+                           field_mask);
+    int written = snprintf(
+        buffer + length, buffer_size - length, "%s%s%s", i ? ", " : "",
+        (entry->formal_mask >> i) & 1 ? "?" : "",
+        type < sizeof(type_names) / sizeof(type_names[0]) ? type_names[type]
+                                                          : "invalid");
+    if (written < 0 || (size_t)written >= buffer_size - length - 1) {
+      break;
+    }
+    length += (size_t)written;
+  }
+  buffer[length++] = ')';
+  buffer[length] = '\0';
+}
+
+static double server_profile_ratio(size_t value, size_t total) {
+  return total ? (double)value / (double)total : 0.0;
+}
+
+static size_t server_profile_cost(const server_profile_entry_t* entry) {
+  return entry->visited_nodes[SERVER_PROFILE_STASH_LOOKUP] +
+         entry->visited_nodes[SERVER_PROFILE_WAITER_LOOKUP];
+}
+
+static int server_compare_profile_cost(const void* lhs, const void* rhs) {
+  size_t left = server_profile_cost(*(server_profile_entry_t* const*)lhs);
+  size_t right = server_profile_cost(*(server_profile_entry_t* const*)rhs);
+  return left > right ? -1 : left < right;
+}
+
+// Sorts the used entries of the table by cost and returns their count.
+static size_t server_rank_profile_entries(const server_profile_t* profile,
+                                          server_profile_entry_t** ranked) {
+  size_t count = 0;
+  for (ts_size_t i = 0; i < profile->entries_size; ++i) {
+    if (profile->entries[i].is_used &&
+        server_profile_cost(&profile->entries[i]) > 0) {
+      ranked[count++] = &profile->entries[i];
+    }
+  }
+  qsort(ranked, count, sizeof(server_profile_entry_t*),
+        server_compare_profile_cost);
+  return count;
+}
+
+static void server_report_templates(server_profile_t* profile,
+                                    server_profile_entry_t** ranked,
+                                    size_t top_count) {
+  char shape[SERVER_PROFILE_SHAPE_SIZE];
+  size_t count = server_rank_profile_entries(profile, ranked);
+  for (size_t i = 0, reported = 0; i < count && reported < top_count; ++i) {
+    const server_profile_entry_t* entry = ranked[i];
+    size_t lookups = entry->lookups[SERVER_PROFILE_STASH_LOOKUP];
+    if (lookups == 0) {
+      continue;
+    }
+    server_format_shape(entry, shape, sizeof(shape));
+    SERVER_LOG_INFO(
+        "  template %s: %zu lookups, %.1f%% hits, %.1f nodes and %.1f "
+        "matches per lookup, %" PRId64 " waiting\n",
+        shape, lookups,
+        100.0 * server_profile_ratio(entry->hits[SERVER_PROFILE_STASH_LOOKUP],
+                                     lookups),
+        server_profile_ratio(
+            entry->visited_nodes[SERVER_PROFILE_STASH_LOOKUP], lookups),
+        server_profile_ratio(
+            entry->matched_nodes[SERVER_PROFILE_STASH_LOOKUP], lookups),
+        entry->queued_templates);
+    ++reported;
+  }
+}
+
+static void server_report_signatures(server_profile_t* profile,
+                                     server_profile_entry_t** ranked,
+                                     size_t top_count) {
+  server_profile_t signatures;
+  server_initialize_profile(&signatures, TS_TRUE);
+  for (ts_size_t i = 0; i < profile->entries_size; ++i) {
+    const server_profile_entry_t* entry = &profile->entries[i];
+    if (!entry->is_used) {
+      continue;
+    }
+    server_profile_entry_t* total = server_profile_entry(
+        &signatures, entry->signature, entry->tuple_size, 0);
+    for (size_t j = 0; j < 2; ++j) {
+      total->lookups[j] += entry->lookups[j];
+      total->hits[j] += entry->hits[j];
+      total->visited_nodes[j] += entry->visited_nodes[j];
+      total->matched_nodes[j] += entry->matched_nodes[j];
+    }
+    total->stashed_tuples += entry->stashed_tuples;
+    total->queued_templates += entry->queued_templates;
+  }
+  char shape[SERVER_PROFILE_SHAPE_SIZE];
+  size_t count = server_rank_profile_entries(&signatures, ranked);
+  for (size_t i = 0; i < count && i < top_count; ++i) {
+    const server_profile_entry_t* entry = ranked[i];
+    size_t stash_lookups = entry->lookups[SERVER_PROFILE_STASH_LOOKUP];
+    size_t waiter_lookups = entry->lookups[SERVER_PROFILE_WAITER_LOOKUP];
+    server_format_shape(entry, shape, sizeof(shape));
+    SERVER_LOG_INFO(
+        "  signature %s: %zu stash lookups, %.1f%% hits, %.1f nodes per "
+        "lookup; %zu waiter lookups, %.1f%% hits, %.1f nodes per lookup; "
+        "%" PRId64 " stashed, %" PRId64 " waiting\n",
+        shape, stash_lookups,
+        100.0 * server_profile_ratio(entry->hits[SERVER_PROFILE_STASH_LOOKUP],
+                                     stash_lookups),
+        server_profile_ratio(
+            entry->visited_nodes[SERVER_PROFILE_STASH_LOOKUP], stash_lookups),
+        waiter_lookups,
+        100.0 * server_profile_ratio(
+                    entry->hits[SERVER_PROFILE_WAITER_LOOKUP], waiter_lookups),
+        server_profile_ratio(
+            entry->visited_nodes[SERVER_PROFILE_WAITER_LOOKUP],
+            waiter_lookups),
+        entry->stashed_tuples, entry->queued_templates);
+  }
+  server_destroy_profile(&signatures);
+}
+
+void server_report_profile(server_profile_t* profile, size_t top_count,
+                           uint64_t interval_ms) {
+  if (profile->entries_count == 0) {
+    return;
+  }
+  server_profile_entry_t** ranked = (server_profile_entry_t**)malloc(
+      profile->entries_count * sizeof(server_profile_entry_t*));
+  if (ranked == NULL) {
+    return;
+  }
+  SERVER_LOG_INFO("Most expensive lookups over the last %" PRIu64 " ms:\n",
+                  interval_ms);
+  server_report_templates(profile, ranked, top_count);
+  server_report_signatures(profile, ranked, top_count);
+  free(ranked);
+  for (ts_size_t i = 0; i < profile->entries_size; ++i) {
+    server_profile_entry_t* entry = &profile->entries[i];
+    memset(entry->lookups, 0, sizeof(entry->lookups));
+    memset(entry->hits, 0, sizeof(entry->hits));
+    memset(entry->visited_nodes, 0, sizeof(entry->visited_nodes));
+    memset(entry->matched_nodes, 0, sizeof(entry->matched_nodes));
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef __SERVER_PROFILE_H__
+#define __SERVER_PROFILE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "../libts/common/tuple_space.h"
+#include "server_tuple_space.h"
+
+#define SERVER_PROFILE_TABLE_INITIAL_SIZE 64
+
+typedef enum {
+  SERVER_PROFILE_STASH_LOOKUP = 0,  // a template searched the stash
+  SERVER_PROFILE_WAITER_LOOKUP = 1  // a data tuple searched the waiters
+} server_profile_lookup_t;
+
+// Counts of one tuple shape: arity, field types and which fields are
+// formal. Data tuples have no formal fields, so the stash population of a
+// signature is kept by its shape without formal fields. Lookup counts cover
+// the current report interval, populations are kept across intervals.
+typedef struct {
+  ts_tuple_signature_t signature;
+  ts_size_t tuple_size;
+  uint16_t formal_mask;  // bit i is set when field i is formal
+  ts_bool_t is_used;
+  size_t lookups[2];  // indexed by server_profile_lookup_t
+  size_t hits[2];
+  size_t visited_nodes[2];
+  size_t matched_nodes[2];
+  int64_t stashed_tuples;
+  int64_t queued_templates;
+} server_profile_entry_t;
+
+// Open addressing with linear probing, one slot per shape.
+typedef struct {
+  server_profile_entry_t* entries;
+  ts_size_t entries_size;
+  ts_size_t entries_count;
+  ts_bool_t is_enabled;
+} server_profile_t;
+
+// A disabled profile ignores everything it is given.
+void server_initialize_profile(server_profile_t* profile,
+                               ts_bool_t is_enabled);
+
+void server_destroy_profile(server_profile_t* profile);
+
+void server_profile_lookup(server_profile_t* profile,
+                           const server_field_t* tuple, ts_size_t tuple_size,
+                           ts_tuple_signature_t signature,
+                           server_profile_lookup_t lookup,
+                           const server_scan_stats_t* scan_stats,
+                           ts_bool_t is_hit);
+
+// Adds to the stash population of the signature when the tuple is data, or
+// to the waiters of its shape when it is a template.
+void server_profile_population(server_profile_t* profile,
+                               const server_field_t* tuple,
+                               ts_size_t tuple_size,
+                               ts_tuple_signature_t signature, int64_t delta);
+
+// Logs the templates and signatures whose lookups walked the most nodes
+// since the previous report, at most top_count of each, and starts a new
+// interval.
+void server_report_profile(server_profile_t* profile, size_t top_count,
+                           uint64_t interval_ms);
+
+#endif  // __SERVER_PROFILE_H__
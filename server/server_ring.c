@@ -0,0 +1,165 @@
+#include "server_ring.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+ts_bool_t server_initialize_ring(server_ring_t* ring, size_t slot_size,
+                                 size_t capacity) {
+  memset(ring, 0, sizeof(server_ring_t));
+  ring->slots = (ts_byte_t*)malloc(slot_size * capacity);
+  if (ring->slots == NULL) {
+    return TS_FALSE;
+  }
+  ring->slot_size = slot_size;
+  ring->capacity = capacity;
+  ring->data_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ring->space_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((ring->data_descriptor < 0) || (ring->space_descriptor < 0)) {
+    server_destroy_ring(ring);
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+void server_destroy_ring(server_ring_t* ring) {
+  if (ring->slots == NULL) {
+    return;
+  }
+  if (ring->data_descriptor >= 0) {
+    close(ring->data_descriptor);
+  }
+  if (ring->space_descriptor >= 0) {
+    close(ring->space_descriptor);
+  }
+  free(ring->slots);
+  ring->slots = NULL;
+}
+
+static void server_ring_signal(int descriptor, int* is_waiting) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(is_waiting, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(is_waiting, 0, __ATOMIC_ACQ_REL)) {
+    uint64_t value = 1;
+    ssize_t written = write(descriptor, &value, sizeof(uint64_t));
+    (void)written;
+  }
+}
+
+void* server_ring_reserve(server_ring_t* ring) {
+  size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (ring->head - tail == ring->capacity) {
+    return NULL;
+  }
+  return ring->slots + (ring->head & (ring->capacity - 1)) * ring->slot_size;
+}
+
+void server_ring_commit(server_ring_t* ring) {
+  size_t head = ring->head + 1;
+  __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+  size_t depth = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (depth > __atomic_load_n(&ring->max_depth, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&ring->max_depth, depth, __ATOMIC_RELAXED);
+  }
+  server_ring_signal(ring->data_descriptor, &ring->is_consumer_waiting);
+}
+
+void* server_ring_peek(server_ring_t* ring, size_t* slots_count) {
+  size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (head == ring->tail) {
+    return NULL;
+  }
+  size_t index = ring->tail & (ring->capacity - 1);
+  size_t count = head - ring->tail;
+  if (count > ring->capacity - index) {
+    count = ring->capacity - index;
+  }
+  *slots_count = count;
+  return ring->slots + index * ring->slot_size;
+}
+
+void server_ring_release(server_ring_t* ring, size_t slots_count) {
+  __atomic_store_n(&ring->tail, ring->tail + slots_count, __ATOMIC_RELEASE);
+  server_ring_signal(ring->space_descriptor, &ring->is_producer_waiting);
+}
+
+size_t server_ring_depth(const server_ring_t* ring) {
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+size_t server_ring_take_max_depth(server_ring_t* ring) {
+  return __atomic_exchange_n(&ring->max_depth, 0, __ATOMIC_RELAXED);
+}
+
+static ts_bool_t server_ring_read_signal(int descriptor, int32_t timeout_ms) {
+  struct pollfd poll_descriptor;
+  poll_descriptor.fd = descriptor;
+  poll_descriptor.events = POLLIN;
+  poll_descriptor.revents = 0;
+  if (poll(&poll_descriptor, 1, timeout_ms) <= 0) {
+    return TS_FALSE;
+  }
+  uint64_t value;
+  ssize_t received = read(descriptor, &value, sizeof(uint64_t));
+  (void)received;
+  return TS_TRUE;
+}
+
+// A signaller that already took the flag writes the descriptor right after,
+// unless that write was read it is waited for. A count left behind would keep
+// the descriptor readable in the level-triggered epoll set of the device.
+static void server_ring_stop_waiting(int descriptor, int* is_waiting,
+                                     ts_bool_t is_signal_read) {
+  if (!__atomic_exchange_n(is_waiting, 0, __ATOMIC_ACQ_REL) &&
+      !is_signal_read) {
+    server_ring_read_signal(descriptor, -1);
+  }
+}
+
+static void server_ring_sleep(int descriptor, int* is_waiting,
+                              int32_t timeout_ms) {
+  server_ring_stop_waiting(descriptor, is_waiting,
+                           server_ring_read_signal(descriptor, timeout_ms));
+}
+
+ts_bool_t server_ring_wait_for_data(server_ring_t* ring, int32_t timeout_ms) {
+  if (server_ring_depth(ring) > 0) {
+    return TS_TRUE;
+  }
+  __atomic_store_n(&ring->is_consumer_waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (server_ring_depth(ring) == 0) {
+    server_ring_sleep(ring->data_descriptor, &ring->is_consumer_waiting,
+                      timeout_ms);
+  } else {
+    server_ring_stop_waiting(ring->data_descriptor, &ring->is_consumer_waiting,
+                             TS_FALSE);
+  }
+  return server_ring_depth(ring) > 0;
+}
+
+ts_bool_t server_ring_wait_for_space(server_ring_t* ring, int32_t timeout_ms) {
+  if (server_ring_depth(ring) < ring->capacity) {
+    return TS_TRUE;
+  }
+  __atomic_store_n(&ring->is_producer_waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (server_ring_depth(ring) == ring->capacity) {
+    server_ring_sleep(ring->space_descriptor, &ring->is_producer_waiting,
+                      timeout_ms);
+  } else {
+    server_ring_stop_waiting(ring->space_descriptor,
+                             &ring->is_producer_waiting, TS_FALSE);
+  }
+  return server_ring_depth(ring) < ring->capacity;
+}
+
+void server_ring_wake(server_ring_t* ring) {
+  uint64_t value = 1;
+  ssize_t written = write(ring->data_descriptor, &value, sizeof(uint64_t));
+  written = write(ring->space_descriptor, &value, sizeof(uint64_t));
+  (void)written;
+}
@@ -0,0 +1,55 @@
+#ifndef __SERVER_RING_H__
+#define __SERVER_RING_H__
+
+#include <stddef.h>
+
+#include "../libts/common/tuple_space.h"
+
+// Bounded single-producer single-consumer ring of fixed-size slots. The
+// producer fills a reserved slot in place and commits it, the consumer reads
+// it in place and releases it. Either side may sleep on an eventfd, which
+// the other side only writes when it knows the sleeper is waiting.
+typedef struct {
+  ts_byte_t* slots;
+  size_t slot_size;
+  size_t capacity;  // power of two
+  size_t head __attribute__((aligned(64)));
+  size_t max_depth;
+  size_t tail __attribute__((aligned(64)));
+  int data_descriptor __attribute__((aligned(64)));
+  int space_descriptor;
+  int is_consumer_waiting;
+  int is_producer_waiting;
+} server_ring_t;
+
+ts_bool_t server_initialize_ring(server_ring_t* ring, size_t slot_size,
+                                 size_t capacity);
+
+void server_destroy_ring(server_ring_t* ring);
+
+// Returns NULL when the ring is full.
+void* server_ring_reserve(server_ring_t* ring);
+
+void server_ring_commit(server_ring_t* ring);
+
+// Returns the oldest committed slot and the number of committed slots that
+// follow it contiguously in slots_count, NULL when the ring is empty.
+void* server_ring_peek(server_ring_t* ring, size_t* slots_count);
+
+void server_ring_release(server_ring_t* ring, size_t slots_count);
+
+size_t server_ring_depth(const server_ring_t* ring);
+
+// Returns the deepest the ring got since the previous call.
+size_t server_ring_take_max_depth(server_ring_t* ring);
+
+// Both return TS_TRUE once the ring is non-empty or not full respectively,
+// TS_FALSE on timeout or server_ring_wake. A negative timeout never expires.
+ts_bool_t server_ring_wait_for_data(server_ring_t* ring, int32_t timeout_ms);
+
+ts_bool_t server_ring_wait_for_space(server_ring_t* ring, int32_t timeout_ms);
+
+// Wakes both sides, e.g. to let them notice a shutdown.
+void server_ring_wake(server_ring_t* ring);
+
+#endif  // __SERVER_RING_H__
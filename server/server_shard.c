@@ -0,0 +1,175 @@
+#include "server_shard.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../libts/common/tuple_space_protocol.h"
+
+ts_bool_t server_initialize_shard_queue(server_shard_queue_t* queue) {
+  memset(queue, 0, sizeof(server_shard_queue_t));
+  queue->cells = (server_shard_cell_t*)malloc(sizeof(server_shard_cell_t) *
+                                              SERVER_SHARD_QUEUE_SIZE);
+  if (queue->cells == NULL) {
+    return TS_FALSE;
+  }
+  for (size_t i = 0; i < SERVER_SHARD_QUEUE_SIZE; ++i) {
+    queue->cells[i].sequence = i;
+  }
+  queue->wakeup_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (queue->wakeup_descriptor < 0) {
+    free(queue->cells);
+    queue->cells = NULL;
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+void server_destroy_shard_queue(server_shard_queue_t* queue) {
+  if (queue->cells != NULL) {
+    close(queue->wakeup_descriptor);
+    free(queue->cells);
+    queue->cells = NULL;
+  }
+}
+
+void server_wake_shard_queue(server_shard_queue_t* queue) {
+  if (__atomic_exchange_n(&queue->is_wakeup_pending, 1, __ATOMIC_SEQ_CST) ==
+      0) {
+    uint64_t value = 1;
+    ssize_t written =
+        write(queue->wakeup_descriptor, &value, sizeof(uint64_t));
+    (void)written;
+  }
+}
+
+ts_bool_t server_push_shard_message(server_shard_queue_t* queue,
+                                    const ts_datagram_t* datagram,
+                                    ts_bool_t is_forwarded_ack) {
+  server_shard_cell_t* cell;
+  size_t position =
+      __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+  for (;;) {
+    cell = &queue->cells[position & (SERVER_SHARD_QUEUE_SIZE - 1)];
+    size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&queue->enqueue_position, &position,
+                                      position + 1, TS_TRUE, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (difference < 0) {
+      return TS_FALSE;
+    } else {
+      position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+    }
+  }
+  cell->is_forwarded_ack = is_forwarded_ack;
+  cell->datagram.ip_address = datagram->ip_address;
+  cell->datagram.port_id = datagram->port_id;
+  cell->datagram.buffer_size = datagram->buffer_size;
+  cell->datagram.receive_time_ns = datagram->receive_time_ns;
+  memcpy(cell->datagram.buffer, datagram->buffer, datagram->buffer_size);
+  __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+  server_wake_shard_queue(queue);
+  return TS_TRUE;
+}
+
+ts_bool_t server_pop_shard_message(server_shard_queue_t* queue,
+                                   ts_datagram_t* datagram,
+                                   ts_bool_t* is_forwarded_ack) {
+  size_t position = queue->dequeue_position;
+  server_shard_cell_t* cell =
+      &queue->cells[position & (SERVER_SHARD_QUEUE_SIZE - 1)];
+  size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+  if (sequence != position + 1) {
+    return TS_FALSE;
+  }
+  *is_forwarded_ack = cell->is_forwarded_ack;
+  datagram->ip_address = cell->datagram.ip_address;
+  datagram->port_id = cell->datagram.port_id;
+  datagram->buffer_size = cell->datagram.buffer_size;
+  datagram->receive_time_ns = cell->datagram.receive_time_ns;
+  memcpy(datagram->buffer, cell->datagram.buffer, cell->datagram.buffer_size);
+  __atomic_store_n(&cell->sequence, position + SERVER_SHARD_QUEUE_SIZE,
+                   __ATOMIC_RELEASE);
+  queue->dequeue_position = position + 1;
+  return TS_TRUE;
+}
+
+void server_clear_shard_wakeup(server_shard_queue_t* queue) {
+  // Cleared before the queue is drained, so a push racing with the drain
+  // either lands in it or writes the eventfd again.
+  __atomic_store_n(&queue->is_wakeup_pending, 0, __ATOMIC_SEQ_CST);
+  uint64_t value;
+  ssize_t received = read(queue->wakeup_descriptor, &value, sizeof(uint64_t));
+  (void)received;
+}
+
+size_t server_shard_owner(const server_shard_t* shard,
+                          ts_tuple_signature_t signature) {
+  uint64_t hash = (uint64_t)signature;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return (size_t)(hash % shard->shards_count);
+}
+
+static void server_broadcast_ack(server_shard_t* shard,
+                                 const ts_datagram_t* datagram) {
+  for (size_t i = 0; i < shard->shards_count; ++i) {
+    if (i != shard->shard_id) {
+      server_push_shard_message(&shard->shards[i].inbox, datagram, TS_TRUE);
+    }
+  }
+}
+
+static ts_bool_t server_is_served_by_any_shard(const server_shard_t* shard,
+                                               const ts_datagram_t* datagram) {
+  ts_bool_t respond_when_available;
+  ts_bool_t remove_after_use;
+  return shard->is_stash_shared &&
+         ts_client_to_server_get_message_flags(
+             datagram->buffer, datagram->buffer_size, &respond_when_available,
+             &remove_after_use) &&
+         !respond_when_available;
+}
+
+ts_size_t server_route_datagrams(server_shard_t* shard,
+                                 ts_datagram_t* datagrams,
+                                 ts_size_t datagrams_count) {
+  ts_size_t local_count = 0;
+  for (ts_size_t i = 0; i < datagrams_count; ++i) {
+    ts_datagram_t* datagram = &datagrams[i];
+    ts_tuple_signature_t signature;
+    ts_bool_t is_local = TS_TRUE;
+    if (!server_is_served_by_any_shard(shard, datagram) &&
+        ts_client_to_server_message_signature(
+            datagram->buffer, datagram->buffer_size, &signature)) {
+      size_t owner = server_shard_owner(shard, signature);
+      if (owner != shard->shard_id) {
+        is_local = TS_FALSE;
+        if (!server_push_shard_message(&shard->shards[owner].inbox, datagram,
+                                       TS_FALSE)) {
+          ++shard->server_data.metrics.total_errors;
+        }
+      }
+    } else if (ts_client_to_server_message_type(datagram->buffer,
+                                                datagram->buffer_size) ==
+                   TS_CLIENT_TO_SERVER_MESSAGE_RECEIVED_MSG &&
+               server_find_connection_node(
+                   &shard->server_data.active_connections,
+                   datagram->ip_address, datagram->port_id) == NULL) {
+      server_broadcast_ack(shard, datagram);
+    }
+    if (is_local) {
+      if (local_count != i) {
+        memcpy(&datagrams[local_count], datagram, sizeof(ts_datagram_t));
+      }
+      ++local_count;
+    }
+  }
+  return local_count;
+}
@@ -0,0 +1,80 @@
+#ifndef __SERVER_SHARD_H__
+#define __SERVER_SHARD_H__
+
+#include <pthread.h>
+
+#include "../libts/common/tuple_space_network.h"
+#include "server_pipeline.h"
+#include "server_process_requests.h"
+
+#define SERVER_SHARD_QUEUE_SIZE 4096  // power of two
+#define SERVER_SHARD_DATAGRAM_BATCH_SIZE 64
+
+typedef struct {
+  size_t sequence;
+  ts_bool_t is_forwarded_ack;
+  ts_datagram_t datagram;
+} server_shard_cell_t;
+
+// Bounded lock-free queue of datagrams forwarded to a shard by the others.
+// Any shard may push, only the owner pops. The eventfd wakes the owner up and
+// is written at most once between two server_clear_shard_wakeup calls.
+typedef struct {
+  server_shard_cell_t* cells;
+  size_t enqueue_position __attribute__((aligned(64)));
+  size_t dequeue_position __attribute__((aligned(64)));
+  int wakeup_descriptor;
+  int is_wakeup_pending;
+} server_shard_queue_t;
+
+// Every shard owns a socket bound with SO_REUSEPORT and the tuple space state
+// for the signatures that hash to it. A datagram landing on the wrong shard is
+// forwarded to the owner, which replies from its own socket on the same port.
+// With a shared stash the owner only keeps the waiters of its signatures, and
+// rdp and inp are served by whichever shard receives them. A pipelined shard
+// receives and sends through the pipeline threads instead of its device.
+typedef struct server_shard {
+  server_data_t server_data;
+  server_tuple_space_t tuple_stash;
+  ts_bool_t is_stash_shared;
+  server_shard_queue_t inbox;
+  server_pipeline_t* pipeline;
+  size_t shard_id;
+  size_t shards_count;
+  struct server_shard* shards;
+  pthread_t thread;
+  server_metrics_t published_metrics;
+  pthread_mutex_t metrics_lock;
+  ts_datagram_t received_datagrams[SERVER_SHARD_DATAGRAM_BATCH_SIZE];
+  ts_datagram_t sent_datagrams[SERVER_SHARD_DATAGRAM_BATCH_SIZE];
+} server_shard_t;
+
+ts_bool_t server_initialize_shard_queue(server_shard_queue_t* queue);
+
+void server_destroy_shard_queue(server_shard_queue_t* queue);
+
+void server_wake_shard_queue(server_shard_queue_t* queue);
+
+// Returns TS_FALSE when the queue is full and the datagram is dropped.
+ts_bool_t server_push_shard_message(server_shard_queue_t* queue,
+                                    const ts_datagram_t* datagram,
+                                    ts_bool_t is_forwarded_ack);
+
+ts_bool_t server_pop_shard_message(server_shard_queue_t* queue,
+                                   ts_datagram_t* datagram,
+                                   ts_bool_t* is_forwarded_ack);
+
+void server_clear_shard_wakeup(server_shard_queue_t* queue);
+
+size_t server_shard_owner(const server_shard_t* shard,
+                          ts_tuple_signature_t signature);
+
+// Forwards the datagrams owned by other shards and moves the local ones to
+// the front of datagrams. Acks for clients without a pending reply on this
+// shard stay local and are also broadcast, since the reply they acknowledge
+// may have come from any shard. Returns the number of local datagrams.
+ts_size_t server_route_datagrams(server_shard_t* shard,
+                                 ts_datagram_t* datagrams,
+                                 ts_size_t datagrams_count);
+
+#endif  // __SERVER_SHARD_H__
@@ -0,0 +1,156 @@
+#include "server_timer_wheel.h"
+
+#include <string.h>
+
+#define SERVER_TIMER_WHEEL_SLOT_MASK (SERVER_TIMER_WHEEL_SLOTS - 1)
+#define SERVER_TIMER_WHEEL_RANGE \
+  ((uint64_t)1 << (SERVER_TIMER_WHEEL_SLOT_BITS * SERVER_TIMER_WHEEL_LEVELS))
+
+void server_initialize_timer_wheel(server_timer_wheel_t* wheel,
+                                   uint64_t current_time_ms) {
+  memset(wheel, 0, sizeof(server_timer_wheel_t));
+  wheel->current_tick = current_time_ms;
+}
+
+static void server_push_timer(server_timer_slot_t* slot,
+                              server_timer_t* timer) {
+  timer->slot = slot;
+  timer->previous_timer = NULL;
+  timer->next_timer = slot->head;
+  if (slot->head != NULL) {
+    slot->head->previous_timer = timer;
+  }
+  slot->head = timer;
+}
+
+static void server_link_timer(server_timer_wheel_t* wheel,
+                              server_timer_t* timer) {
+  uint64_t deadline = timer->deadline;
+  if (deadline <= wheel->current_tick) {
+    deadline = wheel->current_tick + 1;
+  } else if (deadline - wheel->current_tick >= SERVER_TIMER_WHEEL_RANGE) {
+    deadline = wheel->current_tick + SERVER_TIMER_WHEEL_RANGE - 1;
+  }
+  uint64_t delta = deadline - wheel->current_tick;
+  size_t level = 0;
+  while (delta >= ((uint64_t)1 << (SERVER_TIMER_WHEEL_SLOT_BITS *
+                                    (level + 1)))) {
+    ++level;
+  }
+  server_timer_slot_t* slot =
+      &wheel->slots[level][(deadline >> (SERVER_TIMER_WHEEL_SLOT_BITS *
+                                         level)) &
+                           SERVER_TIMER_WHEEL_SLOT_MASK];
+  server_push_timer(slot, timer);
+}
+
+static void server_unlink_timer(server_timer_t* timer) {
+  server_timer_t* previous = (server_timer_t*)timer->previous_timer;
+  server_timer_t* next = (server_timer_t*)timer->next_timer;
+  if (previous != NULL) {
+    previous->next_timer = next;
+  } else {
+    ((server_timer_slot_t*)timer->slot)->head = next;
+  }
+  if (next != NULL) {
+    next->previous_timer = previous;
+  }
+  timer->next_timer = NULL;
+  timer->previous_timer = NULL;
+  timer->slot = NULL;
+}
+
+void server_schedule_timer(server_timer_wheel_t* wheel, server_timer_t* timer,
+                           uint64_t deadline_ms) {
+  if (timer->is_scheduled) {
+    server_cancel_timer(wheel, timer);
+  }
+  timer->deadline = deadline_ms;
+  timer->is_scheduled = TS_TRUE;
+  ++wheel->timers_count;
+  server_link_timer(wheel, timer);
+}
+
+void server_cancel_timer(server_timer_wheel_t* wheel, server_timer_t* timer) {
+  if (!timer->is_scheduled) {
+    return;
+  }
+  server_unlink_timer(timer);
+  timer->is_scheduled = TS_FALSE;
+  --wheel->timers_count;
+}
+
+static void server_cascade_timers(server_timer_wheel_t* wheel, size_t level) {
+  server_timer_slot_t* slot =
+      &wheel->slots[level][(wheel->current_tick >>
+                            (SERVER_TIMER_WHEEL_SLOT_BITS * level)) &
+                           SERVER_TIMER_WHEEL_SLOT_MASK];
+  server_timer_t* timer = slot->head;
+  slot->head = NULL;
+  while (timer != NULL) {
+    server_timer_t* next = (server_timer_t*)timer->next_timer;
+    if (timer->deadline <= wheel->current_tick) {
+      server_push_timer(
+          &wheel->slots[0][wheel->current_tick & SERVER_TIMER_WHEEL_SLOT_MASK],
+          timer);
+    } else {
+      server_link_timer(wheel, timer);
+    }
+    timer = next;
+  }
+}
+
+void server_advance_timer_wheel(server_timer_wheel_t* wheel,
+                                uint64_t current_time_ms,
+                                server_timer_expired_cb_t expired_cb,
+                                void* user_data) {
+  while (wheel->current_tick < current_time_ms) {
+    if (wheel->timers_count == 0) {
+      wheel->current_tick = current_time_ms;
+      return;
+    }
+    ++wheel->current_tick;
+    for (size_t level = SERVER_TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+      uint64_t level_mask =
+          ((uint64_t)1 << (SERVER_TIMER_WHEEL_SLOT_BITS * level)) - 1;
+      if ((wheel->current_tick & level_mask) == 0) {
+        server_cascade_timers(wheel, level);
+      }
+    }
+    server_timer_slot_t* slot =
+        &wheel->slots[0][wheel->current_tick & SERVER_TIMER_WHEEL_SLOT_MASK];
+    while (slot->head != NULL) {
+      server_timer_t* timer = slot->head;
+      server_cancel_timer(wheel, timer);
+      expired_cb(user_data, timer);
+    }
+  }
+}
+
+int64_t server_timer_wheel_timeout(const server_timer_wheel_t* wheel,
+                                   uint64_t current_time_ms) {
+  if (wheel->timers_count == 0) {
+    return -1;
+  }
+  uint64_t next_tick = UINT64_MAX;
+  for (size_t level = 0; level < SERVER_TIMER_WHEEL_LEVELS; ++level) {
+    size_t shift = SERVER_TIMER_WHEEL_SLOT_BITS * level;
+    uint64_t position = wheel->current_tick >> shift;
+    for (size_t step = 1; step <= SERVER_TIMER_WHEEL_SLOTS; ++step) {
+      uint64_t tick = (position + step) << shift;
+      if (tick >= next_tick) {
+        break;
+      }
+      if (wheel->slots[level][(position + step) & SERVER_TIMER_WHEEL_SLOT_MASK]
+              .head != NULL) {
+        next_tick = tick;
+        break;
+      }
+    }
+  }
+  if (next_tick == UINT64_MAX) {
+    return -1;
+  }
+  return next_tick <= current_time_ms ? 0
+                                      : (int64_t)(next_tick - current_time_ms);
+}
@@ -0,0 +1,61 @@
+#ifndef __SERVER_TIMER_WHEEL_H__
+#define __SERVER_TIMER_WHEEL_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "../libts/common/tuple_space.h"
+
+#define SERVER_TIMER_WHEEL_SLOT_BITS 6
+#define SERVER_TIMER_WHEEL_SLOTS (1 << SERVER_TIMER_WHEEL_SLOT_BITS)
+#define SERVER_TIMER_WHEEL_LEVELS 4
+
+// Intrusive timer, embedded in the object it fires for.
+typedef struct {
+  void* next_timer;
+  void* previous_timer;
+  void* slot;
+  uint64_t deadline;
+  ts_bool_t is_scheduled;
+} server_timer_t;
+
+typedef struct {
+  server_timer_t* head;
+} server_timer_slot_t;
+
+// Hierarchical timing wheel with 1 ms ticks. Level n slots span 64^n ticks;
+// timers move down a level when the level above wraps onto their slot, so
+// advancing costs one step per elapsed tick plus the timers that cascade or
+// expire. Deadlines further out than the top level are re-queued there.
+typedef struct {
+  server_timer_slot_t slots[SERVER_TIMER_WHEEL_LEVELS]
+                           [SERVER_TIMER_WHEEL_SLOTS];
+  uint64_t current_tick;
+  size_t timers_count;
+} server_timer_wheel_t;
+
+typedef void (*server_timer_expired_cb_t)(void* user_data,
+                                          server_timer_t* timer);
+
+void server_initialize_timer_wheel(server_timer_wheel_t* wheel,
+                                   uint64_t current_time_ms);
+
+void server_schedule_timer(server_timer_wheel_t* wheel, server_timer_t* timer,
+                           uint64_t deadline_ms);
+
+void server_cancel_timer(server_timer_wheel_t* wheel, server_timer_t* timer);
+
+// Fires every timer due at or before current_time_ms. Expired timers are
+// unscheduled before expired_cb runs, which may schedule them again.
+void server_advance_timer_wheel(server_timer_wheel_t* wheel,
+                                uint64_t current_time_ms,
+                                server_timer_expired_cb_t expired_cb,
+                                void* user_data);
+
+// Milliseconds until the wheel next has work: a timer expiring or a slot
+// cascading to a lower level. Never later than the earliest deadline; -1 when
+// no timer is scheduled.
+int64_t server_timer_wheel_timeout(const server_timer_wheel_t* wheel,
+                                   uint64_t current_time_ms);
+
+#endif  // __SERVER_TIMER_WHEEL_H__
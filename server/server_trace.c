@@ -0,0 +1,184 @@
+#include "server_trace.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "server_metrics.h"
+
+typedef struct {
+  server_trace_record_t records[SERVER_TRACE_BUFFER_SIZE];
+  size_t records_count;
+  size_t unsent_index;  // records from here on may still wait for a send
+  server_trace_record_t* current;
+  uint64_t receive_time_ns;
+  uint32_t requests_until_sample;
+} server_trace_buffer_t;
+
+static int TraceDescriptor = -1;
+static uint32_t SampleInterval = SERVER_TRACE_DEFAULT_SAMPLE_INTERVAL;
+static uint64_t NextRequestId = 1;
+static _Thread_local server_trace_buffer_t TraceBuffer;
+
+static uint64_t server_trace_time_ns(clockid_t clock) {
+  struct timespec time;
+  clock_gettime(clock, &time);
+  return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+// Moves the kernel receive time of the current datagram to the monotonic
+// clock; lost if the realtime clock was stepped in between.
+static uint64_t server_trace_monotonic_receive_time(uint64_t now_ns) {
+  uint64_t receive_time_ns = TraceBuffer.receive_time_ns;
+  if (receive_time_ns == 0) {
+    return 0;
+  }
+  uint64_t realtime_ns = server_trace_time_ns(CLOCK_REALTIME);
+  if (realtime_ns < receive_time_ns ||
+      realtime_ns - receive_time_ns > now_ns) {
+    return 0;
+  }
+  return now_ns - (realtime_ns - receive_time_ns);
+}
+
+ts_bool_t server_open_trace(const char* path, uint32_t sample_interval) {
+  TraceDescriptor =
+      open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (TraceDescriptor < 0) {
+    return TS_FALSE;
+  }
+  SampleInterval = sample_interval > 0 ? sample_interval : 1;
+  server_trace_file_header_t header;
+  memset(&header, 0, sizeof(server_trace_file_header_t));
+  header.magic = SERVER_TRACE_MAGIC;
+  header.record_size = sizeof(server_trace_record_t);
+  header.sample_interval = SampleInterval;
+  if (write(TraceDescriptor, &header, sizeof(server_trace_file_header_t)) !=
+      sizeof(server_trace_file_header_t)) {
+    server_close_trace();
+    return TS_FALSE;
+  }
+  return TS_TRUE;
+}
+
+void server_close_trace(void) {
+  if (TraceDescriptor >= 0) {
+    close(TraceDescriptor);
+    TraceDescriptor = -1;
+  }
+}
+
+ts_bool_t server_is_tracing(void) { return TraceDescriptor >= 0; }
+
+void server_trace_receive(uint64_t receive_time_ns) {
+  TraceBuffer.receive_time_ns = receive_time_ns;
+}
+
+void server_trace_request(uint8_t operation, ts_ipv4_t client_ip_address,
+                          ts_port_t client_port_id) {
+  server_trace_buffer_t* buffer = &TraceBuffer;
+  if (TraceDescriptor < 0) {
+    return;
+  }
+  if (buffer->requests_until_sample > 0) {
+    --buffer->requests_until_sample;
+    return;
+  }
+  buffer->requests_until_sample = SampleInterval - 1;
+  if (buffer->records_count == SERVER_TRACE_BUFFER_SIZE) {
+    return;
+  }
+  server_trace_record_t* record = &buffer->records[buffer->records_count++];
+  memset(record, 0, sizeof(server_trace_record_t));
+  record->request_id = __atomic_fetch_add(&NextRequestId, 1, __ATOMIC_RELAXED);
+  record->client_ip_address = client_ip_address;
+  record->client_port_id = client_port_id;
+  record->kind = SERVER_TRACE_REQUEST_RECORD;
+  record->operation = operation;
+  uint64_t now_ns = server_trace_time_ns(CLOCK_MONOTONIC);
+  record->stage_times_ns[SERVER_TRACE_RECEIVE] =
+      server_trace_monotonic_receive_time(now_ns);
+  record->stage_times_ns[SERVER_TRACE_DECODE] = now_ns;
+  buffer->current = record;
+}
+
+void server_trace_stage(server_trace_stage_t stage) {
+  if (TraceBuffer.current != NULL) {
+    TraceBuffer.current->stage_times_ns[stage] =
+        server_trace_time_ns(CLOCK_MONOTONIC);
+  }
+}
+
+void server_trace_end_request(void) { TraceBuffer.current = NULL; }
+
+// Out requests are answered with an ack the client does not acknowledge,
+// the connections opened while they run belong to the waiters.
+uint64_t server_current_trace_request_id(void) {
+  server_trace_record_t* record = TraceBuffer.current;
+  if (record == NULL || record->operation == SERVER_OPERATION_OUT) {
+    return 0;
+  }
+  return record->request_id;
+}
+
+void server_trace_send(void) {
+  server_trace_buffer_t* buffer = &TraceBuffer;
+  if (buffer->unsent_index == buffer->records_count) {
+    return;
+  }
+  uint64_t now_ns = server_trace_time_ns(CLOCK_MONOTONIC);
+  for (size_t i = buffer->unsent_index; i < buffer->records_count; ++i) {
+    server_trace_record_t* record = &buffer->records[i];
+    if (record->kind == SERVER_TRACE_REQUEST_RECORD) {
+      record->stage_times_ns[SERVER_TRACE_SEND] = now_ns;
+    }
+  }
+  buffer->unsent_index = buffer->records_count;
+  if (buffer->records_count >= SERVER_TRACE_BUFFER_SIZE / 2) {
+    server_flush_trace();
+  }
+}
+
+void server_trace_ack(uint64_t request_id, ts_ipv4_t client_ip_address,
+                      ts_port_t client_port_id) {
+  server_trace_buffer_t* buffer = &TraceBuffer;
+  if (TraceDescriptor < 0 || request_id == 0) {
+    return;
+  }
+  if (buffer->records_count == SERVER_TRACE_BUFFER_SIZE) {
+    server_flush_trace();
+    if (buffer->records_count == SERVER_TRACE_BUFFER_SIZE) {
+      return;
+    }
+  }
+  server_trace_record_t* record = &buffer->records[buffer->records_count++];
+  memset(record, 0, sizeof(server_trace_record_t));
+  record->request_id = request_id;
+  record->client_ip_address = client_ip_address;
+  record->client_port_id = client_port_id;
+  record->kind = SERVER_TRACE_ACK_RECORD;
+  uint64_t now_ns = server_trace_time_ns(CLOCK_MONOTONIC);
+  uint64_t receive_time_ns = server_trace_monotonic_receive_time(now_ns);
+  record->stage_times_ns[SERVER_TRACE_ACK] =
+      receive_time_ns != 0 ? receive_time_ns : now_ns;
+}
+
+// Appends are atomic, so the threads share the descriptor without a lock.
+void server_flush_trace(void) {
+  server_trace_buffer_t* buffer = &TraceBuffer;
+  if (TraceDescriptor < 0 || buffer->unsent_index == 0) {
+    return;
+  }
+  ssize_t written = write(TraceDescriptor, buffer->records,
+                          buffer->unsent_index * sizeof(server_trace_record_t));
+  (void)written;
+  size_t unsent_count = buffer->records_count - buffer->unsent_index;
+  memmove(buffer->records, buffer->records + buffer->unsent_index,
+          unsent_count * sizeof(server_trace_record_t));
+  if (buffer->current != NULL) {
+    buffer->current -= buffer->unsent_index;
+  }
+  buffer->records_count = unsent_count;
+  buffer->unsent_index = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef __SERVER_TRACE_H__
+#define __SERVER_TRACE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "../libts/common/tuple_space_network.h"
+
+#define SERVER_TRACE_DEFAULT_SAMPLE_INTERVAL 100
+#define SERVER_TRACE_BUFFER_SIZE 128  // records per thread
+#define SERVER_TRACE_MAGIC 0x31435254  // "TRC1"
+
+typedef enum {
+  SERVER_TRACE_RECEIVE = 0,  // kernel receive timestamp
+  SERVER_TRACE_DECODE = 1,   // the request reached its callback
+  SERVER_TRACE_MATCH = 2,    // the stash was searched or updated
+  SERVER_TRACE_ENCODE = 3,   // the reply is in the send batch
+  SERVER_TRACE_SEND = 4,     // the send batch was flushed
+  SERVER_TRACE_ACK = 5,      // the client acknowledged the reply
+  SERVER_TRACE_STAGES_COUNT = 6
+} server_trace_stage_t;
+
+typedef enum {
+  SERVER_TRACE_REQUEST_RECORD = 0,
+  SERVER_TRACE_ACK_RECORD = 1
+} server_trace_record_kind_t;
+
+// Times are CLOCK_MONOTONIC nanoseconds, 0 for stages not reached. Request
+// records carry every stage but the ack, which comes later in its own record
+// with the same request_id.
+typedef struct {
+  uint64_t request_id;
+  uint64_t stage_times_ns[SERVER_TRACE_STAGES_COUNT];
+  ts_ipv4_t client_ip_address;
+  ts_port_t client_port_id;
+  uint8_t kind;       // server_trace_record_kind_t
+  uint8_t operation;  // server_operation_t
+} server_trace_record_t;
+
+// The file starts with this header, followed by the records in the byte
+// order of the server.
+typedef struct {
+  uint32_t magic;
+  uint32_t record_size;
+  uint32_t sample_interval;
+  uint32_t reserved;
+} server_trace_file_header_t;
+
+// Traces one request in every sample_interval, counted per thread.
+ts_bool_t server_open_trace(const char* path, uint32_t sample_interval);
+
+// Threads must have flushed their records before.
+void server_close_trace(void);
+
+ts_bool_t server_is_tracing(void);
+
+// Receive time of the datagram the next request comes from, in
+// CLOCK_REALTIME nanoseconds as devices report it, or 0.
+void server_trace_receive(uint64_t receive_time_ns);
+
+// Starts the trace of the decoded request, if it is sampled.
+void server_trace_request(uint8_t operation, ts_ipv4_t client_ip_address,
+                          ts_port_t client_port_id);
+
+void server_trace_stage(server_trace_stage_t stage);
+
+void server_trace_end_request(void);
+
+// Id of the request being traced whose reply awaits an ack, or 0.
+uint64_t server_current_trace_request_id(void);
+
+// Stamps the send time on the requests ended since the previous call.
+void server_trace_send(void);
+
+void server_trace_ack(uint64_t request_id, ts_ipv4_t client_ip_address,
+                      ts_port_t client_port_id);
+
+// Writes out the finished records of the calling thread.
+void server_flush_trace(void);
+
+#endif  // __SERVER_TRACE_H__
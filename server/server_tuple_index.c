@@ -0,0 +1,170 @@
+#include "server_tuple_index.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server_epoch.h"
+
+#define SERVER_FNV_PRIME 16777619u
+
+uint32_t server_hash_bytes(uint32_t hash, const void* data, ts_size_t size) {
+  const ts_byte_t* bytes = (const ts_byte_t*)data;
+  for (ts_size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= SERVER_FNV_PRIME;
+  }
+  return hash;
+}
+
+// Equal strings share their inline characters or their intern id, and
+// 0.0 and -0.0 compare equal, so they have to land in the same bucket.
+static uint32_t server_hash_tuple_field(uint32_t hash,
+                                        const server_field_t* field) {
+  ts_byte_t field_type = server_field_get_type(field);
+  hash = server_hash_bytes(hash, &field_type, 1);
+  if (field_type == TS_FIELD_TYPE_FLOAT && field->data.float_field == 0.0f) {
+    ts_float_t value = 0.0f;
+    return server_hash_bytes(hash, &value, sizeof(ts_float_t));
+  }
+  return server_hash_bytes(hash, &field->data.bits, sizeof(uint32_t));
+}
+
+static ts_size_t server_index_key_fields(ts_size_t tuple_size) {
+  return tuple_size < SERVER_TUPLE_INDEX_KEY_FIELDS
+             ? tuple_size
+             : SERVER_TUPLE_INDEX_KEY_FIELDS;
+}
+
+ts_bool_t server_is_indexable_tuple(const server_field_t* tuple,
+                                    ts_size_t tuple_size) {
+  return server_do_all_fields_contain_data(
+      tuple, server_index_key_fields(tuple_size));
+}
+
+uint32_t server_tuple_key_hash(const server_field_t* tuple,
+                               ts_size_t tuple_size) {
+  uint32_t hash = SERVER_HASH_OFFSET_BASIS;
+  ts_size_t key_fields = server_index_key_fields(tuple_size);
+  for (ts_size_t i = 0; i < key_fields; ++i) {
+    hash = server_hash_tuple_field(hash, &tuple[i]);
+  }
+  return hash;
+}
+
+static server_tuple_list_t* server_tuple_index_bucket_list(
+    const server_tuple_index_t* index, uint32_t key_hash) {
+  return &index->buckets[key_hash & (index->bucket_count - 1)];
+}
+
+// The count is read first: the array it was published after is at least as
+// large, so a racing reader never indexes past the end.
+server_tuple_index_link_t* server_tuple_index_bucket(
+    const server_tuple_index_t* index, uint32_t key_hash) {
+  ts_size_t bucket_count = SERVER_LOAD_LINK(index->bucket_count);
+  server_tuple_list_t* buckets = SERVER_LOAD_LINK(index->buckets);
+  if (buckets == NULL) {
+    return NULL;
+  }
+  return SERVER_LOAD_LINK(buckets[key_hash & (bucket_count - 1)].head);
+}
+
+void server_tuple_list_push_front(server_tuple_list_t* list,
+                                 server_tuple_index_link_t* link) {
+  link->previous_in_bucket = NULL;
+  SERVER_STORE_LINK(link->next_in_bucket, (void*)list->head);
+  if (list->head != NULL) {
+    list->head->previous_in_bucket = link;
+  } else {
+    list->tail = link;
+  }
+  SERVER_STORE_LINK(list->head, link);
+}
+
+void server_tuple_list_push_back(server_tuple_list_t* list,
+                                server_tuple_index_link_t* link) {
+  SERVER_STORE_LINK(link->next_in_bucket, NULL);
+  link->previous_in_bucket = list->tail;
+  if (list->tail != NULL) {
+    SERVER_STORE_LINK(list->tail->next_in_bucket, (void*)link);
+  } else {
+    SERVER_STORE_LINK(list->head, link);
+  }
+  list->tail = link;
+}
+
+void server_tuple_list_remove(server_tuple_list_t* list,
+                              server_tuple_index_link_t* link) {
+  server_tuple_index_link_t* previous =
+      (server_tuple_index_link_t*)link->previous_in_bucket;
+  server_tuple_index_link_t* next =
+      (server_tuple_index_link_t*)link->next_in_bucket;
+  // The link keeps its next pointer, a reader standing on it moves on
+  if (previous != NULL) {
+    SERVER_STORE_LINK(previous->next_in_bucket, (void*)next);
+  } else {
+    SERVER_STORE_LINK(list->head, next);
+  }
+  if (next != NULL) {
+    next->previous_in_bucket = previous;
+  } else {
+    list->tail = previous;
+  }
+}
+
+static void server_free_buckets_cb(void* /*context*/, void* memory,
+                                   ts_size_t /*size*/) {
+  free(memory);
+}
+
+// Relinking may make a concurrent reader miss a node, shared lookups that
+// miss lock-free retry under the bucket lock. The links being relinked are
+// published, so even their terminators are stored through SERVER_STORE_LINK.
+static void server_tuple_index_rehash(server_tuple_index_t* index,
+                                      ts_size_t bucket_count) {
+  server_tuple_list_t* old_buckets = index->buckets;
+  ts_size_t old_bucket_count = index->bucket_count;
+  server_tuple_list_t* new_buckets =
+      (server_tuple_list_t*)calloc(bucket_count, sizeof(server_tuple_list_t));
+  for (ts_size_t i = 0; i < old_bucket_count; ++i) {
+    server_tuple_index_link_t* link = old_buckets[i].head;
+    while (link != NULL) {
+      server_tuple_index_link_t* next =
+          (server_tuple_index_link_t*)link->next_in_bucket;
+      server_tuple_list_push_back(
+          &new_buckets[link->key_hash & (bucket_count - 1)], link);
+      link = next;
+    }
+  }
+  SERVER_STORE_LINK(index->buckets, new_buckets);
+  SERVER_STORE_LINK(index->bucket_count, bucket_count);
+  if ((old_buckets != NULL) &&
+      !server_epoch_retire(old_buckets, 0, server_free_buckets_cb, NULL)) {
+    free(old_buckets);
+  }
+}
+
+void server_tuple_index_insert(server_tuple_index_t* index,
+                               server_tuple_index_link_t* link,
+                               ts_bool_t append) {
+  if (index->buckets == NULL) {
+    server_tuple_index_rehash(index, SERVER_TUPLE_INDEX_INITIAL_BUCKETS);
+  } else if (index->node_count >= index->bucket_count * 2) {
+    server_tuple_index_rehash(index, index->bucket_count * 2);
+  }
+  server_tuple_list_t* bucket =
+      server_tuple_index_bucket_list(index, link->key_hash);
+  if (append) {
+    server_tuple_list_push_back(bucket, link);
+  } else {
+    server_tuple_list_push_front(bucket, link);
+  }
+  ++index->node_count;
+}
+
+void server_tuple_index_remove(server_tuple_index_t* index,
+                               server_tuple_index_link_t* link) {
+  server_tuple_list_remove(
+      server_tuple_index_bucket_list(index, link->key_hash), link);
+  --index->node_count;
+}
@@ -0,0 +1,68 @@
+#ifndef __SERVER_TUPLE_INDEX_H__
+#define __SERVER_TUPLE_INDEX_H__
+
+#include "../libts/common/tuple_space.h"
+#include "server_field.h"
+
+// Number of leading fields tuples are indexed on. Clients built on
+// ts_application_* always send the app id first and usually a task name
+// second, so both are actual in nearly every template.
+#define SERVER_TUPLE_INDEX_KEY_FIELDS 2
+#define SERVER_TUPLE_INDEX_INITIAL_BUCKETS 64
+#define SERVER_HASH_OFFSET_BASIS 2166136261u
+
+// Links followed by lock-free readers of a shared stash are loaded and
+// stored through these, so a node is fully built before it is reachable.
+#define SERVER_LOAD_LINK(link) __atomic_load_n(&(link), __ATOMIC_ACQUIRE)
+#define SERVER_STORE_LINK(link, value) \
+  __atomic_store_n(&(link), (value), __ATOMIC_RELEASE)
+
+// Intrusive bucket link, it has to be the first member of an indexed node.
+typedef struct {
+  void* next_in_bucket;
+  void* previous_in_bucket;
+  uint32_t key_hash;
+} server_tuple_index_link_t;
+
+typedef struct {
+  server_tuple_index_link_t* head;
+  server_tuple_index_link_t* tail;
+} server_tuple_list_t;
+
+typedef struct {
+  server_tuple_list_t* buckets;
+  ts_size_t bucket_count;
+  ts_size_t node_count;
+} server_tuple_index_t;
+
+uint32_t server_hash_bytes(uint32_t hash, const void* data, ts_size_t size);
+
+ts_bool_t server_is_indexable_tuple(const server_field_t* tuple,
+                                    ts_size_t tuple_size);
+
+uint32_t server_tuple_key_hash(const server_field_t* tuple,
+                               ts_size_t tuple_size);
+
+server_tuple_index_link_t* server_tuple_index_bucket(
+    const server_tuple_index_t* index, uint32_t key_hash);
+
+void server_tuple_list_push_front(server_tuple_list_t* list,
+                                 server_tuple_index_link_t* link);
+
+void server_tuple_list_push_back(server_tuple_list_t* list,
+                                server_tuple_index_link_t* link);
+
+void server_tuple_list_remove(server_tuple_list_t* list,
+                              server_tuple_index_link_t* link);
+
+// Links are prepended to their bucket, or appended when append is set. A
+// shared index keeps readers off the bucket array it replaces on growth
+// until no reader can still hold it.
+void server_tuple_index_insert(server_tuple_index_t* index,
+                               server_tuple_index_link_t* link,
+                               ts_bool_t append);
+
+void server_tuple_index_remove(server_tuple_index_t* index,
+                               server_tuple_index_link_t* link);
+
+#endif  // __SERVER_TUPLE_INDEX_H__
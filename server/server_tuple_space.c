@@ -4,82 +4,469 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "server_log.h"
+
+static ts_size_t server_partition_bucket(ts_tuple_signature_t signature,
+                                         ts_size_t tuple_size) {
+  uint32_t hash = server_hash_bytes(SERVER_HASH_OFFSET_BASIS, &signature,
+                                    sizeof(ts_tuple_signature_t));
+  hash = server_hash_bytes(hash, &tuple_size, sizeof(ts_size_t));
+  return hash & (SERVER_TUPLE_PARTITION_BUCKETS - 1);
+}
+
+void server_initialize_tuple_space(server_tuple_space_t* tuple_space) {
+  memset(tuple_space, 0, sizeof(server_tuple_space_t));
+}
+
+ts_bool_t server_initialize_shared_tuple_space(
+    server_tuple_space_t* tuple_space) {
+  server_initialize_tuple_space(tuple_space);
+  tuple_space->bucket_locks = (pthread_mutex_t*)malloc(
+      sizeof(pthread_mutex_t) * SERVER_TUPLE_PARTITION_BUCKETS);
+  if (tuple_space->bucket_locks == NULL) {
+    return TS_FALSE;
+  }
+  for (ts_size_t i = 0; i < SERVER_TUPLE_PARTITION_BUCKETS; ++i) {
+    pthread_mutex_init(&tuple_space->bucket_locks[i], NULL);
+  }
+  return TS_TRUE;
+}
+
+static void server_lock_partition_bucket(server_tuple_space_t* tuple_space,
+                                         ts_size_t bucket) {
+  if (tuple_space->bucket_locks != NULL) {
+    pthread_mutex_lock(&tuple_space->bucket_locks[bucket]);
+  }
+}
+
+static void server_unlock_partition_bucket(server_tuple_space_t* tuple_space,
+                                           ts_size_t bucket) {
+  if (tuple_space->bucket_locks != NULL) {
+    pthread_mutex_unlock(&tuple_space->bucket_locks[bucket]);
+  }
+}
+
+void server_initialize_tuple_queue(server_tuple_queue_t* tuple_space,
+                                   server_dispatch_mode_t dispatch_mode) {
+  memset(tuple_space, 0, sizeof(server_tuple_queue_t));
+  tuple_space->dispatch_mode = dispatch_mode;
+  server_initialize_pool(&tuple_space->node_pool,
+                         sizeof(server_tuple_queue_node_t));
+}
+
+// Partitions are never freed, so the chain can be walked without the lock;
+// creating one requires the lock of its bucket.
+static server_tuple_space_partition_t* server_find_data_partition(
+    server_tuple_space_t* tuple_space, ts_size_t bucket,
+    ts_tuple_signature_t signature, ts_size_t tuple_size, ts_bool_t create) {
+  server_tuple_space_partition_t** partition = &tuple_space->partitions[bucket];
+  server_tuple_space_partition_t* current;
+  for (; (current = SERVER_LOAD_LINK(*partition)) != NULL;
+       partition = (server_tuple_space_partition_t**)&current->next_partition) {
+    if ((current->signature == signature) &&
+        (current->tuple_size == tuple_size)) {
+      return current;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  server_tuple_space_partition_t* new_partition =
+      (server_tuple_space_partition_t*)malloc(
+          sizeof(server_tuple_space_partition_t));
+  memset(new_partition, 0, sizeof(server_tuple_space_partition_t));
+  new_partition->signature = signature;
+  new_partition->tuple_size = tuple_size;
+  SERVER_STORE_LINK(*partition, new_partition);
+  return new_partition;
+}
+
+static server_tuple_queue_partition_t* server_find_template_partition(
+    server_tuple_queue_t* tuple_queue, ts_tuple_signature_t signature,
+    ts_size_t tuple_size, ts_bool_t create) {
+  server_tuple_queue_partition_t** partition =
+      &tuple_queue->partitions[server_partition_bucket(signature, tuple_size)];
+  for (; *partition != NULL;
+       partition =
+           (server_tuple_queue_partition_t**)&(*partition)->next_partition) {
+    if (((*partition)->signature == signature) &&
+        ((*partition)->tuple_size == tuple_size)) {
+      return *partition;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  server_tuple_queue_partition_t* new_partition =
+      (server_tuple_queue_partition_t*)malloc(
+          sizeof(server_tuple_queue_partition_t));
+  memset(new_partition, 0, sizeof(server_tuple_queue_partition_t));
+  new_partition->signature = signature;
+  new_partition->tuple_size = tuple_size;
+  *partition = new_partition;
+  return new_partition;
+}
+
+static void server_remove_data_node(server_tuple_space_partition_t* partition,
+                                    server_tuple_space_node_t* node) {
+  server_tuple_space_node_t* previous =
+      (server_tuple_space_node_t*)node->previous_node;
+  server_tuple_space_node_t* next =
+      (server_tuple_space_node_t*)node->next_node;
+  if (previous != NULL) {
+    SERVER_STORE_LINK(previous->next_node, (void*)next);
+  } else {
+    SERVER_STORE_LINK(partition->nodes, next);
+  }
+  if (next != NULL) {
+    next->previous_node = previous;
+  }
+  server_tuple_index_remove(&partition->index, &node->link);
+}
+
 void server_insert_data_tuple(server_tuple_space_t* tuple_space,
-                              ts_tuple_field_t* tuple, ts_size_t tuple_size) {
-  server_tuple_space_node_t** root_node = &tuple_space->nodes[tuple_size - 1];
-  server_tuple_space_node_t* new_node =
-      (server_tuple_space_node_t*)malloc(sizeof(server_tuple_space_node_t));
+                              server_field_t* tuple, ts_size_t tuple_size,
+                              ts_tuple_signature_t signature) {
+  ts_size_t bucket = server_partition_bucket(signature, tuple_size);
+  server_lock_partition_bucket(tuple_space, bucket);
+  server_tuple_space_partition_t* partition = server_find_data_partition(
+      tuple_space, bucket, signature, tuple_size, TS_TRUE);
+  server_tuple_space_node_t* new_node = SERVER_TUPLE_SPACE_TUPLE_NODE(tuple);
   memset(new_node, 0, sizeof(server_tuple_space_node_t));
-  new_node->tuple = tuple;
-  new_node->next_node = NULL;
-  if (*root_node == NULL) {
-    *root_node = new_node;
+  new_node->link.key_hash = server_tuple_key_hash(tuple, tuple_size);
+  new_node->next_node = partition->nodes;
+  if (partition->nodes != NULL) {
+    partition->nodes->previous_node = new_node;
+  }
+  SERVER_STORE_LINK(partition->nodes, new_node);
+  server_tuple_index_insert(&partition->index, &new_node->link, TS_FALSE);
+  server_unlock_partition_bucket(tuple_space, bucket);
+}
+
+static void server_remove_template_node(
+    server_tuple_queue_partition_t* partition,
+    server_tuple_queue_node_t* node) {
+  if (node->is_indexed) {
+    server_tuple_index_remove(&partition->index, &node->link);
   } else {
-    new_node->next_node = *root_node;
-    *root_node = new_node;
+    server_tuple_list_remove(&partition->unindexed_nodes, &node->link);
   }
 }
 
-void server_insert_template_tuple(server_tuple_queue_t* tuple_space,
-                                  ts_tuple_field_t* tuple, ts_size_t tuple_size,
-                                  ts_ipv4_t sender_ip_address,
-                                  ts_port_t sender_port_id,
-                                  ts_bool_t remove_matching) {
-  server_tuple_queue_node_t** root_node = &tuple_space->nodes[tuple_size - 1];
+ts_bool_t server_insert_template_tuple(server_tuple_queue_t* tuple_space,
+                                       server_field_t* tuple,
+                                       ts_size_t tuple_size,
+                                       ts_tuple_signature_t signature,
+                                       ts_ipv4_t sender_ip_address,
+                                       ts_port_t sender_port_id,
+                                       ts_bool_t remove_matching) {
   server_tuple_queue_node_t* new_node =
-      (server_tuple_queue_node_t*)malloc(sizeof(server_tuple_queue_node_t));
+      (server_tuple_queue_node_t*)server_pool_allocate(&tuple_space->node_pool);
+  if (new_node == NULL) {
+    return TS_FALSE;
+  }
+  server_tuple_queue_partition_t* partition = server_find_template_partition(
+      tuple_space, signature, tuple_size, TS_TRUE);
   memset(new_node, 0, sizeof(server_tuple_queue_node_t));
   new_node->entry.tuple = tuple;
   new_node->entry.sender_ip_address = sender_ip_address;
   new_node->entry.sender_port_id = sender_port_id;
   new_node->entry.remove_matching = remove_matching;
-  new_node->next_node = NULL;
-  if (*root_node == NULL) {
-    *root_node = new_node;
+  new_node->entry.insertion_time_us = server_monotonic_time_us();
+  new_node->sequence = tuple_space->next_sequence++;
+  new_node->is_indexed = server_is_indexable_tuple(tuple, tuple_size);
+  ts_bool_t append = tuple_space->dispatch_mode != SERVER_DISPATCH_LIFO;
+  if (new_node->is_indexed) {
+    new_node->link.key_hash = server_tuple_key_hash(tuple, tuple_size);
+    server_tuple_index_insert(&partition->index, &new_node->link, append);
+  } else if (append) {
+    server_tuple_list_push_back(&partition->unindexed_nodes, &new_node->link);
   } else {
-    new_node->next_node = *root_node;
-    *root_node = new_node;
-  }
-}
-
-server_tuple_queue_entry_t server_get_template_node(
-    server_tuple_queue_t* tuple_space, ts_tuple_field_t* data_tuple,
-    ts_size_t tuple_size, ts_bool_t remove_when_found) {
-  server_tuple_queue_node_t** node = &tuple_space->nodes[tuple_size - 1];
-  server_tuple_queue_entry_t entry;
-  entry.tuple = NULL;
-  for (; *node != NULL;
-       node = (server_tuple_queue_node_t**)&(*node)->next_node) {
-    if (ts_is_matching_tuple((*node)->entry.tuple, data_tuple, tuple_size)) {
-      entry = (*node)->entry;
-      if (remove_when_found) {
-        server_tuple_queue_node_t* old_node = *node;
-        *node = (*node)->next_node;
-        free(old_node);
-      }
-      return entry;
+    server_tuple_list_push_front(&partition->unindexed_nodes, &new_node->link);
+  }
+  return TS_TRUE;
+}
+
+static server_client_stamp_t* server_find_client_stamp_slot(
+    server_client_stamp_t* stamps, ts_size_t stamps_size,
+    ts_ipv4_t ip_address, ts_port_t port_id) {
+  uint32_t hash = server_hash_bytes(SERVER_HASH_OFFSET_BASIS, &ip_address,
+                                    sizeof(ts_ipv4_t));
+  hash = server_hash_bytes(hash, &port_id, sizeof(ts_port_t));
+  ts_size_t slot = hash & (stamps_size - 1);
+  while (stamps[slot].is_used && ((stamps[slot].ip_address != ip_address) ||
+                                  (stamps[slot].port_id != port_id))) {
+    slot = (slot + 1) & (stamps_size - 1);
+  }
+  return &stamps[slot];
+}
+
+static uint64_t server_client_last_served(server_tuple_queue_t* tuple_space,
+                                          ts_ipv4_t ip_address,
+                                          ts_port_t port_id) {
+  if (tuple_space->client_stamps == NULL) {
+    return 0;
+  }
+  server_client_stamp_t* stamp = server_find_client_stamp_slot(
+      tuple_space->client_stamps, tuple_space->client_stamps_size, ip_address,
+      port_id);
+  return stamp->is_used ? stamp->last_served : 0;
+}
+
+static void server_grow_client_stamps(server_tuple_queue_t* tuple_space) {
+  server_client_stamp_t* old_stamps = tuple_space->client_stamps;
+  ts_size_t old_size = tuple_space->client_stamps_size;
+  ts_size_t new_size =
+      old_size ? old_size * 2 : SERVER_CLIENT_TABLE_INITIAL_SIZE;
+  tuple_space->client_stamps =
+      (server_client_stamp_t*)calloc(new_size, sizeof(server_client_stamp_t));
+  tuple_space->client_stamps_size = new_size;
+  for (ts_size_t i = 0; i < old_size; ++i) {
+    if (old_stamps[i].is_used) {
+      *server_find_client_stamp_slot(tuple_space->client_stamps, new_size,
+                                     old_stamps[i].ip_address,
+                                     old_stamps[i].port_id) = old_stamps[i];
     }
   }
-  return entry;
+  free(old_stamps);
 }
 
-ts_tuple_field_t* server_get_data_node(server_tuple_space_t* tuple_space,
-                                       ts_tuple_field_t* template_tuple,
-                                       ts_size_t tuple_size,
-                                       ts_bool_t remove_when_found) {
-  server_tuple_space_node_t** node = &tuple_space->nodes[tuple_size - 1];
-  ts_tuple_field_t* tuple = NULL;
-  for (; *node != NULL;
-       node = (server_tuple_space_node_t**)&(*node)->next_node) {
-    if (ts_is_matching_tuple(template_tuple, (*node)->tuple, tuple_size)) {
-      tuple = (*node)->tuple;
-      if (remove_when_found) {
-        server_tuple_space_node_t* old_node = *node;
-        *node = (*node)->next_node;
-        free(old_node);
-      }
-      return tuple;
+static void server_mark_client_served(server_tuple_queue_t* tuple_space,
+                                      ts_ipv4_t ip_address,
+                                      ts_port_t port_id) {
+  if ((tuple_space->client_stamps_count + 1) * 2 >
+      tuple_space->client_stamps_size) {
+    server_grow_client_stamps(tuple_space);
+  }
+  server_client_stamp_t* stamp = server_find_client_stamp_slot(
+      tuple_space->client_stamps, tuple_space->client_stamps_size, ip_address,
+      port_id);
+  if (!stamp->is_used) {
+    stamp->is_used = TS_TRUE;
+    stamp->ip_address = ip_address;
+    stamp->port_id = port_id;
+    ++tuple_space->client_stamps_count;
+  }
+  stamp->last_served = ++tuple_space->served_counter;
+}
+
+static server_tuple_queue_node_t* server_next_matching_template_node(
+    server_tuple_queue_node_t* node, server_field_t* data_tuple,
+    ts_size_t tuple_size, uint32_t key_hash, server_scan_stats_t* scan_stats) {
+  for (; node != NULL;
+       node = (server_tuple_queue_node_t*)node->link.next_in_bucket) {
+    ++scan_stats->visited_nodes;
+    if (node->is_indexed && (node->link.key_hash != key_hash)) {
+      continue;
+    }
+    ++scan_stats->matched_nodes;
+    if (server_is_matching_fields(node->entry.tuple, data_tuple, tuple_size)) {
+      return node;
     }
   }
-  return tuple;
+  return NULL;
+}
+
+// Walks the matching waiters of a partition in dispatch order by merging
+// its indexed bucket with the unindexed list on the arrival sequence.
+typedef struct {
+  server_tuple_queue_node_t* indexed;
+  server_tuple_queue_node_t* unindexed;
+  server_field_t* data_tuple;
+  ts_size_t tuple_size;
+  uint32_t key_hash;
+  ts_bool_t newest_first;
+  server_scan_stats_t* scan_stats;
+} server_template_cursor_t;
+
+static void server_template_cursor_reset(
+    server_template_cursor_t* cursor,
+    server_tuple_queue_partition_t* partition) {
+  cursor->indexed = server_next_matching_template_node(
+      (server_tuple_queue_node_t*)server_tuple_index_bucket(&partition->index,
+                                                            cursor->key_hash),
+      cursor->data_tuple, cursor->tuple_size, cursor->key_hash,
+      cursor->scan_stats);
+  cursor->unindexed = server_next_matching_template_node(
+      (server_tuple_queue_node_t*)partition->unindexed_nodes.head,
+      cursor->data_tuple, cursor->tuple_size, cursor->key_hash,
+      cursor->scan_stats);
+}
+
+static server_tuple_queue_node_t* server_template_cursor_next(
+    server_template_cursor_t* cursor) {
+  server_tuple_queue_node_t** side;
+  if (cursor->unindexed == NULL) {
+    side = &cursor->indexed;
+  } else if (cursor->indexed == NULL) {
+    side = &cursor->unindexed;
+  } else {
+    ts_bool_t indexed_first =
+        cursor->newest_first
+            ? cursor->indexed->sequence > cursor->unindexed->sequence
+            : cursor->indexed->sequence < cursor->unindexed->sequence;
+    side = indexed_first ? &cursor->indexed : &cursor->unindexed;
+  }
+  server_tuple_queue_node_t* node = *side;
+  if (node != NULL) {
+    *side = server_next_matching_template_node(
+        (server_tuple_queue_node_t*)node->link.next_in_bucket,
+        cursor->data_tuple, cursor->tuple_size, cursor->key_hash,
+        cursor->scan_stats);
+  }
+  return node;
+}
+
+static server_tuple_queue_node_t* server_least_recently_served_in_waiter(
+    server_tuple_queue_t* tuple_space, server_template_cursor_t* cursor) {
+  server_tuple_queue_node_t* chosen = NULL;
+  uint64_t chosen_last_served = 0;
+  server_tuple_queue_node_t* node = server_template_cursor_next(cursor);
+  for (; node != NULL; node = server_template_cursor_next(cursor)) {
+    if (!node->entry.remove_matching) {
+      continue;
+    }
+    uint64_t last_served = server_client_last_served(
+        tuple_space, node->entry.sender_ip_address, node->entry.sender_port_id);
+    if ((chosen == NULL) || (last_served < chosen_last_served)) {
+      chosen = node;
+      chosen_last_served = last_served;
+    }
+  }
+  return chosen;
+}
+
+ts_size_t server_take_template_nodes(server_tuple_queue_t* tuple_space,
+                                     server_field_t* data_tuple,
+                                     ts_size_t tuple_size,
+                                     ts_tuple_signature_t signature,
+                                     server_tuple_queue_visitor_cb_t visitor_cb,
+                                     void* user_data,
+                                     server_scan_stats_t* scan_stats) {
+  server_tuple_queue_partition_t* partition = server_find_template_partition(
+      tuple_space, signature, tuple_size, TS_FALSE);
+  if (partition == NULL) {
+    return 0;
+  }
+  server_template_cursor_t cursor;
+  memset(&cursor, 0, sizeof(server_template_cursor_t));
+  cursor.data_tuple = data_tuple;
+  cursor.tuple_size = tuple_size;
+  cursor.key_hash = server_tuple_key_hash(data_tuple, tuple_size);
+  cursor.newest_first = tuple_space->dispatch_mode == SERVER_DISPATCH_LIFO;
+  cursor.scan_stats = scan_stats;
+  server_tuple_queue_node_t* chosen_in_waiter = NULL;
+  if (tuple_space->dispatch_mode == SERVER_DISPATCH_ROUND_ROBIN) {
+    server_template_cursor_reset(&cursor, partition);
+    chosen_in_waiter =
+        server_least_recently_served_in_waiter(tuple_space, &cursor);
+  }
+  server_template_cursor_reset(&cursor, partition);
+  ts_size_t taken = 0;
+  server_tuple_queue_node_t* node = server_template_cursor_next(&cursor);
+  for (; node != NULL; node = server_template_cursor_next(&cursor)) {
+    if (node->entry.remove_matching && (chosen_in_waiter != NULL) &&
+        (node != chosen_in_waiter)) {
+      continue;
+    }
+    server_remove_template_node(partition, node);
+    server_tuple_queue_entry_t entry = node->entry;
+    server_pool_free(&tuple_space->node_pool, node);
+    ++taken;
+    if (entry.remove_matching &&
+        (tuple_space->dispatch_mode == SERVER_DISPATCH_ROUND_ROBIN)) {
+      server_mark_client_served(tuple_space, entry.sender_ip_address,
+                                entry.sender_port_id);
+    }
+    visitor_cb(user_data, &entry);
+    if (entry.remove_matching) {
+      break;
+    }
+  }
+  return taken;
+}
+
+static server_tuple_space_node_t* server_find_data_node_in_bucket(
+    server_tuple_space_partition_t* partition,
+    server_field_t* template_tuple, ts_size_t tuple_size,
+    server_scan_stats_t* scan_stats) {
+  uint32_t key_hash = server_tuple_key_hash(template_tuple, tuple_size);
+  server_tuple_space_node_t* node =
+      (server_tuple_space_node_t*)server_tuple_index_bucket(&partition->index,
+                                                            key_hash);
+  for (; node != NULL; node = (server_tuple_space_node_t*)SERVER_LOAD_LINK(
+                           node->link.next_in_bucket)) {
+    ++scan_stats->visited_nodes;
+    if (node->link.key_hash != key_hash) {
+      continue;
+    }
+    ++scan_stats->matched_nodes;
+    if (server_is_matching_fields(
+            template_tuple, SERVER_TUPLE_SPACE_NODE_TUPLE(node), tuple_size)) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+static server_tuple_space_node_t* server_find_data_node_in_list(
+    server_tuple_space_partition_t* partition,
+    server_field_t* template_tuple, ts_size_t tuple_size,
+    server_scan_stats_t* scan_stats) {
+  server_tuple_space_node_t* node = SERVER_LOAD_LINK(partition->nodes);
+  for (; node != NULL;
+       node = (server_tuple_space_node_t*)SERVER_LOAD_LINK(node->next_node)) {
+    ++scan_stats->visited_nodes;
+    ++scan_stats->matched_nodes;
+    if (server_is_matching_fields(
+            template_tuple, SERVER_TUPLE_SPACE_NODE_TUPLE(node), tuple_size)) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+static server_tuple_space_node_t* server_find_data_node(
+    server_tuple_space_partition_t* partition,
+    server_field_t* template_tuple, ts_size_t tuple_size,
+    server_scan_stats_t* scan_stats) {
+  if (partition == NULL) {
+    return NULL;
+  }
+  return server_is_indexable_tuple(template_tuple, tuple_size)
+             ? server_find_data_node_in_bucket(partition, template_tuple,
+                                               tuple_size, scan_stats)
+             : server_find_data_node_in_list(partition, template_tuple,
+                                             tuple_size, scan_stats);
+}
+
+server_field_t* server_get_data_node(server_tuple_space_t* tuple_space,
+                                     server_field_t* template_tuple,
+                                     ts_size_t tuple_size,
+                                     ts_tuple_signature_t signature,
+                                     ts_bool_t remove_when_found,
+                                     server_scan_stats_t* scan_stats) {
+  ts_size_t bucket = server_partition_bucket(signature, tuple_size);
+  server_tuple_space_partition_t* partition = server_find_data_partition(
+      tuple_space, bucket, signature, tuple_size, TS_FALSE);
+  server_tuple_space_node_t* node = NULL;
+  if (!remove_when_found) {
+    node = server_find_data_node(partition, template_tuple, tuple_size,
+                                 scan_stats);
+    // A lock-free miss may come from a node relinked by a concurrent rehash
+    if ((node != NULL) || (tuple_space->bucket_locks == NULL)) {
+      return node != NULL ? SERVER_TUPLE_SPACE_NODE_TUPLE(node) : NULL;
+    }
+  }
+  if (partition == NULL) {
+    return NULL;
+  }
+  server_lock_partition_bucket(tuple_space, bucket);
+  node = server_find_data_node(partition, template_tuple, tuple_size,
+                               scan_stats);
+  if ((node != NULL) && remove_when_found) {
+    server_remove_data_node(partition, node);
+  }
+  server_unlock_partition_bucket(tuple_space, bucket);
+  return node != NULL ? SERVER_TUPLE_SPACE_NODE_TUPLE(node) : NULL;
 }
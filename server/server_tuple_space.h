@@ -1,50 +1,153 @@
 #ifndef __SERVER_TUPLE_SPACE_H__
 #define __SERVER_TUPLE_SPACE_H__
 
+#include <pthread.h>
+
 #include "../libts/common/tuple_space.h"
 #include "../libts/common/tuple_space_network.h"
+#include "server_pool.h"
+#include "server_tuple_index.h"
+
+#define SERVER_TUPLE_PARTITION_BUCKETS 64
+#define SERVER_CLIENT_TABLE_INITIAL_SIZE 64
+
+typedef enum {
+  SERVER_DISPATCH_LIFO = 0,
+  SERVER_DISPATCH_FIFO = 1,
+  SERVER_DISPATCH_ROUND_ROBIN = 2
+} server_dispatch_mode_t;
 
+// Stash nodes are not allocated on their own: the node is the header the
+// server context reserves in front of every tuple block, so the compact
+// fields start right after it.
 typedef struct {
-  ts_tuple_field_t* tuple;
+  server_tuple_index_link_t link;
   void* next_node;
+  void* previous_node;
 } server_tuple_space_node_t;
 
+#define SERVER_TUPLE_SPACE_NODE_TUPLE(node) ((server_field_t*)((node) + 1))
+#define SERVER_TUPLE_SPACE_TUPLE_NODE(tuple) \
+  ((server_tuple_space_node_t*)(tuple) - 1)
+
 typedef struct {
-  ts_tuple_field_t* tuple;
+  server_field_t* tuple;
   ts_ipv4_t sender_ip_address;
   ts_port_t sender_port_id;
   ts_bool_t remove_matching;
+  uint64_t insertion_time_us;
 } server_tuple_queue_entry_t;
 
+// Waiters whose key fields are actual live in the partition index, the
+// rest in its unindexed list. Both are linked through the index link.
 typedef struct {
+  server_tuple_index_link_t link;
   server_tuple_queue_entry_t entry;
-  void* next_node;
+  uint64_t sequence;
+  ts_bool_t is_indexed;
 } server_tuple_queue_node_t;
 
+// Tuples are partitioned by arity and type signature, so a lookup only
+// visits tuples of the same shape as its template.
 typedef struct {
-  server_tuple_space_node_t* nodes[TS_MAX_TUPLE_SIZE];
+  ts_tuple_signature_t signature;
+  ts_size_t tuple_size;
+  server_tuple_space_node_t* nodes;
+  server_tuple_index_t index;
+  void* next_partition;
+} server_tuple_space_partition_t;
+
+typedef struct {
+  ts_tuple_signature_t signature;
+  ts_size_t tuple_size;
+  server_tuple_index_t index;
+  server_tuple_list_t unindexed_nodes;
+  void* next_partition;
+} server_tuple_queue_partition_t;
+
+// Remembers when each client last had an in waiter served, used by the
+// round-robin dispatch to pick the least recently served client.
+typedef struct {
+  ts_ipv4_t ip_address;
+  ts_port_t port_id;
+  ts_bool_t is_used;
+  uint64_t last_served;
+} server_client_stamp_t;
+
+// A shared stash takes the lock of a partition bucket to change it or to
+// remove from it, reads run lock-free. Removed tuples must then be freed
+// through server_epoch_retire.
+typedef struct {
+  server_tuple_space_partition_t* partitions[SERVER_TUPLE_PARTITION_BUCKETS];
+  pthread_mutex_t* bucket_locks;
 } server_tuple_space_t;
 
 typedef struct {
-  server_tuple_queue_node_t* nodes[TS_MAX_TUPLE_SIZE];
+  server_tuple_queue_partition_t* partitions[SERVER_TUPLE_PARTITION_BUCKETS];
+  uint64_t next_sequence;
+  server_dispatch_mode_t dispatch_mode;
+  server_client_stamp_t* client_stamps;
+  ts_size_t client_stamps_size;
+  ts_size_t client_stamps_count;
+  uint64_t served_counter;
+  server_pool_t node_pool;
 } server_tuple_queue_t;
 
-void server_insert_data_tuple(server_tuple_space_t* tuple_space,
-                              ts_tuple_field_t* tuple, ts_size_t tuple_size);
+// Work done by lookups, added up across calls: the nodes they walked and
+// how many of those had to be compared field by field.
+typedef struct {
+  ts_size_t visited_nodes;
+  ts_size_t matched_nodes;
+} server_scan_stats_t;
+
+typedef void (*server_tuple_queue_visitor_cb_t)(
+    void* user_data, const server_tuple_queue_entry_t* entry);
+
+void server_initialize_tuple_space(server_tuple_space_t* tuple_space);
 
-void server_insert_template_tuple(server_tuple_queue_t* tuple_space,
-                                  ts_tuple_field_t* tuple, ts_size_t tuple_size,
-                                  ts_ipv4_t sender_ip_address,
-                                  ts_port_t sender_port_id,
-                                  ts_bool_t remove_matching);
+ts_bool_t server_initialize_shared_tuple_space(
+    server_tuple_space_t* tuple_space);
 
-server_tuple_queue_entry_t server_get_template_node(
-    server_tuple_queue_t* tuple_space, ts_tuple_field_t* data_tuple,
-    ts_size_t tuple_size, ts_bool_t remove_when_found);
+void server_initialize_tuple_queue(server_tuple_queue_t* tuple_space,
+                                   server_dispatch_mode_t dispatch_mode);
 
-ts_tuple_field_t* server_get_data_node(server_tuple_space_t* tuple_space,
-                                       ts_tuple_field_t* template_tuple,
+// The tuple must carry a server_tuple_space_node_t header, see
+// SERVER_TUPLE_SPACE_TUPLE_NODE. Tuples and templates given to the functions
+// below are compact, see server_compact_fields.
+void server_insert_data_tuple(server_tuple_space_t* tuple_space,
+                              server_field_t* tuple, ts_size_t tuple_size,
+                              ts_tuple_signature_t signature);
+
+// Returns TS_FALSE when the queue node cannot be allocated.
+ts_bool_t server_insert_template_tuple(server_tuple_queue_t* tuple_space,
+                                       server_field_t* tuple,
                                        ts_size_t tuple_size,
-                                       ts_bool_t remove_when_found);
+                                       ts_tuple_signature_t signature,
+                                       ts_ipv4_t sender_ip_address,
+                                       ts_port_t sender_port_id,
+                                       ts_bool_t remove_matching);
+
+// Removes every waiter the data tuple is delivered to - all matching rd
+// waiters up to and including the in waiter that consumes it - and passes
+// them to visitor_cb in dispatch order. Returns the number of waiters.
+// LIFO and FIFO hand the tuple to the newest/oldest matching in waiter,
+// round-robin to the matching in waiter of the least recently served
+// client, falling back to FIFO order between equally served clients.
+ts_size_t server_take_template_nodes(server_tuple_queue_t* tuple_space,
+                                     server_field_t* data_tuple,
+                                     ts_size_t tuple_size,
+                                     ts_tuple_signature_t signature,
+                                     server_tuple_queue_visitor_cb_t visitor_cb,
+                                     void* user_data,
+                                     server_scan_stats_t* scan_stats);
+
+// A tuple returned without removal from a shared stash stays valid until
+// the calling thread leaves its epoch critical section.
+server_field_t* server_get_data_node(server_tuple_space_t* tuple_space,
+                                     server_field_t* template_tuple,
+                                     ts_size_t tuple_size,
+                                     ts_tuple_signature_t signature,
+                                     ts_bool_t remove_when_found,
+                                     server_scan_stats_t* scan_stats);
 
 #endif  // __SERVER_TUPLE_SPACE_H__
@@ -0,0 +1,190 @@
+// Randomized check of the connection table against a reference model: the
+// singly linked list the table replaced, newest node first, searched by the
+// receiver ip and port. Nodes are added, removed by client, erased from the
+// list of all connections as the resend loop does, and after every step the
+// newest node of the client must agree with the model.
+//
+// Build and run:
+//   gcc -O2 -o server_active_connections_test
+//       server/tests/server_active_connections_test.c server/server_[a-z]*.c
+//       libts/common/*.c libts/unix/*.c -lpthread
+//   ./server_active_connections_test
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../server_active_connections.h"
+
+#define TEST_ITERATIONS 300000
+#define TEST_IP_ADDRESSES 40
+#define TEST_PORTS 60
+#define TEST_MAX_ERASE_DEPTH 50
+
+typedef struct test_reference_node {
+  struct test_reference_node* next_node;
+  ts_ipv4_t receiver_ip;
+  ts_port_t receiver_port;
+  uintptr_t id;
+} test_reference_node_t;
+
+typedef struct {
+  test_reference_node_t* list;
+  size_t nodes_count;
+} test_reference_t;
+
+static test_reference_node_t** test_find_reference_node(
+    test_reference_t* reference, ts_ipv4_t receiver_ip,
+    ts_port_t receiver_port) {
+  test_reference_node_t** node = &reference->list;
+  while ((*node != NULL) && (((*node)->receiver_ip != receiver_ip) ||
+                             ((*node)->receiver_port != receiver_port))) {
+    node = &(*node)->next_node;
+  }
+  return node;
+}
+
+static void test_unlink_reference_node(test_reference_t* reference,
+                                       test_reference_node_t** node) {
+  test_reference_node_t* removed_node = *node;
+  *node = removed_node->next_node;
+  free(removed_node);
+  --reference->nodes_count;
+}
+
+// Nodes carry their id in place of the tuple, it is never dereferenced.
+static uintptr_t test_node_id(const server_connection_node_t* node) {
+  return node != NULL ? (uintptr_t)node->data_tuple : 0;
+}
+
+static int test_add(server_active_connections_t* connections,
+                    test_reference_t* reference, ts_ipv4_t receiver_ip,
+                    ts_port_t receiver_port, uintptr_t id) {
+  if (!server_add_connection_node(connections, receiver_ip, receiver_port,
+                                  (server_field_t*)id, 1, TS_FALSE,
+                                  TS_FALSE)) {
+    printf("Adding node %" PRIuPTR " failed\n", id);
+    return 0;
+  }
+  test_reference_node_t* node =
+      (test_reference_node_t*)malloc(sizeof(test_reference_node_t));
+  memset(node, 0, sizeof(test_reference_node_t));
+  node->receiver_ip = receiver_ip;
+  node->receiver_port = receiver_port;
+  node->id = id;
+  node->next_node = reference->list;
+  reference->list = node;
+  ++reference->nodes_count;
+  return 1;
+}
+
+static int test_remove(server_active_connections_t* connections,
+                       test_reference_t* reference, ts_ipv4_t receiver_ip,
+                       ts_port_t receiver_port) {
+  server_connection_node_t removed_node =
+      server_remove_connection_node(connections, receiver_ip, receiver_port);
+  test_reference_node_t** node =
+      test_find_reference_node(reference, receiver_ip, receiver_port);
+  uintptr_t expected_id = 0;
+  if (*node != NULL) {
+    expected_id = (*node)->id;
+    test_unlink_reference_node(reference, node);
+  }
+  if ((uintptr_t)removed_node.data_tuple != expected_id) {
+    printf("Removed node %" PRIuPTR ", expected %" PRIuPTR "\n",
+           (uintptr_t)removed_node.data_tuple, expected_id);
+    return 0;
+  }
+  return 1;
+}
+
+static int test_erase(server_active_connections_t* connections,
+                      test_reference_t* reference, size_t depth) {
+  server_connection_node_t* erased_node = connections->list;
+  while ((erased_node != NULL) && (depth-- > 0)) {
+    erased_node = (server_connection_node_t*)erased_node->next_node;
+  }
+  if (erased_node == NULL) {
+    return 1;
+  }
+  uintptr_t id = test_node_id(erased_node);
+  test_reference_node_t** node = &reference->list;
+  while ((*node != NULL) && ((*node)->id != id)) {
+    node = &(*node)->next_node;
+  }
+  if (*node == NULL) {
+    printf("Erased node %" PRIuPTR " is not in the reference\n", id);
+    return 0;
+  }
+  test_unlink_reference_node(reference, node);
+  server_erase_connection_node(connections, erased_node);
+  return 1;
+}
+
+static int test_find(server_active_connections_t* connections,
+                     test_reference_t* reference, ts_ipv4_t receiver_ip,
+                     ts_port_t receiver_port) {
+  uintptr_t found_id = test_node_id(
+      server_find_connection_node(connections, receiver_ip, receiver_port));
+  test_reference_node_t* node =
+      *test_find_reference_node(reference, receiver_ip, receiver_port);
+  uintptr_t expected_id = node != NULL ? node->id : 0;
+  if (found_id != expected_id) {
+    printf("Found node %" PRIuPTR ", expected %" PRIuPTR "\n", found_id,
+           expected_id);
+    return 0;
+  }
+  return 1;
+}
+
+int main(void) {
+  server_active_connections_t connections;
+  server_initialize_active_connections(&connections, 1000, 8000);
+  test_reference_t reference;
+  memset(&reference, 0, sizeof(test_reference_t));
+  srand(7);
+  uintptr_t next_id = 1;
+  int status = 1;
+  for (size_t i = 0; status && (i < TEST_ITERATIONS); ++i) {
+    ts_ipv4_t receiver_ip = 0x7f000001 + rand() % TEST_IP_ADDRESSES;
+    ts_port_t receiver_port = 1000 + rand() % TEST_PORTS;
+    switch (rand() % 4) {
+      case 0:
+      case 1:
+        status = test_add(&connections, &reference, receiver_ip, receiver_port,
+                          next_id++);
+        break;
+      case 2:
+        status =
+            test_remove(&connections, &reference, receiver_ip, receiver_port);
+        break;
+      default:
+        status = test_erase(&connections, &reference,
+                            rand() % TEST_MAX_ERASE_DEPTH);
+        break;
+    }
+    status = status &&
+             test_find(&connections, &reference, receiver_ip, receiver_port);
+    if (!status) {
+      printf("Failed at iteration %zu\n", i);
+    }
+  }
+
+  size_t nodes_count = 0;
+  for (server_connection_node_t* node = connections.list; node != NULL;
+       node = (server_connection_node_t*)node->next_node) {
+    ++nodes_count;
+  }
+  if (status && (nodes_count != reference.nodes_count)) {
+    printf("The table holds %zu nodes, expected %zu\n", nodes_count,
+           reference.nodes_count);
+    status = 0;
+  }
+  while (reference.list != NULL) {
+    test_unlink_reference_node(&reference, &reference.list);
+  }
+  server_destroy_active_connections(&connections);
+  printf("%s\n", status ? "OK" : "FAILED");
+  return status ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// Stress test of a shared stash. Worker threads insert tuples and look them
+// up with rd and in templates, which grows and relinks the partition index
+// while lock-free readers walk it, and retire the tuples they take through
+// the epoch domain. Every tuple found must match its template, and the
+// tuples left in the stash must be exactly those inserted and not taken.
+// Meant to be run under ThreadSanitizer or AddressSanitizer.
+//
+// Build and run:
+//   gcc -O1 -g -fsanitize=thread -o server_shared_tuple_space_test
+//       server/tests/server_shared_tuple_space_test.c server/server_[a-z]*.c
+//       libts/common/*.c libts/unix/*.c -lpthread
+//   ./server_shared_tuple_space_test
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../server_epoch.h"
+#include "../server_field.h"
+#include "../server_intern.h"
+#include "../server_tuple_space.h"
+
+#define TEST_THREADS 4
+#define TEST_ITERATIONS 60000
+#define TEST_KEYS 50
+#define TEST_TUPLE_SIZE 3
+
+typedef enum {
+  TEST_OPERATION_OUT = 0,
+  TEST_OPERATION_RD = 1,
+  TEST_OPERATION_IN = 2
+} test_operation_t;
+
+static server_tuple_space_t TupleStash;
+static server_intern_table_t InternTable;
+static server_epoch_domain_t EpochDomain;
+static long InsertedTuples;
+static long RemovedTuples;
+static int IsFailed;
+
+static void test_free_tuple_cb(void* /*context*/, void* memory,
+                               ts_size_t /*size*/) {
+  free(SERVER_TUPLE_SPACE_TUPLE_NODE((server_field_t*)memory));
+}
+
+// Tuples of one key share their uint and string fields, so both the index
+// and the string table see a small set of hot keys.
+static ts_tuple_signature_t test_make_tuple(server_field_t* tuple,
+                                            unsigned key, ts_int_t value,
+                                            ts_bool_t is_template,
+                                            ts_bool_t is_string_formal) {
+  ts_tuple_field_t fields[TEST_TUPLE_SIZE];
+  fields[0] = ts_tuple_field_set_uint(key % 5, TS_TRUE);
+  fields[1] = ts_tuple_field_set_string(key % 2 ? "abcdef" : "ab",
+                                        !is_string_formal);
+  fields[2] = ts_tuple_field_set_int(value, !is_template);
+  server_compact_fields(&InternTable, tuple, fields, TEST_TUPLE_SIZE);
+  return ts_tuple_type_signature(fields, TEST_TUPLE_SIZE);
+}
+
+static void test_out(unsigned key, ts_int_t value) {
+  server_tuple_space_node_t* node = (server_tuple_space_node_t*)malloc(
+      sizeof(server_tuple_space_node_t) +
+      sizeof(server_field_t) * TEST_TUPLE_SIZE);
+  server_field_t* tuple = SERVER_TUPLE_SPACE_NODE_TUPLE(node);
+  ts_tuple_signature_t signature =
+      test_make_tuple(tuple, key, value, TS_FALSE, TS_FALSE);
+  server_insert_data_tuple(&TupleStash, tuple, TEST_TUPLE_SIZE, signature);
+}
+
+static server_field_t* test_get(unsigned key, ts_bool_t is_string_formal,
+                                ts_bool_t remove_when_found) {
+  server_field_t template_tuple[TEST_TUPLE_SIZE];
+  ts_tuple_signature_t signature =
+      test_make_tuple(template_tuple, key, 0, TS_TRUE, is_string_formal);
+  server_scan_stats_t scan_stats;
+  memset(&scan_stats, 0, sizeof(server_scan_stats_t));
+  server_field_t* tuple =
+      server_get_data_node(&TupleStash, template_tuple, TEST_TUPLE_SIZE,
+                           signature, remove_when_found, &scan_stats);
+  if ((tuple != NULL) &&
+      !server_is_matching_fields(template_tuple, tuple, TEST_TUPLE_SIZE)) {
+    printf("Found a tuple that does not match its template\n");
+    __atomic_store_n(&IsFailed, 1, __ATOMIC_RELAXED);
+  }
+  return tuple;
+}
+
+static void* test_worker(void* user_data) {
+  unsigned seed = (unsigned)(size_t)user_data;
+  long inserted_tuples = 0;
+  long removed_tuples = 0;
+  server_register_epoch_participant(&EpochDomain);
+  for (ts_int_t i = 0; i < TEST_ITERATIONS; ++i) {
+    test_operation_t operation = (test_operation_t)(rand_r(&seed) % 3);
+    unsigned key = rand_r(&seed) % TEST_KEYS;
+    ts_bool_t is_string_formal = rand_r(&seed) % 4 == 0;
+    server_epoch_enter();
+    if (operation == TEST_OPERATION_OUT) {
+      test_out(key, i);
+      ++inserted_tuples;
+    } else {
+      server_field_t* tuple = test_get(key, is_string_formal,
+                                       operation == TEST_OPERATION_IN);
+      if ((tuple != NULL) && (operation == TEST_OPERATION_IN)) {
+        server_epoch_retire(tuple, TEST_TUPLE_SIZE, test_free_tuple_cb, NULL);
+        ++removed_tuples;
+      }
+    }
+    server_epoch_exit();
+    server_epoch_collect();
+  }
+  __atomic_add_fetch(&InsertedTuples, inserted_tuples, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&RemovedTuples, removed_tuples, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// The workers are gone, nothing they retired can still be read.
+static void test_free_retired_tuples(void) {
+  for (size_t i = 0; i < TEST_THREADS; ++i) {
+    for (size_t j = 0; j < SERVER_EPOCH_LIMBO_LISTS; ++j) {
+      server_epoch_limbo_t* limbo = &EpochDomain.participants[i].limbo[j];
+      for (ts_size_t k = 0; k < limbo->size; ++k) {
+        limbo->entries[k].free_cb(limbo->entries[k].context,
+                                  limbo->entries[k].memory,
+                                  limbo->entries[k].size);
+      }
+      free(limbo->entries);
+    }
+  }
+}
+
+int main(void) {
+  server_initialize_intern_table(&InternTable, TS_TRUE);
+  server_initialize_shared_tuple_space(&TupleStash);
+  server_initialize_epoch_domain(&EpochDomain);
+  pthread_t threads[TEST_THREADS];
+  for (size_t i = 0; i < TEST_THREADS; ++i) {
+    pthread_create(&threads[i], NULL, test_worker, (void*)(i + 1));
+  }
+  for (size_t i = 0; i < TEST_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  test_free_retired_tuples();
+
+  long left_tuples = 0;
+  for (unsigned key = 0; key < TEST_KEYS; ++key) {
+    server_field_t* tuple;
+    while ((tuple = test_get(key, TS_TRUE, TS_TRUE)) != NULL) {
+      test_free_tuple_cb(NULL, tuple, TEST_TUPLE_SIZE);
+      ++left_tuples;
+    }
+  }
+  int status = !IsFailed;
+  if (left_tuples != InsertedTuples - RemovedTuples) {
+    printf("%ld tuples left, expected %ld\n", left_tuples,
+           InsertedTuples - RemovedTuples);
+    status = 0;
+  }
+  printf("%s\n", status ? "OK" : "FAILED");
+  return status ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+// Reads a trace file written by the server with --trace-file and prints the
+// percentiles of the time requests spend between consecutive stages, for all
+// requests and, with --by-operation, for each operation separately.
+//
+// Build:
+//   gcc -O2 -o server_trace_report server/tools/server_trace_report.c
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../server_metrics.h"
+#include "../server_trace.h"
+
+#define REPORT_ALL_OPERATIONS SERVER_OPERATIONS_COUNT
+
+typedef struct {
+  const char* name;
+  server_trace_stage_t from;
+  server_trace_stage_t to;
+} report_interval_t;
+
+static const report_interval_t ReportIntervals[] = {
+    {"receive-decode", SERVER_TRACE_RECEIVE, SERVER_TRACE_DECODE},
+    {"decode-match", SERVER_TRACE_DECODE, SERVER_TRACE_MATCH},
+    {"match-encode", SERVER_TRACE_MATCH, SERVER_TRACE_ENCODE},
+    {"encode-send", SERVER_TRACE_ENCODE, SERVER_TRACE_SEND},
+    {"send-ack", SERVER_TRACE_SEND, SERVER_TRACE_ACK},
+    {"receive-send", SERVER_TRACE_RECEIVE, SERVER_TRACE_SEND},
+    {"decode-send", SERVER_TRACE_DECODE, SERVER_TRACE_SEND}};
+
+static const char* ReportOperationNames[] = {"out", "in", "inp", "rd", "rdp"};
+
+typedef struct {
+  server_trace_record_t* records;
+  size_t records_count;
+  uint64_t* ack_times_ns;  // per request record, 0 when not acknowledged
+  uint32_t sample_interval;
+} report_trace_t;
+
+static int report_compare_times(const void* lhs, const void* rhs) {
+  uint64_t left = *(const uint64_t*)lhs;
+  uint64_t right = *(const uint64_t*)rhs;
+  return left < right ? -1 : left > right;
+}
+
+static int report_compare_records(const void* lhs, const void* rhs) {
+  const server_trace_record_t* left = (const server_trace_record_t*)lhs;
+  const server_trace_record_t* right = (const server_trace_record_t*)rhs;
+  if (left->request_id != right->request_id) {
+    return left->request_id < right->request_id ? -1 : 1;
+  }
+  return (int)left->kind - (int)right->kind;
+}
+
+static ts_bool_t report_read_trace(const char* path, report_trace_t* trace) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return TS_FALSE;
+  }
+  server_trace_file_header_t header;
+  if (fread(&header, sizeof(server_trace_file_header_t), 1, file) != 1 ||
+      header.magic != SERVER_TRACE_MAGIC ||
+      header.record_size != sizeof(server_trace_record_t)) {
+    fprintf(stderr, "%s is not a trace file of this server version\n", path);
+    fclose(file);
+    return TS_FALSE;
+  }
+  trace->sample_interval = header.sample_interval;
+  size_t capacity = 0;
+  for (;;) {
+    if (trace->records_count == capacity) {
+      capacity = capacity ? capacity * 2 : 4096;
+      trace->records = (server_trace_record_t*)realloc(
+          trace->records, capacity * sizeof(server_trace_record_t));
+    }
+    size_t count = fread(trace->records + trace->records_count,
+                         sizeof(server_trace_record_t),
+                         capacity - trace->records_count, file);
+    trace->records_count += count;
+    if (count == 0) {
+      break;
+    }
+  }
+  fclose(file);
+  return TS_TRUE;
+}
+
+// Sorting puts every ack right after its request, the first ack wins.
+static void report_pair_acks(report_trace_t* trace) {
+  qsort(trace->records, trace->records_count, sizeof(server_trace_record_t),
+        report_compare_records);
+  size_t requests_count = 0;
+  uint64_t* ack_times_ns =
+      (uint64_t*)calloc(trace->records_count + 1, sizeof(uint64_t));
+  for (size_t i = 0; i < trace->records_count; ++i) {
+    const server_trace_record_t* record = &trace->records[i];
+    if (record->kind == SERVER_TRACE_REQUEST_RECORD) {
+      trace->records[requests_count] = *record;
+      ++requests_count;
+    } else if (requests_count > 0 &&
+               trace->records[requests_count - 1].request_id ==
+                   record->request_id &&
+               ack_times_ns[requests_count - 1] == 0) {
+      ack_times_ns[requests_count - 1] =
+          record->stage_times_ns[SERVER_TRACE_ACK];
+    }
+  }
+  trace->records_count = requests_count;
+  trace->ack_times_ns = ack_times_ns;
+}
+
+static double report_percentile_us(const uint64_t* times_ns, size_t count,
+                                   double percentile) {
+  if (count == 0) {
+    return 0.0;
+  }
+  size_t index = (size_t)(percentile * (double)(count - 1));
+  return (double)times_ns[index] / 1000.0;
+}
+
+static uint64_t report_stage_time(const report_trace_t* trace, size_t index,
+                                  server_trace_stage_t stage) {
+  return stage == SERVER_TRACE_ACK
+             ? trace->ack_times_ns[index]
+             : trace->records[index].stage_times_ns[stage];
+}
+
+static void report_print_operation(const report_trace_t* trace,
+                                   size_t operation, uint64_t* times_ns) {
+  size_t requests_count = 0;
+  for (size_t i = 0; i < trace->records_count; ++i) {
+    requests_count += operation == REPORT_ALL_OPERATIONS ||
+                      trace->records[i].operation == operation;
+  }
+  printf("%s: %zu requests\n",
+         operation == REPORT_ALL_OPERATIONS ? "all"
+                                            : ReportOperationNames[operation],
+         requests_count);
+  if (requests_count == 0) {
+    return;
+  }
+  printf("  %-16s %8s %10s %10s %10s %10s %10s\n", "stage", "count",
+         "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+  for (size_t j = 0; j < sizeof(ReportIntervals) / sizeof(ReportIntervals[0]);
+       ++j) {
+    const report_interval_t* interval = &ReportIntervals[j];
+    size_t count = 0;
+    for (size_t i = 0; i < trace->records_count; ++i) {
+      if (operation != REPORT_ALL_OPERATIONS &&
+          trace->records[i].operation != operation) {
+        continue;
+      }
+      uint64_t from = report_stage_time(trace, i, interval->from);
+      uint64_t to = report_stage_time(trace, i, interval->to);
+      if (from != 0 && to >= from) {
+        times_ns[count++] = to - from;
+      }
+    }
+    qsort(times_ns, count, sizeof(uint64_t), report_compare_times);
+    printf("  %-16s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", interval->name,
+           count, report_percentile_us(times_ns, count, 0.50),
+           report_percentile_us(times_ns, count, 0.90),
+           report_percentile_us(times_ns, count, 0.99),
+           report_percentile_us(times_ns, count, 0.999),
+           report_percentile_us(times_ns, count, 1.0));
+  }
+}
+
+int main(int argc, char** argv) {
+  static const struct option options[] = {
+      {"by-operation", no_argument, NULL, 'o'}, {NULL, 0, NULL, 0}};
+  ts_bool_t by_operation = TS_FALSE;
+  int option;
+  while ((option = getopt_long(argc, argv, "o", options, NULL)) != -1) {
+    if (option != 'o') {
+      fprintf(stderr, "Usage: %s [--by-operation] TRACE_FILE\n", argv[0]);
+      return -1;
+    }
+    by_operation = TS_TRUE;
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "Usage: %s [--by-operation] TRACE_FILE\n", argv[0]);
+    return -1;
+  }
+  report_trace_t trace;
+  memset(&trace, 0, sizeof(report_trace_t));
+  if (!report_read_trace(argv[optind], &trace)) {
+    return -1;
+  }
+  report_pair_acks(&trace);
+  printf("one in %" PRIu32 " requests traced\n", trace.sample_interval);
+  uint64_t* times_ns =
+      (uint64_t*)malloc((trace.records_count + 1) * sizeof(uint64_t));
+  report_print_operation(&trace, REPORT_ALL_OPERATIONS, times_ns);
+  for (size_t i = 0; by_operation && i < SERVER_OPERATIONS_COUNT; ++i) {
+    report_print_operation(&trace, i, times_ns);
+  }
+  free(times_ns);
+  free(trace.ack_times_ns);
+  free(trace.records);
+  return 0;
+}
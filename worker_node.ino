@@ -56,7 +56,7 @@ static bool application_one_get_task(const ts_allocator_t& allocator,
           "Error, the tuple does not contain string at the first place");
       return false;
     }
-    Serial.println(result.tuple[0].data.string_field);
+    Serial.println(task_name);
     if (strcmp(task_name, "check_if_prime")) {
       Serial.println("Error, invalid task name");
       return false;